@@ -0,0 +1,93 @@
+// SPDX-FileCopyrightText: © 2020 Alias Developers
+//
+// SPDX-License-Identifier: MIT
+
+#ifndef SPEC_ARENA_H
+#define SPEC_ARENA_H
+
+#include <memory>
+#include <new>
+#include <stddef.h>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Bytes the heap uses for an allocation of nAlloc bytes, 16 byte aligned
+// chunks with a size word as glibc malloc has them on 64 bit.
+static inline size_t MallocUsage(size_t nAlloc)
+{
+    if (nAlloc == 0)
+        return 0;
+    return ((nAlloc + sizeof(size_t) + 15) >> 4) << 4;
+}
+
+// Allocates objects of one type from slabs of N, instead of one heap block
+// per object. Deleted objects leave a slot for the next New(), the memory is
+// only released by Clear(), which invalidates every object of the arena.
+template<typename T, size_t N = 4096>
+class CArena
+{
+    static_assert(std::is_trivially_destructible<T>::value, "CArena doesn't run destructors on Clear()");
+
+private:
+    union Slot
+    {
+        Slot *pnextFree;
+        typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+    };
+
+    std::vector<std::unique_ptr<Slot[]> > vSlabs;
+    Slot *pfree;
+    size_t nUsedInSlab;
+    size_t nObjects;
+
+    CArena(const CArena&);
+    CArena &operator=(const CArena&);
+
+public:
+    CArena() : pfree(NULL), nUsedInSlab(N), nObjects(0) {}
+
+    template<typename... Args>
+    T *New(Args&&... args)
+    {
+        Slot *slot;
+        if (pfree)
+        {
+            slot = pfree;
+            pfree = pfree->pnextFree;
+        } else
+        {
+            if (nUsedInSlab == N)
+            {
+                vSlabs.emplace_back(new Slot[N]);
+                nUsedInSlab = 0;
+            };
+            slot = &vSlabs.back()[nUsedInSlab++];
+        };
+        nObjects++;
+        return new (&slot->storage) T(std::forward<Args>(args)...);
+    }
+
+    void Delete(T *p)
+    {
+        if (!p)
+            return;
+        Slot *slot = reinterpret_cast<Slot*>(p);
+        slot->pnextFree = pfree;
+        pfree = slot;
+        nObjects--;
+    }
+
+    void Clear()
+    {
+        vSlabs.clear();
+        pfree = NULL;
+        nUsedInSlab = N;
+        nObjects = 0;
+    }
+
+    size_t size() const          { return nObjects; }
+    size_t DynamicUsage() const  { return vSlabs.size() * MallocUsage(N * sizeof(Slot)); }
+};
+
+#endif // SPEC_ARENA_H
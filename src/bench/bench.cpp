@@ -0,0 +1,80 @@
+// SPDX-FileCopyrightText: © 2020 Alias Developers
+// SPDX-FileCopyrightText: © 2015 Bitcoin Developers
+//
+// SPDX-License-Identifier: MIT
+
+#include "bench.h"
+
+#include <iostream>
+#include <sys/time.h>
+
+using namespace benchmark;
+
+static double gettimedouble(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_usec * 0.000001 + tv.tv_sec;
+}
+
+BenchRunner::BenchmarkMap &BenchRunner::benchmarks()
+{
+    static BenchmarkMap benchmarks_map;
+    return benchmarks_map;
+}
+
+BenchRunner::BenchRunner(std::string name, BenchFunction func)
+{
+    benchmarks().insert(std::make_pair(name, func));
+}
+
+void BenchRunner::RunAll(double elapsedTimeForOne, const std::string &strFilter)
+{
+    std::cout << "#Benchmark" << "," << "count" << "," << "min" << "," << "max" << "," << "average" << "\n";
+
+    for (BenchmarkMap::iterator it = benchmarks().begin(); it != benchmarks().end(); ++it)
+    {
+        if (!strFilter.empty()
+            && it->first.find(strFilter) == std::string::npos)
+            continue;
+
+        State state(it->first, elapsedTimeForOne);
+        it->second(state);
+    };
+}
+
+bool State::KeepRunning()
+{
+    double now;
+    if (count == 0)
+    {
+        beginTime = now = gettimedouble();
+    } else
+    {
+        // timeCheckCount is used to avoid calling gettime most of the time,
+        // so benchmarks that run very quickly get consistent results.
+        if ((count+1) % timeCheckCount != 0)
+        {
+            ++count;
+            return true; // keep going
+        };
+        now = gettimedouble();
+        double elapsedOne = (now - lastTime) / timeCheckCount;
+        if (elapsedOne < minTime) minTime = elapsedOne;
+        if (elapsedOne > maxTime) maxTime = elapsedOne;
+        if (elapsedOne * timeCheckCount < maxElapsed / 16) timeCheckCount *= 2;
+    };
+    lastTime = now;
+    ++count;
+
+    if (now - beginTime < maxElapsed)
+        return true; // Keep going
+
+    --count;
+
+    // Output results
+    double average = (now - beginTime) / count;
+    std::cout << name << "," << count << "," << minTime << "," << maxTime << "," << average << "\n";
+
+    return false;
+}
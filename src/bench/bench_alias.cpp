@@ -0,0 +1,57 @@
+// SPDX-FileCopyrightText: © 2020 Alias Developers
+// SPDX-FileCopyrightText: © 2015 Bitcoin Developers
+//
+// SPDX-License-Identifier: MIT
+
+#include "bench.h"
+
+#include "chainparams.h"
+#include "key.h"
+#include "ringsig.h"
+#include "state.h"
+#include "util.h"
+
+#include <boost/filesystem.hpp>
+
+#include <iostream>
+
+int main(int argc, char** argv)
+{
+    ParseParameters(argc, argv);
+
+    if (mapArgs.count("-?") || mapArgs.count("-help"))
+    {
+        std::cout << "Usage: bench_alias [options]\n\n"
+                  << "  -filter=<s>            Only run benchmarks with <s> in their name\n"
+                  << "  -budget=<n>            Time spent on each benchmark in milliseconds (default: 1000)\n"
+                  << "  -testnet               Use the test network parameters\n";
+        return 0;
+    };
+
+    if (!SelectParamsFromCommandLine())
+    {
+        std::cerr << "Error: Invalid combination of -regtest and -testnet.\n";
+        return 1;
+    };
+
+    fPrintToDebugLog = false;
+
+    // - CTxDB benchmarks open a scratch database
+    boost::filesystem::path pathTemp = GetTempPath() / strprintf("bench_alias_%lu_%i", (unsigned long)GetTime(), (int)(GetRand(100000)));
+    boost::filesystem::create_directories(pathTemp);
+    mapArgs["-datadir"] = pathTemp.string();
+
+    if (!ECC_InitSanityCheck()
+        || initialiseRingSigs() != 0)
+    {
+        std::cerr << "Error: Crypto setup failed.\n";
+        return 1;
+    };
+
+    benchmark::BenchRunner::RunAll(GetArg("-budget", 1000) / 1000.0, GetArg("-filter", ""));
+
+    finaliseRingSigs();
+    boost::filesystem::remove_all(pathTemp);
+
+    return 0;
+}
@@ -0,0 +1,218 @@
+// SPDX-FileCopyrightText: © 2020 Alias Developers
+// SPDX-FileCopyrightText: © 2016 Bitcoin Developers
+//
+// SPDX-License-Identifier: MIT
+
+#include "bench.h"
+
+#include "coinselection.h"
+#include "main.h"
+#include "wallet.h"
+
+#include <algorithm>
+#include <iostream>
+#include <set>
+
+
+static void AddCoin(const CWallet &wallet, std::vector<CWalletTx*> &vWtx, std::vector<COutput> &vCoins, int64_t nValue)
+{
+    static int nextLockTime = 0;
+    CTransaction tx;
+    tx.nLockTime = nextLockTime++;  // so all transactions get different hashes
+    tx.nTime = 0;
+    tx.vout.resize(1);
+    tx.vout[0].nValue = nValue;
+
+    CWalletTx *wtx = new CWalletTx(&wallet, tx);
+    vWtx.push_back(wtx);
+    vCoins.push_back(COutput(wtx, 0, 6 * 24));
+}
+
+// Simple benchmark for wallet coin selection. Note that it may be necessary
+// to build up more complicated scenarios in order to get meaningful
+// measurements of performance. From laanwj, "Wallet coin selection is probably
+// the hardest, as you need a wider selection of scenarios, just testing the
+// same one over and over isn't too useful. Generating random isn't useful
+// either for measurements."
+static void CoinSelection(benchmark::State& state)
+{
+    const CWallet wallet;
+    std::vector<CWalletTx*> vWtx;
+    std::vector<COutput> vCoins;
+
+    // - 1000 equal coins and one larger coin, target needs the subset solver
+    for (int i = 0; i < 1000; i++)
+        AddCoin(wallet, vWtx, vCoins, 1000 * COIN);
+    AddCoin(wallet, vWtx, vCoins, 3 * COIN);
+
+    while (state.KeepRunning())
+    {
+        std::set<std::pair<const CWalletTx*, unsigned int> > setCoinsRet;
+        int64_t nValueRet;
+        bool fSuccess = wallet.SelectCoinsMinConf(1003 * COIN, GetAdjustedTime(), 1, 6, vCoins, setCoinsRet, nValueRet);
+        assert(fSuccess);
+        assert(nValueRet == 1003 * COIN);
+        assert(setCoinsRet.size() == 2);
+    }
+
+    BOOST_FOREACH(CWalletTx *wtx, vWtx)
+        delete wtx;
+}
+
+static void CoinSelectionMixed(benchmark::State& state)
+{
+    const CWallet wallet;
+    std::vector<CWalletTx*> vWtx;
+    std::vector<COutput> vCoins;
+
+    // - a staking wallet: many small rewards and change outputs of varied size
+    for (int i = 0; i < 2000; i++)
+        AddCoin(wallet, vWtx, vCoins, (i % 50 + 1) * CENT + i);
+
+    while (state.KeepRunning())
+    {
+        std::set<std::pair<const CWalletTx*, unsigned int> > setCoinsRet;
+        int64_t nValueRet;
+        wallet.SelectCoinsMinConf(25 * COIN, GetAdjustedTime(), 1, 6, vCoins, setCoinsRet, nValueRet);
+    }
+
+    BOOST_FOREACH(CWalletTx *wtx, vWtx)
+        delete wtx;
+}
+
+static int64_t SyntheticValue(int i)
+{
+    // - 0.00001 to 1 coin, times 1, 10 or 100: payments received and the
+    //   change of earlier sends
+    uint32_t h = (uint32_t)i * 2654435761u;
+    int64_t nValue = (h % 100000 + 1) * 1000;
+    for (uint32_t n = (h >> 24) % 3; n > 0; --n)
+        nValue *= 10;
+    return nValue;
+}
+
+static int64_t SyntheticTarget(int i)
+{
+    // - 0.01 to 50 coins
+    return ((uint32_t)i * 104729u % 5000 + 1) * CENT;
+}
+
+struct CSelectionQuality
+{
+    int nSelections;
+    int nChangeless;
+    int64_t nInputs;
+    int64_t nChange;
+
+    CSelectionQuality() : nSelections(0), nChangeless(0), nInputs(0), nChange(0) {}
+
+    void Add(int64_t nTargetValue, int64_t nValueRet, size_t nSelectedInputs)
+    {
+        nSelections++;
+        nInputs += nSelectedInputs;
+        if (nValueRet - nTargetValue <= GetCostOfChange(nTransactionFee))
+            nChangeless++;
+        else
+            nChange += nValueRet - nTargetValue;
+    }
+
+    void Print(const char *pszName) const
+    {
+        if (nSelections == 0)
+            return;
+        // - as a comment line of the csv output
+        std::cout << strprintf("#%s: %d selections, %.1f%% without change, %.2f inputs, %s change on average\n",
+            pszName, nSelections, 100.0 * nChangeless / nSelections, (double)nInputs / nSelections,
+            FormatMoney(nSelections > nChangeless ? nChange / (nSelections - nChangeless) : 0));
+    }
+};
+
+// Selection time, and the share of the selections without change, for
+// wallets of many coins of synthetic values and targets.
+static void SelectFromSyntheticWallet(benchmark::State& state, const char *pszName, int nCoins)
+{
+    const CWallet wallet;
+    std::vector<CWalletTx*> vWtx;
+    std::vector<COutput> vCoins;
+
+    for (int i = 0; i < nCoins; i++)
+        AddCoin(wallet, vWtx, vCoins, SyntheticValue(i));
+
+    CSelectionQuality quality;
+    int i = 0;
+    while (state.KeepRunning())
+    {
+        std::set<std::pair<const CWalletTx*, unsigned int> > setCoinsRet;
+        int64_t nValueRet;
+        int64_t nTargetValue = SyntheticTarget(i++);
+        if (wallet.SelectCoinsMinConf(nTargetValue, GetAdjustedTime(), 1, 6, vCoins, setCoinsRet, nValueRet))
+            quality.Add(nTargetValue, nValueRet, setCoinsRet.size());
+    }
+    quality.Print(pszName);
+
+    BOOST_FOREACH(CWalletTx *wtx, vWtx)
+        delete wtx;
+}
+
+// The knapsack alone, on the values SelectCoinsMinConf passes it, to
+// compare with the selection trying branch and bound first.
+static void SelectKnapsackFromSyntheticWallet(benchmark::State& state, const char *pszName, int nCoins)
+{
+    std::vector<int64_t> vAll;
+    for (int i = 0; i < nCoins; i++)
+        vAll.push_back(SyntheticValue(i));
+    std::sort(vAll.begin(), vAll.end(), std::greater<int64_t>());
+
+    CSelectionQuality quality;
+    std::vector<int64_t> vValue;
+    std::vector<char> vfBest;
+    int i = 0;
+    while (state.KeepRunning())
+    {
+        int64_t nTargetValue = SyntheticTarget(i++);
+        int64_t nTotalLower = 0;
+        vValue.clear();
+        BOOST_FOREACH(int64_t n, vAll)
+            if (n < nTargetValue + CENT)
+            {
+                vValue.push_back(n);
+                nTotalLower += n;
+            }
+        if (nTotalLower < nTargetValue)
+            continue;
+
+        int64_t nBest;
+        ApproximateBestSubset(vValue, nTotalLower, nTargetValue, vfBest, nBest);
+        if (nBest != nTargetValue && nTotalLower >= nTargetValue + CENT)
+            ApproximateBestSubset(vValue, nTotalLower, nTargetValue + CENT, vfBest, nBest);
+        quality.Add(nTargetValue, nBest, std::count(vfBest.begin(), vfBest.end(), true));
+    }
+    quality.Print(pszName);
+}
+
+static void CoinSelection10k(benchmark::State& state)
+{
+    SelectFromSyntheticWallet(state, "CoinSelection10k", 10000);
+}
+
+static void CoinSelection100k(benchmark::State& state)
+{
+    SelectFromSyntheticWallet(state, "CoinSelection100k", 100000);
+}
+
+static void CoinSelectionKnapsack10k(benchmark::State& state)
+{
+    SelectKnapsackFromSyntheticWallet(state, "CoinSelectionKnapsack10k", 10000);
+}
+
+static void CoinSelectionKnapsack100k(benchmark::State& state)
+{
+    SelectKnapsackFromSyntheticWallet(state, "CoinSelectionKnapsack100k", 100000);
+}
+
+BENCHMARK(CoinSelection);
+BENCHMARK(CoinSelectionMixed);
+BENCHMARK(CoinSelection10k);
+BENCHMARK(CoinSelection100k);
+BENCHMARK(CoinSelectionKnapsack10k);
+BENCHMARK(CoinSelectionKnapsack100k);
@@ -0,0 +1,149 @@
+// SPDX-FileCopyrightText: © 2020 Alias Developers
+//
+// SPDX-License-Identifier: MIT
+
+#include "bench.h"
+
+#include "hash.h"
+#include "key.h"
+#include "ringsig.h"
+#include "scrypt.h"
+#include "stealth.h"
+#include "util.h"
+
+
+static void Sha256d_1KiB(benchmark::State& state)
+{
+    std::vector<uint8_t> vData(1024, 0x5a);
+    uint256 hash;
+    while (state.KeepRunning())
+        hash = Hash(vData.begin(), vData.end());
+}
+
+static void HashWriter_Tx(benchmark::State& state)
+{
+    // - the txn preimage / sighash pattern, many small writes
+    uint256 a = GetRandHash(), b = GetRandHash();
+    uint256 hash;
+    while (state.KeepRunning())
+    {
+        CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
+        for (int i = 0; i < 16; ++i)
+            ss << a << b << i;
+        hash = ss.GetHash();
+    }
+}
+
+static void ScryptBlockHash(benchmark::State& state)
+{
+    uint8_t header[80];
+    memset(header, 0x11, sizeof(header));
+    uint256 hash;
+    while (state.KeepRunning())
+    {
+        hash = scrypt_blockhash(header);
+        header[76]++;
+    }
+}
+
+static void StealthSecretBench(benchmark::State& state)
+{
+    // - the per output work of a stealth wallet scan
+    ec_secret sScan, sSpend, sEphem, sShared;
+    ec_point pkScan, pkSpend, pkEphem, pkOut;
+
+    if (GenerateRandomSecret(sScan) != 0
+        || GenerateRandomSecret(sSpend) != 0
+        || GenerateRandomSecret(sEphem) != 0
+        || SecretToPublicKey(sScan, pkScan) != 0
+        || SecretToPublicKey(sSpend, pkSpend) != 0
+        || SecretToPublicKey(sEphem, pkEphem) != 0)
+    {
+        LogPrintf("StealthSecretBench: key setup failed.\n");
+        return;
+    };
+
+    while (state.KeepRunning())
+        StealthSecret(sScan, pkEphem, pkSpend, sShared, pkOut);
+}
+
+static bool MakeRing(int nRingSize, std::vector<uint8_t> &vPubkeys, ec_secret &sSpend, ec_point &keyImage, int &iSender)
+{
+    vPubkeys.resize(EC_COMPRESSED_SIZE * nRingSize);
+    iSender = GetRandInt(nRingSize);
+
+    for (int i = 0; i < nRingSize; ++i)
+    {
+        CKey key;
+        key.MakeNewKey(true);
+        CPubKey pk = key.GetPubKey();
+        memcpy(&vPubkeys[i * EC_COMPRESSED_SIZE], pk.begin(), EC_COMPRESSED_SIZE);
+        if (i == iSender)
+            memcpy(&sSpend.e[0], key.begin(), EC_SECRET_SIZE);
+    };
+
+    ec_point pkSpend;
+    return SecretToPublicKey(sSpend, pkSpend) == 0
+        && generateKeyImage(pkSpend, sSpend, keyImage) == 0;
+}
+
+static void RingSigGenerateAB(benchmark::State& state, int nRingSize)
+{
+    std::vector<uint8_t> vPubkeys;
+    std::vector<uint8_t> vSigS(EC_SECRET_SIZE * nRingSize);
+    ec_secret sSpend;
+    ec_point keyImage, sigC;
+    int iSender;
+
+    if (!MakeRing(nRingSize, vPubkeys, sSpend, keyImage, iSender))
+    {
+        LogPrintf("RingSigGenerateAB: ring setup failed.\n");
+        return;
+    };
+
+    while (state.KeepRunning())
+        generateRingSignatureAB(keyImage, nRingSize, iSender, sSpend, &vPubkeys[0], sigC, &vSigS[0]);
+}
+
+static void RingSigVerifyAB(benchmark::State& state, int nRingSize, bool fPointCache)
+{
+    std::vector<uint8_t> vPubkeys;
+    std::vector<uint8_t> vSigS(EC_SECRET_SIZE * nRingSize);
+    ec_secret sSpend;
+    ec_point keyImage, sigC;
+    int iSender;
+
+    if (!MakeRing(nRingSize, vPubkeys, sSpend, keyImage, iSender)
+        || generateRingSignatureAB(keyImage, nRingSize, iSender, sSpend, &vPubkeys[0], sigC, &vSigS[0]) != 0)
+    {
+        LogPrintf("RingSigVerifyAB: ring setup failed.\n");
+        return;
+    };
+
+    // - without the point cache every member is decompressed and hashed to the curve again
+    if (!fPointCache)
+        SetRingPointCacheSize(0);
+
+    while (state.KeepRunning())
+        verifyRingSignatureAB(keyImage, nRingSize, &vPubkeys[0], sigC, &vSigS[0]);
+
+    SetRingPointCacheSize(GetArg("-maxringpointcache", DEFAULT_RING_POINT_CACHE_SIZE));
+}
+
+BENCHMARK(Sha256d_1KiB);
+BENCHMARK(HashWriter_Tx);
+BENCHMARK(ScryptBlockHash);
+BENCHMARK(StealthSecretBench);
+
+static struct RingSigBenchmarks
+{
+    RingSigBenchmarks()
+    {
+        for (int n = MIN_RING_SIZE; n <= (int)MAX_RING_SIZE; ++n)
+        {
+            benchmark::BenchRunner(strprintf("RingSigGenerateAB_%02d", n), [n](benchmark::State& state) { RingSigGenerateAB(state, n); });
+            benchmark::BenchRunner(strprintf("RingSigVerifyAB_%02d", n), [n](benchmark::State& state) { RingSigVerifyAB(state, n, false); });
+            benchmark::BenchRunner(strprintf("RingSigVerifyABCached_%02d", n), [n](benchmark::State& state) { RingSigVerifyAB(state, n, true); });
+        };
+    };
+} ringSigBenchmarks;
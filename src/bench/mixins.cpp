@@ -0,0 +1,43 @@
+// SPDX-FileCopyrightText: © 2020 Alias Developers
+//
+// SPDX-License-Identifier: MIT
+
+#include "bench.h"
+
+#include "core.h"
+#include "key.h"
+#include "ringsig.h"
+#include "util.h"
+
+
+static void MixinsPick(benchmark::State& state)
+{
+    // - 10000 anon outputs of one denomination in 2500 transactions, half of them recent
+    const int64_t nValue = COIN;
+    const int nHeight = 100000;
+
+    CMixins mixinsAll;
+    for (int i = 0; i < 10000; ++i)
+    {
+        CKey key;
+        key.MakeNewKey(true);
+        CPubKey pk = key.GetPubKey();
+
+        COutPoint outpoint(uint256(i / 4 + 1), i % 4);
+        CAnonOutput ao(outpoint, nValue, nHeight - (i % 2 ? 100 : 5000), 0, 0);
+        mixinsAll.AddAnonOutput(pk, ao, nHeight);
+    };
+
+    // Pick removes the picked outputs, start again from a copy when too few are left,
+    // the copy is amortised over ~1000 picks
+    CMixins mixins = mixinsAll;
+    std::vector<CPubKey> vPicked;
+    while (state.KeepRunning())
+    {
+        vPicked.clear();
+        if (!mixins.Pick(nValue, MIN_RING_SIZE - 1, vPicked))
+            mixins = mixinsAll;
+    }
+}
+
+BENCHMARK(MixinsPick);
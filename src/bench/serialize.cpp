@@ -0,0 +1,96 @@
+// SPDX-FileCopyrightText: © 2020 Alias Developers
+//
+// SPDX-License-Identifier: MIT
+
+#include "bench.h"
+
+#include "main.h"
+#include "util.h"
+
+
+static CTransaction MakeTx(int nIn, int nOut)
+{
+    CTransaction tx;
+    tx.nTime = 1600000000;
+    for (int i = 0; i < nIn; ++i)
+    {
+        CTxIn txin(COutPoint(GetRandHash(), i), CScript() << std::vector<uint8_t>(72, 0x30) << std::vector<uint8_t>(33, 0x02));
+        tx.vin.push_back(txin);
+    };
+    for (int i = 0; i < nOut; ++i)
+    {
+        CScript scriptPubKey;
+        scriptPubKey << OP_DUP << OP_HASH160 << std::vector<uint8_t>(20, 0xab) << OP_EQUALVERIFY << OP_CHECKSIG;
+        tx.vout.push_back(CTxOut(COIN + i, scriptPubKey));
+    };
+    return tx;
+}
+
+static CBlock MakeBlock(int nTx)
+{
+    CBlock block;
+    block.nVersion = 7;
+    block.nTime = 1600000000;
+    for (int i = 0; i < nTx; ++i)
+        block.vtx.push_back(MakeTx(2, 2));
+    block.hashMerkleRoot = block.BuildMerkleTree();
+    return block;
+}
+
+static void SerializeTx(benchmark::State& state)
+{
+    CTransaction tx = MakeTx(2, 2);
+    while (state.KeepRunning())
+    {
+        CDataStream ss(SER_DISK, CLIENT_VERSION);
+        ss << tx;
+    }
+}
+
+static void DeserializeTx(benchmark::State& state)
+{
+    CDataStream ssTx(SER_DISK, CLIENT_VERSION);
+    ssTx << MakeTx(2, 2);
+    while (state.KeepRunning())
+    {
+        CDataStream ss(ssTx);
+        CTransaction tx;
+        ss >> tx;
+    }
+}
+
+static void SerializeBlock(benchmark::State& state)
+{
+    CBlock block = MakeBlock(500);
+    while (state.KeepRunning())
+    {
+        CDataStream ss(SER_DISK, CLIENT_VERSION);
+        ss.reserve(1000000);
+        ss << block;
+    }
+}
+
+static void DeserializeBlock(benchmark::State& state)
+{
+    CDataStream ssBlock(SER_DISK, CLIENT_VERSION);
+    ssBlock << MakeBlock(500);
+    while (state.KeepRunning())
+    {
+        CDataStream ss(ssBlock);
+        CBlock block;
+        ss >> block;
+    }
+}
+
+static void BlockMerkleRoot(benchmark::State& state)
+{
+    CBlock block = MakeBlock(500);
+    while (state.KeepRunning())
+        block.BuildMerkleTree();
+}
+
+BENCHMARK(SerializeTx);
+BENCHMARK(DeserializeTx);
+BENCHMARK(SerializeBlock);
+BENCHMARK(DeserializeBlock);
+BENCHMARK(BlockMerkleRoot);
@@ -0,0 +1,131 @@
+// SPDX-FileCopyrightText: © 2020 Alias Developers
+//
+// SPDX-License-Identifier: MIT
+
+#include "bench.h"
+
+#include "main.h"
+#include "txdb.h"
+#include "util.h"
+
+static const int BENCH_TXDB_RECORDS = 20000;
+
+static uint256 TxHash(int i)
+{
+    return Hash(BEGIN(i), END(i));
+}
+
+static CPubKey AnonKey(int i)
+{
+    // - any 33 bytes do as a key, the db doesn't parse them
+    std::vector<uint8_t> vch(33, 0x02);
+    uint256 h = TxHash(i);
+    memcpy(&vch[1], h.begin(), 32);
+    return CPubKey(vch);
+}
+
+static void OpenBenchTxDB(CTxDB &txdb)
+{
+    // - the scratch db in -datadir is filled on first use
+    int nVersion;
+    if (txdb.ReadVersion(nVersion) && nVersion == BENCH_TXDB_RECORDS)
+        return;
+
+    txdb.TxnBegin();
+    for (int i = 0; i < BENCH_TXDB_RECORDS; ++i)
+    {
+        CTxIndex txindex(CDiskTxPos(1, i * 1000, i * 1000 + 81), 2);
+        txdb.UpdateTxIndex(TxHash(i), txindex);
+
+        CPubKey pk = AnonKey(i);
+        COutPoint outpoint(TxHash(i), 0);
+        CAnonOutput ao(outpoint, COIN, i, 0, 0);
+        txdb.WriteAnonOutput(pk, ao);
+    };
+    txdb.WriteVersion(BENCH_TXDB_RECORDS);
+    txdb.TxnCommit();
+}
+
+static void TxDBReadTxIndex(benchmark::State& state)
+{
+    CTxDB txdb("cr+");
+    OpenBenchTxDB(txdb);
+
+    CTxIndex txindex;
+    int i = 0;
+    while (state.KeepRunning())
+    {
+        txdb.ReadTxIndex(TxHash(i), txindex);
+        i = (i + 7919) % BENCH_TXDB_RECORDS;
+    }
+
+    txdb.Close();
+}
+
+static void TxDBReadAnonOutput(benchmark::State& state)
+{
+    CTxDB txdb("cr+");
+    OpenBenchTxDB(txdb);
+
+    CAnonOutput ao;
+    int i = 0;
+    while (state.KeepRunning())
+    {
+        CPubKey pk = AnonKey(i);
+        txdb.ReadAnonOutput(pk, ao);
+        i = (i + 7919) % BENCH_TXDB_RECORDS;
+    }
+
+    txdb.Close();
+}
+
+static void ReadTxIndexInBatch(benchmark::State& state, int nPending)
+{
+    // - ConnectBlock reads through a pending batch holding the block's writes,
+    //   the cost per read should not grow with the size of the batch
+    CTxDB txdb("cr+");
+    OpenBenchTxDB(txdb);
+
+    txdb.TxnBegin();
+    for (int i = 0; i < nPending; ++i)
+    {
+        CTxIndex txindex(CDiskTxPos(2, i * 1000, i * 1000 + 81), 2);
+        txdb.UpdateTxIndex(TxHash(BENCH_TXDB_RECORDS + i), txindex);
+    };
+
+    // - every other read is of a pending write
+    CTxIndex txindex;
+    int i = 0;
+    while (state.KeepRunning())
+    {
+        if (i & 1)
+            txdb.ReadTxIndex(TxHash(BENCH_TXDB_RECORDS + i % nPending), txindex);
+        else
+            txdb.ReadTxIndex(TxHash(i), txindex);
+        i = (i + 7919) % BENCH_TXDB_RECORDS;
+    }
+
+    txdb.TxnAbort();
+    txdb.Close();
+}
+
+static void TxDBReadTxIndexInBatch100(benchmark::State& state)
+{
+    ReadTxIndexInBatch(state, 100);
+}
+
+static void TxDBReadTxIndexInBatch1000(benchmark::State& state)
+{
+    ReadTxIndexInBatch(state, 1000);
+}
+
+static void TxDBReadTxIndexInBatch10000(benchmark::State& state)
+{
+    ReadTxIndexInBatch(state, 10000);
+}
+
+BENCHMARK(TxDBReadTxIndex);
+BENCHMARK(TxDBReadAnonOutput);
+BENCHMARK(TxDBReadTxIndexInBatch100);
+BENCHMARK(TxDBReadTxIndexInBatch1000);
+BENCHMARK(TxDBReadTxIndexInBatch10000);
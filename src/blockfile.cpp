@@ -0,0 +1,513 @@
+// SPDX-FileCopyrightText: © 2020 Alias Developers
+//
+// SPDX-License-Identifier: MIT
+
+#include "blockfile.h"
+
+#include "chainparams.h"
+#include "main.h"
+#include "sync.h"
+#include "util.h"
+
+#include "lz4/lz4.h"
+#include "xxhash/xxhash.h"
+
+#include <atomic>
+#include <map>
+
+#ifndef WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+typedef std::pair<bool, unsigned int> BlockFileKey;
+
+// - live mappings per file, in the pool or held by readers only,
+//   ReleaseBlockFileMap waits for the count of a file to drop to 0
+static boost::mutex cs_blockFileUsers;
+static boost::condition_variable condBlockFileUsers;
+static std::map<BlockFileKey, int> mapBlockFileUsers;
+
+static void AddBlockFileUser(const BlockFileKey &key)
+{
+    boost::mutex::scoped_lock lock(cs_blockFileUsers);
+    mapBlockFileUsers[key]++;
+}
+
+static void RemoveBlockFileUser(const BlockFileKey &key)
+{
+    boost::mutex::scoped_lock lock(cs_blockFileUsers);
+    std::map<BlockFileKey, int>::iterator mi = mapBlockFileUsers.find(key);
+    if (mi != mapBlockFileUsers.end() && --mi->second < 1)
+    {
+        mapBlockFileUsers.erase(mi);
+        condBlockFileUsers.notify_all();
+    };
+}
+
+class CBlockFileMapping
+{
+public:
+    BlockFileKey key;
+    const char *pdata;
+    uint64_t nSize;
+    int64_t nLastUse;
+
+    CBlockFileMapping(const BlockFileKey &keyIn, const char *pdataIn, uint64_t nSizeIn) : key(keyIn), pdata(pdataIn), nSize(nSizeIn), nLastUse(0)
+    {
+        AddBlockFileUser(key);
+    }
+
+    ~CBlockFileMapping()
+    {
+#ifndef WIN32
+        if (pdata)
+            munmap((void*)pdata, nSize);
+#endif
+        RemoveBlockFileUser(key);
+    }
+
+private:
+    CBlockFileMapping(const CBlockFileMapping&);
+    CBlockFileMapping &operator=(const CBlockFileMapping&);
+};
+
+CBlockFileStream::CBlockFileStream(std::shared_ptr<const void> ownerIn, const char *pbeginIn, const char *pendIn, uint64_t nPos, int nTypeIn, int nVersionIn)
+    : owner(ownerIn)
+{
+    pbegin = pbeginIn;
+    pend   = pendIn;
+    pread  = pbegin + std::min(nPos, (uint64_t)(pend - pbegin));
+    nType = nTypeIn;
+    nVersion = nVersionIn;
+}
+
+CBlockFileStream::CBlockFileStream(BlockRecordPtr record, uint64_t nPos, int nTypeIn, int nVersionIn)
+    : CBlockFileStream(record, record->data(), record->data() + record->size(), nPos, nTypeIn, nVersionIn)
+{
+}
+
+bool fCompressBlocks = false;
+
+
+static CCriticalSection cs_blockFileMaps;
+static std::map<BlockFileKey, std::shared_ptr<CBlockFileMapping> > mapBlockFileMaps;
+static std::map<BlockFileKey, int> mapBlockFilesUnmapped;   // CBlockFileUnmapped scopes per file
+static int nMaxBlockFileMaps = DEFAULT_MAX_BLOCKFILE_MAPS;
+static int64_t nBlockFileMapUse = 0;
+static uint64_t nBlockFileMapCalls = 0;
+
+static std::atomic<uint64_t> nBlockFileReads(0);
+static std::atomic<uint64_t> nBlockFileBytesRead(0);
+static std::atomic<uint64_t> nBlockFileFallbacks(0);
+static std::atomic<uint64_t> nBlockRecordsDecompressed(0);
+
+// - decompressed records, the transactions of a block are often read together
+static const unsigned int BLOCK_RECORD_CACHE_SIZE = 16;
+
+struct CBlockRecordCacheEntry
+{
+    bool fHeaderFile;
+    unsigned int nFile;
+    uint64_t nBlockPos;
+    BlockRecordPtr record;
+};
+
+static CCriticalSection cs_blockRecordCache;
+static std::vector<CBlockRecordCacheEntry> vBlockRecordCache; // most recently used last
+
+static void EraseBlockRecords(bool fHeaderFile, unsigned int nFile)
+{
+    LOCK(cs_blockRecordCache);
+    std::vector<CBlockRecordCacheEntry>::iterator it = vBlockRecordCache.begin();
+    while (it != vBlockRecordCache.end())
+    {
+        if (it->fHeaderFile == fHeaderFile && it->nFile == nFile)
+            it = vBlockRecordCache.erase(it);
+        else
+            ++it;
+    };
+}
+
+static std::shared_ptr<CBlockFileMapping> MapBlockFile(bool fHeaderFile, unsigned int nFile)
+{
+#ifdef WIN32
+    return std::shared_ptr<CBlockFileMapping>();
+#else
+    std::string strBlockFn = strprintf(fHeaderFile ? "blk_hdr%04u.dat": "blk%04u.dat", nFile);
+    int fd = open((GetDataDir() / strBlockFn).string().c_str(), O_RDONLY);
+    if (fd < 0)
+        return std::shared_ptr<CBlockFileMapping>();
+
+    struct stat st;
+    void *p = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size > 0)
+        p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (p == MAP_FAILED)
+        return std::shared_ptr<CBlockFileMapping>();
+
+    nBlockFileMapCalls++;
+    return std::make_shared<CBlockFileMapping>(BlockFileKey(fHeaderFile, nFile), (const char*)p, (uint64_t)st.st_size);
+#endif
+}
+
+void SetBlockFileMapLimit(int nMaxMaps)
+{
+    LOCK(cs_blockFileMaps);
+    nMaxBlockFileMaps = std::max(0, nMaxMaps);
+    if (nMaxBlockFileMaps == 0)
+        mapBlockFileMaps.clear();
+}
+
+CBlockFileUnmapped::CBlockFileUnmapped(bool fHeaderFileIn, unsigned int nFileIn)
+    : fHeaderFile(fHeaderFileIn), nFile(nFileIn)
+{
+    BlockFileKey key(fHeaderFile, nFile);
+    {
+        // - no new mapping of the file from here on, OpenBlockFileStream checks under the same lock
+        LOCK(cs_blockFileMaps);
+        mapBlockFilesUnmapped[key]++;
+        mapBlockFileMaps.erase(key);
+    }
+    EraseBlockRecords(fHeaderFile, nFile);
+
+    // - readers hold a mapping for the read of one object only
+    boost::mutex::scoped_lock lock(cs_blockFileUsers);
+    while (mapBlockFileUsers.count(key))
+        condBlockFileUsers.wait(lock);
+}
+
+CBlockFileUnmapped::~CBlockFileUnmapped()
+{
+    LOCK(cs_blockFileMaps);
+    std::map<BlockFileKey, int>::iterator mi = mapBlockFilesUnmapped.find(BlockFileKey(fHeaderFile, nFile));
+    if (mi != mapBlockFilesUnmapped.end() && --mi->second < 1)
+        mapBlockFilesUnmapped.erase(mi);
+}
+
+void ReleaseBlockFileMap(bool fHeaderFile, unsigned int nFile)
+{
+    CBlockFileUnmapped unmapped(fHeaderFile, nFile);
+}
+
+void GetBlockFileStats(CBlockFileStats &stats)
+{
+    {
+        LOCK(cs_blockFileMaps);
+        stats.nMappings = mapBlockFileMaps.size();
+        stats.nMapped = 0;
+        std::map<BlockFileKey, std::shared_ptr<CBlockFileMapping> >::const_iterator it;
+        for (it = mapBlockFileMaps.begin(); it != mapBlockFileMaps.end(); ++it)
+            stats.nMapped += it->second->nSize;
+        stats.nMapCalls = nBlockFileMapCalls;
+    }
+    stats.nReads = nBlockFileReads;
+    stats.nBytesRead = nBlockFileBytesRead;
+    stats.nFallbacks = nBlockFileFallbacks;
+    stats.nDecompressed = nBlockRecordsDecompressed;
+}
+
+bool OpenBlockFileStream(bool fHeaderFile, unsigned int nFile, uint64_t nPos, int nType, int nVersion, std::unique_ptr<CBlockFileStream> &stream)
+{
+    if ((nFile < 1) || (nFile == (unsigned int) -1))
+        return false;
+
+    std::shared_ptr<CBlockFileMapping> mapping;
+    {
+        LOCK(cs_blockFileMaps);
+        if (nMaxBlockFileMaps < 1)
+            return false;
+
+        BlockFileKey key(fHeaderFile, nFile);
+        if (mapBlockFilesUnmapped.count(key))
+            return false;
+
+        std::map<BlockFileKey, std::shared_ptr<CBlockFileMapping> >::iterator mi = mapBlockFileMaps.find(key);
+        if (mi == mapBlockFileMaps.end() || nPos >= mi->second->nSize)
+        {
+            // - not mapped yet, or the block was appended after the file was mapped
+            mapping = MapBlockFile(fHeaderFile, nFile);
+            if (!mapping || nPos >= mapping->nSize)
+                return false;
+
+            if (mi != mapBlockFileMaps.end())
+                mi->second = mapping;
+            else
+            {
+                if ((int)mapBlockFileMaps.size() >= nMaxBlockFileMaps)
+                {
+                    // - drop the least recently used, readers still holding it keep it mapped
+                    std::map<BlockFileKey, std::shared_ptr<CBlockFileMapping> >::iterator miOld = mapBlockFileMaps.begin();
+                    for (std::map<BlockFileKey, std::shared_ptr<CBlockFileMapping> >::iterator it = mapBlockFileMaps.begin(); it != mapBlockFileMaps.end(); ++it)
+                        if (it->second->nLastUse < miOld->second->nLastUse)
+                            miOld = it;
+                    mapBlockFileMaps.erase(miOld);
+                };
+                mapBlockFileMaps[key] = mapping;
+            };
+        } else
+            mapping = mi->second;
+
+        mapping->nLastUse = ++nBlockFileMapUse;
+    }
+
+    stream.reset(new CBlockFileStream(mapping, mapping->pdata, mapping->pdata + mapping->nSize, nPos, nType, nVersion));
+    return true;
+}
+
+void RecordBlockFileRead(bool fMapped, size_t nBytes)
+{
+    if (fMapped)
+    {
+        nBlockFileReads++;
+        nBlockFileBytesRead += nBytes;
+    } else
+        nBlockFileFallbacks++;
+}
+
+bool CompressBlockRecord(const char *pRaw, size_t nRaw, std::vector<char> &vRecord)
+{
+    if (nRaw < 1 || nRaw > MAX_BLOCK_SIZE)
+        return false;
+
+    vRecord.resize(BLOCK_RECORD_LZ4_HEADER_SIZE + LZ4_compressBound(nRaw));
+    int nCompressed = LZ4_compress(pRaw, &vRecord[BLOCK_RECORD_LZ4_HEADER_SIZE], nRaw);
+    if (nCompressed < 1 || BLOCK_RECORD_LZ4_HEADER_SIZE + nCompressed >= nRaw)
+        return false;
+
+    uint32_t header[4] = {
+        BLOCK_RECORD_LZ4_MAGIC,
+        (uint32_t)nRaw,
+        (uint32_t)nCompressed,
+        XXH32(pRaw, nRaw, 0)
+    };
+    memcpy(&vRecord[0], header, BLOCK_RECORD_LZ4_HEADER_SIZE);
+    vRecord.resize(BLOCK_RECORD_LZ4_HEADER_SIZE + nCompressed);
+    return true;
+}
+
+bool IsCompressedBlockRecord(const char *p, size_t nAvail)
+{
+    uint32_t nMagic;
+    if (nAvail < sizeof(nMagic))
+        return false;
+    memcpy(&nMagic, p, sizeof(nMagic));
+    return nMagic == BLOCK_RECORD_LZ4_MAGIC;
+}
+
+void DecompressBlockRecord(const char *p, size_t nAvail, std::vector<char> &vRaw)
+{
+    uint32_t header[4];
+    if (nAvail < BLOCK_RECORD_LZ4_HEADER_SIZE)
+        throw std::ios_base::failure("DecompressBlockRecord() : end of data");
+    memcpy(header, p, BLOCK_RECORD_LZ4_HEADER_SIZE);
+
+    uint32_t nRaw = header[1], nCompressed = header[2];
+    if (header[0] != BLOCK_RECORD_LZ4_MAGIC
+        || nRaw < 1 || nRaw > MAX_BLOCK_SIZE
+        || nCompressed < 1 || nCompressed > LZ4_MAX_INPUT_SIZE)
+        throw std::ios_base::failure("DecompressBlockRecord() : bad record header");
+    if (nCompressed > nAvail - BLOCK_RECORD_LZ4_HEADER_SIZE)
+        throw std::ios_base::failure("DecompressBlockRecord() : end of data");
+
+    vRaw.resize(nRaw);
+    if (LZ4_decompress_safe(p + BLOCK_RECORD_LZ4_HEADER_SIZE, &vRaw[0], nCompressed, nRaw) != (int)nRaw
+        || XXH32(&vRaw[0], nRaw, 0) != header[3])
+        throw std::ios_base::failure("DecompressBlockRecord() : corrupt record");
+
+    nBlockRecordsDecompressed++;
+}
+
+BlockRecordPtr GetBlockRecord(bool fHeaderFile, unsigned int nFile, uint64_t nBlockPos, const char *p, size_t nAvail)
+{
+    {
+        LOCK(cs_blockRecordCache);
+        for (std::vector<CBlockRecordCacheEntry>::iterator it = vBlockRecordCache.begin(); it != vBlockRecordCache.end(); ++it)
+        {
+            if (it->nBlockPos != nBlockPos || it->nFile != nFile || it->fHeaderFile != fHeaderFile)
+                continue;
+            CBlockRecordCacheEntry entry = *it;
+            vBlockRecordCache.erase(it);
+            vBlockRecordCache.push_back(entry);
+            return entry.record;
+        };
+    }
+
+    std::shared_ptr<std::vector<char> > record = std::make_shared<std::vector<char> >();
+    DecompressBlockRecord(p, nAvail, *record);
+
+    CBlockRecordCacheEntry entry;
+    entry.fHeaderFile = fHeaderFile;
+    entry.nFile = nFile;
+    entry.nBlockPos = nBlockPos;
+    entry.record = record;
+
+    LOCK(cs_blockRecordCache);
+    if (vBlockRecordCache.size() >= BLOCK_RECORD_CACHE_SIZE)
+        vBlockRecordCache.erase(vBlockRecordCache.begin());
+    vBlockRecordCache.push_back(entry);
+    return record;
+}
+
+bool ReadCompressedBlockRecord(FILE *file, std::vector<char> &vRaw)
+{
+    long nPos = ftell(file);
+    char header[BLOCK_RECORD_LZ4_HEADER_SIZE];
+    size_t nRead = fread(header, 1, sizeof(header), file);
+    if (!IsCompressedBlockRecord(header, nRead))
+    {
+        if (nPos < 0 || fseek(file, nPos, SEEK_SET) != 0)
+            throw std::ios_base::failure("ReadCompressedBlockRecord() : fseek failed");
+        return false;
+    };
+
+    if (nRead < sizeof(header))
+        throw std::ios_base::failure("ReadCompressedBlockRecord() : end of data");
+
+    uint32_t nCompressed;
+    memcpy(&nCompressed, &header[8], sizeof(nCompressed));
+    if (nCompressed < 1 || nCompressed > MAX_BLOCK_SIZE)
+        throw std::ios_base::failure("ReadCompressedBlockRecord() : bad record header");
+
+    std::vector<char> vData(BLOCK_RECORD_LZ4_HEADER_SIZE + nCompressed);
+    memcpy(&vData[0], header, sizeof(header));
+    if (fread(&vData[BLOCK_RECORD_LZ4_HEADER_SIZE], 1, nCompressed, file) != nCompressed)
+        throw std::ios_base::failure("ReadCompressedBlockRecord() : end of data");
+
+    DecompressBlockRecord(&vData[0], vData.size(), vRaw);
+    return true;
+}
+
+static bool CopyBlockFileRest(FILE *fileIn, FILE *fileOut)
+{
+    char buf[65536];
+    size_t nRead;
+    while ((nRead = fread(buf, 1, sizeof(buf), fileIn)) > 0)
+        if (fwrite(buf, 1, nRead, fileOut) != nRead)
+            return false;
+    return !ferror(fileIn);
+}
+
+static bool ConvertBlockFile(FILE *fileIn, FILE *fileOut, bool fCompress)
+{
+    std::vector<char> vRecord, vConverted;
+    for (;;)
+    {
+        long nPos = ftell(fileIn);
+        char header[MESSAGE_START_SIZE + sizeof(uint32_t)];
+        size_t nRead = fread(header, 1, sizeof(header), fileIn);
+        if (nRead == 0)
+            return !ferror(fileIn);
+
+        uint32_t nSize = 0;
+        if (nRead == sizeof(header))
+            memcpy(&nSize, &header[MESSAGE_START_SIZE], sizeof(nSize));
+
+        bool fRecord = nRead == sizeof(header)
+            && memcmp(header, Params().MessageStart(), MESSAGE_START_SIZE) == 0
+            && nSize > 0 && nSize <= MAX_BLOCK_SIZE;
+        if (fRecord)
+        {
+            vRecord.resize(nSize);
+            fRecord = fread(&vRecord[0], 1, nSize, fileIn) == nSize;
+        };
+
+        const std::vector<char> *pOut = &vRecord;
+        if (fRecord)
+        {
+            try {
+                if (IsCompressedBlockRecord(&vRecord[0], nSize))
+                {
+                    if (!fCompress)
+                    {
+                        DecompressBlockRecord(&vRecord[0], nSize, vConverted);
+                        pOut = &vConverted;
+                    };
+                } else
+                if (fCompress && CompressBlockRecord(&vRecord[0], nSize, vConverted))
+                    pOut = &vConverted;
+            } catch (std::exception &e)
+            {
+                fRecord = false;
+            };
+        };
+
+        if (!fRecord)
+        {
+            // - not a block record, keep the rest of the file as it is, reindexing searches it for blocks
+            LogPrintf("ConvertBlockFile() : no block record at %d, copying the rest of the file.\n", nPos);
+            if (nPos < 0 || fseek(fileIn, nPos, SEEK_SET) != 0)
+                return false;
+            return CopyBlockFileRest(fileIn, fileOut);
+        };
+
+        uint32_t nSizeOut = pOut->size();
+        if (fwrite(Params().MessageStart(), 1, MESSAGE_START_SIZE, fileOut) != MESSAGE_START_SIZE
+            || fwrite(&nSizeOut, 1, sizeof(nSizeOut), fileOut) != sizeof(nSizeOut)
+            || fwrite(&(*pOut)[0], 1, nSizeOut, fileOut) != nSizeOut)
+            return false;
+    };
+}
+
+bool ConvertBlockFiles(bool fCompress)
+{
+    LogPrintf("Converting block files to %s records...\n", fCompress ? "compressed" : "plain");
+    int64_t nStart = GetTimeMillis();
+
+    {
+        LOCK(cs_blockFileMaps);
+        mapBlockFileMaps.clear();
+    }
+    {
+        LOCK(cs_blockRecordCache);
+        vBlockRecordCache.clear();
+    }
+
+    uint64_t nBytesIn = 0, nBytesOut = 0;
+    for (unsigned int nFile = 1; ; ++nFile)
+    {
+        boost::filesystem::path pathBlocks = GetDataDir() / strprintf("blk%04u.dat", nFile);
+        boost::filesystem::path pathTmp = GetDataDir() / strprintf("blk%04u.dat.convert", nFile);
+        if (!boost::filesystem::exists(pathBlocks))
+            break;
+
+        FILE *fileIn = fopen(pathBlocks.string().c_str(), "rb");
+        if (!fileIn)
+            return error("ConvertBlockFiles() : can't open %s", pathBlocks.string());
+        FILE *fileOut = fopen(pathTmp.string().c_str(), "wb");
+        if (!fileOut)
+        {
+            fclose(fileIn);
+            return error("ConvertBlockFiles() : can't create %s", pathTmp.string());
+        };
+
+        bool fOk = ConvertBlockFile(fileIn, fileOut, fCompress);
+        fOk = fOk && fflush(fileOut) == 0;
+        if (fOk)
+            FileCommit(fileOut);
+        fclose(fileIn);
+        fclose(fileOut);
+
+        if (!fOk)
+        {
+            boost::filesystem::remove(pathTmp);
+            return error("ConvertBlockFiles() : converting %s failed", pathBlocks.string());
+        };
+
+        uint64_t nSizeIn = boost::filesystem::file_size(pathBlocks);
+        uint64_t nSizeOut = boost::filesystem::file_size(pathTmp);
+        if (!RenameOver(pathTmp, pathBlocks))
+            return error("ConvertBlockFiles() : can't replace %s", pathBlocks.string());
+
+        LogPrintf("Converted blk%04u.dat, %u -> %u bytes.\n", nFile, nSizeIn, nSizeOut);
+        nBytesIn += nSizeIn;
+        nBytesOut += nSizeOut;
+    };
+
+    LogPrintf("Converted block files, %u -> %u bytes in %dms.\n", nBytesIn, nBytesOut, GetTimeMillis() - nStart);
+    return true;
+}
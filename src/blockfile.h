@@ -0,0 +1,225 @@
+// SPDX-FileCopyrightText: © 2020 Alias Developers
+//
+// SPDX-License-Identifier: MIT
+
+#ifndef SPEC_BLOCKFILE_H
+#define SPEC_BLOCKFILE_H
+
+#include "serialize.h"
+
+#include <memory>
+#include <stdint.h>
+#include <vector>
+
+// Read-only memory mappings of the blkNNNN.dat / blk_hdrNNNN.dat files.
+//
+// Blocks and transactions are deserialized straight from the mapped file
+// instead of an fopen + fseek + fread per read. Mappings are pooled (at most
+// -maxblockfilemaps, least recently used are dropped) and a file is mapped
+// again when a read starts past the end of its mapping, i.e. after blocks were
+// appended. Readers keep the mapping they use alive, so a remap never pulls
+// the data out from under them. A mapping is made at the size of the file
+// though, touching it past the end of a truncated file raises SIGBUS: a file
+// must only be truncated in the scope of a CBlockFileUnmapped.
+//
+// ReadFromBlockFile() returns false whenever the mapped read can't be done
+// (mapping disabled, unsupported platform, short data); callers then use the
+// FILE* path, which also does the error reporting.
+//
+// With -compressblocks new block records are stored LZ4 compressed. The record
+// keeps the message start and size prefix, the block position points at a
+// header (magic, raw size, compressed size, xxhash32 of the raw block) that is
+// followed by the LZ4 data. The magic can't be the version of a plain block,
+// so a file can hold both kinds of record and the option can be switched at
+// any time. nTxPos - nBlockPos of a CDiskTxPos stays the offset of the
+// transaction in the raw block, the stake kernel hashes it.
+
+static const int DEFAULT_MAX_BLOCKFILE_MAPS = 64;
+
+static const uint32_t BLOCK_RECORD_LZ4_MAGIC = 0x345a4c41; // "ALZ4"
+static const unsigned int BLOCK_RECORD_LZ4_HEADER_SIZE = 16;
+
+extern bool fCompressBlocks;
+
+typedef std::shared_ptr<const std::vector<char> > BlockRecordPtr;
+
+// Stream over the mapped bytes of a block file, or a decompressed block
+// record, from an offset to the end, the read subset of CAutoFile.
+class CBlockFileStream
+{
+private:
+    std::shared_ptr<const void> owner;
+    const char *pbegin;
+    const char *pread;
+    const char *pend;
+
+public:
+    int nType;
+    int nVersion;
+
+    CBlockFileStream(std::shared_ptr<const void> ownerIn, const char *pbeginIn, const char *pendIn, uint64_t nPos, int nTypeIn, int nVersionIn);
+    CBlockFileStream(BlockRecordPtr record, uint64_t nPos, int nTypeIn, int nVersionIn);
+
+    int GetType()                { return nType; }
+    int GetVersion()             { return nVersion; }
+
+    size_t GetPos() const        { return pread - pbegin; }
+    const char *data() const     { return pread; }
+    size_t size() const          { return pend - pread; }
+
+    CBlockFileStream& read(char* pch, size_t nSize)
+    {
+        if (nSize > (size_t)(pend - pread))
+            throw std::ios_base::failure("CBlockFileStream::read : end of data");
+        memcpy(pch, pread, nSize);
+        pread += nSize;
+        return (*this);
+    }
+
+    CBlockFileStream& ignore(size_t nSize)
+    {
+        if (nSize > (size_t)(pend - pread))
+            throw std::ios_base::failure("CBlockFileStream::ignore : end of data");
+        pread += nSize;
+        return (*this);
+    }
+
+    template<typename T>
+    unsigned int GetSerializeSize(const T& obj)
+    {
+        return ::GetSerializeSize(obj, nType, nVersion);
+    }
+
+    template<typename T>
+    CBlockFileStream& operator>>(T& obj)
+    {
+        ::Unserialize(*this, obj, nType, nVersion);
+        return (*this);
+    }
+};
+
+struct CBlockFileStats
+{
+    uint64_t nMappings;     // files currently mapped
+    uint64_t nMapped;       // total bytes currently mapped
+    uint64_t nMapCalls;     // mmap calls, including remaps after appends
+    uint64_t nReads;        // objects read from a mapping
+    uint64_t nBytesRead;    // bytes deserialized from mappings
+    uint64_t nFallbacks;    // reads left to the FILE* path
+    uint64_t nDecompressed; // compressed block records decompressed
+};
+
+// Sets the pool size from -maxblockfilemaps, 0 disables mapped reads.
+void SetBlockFileMapLimit(int nMaxMaps);
+
+// Drops the mappings of a file and waits until no reader holds one, reads of
+// the file take the FILE* path while it lives. Truncate a file in its scope.
+// Must not be created by a thread holding a CBlockFileStream of the file.
+class CBlockFileUnmapped
+{
+private:
+    bool fHeaderFile;
+    unsigned int nFile;
+
+    CBlockFileUnmapped(const CBlockFileUnmapped&);
+    CBlockFileUnmapped &operator=(const CBlockFileUnmapped&);
+
+public:
+    CBlockFileUnmapped(bool fHeaderFileIn, unsigned int nFileIn);
+    ~CBlockFileUnmapped();
+};
+
+// Drops the mappings of a file and waits until no reader holds one.
+void ReleaseBlockFileMap(bool fHeaderFile, unsigned int nFile);
+
+void GetBlockFileStats(CBlockFileStats &stats);
+
+// Returns a stream positioned at nPos of the block file, false when the file
+// can't be mapped or nPos is past its end.
+bool OpenBlockFileStream(bool fHeaderFile, unsigned int nFile, uint64_t nPos, int nType, int nVersion, std::unique_ptr<CBlockFileStream> &stream);
+
+void RecordBlockFileRead(bool fMapped, size_t nBytes);
+
+// Fills vRecord with the compressed record of a serialized block, false when
+// compressing doesn't make it smaller and the block should be written as is.
+bool CompressBlockRecord(const char *pRaw, size_t nRaw, std::vector<char> &vRecord);
+
+bool IsCompressedBlockRecord(const char *p, size_t nAvail);
+
+// Decompresses a compressed record, throws on short or corrupt data.
+void DecompressBlockRecord(const char *p, size_t nAvail, std::vector<char> &vRaw);
+
+// Decompresses the record at nBlockPos through a small cache, so reading the
+// transactions of a block one by one doesn't decompress it each time.
+BlockRecordPtr GetBlockRecord(bool fHeaderFile, unsigned int nFile, uint64_t nBlockPos, const char *p, size_t nAvail);
+
+// Reads the compressed record at the current position of file into vRaw,
+// returns false and leaves the position unchanged when it isn't compressed.
+bool ReadCompressedBlockRecord(FILE *file, std::vector<char> &vRaw);
+
+// Rewrites the blkNNNN.dat files with every record compressed, or with every
+// record plain, the block index has to be rebuilt after.
+bool ConvertBlockFiles(bool fCompress);
+
+// Reads obj at nOffset into the block record at nBlockPos of a block file.
+template<typename T>
+bool ReadFromBlockFile(bool fHeaderFile, unsigned int nFile, uint64_t nBlockPos, uint64_t nOffset, T& obj, int nType, int nVersion)
+{
+    // - a second try maps the file again in case the object was appended after
+    //   the current mapping was made
+    for (int i = 0; i < 2; ++i)
+    {
+        std::unique_ptr<CBlockFileStream> stream;
+        if (!OpenBlockFileStream(fHeaderFile, nFile, nBlockPos, nType, nVersion, stream))
+            break;
+
+        try {
+            if (IsCompressedBlockRecord(stream->data(), stream->size()))
+            {
+                BlockRecordPtr record = GetBlockRecord(fHeaderFile, nFile, nBlockPos, stream->data(), stream->size());
+                CBlockFileStream streamRaw(record, nOffset, nType, nVersion);
+                streamRaw >> obj;
+                RecordBlockFileRead(true, streamRaw.GetPos() - nOffset);
+                return true;
+            };
+
+            stream->ignore(nOffset);
+            *stream >> obj;
+            RecordBlockFileRead(true, stream->GetPos() - nBlockPos - nOffset);
+            return true;
+        } catch (std::exception &e)
+        {
+            if (i > 0)
+                break;
+            // - ReleaseBlockFileMap waits for the readers of the file, this one included
+            stream.reset();
+            ReleaseBlockFileMap(fHeaderFile, nFile);
+        };
+    };
+
+    RecordBlockFileRead(false, 0);
+    return false;
+}
+
+// The FILE* path of ReadFromBlockFile, filein is at the start of the block
+// record. Throws on I/O errors, returns whether the record was compressed.
+template<typename T>
+bool ReadBlockRecord(CAutoFile &filein, uint64_t nOffset, T& obj)
+{
+    std::vector<char> vRaw;
+    if (ReadCompressedBlockRecord(filein, vRaw))
+    {
+        if (nOffset > vRaw.size())
+            throw std::ios_base::failure("ReadBlockRecord() : offset past the end of the record");
+        CDataStream ss(vRaw.data() + nOffset, vRaw.data() + vRaw.size(), filein.nType, filein.nVersion);
+        ss >> obj;
+        return true;
+    };
+
+    if (nOffset > 0 && fseek(filein, nOffset, SEEK_CUR) != 0)
+        throw std::ios_base::failure("ReadBlockRecord() : fseek failed");
+    filein >> obj;
+    return false;
+}
+
+#endif // SPEC_BLOCKFILE_H
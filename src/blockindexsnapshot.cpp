@@ -0,0 +1,253 @@
+// SPDX-FileCopyrightText: © 2020 Alias Developers
+//
+// SPDX-License-Identifier: MIT
+
+#include "blockindexsnapshot.h"
+
+#include "main.h"
+#include "util.h"
+
+#include "xxhash/xxhash.h"
+
+#include <algorithm>
+#include <unordered_map>
+
+#ifndef WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// - the records are read in place, the layout must not depend on the compiler
+//   and has no padding, so the checksum doesn't cover uninitialised bytes
+static_assert(sizeof(CBlockIndexSnapshotHeader) == 56, "CBlockIndexSnapshotHeader layout changed");
+static_assert(sizeof(CBlockIndexRecord) == 272, "CBlockIndexRecord layout changed, bump BLOCK_INDEX_SNAPSHOT_VERSION");
+
+bool fBlockIndexSnapshot = true;
+
+static boost::filesystem::path GetSnapshotPath()
+{
+    return GetDataDir() / "blkindex.snp";
+}
+
+static uint32_t ChecksumRecords(const char *p, uint64_t nBytes)
+{
+    // - XXH32_update takes an int length
+    void *state = XXH32_init(0);
+    while (nBytes > 0)
+    {
+        int nChunk = (int)std::min(nBytes, (uint64_t)(1 << 30));
+        XXH32_update(state, p, nChunk);
+        p += nChunk;
+        nBytes -= nChunk;
+    };
+    return XXH32_digest(state);
+}
+
+void CBlockIndexRecord::ToBlockIndex(CBlockIndex *pindex) const
+{
+    pindex->nFile             = nFile;
+    pindex->nBlockPos         = nBlockPos;
+    pindex->nChainTrust       = nChainTrust;
+    pindex->nHeight           = nHeight;
+    pindex->nMint             = nMint;
+    pindex->nMoneySupply      = nMoneySupply;
+    pindex->nAnonSupply       = nAnonSupply;
+    pindex->nFlags            = nFlags;
+    pindex->nStakeModifier    = nStakeModifier;
+    pindex->bnStakeModifierV2 = bnStakeModifierV2;
+    pindex->prevoutStake      = COutPoint(hashPrevoutStake, nPrevoutStakeN);
+    pindex->nStakeTime        = nStakeTime;
+    pindex->hashProof         = hashProof;
+    pindex->nVersion          = nVersion;
+    pindex->hashMerkleRoot    = hashMerkleRoot;
+    pindex->nTime             = nTime;
+    pindex->nBits             = nBits;
+    pindex->nNonce            = nNonce;
+}
+
+bool CBlockIndexSnapshot::Open(const uint256 &hashBestChain)
+{
+    Close();
+
+#ifdef WIN32
+    return false;
+#else
+    int fd = open(GetSnapshotPath().string().c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+    void *p = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && (uint64_t)st.st_size >= sizeof(CBlockIndexSnapshotHeader))
+        p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (p == MAP_FAILED)
+        return false;
+
+    pdata = (const char*)p;
+    nSize = st.st_size;
+
+    const CBlockIndexSnapshotHeader *header = (const CBlockIndexSnapshotHeader*)pdata;
+    const CBlockIndexRecord *records = (const CBlockIndexRecord*)(pdata + sizeof(CBlockIndexSnapshotHeader));
+    uint64_t nRecordBytes = nSize - sizeof(CBlockIndexSnapshotHeader);
+
+    if (header->nMagic != BLOCK_INDEX_SNAPSHOT_MAGIC
+        || header->nVersion != BLOCK_INDEX_SNAPSHOT_VERSION
+        || header->nRecordSize != sizeof(CBlockIndexRecord)
+        || nRecordBytes != (uint64_t)header->nRecords * sizeof(CBlockIndexRecord)
+        || header->nBestRecord >= header->nRecords)
+    {
+        LogPrintf("Block index snapshot is invalid.\n");
+        Close();
+        return false;
+    };
+
+    if (header->hashBestChain != hashBestChain
+        || records[header->nBestRecord].hashBlock != hashBestChain)
+    {
+        LogPrintf("Block index snapshot is of block %s, not of the best block.\n", header->hashBestChain.ToString());
+        Close();
+        return false;
+    };
+
+    if (ChecksumRecords((const char*)records, nRecordBytes) != header->nChecksum)
+    {
+        LogPrintf("Block index snapshot checksum mismatch.\n");
+        Close();
+        return false;
+    };
+
+    pheader = header;
+    precords = records;
+    return true;
+#endif
+}
+
+void CBlockIndexSnapshot::Close()
+{
+#ifndef WIN32
+    if (pdata)
+        munmap((void*)pdata, nSize);
+#endif
+    pdata = NULL;
+    nSize = 0;
+    pheader = NULL;
+    precords = NULL;
+}
+
+bool WriteBlockIndexSnapshot(const BlockMap &mapIndex, const uint256 &hashBestChain)
+{
+    int64_t nStart = GetTimeMillis();
+
+    if (mapIndex.size() >= (uint64_t)std::numeric_limits<int32_t>::max())
+        return error("WriteBlockIndexSnapshot() : too many entries");
+
+    // - sorted by height, a record only refers back to records before it
+    std::vector<const CBlockIndex*> vIndex;
+    vIndex.reserve(mapIndex.size());
+    for (BlockMap::const_iterator it = mapIndex.begin(); it != mapIndex.end(); ++it)
+        vIndex.push_back(it->second);
+    std::stable_sort(vIndex.begin(), vIndex.end(), [] (const CBlockIndex *a, const CBlockIndex *b) {
+        return a->nHeight < b->nHeight;
+    });
+
+    std::unordered_map<const CBlockIndex*, int32_t> mapRecord;
+    mapRecord.reserve(vIndex.size());
+    for (size_t i = 0; i < vIndex.size(); ++i)
+        mapRecord[vIndex[i]] = i;
+
+    CBlockIndexSnapshotHeader header;
+    header.nMagic = BLOCK_INDEX_SNAPSHOT_MAGIC;
+    header.nVersion = BLOCK_INDEX_SNAPSHOT_VERSION;
+    header.nRecordSize = sizeof(CBlockIndexRecord);
+    header.nRecords = vIndex.size();
+    header.hashBestChain = hashBestChain;
+    header.nChecksum = 0;
+
+    BlockMap::const_iterator mi = mapIndex.find(hashBestChain);
+    if (mi == mapIndex.end())
+        return error("WriteBlockIndexSnapshot() : best block %s not in the index", hashBestChain.ToString());
+    header.nBestRecord = mapRecord[mi->second];
+
+    boost::filesystem::path pathSnapshot = GetSnapshotPath();
+    boost::filesystem::path pathTmp = GetDataDir() / "blkindex.snp.new";
+
+    FILE *file = fopen(pathTmp.string().c_str(), "wb");
+    if (!file)
+        return error("WriteBlockIndexSnapshot() : can't create %s", pathTmp.string());
+
+    // - the header is written again once the checksum is known
+    bool fOk = fwrite(&header, sizeof(header), 1, file) == 1;
+
+    void *state = XXH32_init(0);
+    std::vector<CBlockIndexRecord> vRecords;
+    vRecords.reserve(4096);
+    for (size_t i = 0; fOk && i < vIndex.size(); ++i)
+    {
+        const CBlockIndex *pindex = vIndex[i];
+
+        CBlockIndexRecord record;
+        record.hashBlock         = pindex->GetBlockHash();
+        record.nPrev             = -1;
+        record.nNext             = -1;
+        std::unordered_map<const CBlockIndex*, int32_t>::const_iterator ri;
+        if (pindex->pprev && (ri = mapRecord.find(pindex->pprev)) != mapRecord.end())
+            record.nPrev = ri->second;
+        if (pindex->pnext && (ri = mapRecord.find(pindex->pnext)) != mapRecord.end())
+            record.nNext = ri->second;
+        record.nFile             = pindex->nFile;
+        record.nBlockPos         = pindex->nBlockPos;
+        record.nHeight           = pindex->nHeight;
+        record.nFlags            = pindex->nFlags;
+        record.nMint             = pindex->nMint;
+        record.nMoneySupply      = pindex->nMoneySupply;
+        record.nAnonSupply       = pindex->nAnonSupply;
+        record.nStakeModifier    = pindex->nStakeModifier;
+        record.bnStakeModifierV2 = pindex->bnStakeModifierV2;
+        record.hashPrevoutStake  = pindex->prevoutStake.hash;
+        record.nPrevoutStakeN    = pindex->prevoutStake.n;
+        record.nStakeTime        = pindex->nStakeTime;
+        record.hashProof         = pindex->hashProof;
+        record.nVersion          = pindex->nVersion;
+        record.hashMerkleRoot    = pindex->hashMerkleRoot;
+        record.nTime             = pindex->nTime;
+        record.nBits             = pindex->nBits;
+        record.nNonce            = pindex->nNonce;
+        record.nChainTrust       = pindex->nChainTrust;
+        vRecords.push_back(record);
+
+        if (vRecords.size() == vRecords.capacity() || i + 1 == vIndex.size())
+        {
+            XXH32_update(state, &vRecords[0], vRecords.size() * sizeof(CBlockIndexRecord));
+            fOk = fwrite(&vRecords[0], sizeof(CBlockIndexRecord), vRecords.size(), file) == vRecords.size();
+            vRecords.clear();
+        };
+    };
+    header.nChecksum = XXH32_digest(state);
+
+    fOk = fOk
+        && fseek(file, 0, SEEK_SET) == 0
+        && fwrite(&header, sizeof(header), 1, file) == 1
+        && fflush(file) == 0;
+    if (fOk)
+        FileCommit(file);
+    fclose(file);
+
+    if (!fOk || !RenameOver(pathTmp, pathSnapshot))
+    {
+        boost::filesystem::remove(pathTmp);
+        return error("WriteBlockIndexSnapshot() : writing %s failed", pathSnapshot.string());
+    };
+
+    LogPrintf("Wrote block index snapshot of %u blocks in %dms.\n", vIndex.size(), GetTimeMillis() - nStart);
+    return true;
+}
+
+void RemoveBlockIndexSnapshot()
+{
+    boost::system::error_code ec;
+    boost::filesystem::remove(GetSnapshotPath(), ec);
+}
@@ -0,0 +1,99 @@
+// SPDX-FileCopyrightText: © 2020 Alias Developers
+//
+// SPDX-License-Identifier: MIT
+
+#ifndef SPEC_BLOCKINDEXSNAPSHOT_H
+#define SPEC_BLOCKINDEXSNAPSHOT_H
+
+#include "blockmap.h"
+#include "uint256.h"
+
+#include <stdint.h>
+
+// Flat snapshot of the block index, blkindex.snp in the data dir.
+//
+// Written at a clean shutdown: fixed size records sorted by height, pprev and
+// pnext stored as record numbers, nChainTrust included. The file is mapped
+// and LoadBlockIndex builds the CBlockIndex objects in one pass over it,
+// without reading the "bidx" records or sorting them to compute the trust.
+//
+// The snapshot only holds for the txdb it was written with: it's used when
+// its best block is the hashBestChain of the txdb and the checksum matches,
+// and is removed once read, as the txdb changes from then on. Any other case
+// falls back to the txdb.
+
+static const uint32_t BLOCK_INDEX_SNAPSHOT_MAGIC = 0x58444942; // "BIDX"
+static const uint32_t BLOCK_INDEX_SNAPSHOT_VERSION = 1;
+
+extern bool fBlockIndexSnapshot;
+
+struct CBlockIndexSnapshotHeader
+{
+    uint32_t nMagic;
+    uint32_t nVersion;
+    uint32_t nRecordSize;
+    uint32_t nRecords;
+    uint256 hashBestChain;
+    uint32_t nBestRecord;
+    uint32_t nChecksum;     // xxhash32 of the records
+};
+
+struct CBlockIndexRecord
+{
+    uint256 hashBlock;
+    int32_t nPrev;          // record number of pprev, -1 for none
+    int32_t nNext;          // record number of pnext, -1 for none
+    uint32_t nFile;
+    uint32_t nBlockPos;
+    int32_t nHeight;
+    uint32_t nFlags;
+    int64_t nMint;
+    int64_t nMoneySupply;
+    int64_t nAnonSupply;
+    uint64_t nStakeModifier;
+    uint256 bnStakeModifierV2;
+    uint256 hashPrevoutStake;
+    uint32_t nPrevoutStakeN;
+    uint32_t nStakeTime;
+    uint256 hashProof;
+    int32_t nVersion;
+    uint256 hashMerkleRoot;
+    uint32_t nTime;
+    uint32_t nBits;
+    uint32_t nNonce;
+    uint256 nChainTrust;
+
+    // Copies the fields, pprev, pnext and phashBlock are left to the caller.
+    void ToBlockIndex(CBlockIndex *pindex) const;
+};
+
+class CBlockIndexSnapshot
+{
+private:
+    const char *pdata;
+    uint64_t nSize;
+    const CBlockIndexSnapshotHeader *pheader;
+    const CBlockIndexRecord *precords;
+
+    CBlockIndexSnapshot(const CBlockIndexSnapshot&);
+    CBlockIndexSnapshot &operator=(const CBlockIndexSnapshot&);
+
+public:
+    CBlockIndexSnapshot() : pdata(NULL), nSize(0), pheader(NULL), precords(NULL) {}
+    ~CBlockIndexSnapshot() { Close(); }
+
+    // Maps the snapshot, false when there is none or it isn't of hashBestChain.
+    bool Open(const uint256 &hashBestChain);
+    void Close();
+
+    uint32_t size() const                                  { return pheader ? pheader->nRecords : 0; }
+    uint32_t GetBestRecord() const                         { return pheader->nBestRecord; }
+    const CBlockIndexRecord &operator[](uint32_t i) const  { return precords[i]; }
+};
+
+// Writes the snapshot of mapIndex with hashBestChain as best block.
+bool WriteBlockIndexSnapshot(const BlockMap &mapIndex, const uint256 &hashBestChain);
+
+void RemoveBlockIndexSnapshot();
+
+#endif // SPEC_BLOCKINDEXSNAPSHOT_H
@@ -0,0 +1,34 @@
+// SPDX-FileCopyrightText: © 2020 Alias Developers
+//
+// SPDX-License-Identifier: MIT
+
+#ifndef SPEC_BLOCKMAP_H
+#define SPEC_BLOCKMAP_H
+
+#include "uint256.h"
+
+#include <stdint.h>
+#include <unordered_map>
+
+class CBlockIndex;
+class CBlockThinIndex;
+
+/** Hash of a block hash for the block index maps. Salted per process, as
+ *  the low bits of a block hash are not costly to choose. */
+struct BlockHasher
+{
+    uint64_t k0, k1;
+
+    BlockHasher();
+
+    size_t operator()(const uint256& hash) const noexcept
+    {
+        uint64_t h = (hash.Get64(0) ^ k0) * 0x9E3779B97F4A7C15ULL + (hash.Get64(1) ^ k1);
+        return h ^ (h >> 32);
+    }
+};
+
+typedef std::unordered_map<uint256, CBlockIndex*, BlockHasher> BlockMap;
+typedef std::unordered_map<uint256, CBlockThinIndex*, BlockHasher> BlockThinMap;
+
+#endif // SPEC_BLOCKMAP_H
@@ -8,6 +8,7 @@
 #define  BITCOIN_CHECKPOINT_H
 
 #include <map>
+#include "blockmap.h"
 #include "net.h"
 #include "util.h"
 
@@ -28,8 +29,8 @@ namespace Checkpoints
     int GetTotalBlocksEstimate();
 
     // Returns last CBlockIndex* in mapBlockIndex that is a checkpoint
-    CBlockIndex* GetLastCheckpoint(const std::map<uint256, CBlockIndex*>& mapBlockIndex);
-    CBlockThinIndex* GetLastCheckpoint(const std::map<uint256, CBlockThinIndex*>& mapBlockThinIndex);
+    CBlockIndex* GetLastCheckpoint(const BlockMap& mapBlockIndex);
+    CBlockThinIndex* GetLastCheckpoint(const BlockThinMap& mapBlockThinIndex);
 
     extern MapCheckpoints mapCheckpoints;
     extern MapCheckpoints mapCheckpointsTestnet;
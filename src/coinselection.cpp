@@ -0,0 +1,160 @@
+// SPDX-FileCopyrightText: © 2020 Alias Developers
+// SPDX-FileCopyrightText: © 2017 The Bitcoin Core developers
+//
+// SPDX-License-Identifier: MIT
+
+#include "coinselection.h"
+#include "state.h"
+
+#include <algorithm>
+#include <limits>
+#include <stdlib.h>
+
+int64_t GetCostOfChange(int64_t nFeePerKB)
+{
+    return nFeePerKB * (COIN_SELECTION_OUTPUT_BYTES + COIN_SELECTION_INPUT_BYTES) / 1000;
+}
+
+int64_t GetMaxChangeToFee(int64_t nFeePerKB)
+{
+    return std::min(GetCostOfChange(nFeePerKB), CENT);
+}
+
+int64_t GetSelectionWaste(int64_t nValueSelected, int64_t nTargetValue)
+{
+    // - the wallet pays one fee rate, an input costs the same now as later,
+    //   only the excess is lost
+    return nValueSelected - nTargetValue;
+}
+
+bool SelectCoinsBnB(const std::vector<int64_t> &vValue, int64_t nTargetValue, int64_t nCostOfChange,
+    std::vector<char> &vfSelected, int64_t &nValueRet, int nMaxTries)
+{
+    vfSelected.clear();
+    nValueRet = 0;
+
+    int64_t nAvailable = 0;
+    for (size_t i = 0; i < vValue.size(); ++i)
+        nAvailable += vValue[i];
+    if (nAvailable < nTargetValue)
+        return false;
+
+    // - vCurrent holds the decision for each coin down to the current depth,
+    //   nAvailable the total of the coins below it
+    std::vector<char> vCurrent;
+    vCurrent.reserve(vValue.size());
+    int64_t nCurrent = 0;
+    size_t nCurrentInputs = 0;
+
+    std::vector<char> vBest;
+    int64_t nBestWaste = std::numeric_limits<int64_t>::max();
+    size_t nBestInputs = 0;
+
+    for (int nTries = 0; nTries < nMaxTries; ++nTries)
+    {
+        bool fBacktrack = false;
+        if (nCurrent + nAvailable < nTargetValue            // - can't reach the target anymore
+            || nCurrent > nTargetValue + nCostOfChange)     // - over the window, the coins below only add
+        {
+            fBacktrack = true;
+        } else
+        if (nCurrent >= nTargetValue)
+        {
+            int64_t nWaste = GetSelectionWaste(nCurrent, nTargetValue);
+            if (nWaste < nBestWaste
+                || (nWaste == nBestWaste && nCurrentInputs < nBestInputs))
+            {
+                vBest = vCurrent;
+                nBestWaste = nWaste;
+                nBestInputs = nCurrentInputs;
+            };
+            // - adding more coins only adds waste
+            fBacktrack = true;
+        };
+
+        if (fBacktrack)
+        {
+            // - up to the last coin included, and try without it
+            while (!vCurrent.empty() && !vCurrent.back())
+            {
+                vCurrent.pop_back();
+                nAvailable += vValue[vCurrent.size()];
+            };
+            if (vCurrent.empty())
+                break;
+
+            vCurrent.back() = false;
+            nCurrent -= vValue[vCurrent.size() - 1];
+            nCurrentInputs--;
+        } else
+        {
+            int64_t nValue = vValue[vCurrent.size()];
+            nAvailable -= nValue;
+
+            // - a coin of the value of the one before, which was left out,
+            //   would only repeat the branch of that one
+            if (!vCurrent.empty()
+                && !vCurrent.back()
+                && nValue == vValue[vCurrent.size() - 1])
+            {
+                vCurrent.push_back(false);
+            } else
+            {
+                vCurrent.push_back(true);
+                nCurrent += nValue;
+                nCurrentInputs++;
+            };
+        };
+    };
+
+    if (nBestWaste == std::numeric_limits<int64_t>::max())
+        return false;
+
+    vfSelected.assign(vValue.size(), false);
+    for (size_t i = 0; i < vBest.size(); ++i)
+    {
+        if (!vBest[i])
+            continue;
+        vfSelected[i] = true;
+        nValueRet += vValue[i];
+    };
+    return true;
+}
+
+void ApproximateBestSubset(const std::vector<int64_t> &vValue, int64_t nTotalLower, int64_t nTargetValue,
+    std::vector<char> &vfBest, int64_t &nBest, int iterations)
+{
+    std::vector<char> vfIncluded;
+
+    vfBest.assign(vValue.size(), true);
+    nBest = nTotalLower;
+
+    for (int nRep = 0; nRep < iterations && nBest != nTargetValue; nRep++)
+    {
+        vfIncluded.assign(vValue.size(), false);
+        int64_t nTotal = 0;
+        bool fReachedTarget = false;
+        for (int nPass = 0; nPass < 2 && !fReachedTarget; nPass++)
+        {
+            for (unsigned int i = 0; i < vValue.size(); i++)
+            {
+                if (nPass == 0 ? rand() % 2 : !vfIncluded[i])
+                {
+                    nTotal += vValue[i];
+                    vfIncluded[i] = true;
+                    if (nTotal >= nTargetValue)
+                    {
+                        fReachedTarget = true;
+                        if (nTotal < nBest)
+                        {
+                            nBest = nTotal;
+                            vfBest = vfIncluded;
+                        }
+                        nTotal -= vValue[i];
+                        vfIncluded[i] = false;
+                    }
+                }
+            }
+        }
+    }
+}
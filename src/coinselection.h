@@ -0,0 +1,50 @@
+// SPDX-FileCopyrightText: © 2020 Alias Developers
+//
+// SPDX-License-Identifier: MIT
+
+#ifndef SPEC_COINSELECTION_H
+#define SPEC_COINSELECTION_H
+
+#include <stdint.h>
+#include <vector>
+
+// Coin selection of SelectCoinsMinConf, on the values of the candidate coins.
+// The selection is returned as flags into the values.
+//
+// SelectCoinsBnB looks for a set of coins that pays the target without
+// change, the excess going to the fee has to be at most the cost of change.
+// When there is none the stochastic subset sum approximation (knapsack) of
+// ApproximateBestSubset is used, which leaves change.
+
+// - bytes of a pay to pubkey hash output and of the input spending it,
+//   a change output costs both: now to create it and later to spend it
+static const int64_t COIN_SELECTION_OUTPUT_BYTES = 34;
+static const int64_t COIN_SELECTION_INPUT_BYTES = 148;
+
+// - branches of the search tried before giving up
+static const int BNB_MAX_TRIES = 100000;
+
+// Cost of change at a fee of nFeePerKB.
+int64_t GetCostOfChange(int64_t nFeePerKB);
+
+// Change up to this value goes to the fee rather than to a change output:
+// the cost of change, but not more than a CENT at high fee rates.
+int64_t GetMaxChangeToFee(int64_t nFeePerKB);
+
+// Waste of a selection: the excess over the target, given up to the fee.
+// Among selections of equal waste the one of fewer inputs is preferred.
+int64_t GetSelectionWaste(int64_t nValueSelected, int64_t nTargetValue);
+
+// Depth first search over vValue, sorted by value descending, for the set
+// with a total in [nTargetValue, nTargetValue + nCostOfChange] and the least
+// waste. Returns false when there is none.
+bool SelectCoinsBnB(const std::vector<int64_t> &vValue, int64_t nTargetValue, int64_t nCostOfChange,
+    std::vector<char> &vfSelected, int64_t &nValueRet, int nMaxTries = BNB_MAX_TRIES);
+
+// Random subsets of vValue, sorted by value descending, for the one with the
+// smallest total of at least nTargetValue. vfBest is all of vValue when none
+// is better.
+void ApproximateBestSubset(const std::vector<int64_t> &vValue, int64_t nTotalLower, int64_t nTargetValue,
+    std::vector<char> &vfBest, int64_t &nBest, int iterations = 1000);
+
+#endif // SPEC_COINSELECTION_H
@@ -351,6 +351,7 @@ public:
     {
         nValue = 0;
         nExists = 0;
+        nUnconfirmed = 0;
         nSpends = 0;
         nOwned = 0;
         nLastHeight = 0;
@@ -444,6 +445,21 @@ public:
         return nMature - nSpends;
     }
 
+    IMPLEMENT_SERIALIZE
+    (
+        READWRITE(nValue);
+        READWRITE(nExists);
+        READWRITE(nUnconfirmed);
+        READWRITE(nSpends);
+        READWRITE(nOwned);
+        READWRITE(nLastHeight);
+        READWRITE(nCompromised);
+        READWRITE(nCompromisedHeight);
+        READWRITE(nMature);
+        READWRITE(nMixins);
+        READWRITE(nMixinsStaking);
+        READWRITE(nStakes);
+    )
 
     int64_t nValue;
     int nExists;
@@ -475,6 +491,24 @@ public:
     int64_t nTime;
 };
 
+class CStakeCandidate
+{
+// for CheckKernel, what the kernel hash needs of a staked output, its
+// transaction and block, read once instead of for every time tried
+public:
+    CStakeCandidate()
+        : nValue(0), nTimeTxPrev(0), nTxPrevOffset(0), nTimeBlockFrom(0), nHeightBlockFrom(0)
+    {};
+
+    COutPoint prevout;
+    int64_t nValue;
+    unsigned int nTimeTxPrev;
+    unsigned int nTxPrevOffset;
+    uint256 hashBlockFrom;
+    unsigned int nTimeBlockFrom;
+    int nHeightBlockFrom;
+};
+
 
 struct CTxMixins
 {
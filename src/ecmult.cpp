@@ -0,0 +1,1071 @@
+// SPDX-FileCopyrightText: © 2020 Alias Developers
+//
+// SPDX-License-Identifier: MIT
+
+#include "ecmult.h"
+
+#ifdef USE_NATIVE_SECP256K1
+
+#include <assert.h>
+#include <string.h>
+
+typedef unsigned __int128 uint128_t;
+
+// p = 2^256 - 2^32 - 977
+static const uint64_t FIELD_P[4]     = { 0xFFFFFFFEFFFFFC2FULL, 0xFFFFFFFFFFFFFFFFULL, 0xFFFFFFFFFFFFFFFFULL, 0xFFFFFFFFFFFFFFFFULL };
+static const uint64_t FIELD_C        = 0x1000003D1ULL; // 2^256 - p
+static const uint64_t FIELD_P_MINUS2[4] = { 0xFFFFFFFEFFFFFC2DULL, 0xFFFFFFFFFFFFFFFFULL, 0xFFFFFFFFFFFFFFFFULL, 0xFFFFFFFFFFFFFFFFULL };
+static const uint64_t FIELD_SQRT_EXP[4] = { 0xFFFFFFFFBFFFFF0CULL, 0xFFFFFFFFFFFFFFFFULL, 0xFFFFFFFFFFFFFFFFULL, 0x3FFFFFFFFFFFFFFFULL }; // (p+1)/4
+
+// group order
+static const uint64_t SCALAR_N[4]  = { 0xBFD25E8CD0364141ULL, 0xBAAEDCE6AF48A03BULL, 0xFFFFFFFFFFFFFFFEULL, 0xFFFFFFFFFFFFFFFFULL };
+static const uint64_t SCALAR_NC[3] = { 0x402DA1732FC9BEBFULL, 0x4551231950B75FC4ULL, 0x0000000000000001ULL }; // 2^256 - n
+
+static const uint8_t GENERATOR_X[32] = {
+    0x79, 0xBE, 0x66, 0x7E, 0xF9, 0xDC, 0xBB, 0xAC, 0x55, 0xA0, 0x62, 0x95, 0xCE, 0x87, 0x0B, 0x07,
+    0x02, 0x9B, 0xFC, 0xDB, 0x2D, 0xCE, 0x28, 0xD9, 0x59, 0xF2, 0x81, 0x5B, 0x16, 0xF8, 0x17, 0x98 };
+static const uint8_t GENERATOR_Y[32] = {
+    0x48, 0x3A, 0xDA, 0x77, 0x26, 0xA3, 0xC4, 0x65, 0x5D, 0xA4, 0xFB, 0xFC, 0x0E, 0x11, 0x08, 0xA8,
+    0xFD, 0x17, 0xB4, 0x48, 0xA6, 0x85, 0x54, 0x19, 0x9C, 0x47, 0xD0, 0x8F, 0xFB, 0x10, 0xD4, 0xB8 };
+
+static const int WINDOW_A = 5;                      // wNAF window for variable points
+static const int WINDOW_G = 8;                      // wNAF window for G in ECMult
+static const int TABLE_SIZE_A = 1 << (WINDOW_A - 2);
+static const int TABLE_SIZE_G = 1 << (WINDOW_G - 2);
+static const int WNAF_MAX = 258;
+
+
+/*
+ * Field
+ */
+
+static inline void LoadB32(uint64_t *r, const uint8_t *p)
+{
+    for (int i = 0; i < 4; ++i)
+    {
+        const uint8_t *q = p + (3 - i) * 8;
+        r[i] = ((uint64_t)q[0] << 56) | ((uint64_t)q[1] << 48) | ((uint64_t)q[2] << 40) | ((uint64_t)q[3] << 32)
+             | ((uint64_t)q[4] << 24) | ((uint64_t)q[5] << 16) | ((uint64_t)q[6] << 8)  | ((uint64_t)q[7]);
+    };
+}
+
+static inline void StoreB32(uint8_t *p, const uint64_t *a)
+{
+    for (int i = 0; i < 4; ++i)
+    {
+        uint8_t *q = p + (3 - i) * 8;
+        for (int k = 0; k < 8; ++k)
+            q[k] = (uint8_t)(a[i] >> (56 - 8 * k));
+    };
+}
+
+// returns true if a >= m, the borrow of a - m, no early exit
+static inline bool GreaterEqual(const uint64_t *a, const uint64_t *m)
+{
+    uint64_t borrow = 0;
+    for (int i = 0; i < 4; ++i)
+    {
+        uint128_t t = (uint128_t)a[i] - m[i] - borrow;
+        borrow = (uint64_t)(t >> 64) & 1;
+    };
+    return !borrow;
+}
+
+// r += v, returns carry
+static inline uint64_t AddSmall(uint64_t *r, uint64_t v)
+{
+    uint128_t t = (uint128_t)r[0] + v;
+    r[0] = (uint64_t)t;
+    for (int i = 1; i < 4; ++i)
+    {
+        t = (t >> 64) + r[i];
+        r[i] = (uint64_t)t;
+    };
+    return (uint64_t)(t >> 64);
+}
+
+static inline void FieldNormalize(uint64_t *r, uint64_t carry)
+{
+    // - branch free, the field arithmetic runs on secret values in ECMultGen
+    //   and ECMultConst
+
+    // value is r + carry * 2^256 == r + carry * C, carry < 2^35
+    uint128_t d = (uint128_t)carry * FIELD_C;
+    uint128_t t = (uint128_t)r[0] + (uint64_t)d;
+    r[0] = (uint64_t)t;
+    t = (t >> 64) + r[1] + (uint64_t)(d >> 64);
+    r[1] = (uint64_t)t;
+    t = (t >> 64) + r[2];
+    r[2] = (uint64_t)t;
+    t = (t >> 64) + r[3];
+    r[3] = (uint64_t)t;
+    // wrapped, r is tiny now
+    AddSmall(r, FIELD_C & -(uint64_t)(t >> 64));
+
+    // r >= p when r + C carries, r - p == r + C mod 2^256
+    uint64_t s[4] = { r[0], r[1], r[2], r[3] };
+    uint64_t mask = -AddSmall(s, FIELD_C);
+    for (int i = 0; i < 4; ++i)
+        r[i] = (r[i] & ~mask) | (s[i] & mask);
+}
+
+static inline bool FieldIsZero(const ec_fe &a)
+{
+    return (a.n[0] | a.n[1] | a.n[2] | a.n[3]) == 0;
+}
+
+static inline bool FieldEqual(const ec_fe &a, const ec_fe &b)
+{
+    return ((a.n[0] ^ b.n[0]) | (a.n[1] ^ b.n[1]) | (a.n[2] ^ b.n[2]) | (a.n[3] ^ b.n[3])) == 0;
+}
+
+static inline bool FieldIsOdd(const ec_fe &a)
+{
+    return a.n[0] & 1;
+}
+
+static inline void FieldSetInt(ec_fe &r, uint64_t v)
+{
+    r.n[0] = v; r.n[1] = r.n[2] = r.n[3] = 0;
+}
+
+static inline void FieldAdd(ec_fe &r, const ec_fe &a, const ec_fe &b)
+{
+    uint128_t t = 0;
+    for (int i = 0; i < 4; ++i)
+    {
+        t += (uint128_t)a.n[i] + b.n[i];
+        r.n[i] = (uint64_t)t;
+        t >>= 64;
+    };
+    FieldNormalize(r.n, (uint64_t)t);
+}
+
+static inline void FieldSub(ec_fe &r, const ec_fe &a, const ec_fe &b)
+{
+    uint64_t borrow = 0;
+    for (int i = 0; i < 4; ++i)
+    {
+        uint128_t t = (uint128_t)a.n[i] - b.n[i] - borrow;
+        r.n[i] = (uint64_t)t;
+        borrow = (uint64_t)(t >> 64) & 1;
+    };
+    // r + p == r - C mod 2^256 on a borrow, r > C then
+    uint128_t t = (uint128_t)r.n[0] - (FIELD_C & -borrow);
+    r.n[0] = (uint64_t)t;
+    borrow = (uint64_t)(t >> 64) & 1;
+    for (int i = 1; i < 4; ++i)
+    {
+        t = (uint128_t)r.n[i] - borrow;
+        r.n[i] = (uint64_t)t;
+        borrow = (uint64_t)(t >> 64) & 1;
+    };
+}
+
+static inline void FieldNegate(ec_fe &r, const ec_fe &a)
+{
+    ec_fe zero;
+    FieldSetInt(zero, 0);
+    FieldSub(r, zero, a);
+}
+
+static inline void FieldMul(ec_fe &r, const ec_fe &a, const ec_fe &b)
+{
+    uint64_t t[8] = {0};
+    for (int i = 0; i < 4; ++i)
+    {
+        uint64_t carry = 0;
+        for (int j = 0; j < 4; ++j)
+        {
+            uint128_t m = (uint128_t)a.n[i] * b.n[j] + t[i + j] + carry;
+            t[i + j] = (uint64_t)m;
+            carry = (uint64_t)(m >> 64);
+        };
+        t[i + 4] = carry;
+    };
+
+    // t_lo + t_hi * 2^256 == t_lo + t_hi * C mod p
+    uint128_t c = 0;
+    for (int i = 0; i < 4; ++i)
+    {
+        c += (uint128_t)t[i + 4] * FIELD_C + t[i];
+        r.n[i] = (uint64_t)c;
+        c >>= 64;
+    };
+    FieldNormalize(r.n, (uint64_t)c);
+}
+
+static inline void FieldSqr(ec_fe &r, const ec_fe &a)
+{
+    FieldMul(r, a, a);
+}
+
+static void FieldPow(ec_fe &r, const ec_fe &a, const uint64_t *e)
+{
+    // fixed 4 bit window
+    ec_fe table[16];
+    FieldSetInt(table[0], 1);
+    table[1] = a;
+    for (int i = 2; i < 16; ++i)
+        FieldMul(table[i], table[i - 1], a);
+
+    ec_fe t;
+    FieldSetInt(t, 1);
+    for (int i = 63; i >= 0; --i)
+    {
+        for (int k = 0; k < 4; ++k)
+            FieldSqr(t, t);
+        int nibble = (e[i / 16] >> ((i % 16) * 4)) & 0xF;
+        if (nibble)
+            FieldMul(t, t, table[nibble]);
+    };
+    r = t;
+}
+
+static inline void FieldInv(ec_fe &r, const ec_fe &a)
+{
+    FieldPow(r, a, FIELD_P_MINUS2);
+}
+
+// returns false if a is not a quadratic residue
+static bool FieldSqrt(ec_fe &r, const ec_fe &a)
+{
+    ec_fe t, check;
+    FieldPow(t, a, FIELD_SQRT_EXP);
+    FieldSqr(check, t);
+    if (!FieldEqual(check, a))
+        return false;
+    r = t;
+    return true;
+}
+
+static inline void FieldCMov(ec_fe &r, const ec_fe &a, uint64_t mask)
+{
+    for (int i = 0; i < 4; ++i)
+        r.n[i] = (r.n[i] & ~mask) | (a.n[i] & mask);
+}
+
+void ECFieldSetB32(ec_fe &r, const uint8_t *p)
+{
+    LoadB32(r.n, p);
+    FieldNormalize(r.n, 0);
+}
+
+bool ECFieldSetB32Check(ec_fe &r, const uint8_t *p)
+{
+    LoadB32(r.n, p);
+    return !GreaterEqual(r.n, FIELD_P);
+}
+
+void ECFieldGetB32(uint8_t *p, const ec_fe &a)
+{
+    StoreB32(p, a.n);
+}
+
+void ECFieldAddInt(ec_fe &r, uint32_t v)
+{
+    ec_fe t;
+    FieldSetInt(t, v);
+    FieldAdd(r, r, t);
+}
+
+
+/*
+ * Scalar
+ */
+
+static inline void ScalarReduceOnce(uint64_t *r, uint64_t carry)
+{
+    // value is r + carry * 2^256 < 2n, branch free as the scalars of signing
+    // are secret: r >= n when r + nc carries, r - n == r + nc mod 2^256
+    uint64_t s[4];
+    uint128_t t = 0;
+    for (int i = 0; i < 4; ++i)
+    {
+        t += (uint128_t)r[i] + (i < 3 ? SCALAR_NC[i] : 0);
+        s[i] = (uint64_t)t;
+        t >>= 64;
+    };
+    uint64_t mask = -(uint64_t)((carry | (uint64_t)t) != 0);
+    for (int i = 0; i < 4; ++i)
+        r[i] = (r[i] & ~mask) | (s[i] & mask);
+}
+
+// reduce a 512 bit number mod n by repeatedly folding the high half with 2^256 == nc mod n
+static void ScalarReduce512(ec_scalar &r, const uint64_t *t)
+{
+    uint64_t m[8];
+    memcpy(m, t, sizeof(m));
+
+    // - a fixed number of rounds, folding a zero high half changes nothing
+    for (int round = 0; round < 4; ++round)
+    {
+        uint64_t acc[8] = { m[0], m[1], m[2], m[3], 0, 0, 0, 0 };
+        for (int i = 0; i < 4; ++i)
+        {
+            uint64_t h = m[4 + i];
+            uint64_t carry = 0;
+            for (int j = 0; j < 3; ++j)
+            {
+                uint128_t x = (uint128_t)h * SCALAR_NC[j] + acc[i + j] + carry;
+                acc[i + j] = (uint64_t)x;
+                carry = (uint64_t)(x >> 64);
+            };
+            for (int k = i + 3; k < 8; ++k)
+            {
+                uint128_t x = (uint128_t)acc[k] + carry;
+                acc[k] = (uint64_t)x;
+                carry = (uint64_t)(x >> 64);
+            };
+        };
+        memcpy(m, acc, sizeof(m));
+    };
+    assert((m[4] | m[5] | m[6] | m[7]) == 0);
+
+    ScalarReduceOnce(m, 0);
+    memcpy(r.d, m, sizeof(r.d));
+}
+
+void ECScalarSetB32(ec_scalar &r, const uint8_t *p, bool *pfOverflow)
+{
+    LoadB32(r.d, p);
+    bool fOverflow = GreaterEqual(r.d, SCALAR_N);
+    ScalarReduceOnce(r.d, 0);
+    if (pfOverflow)
+        *pfOverflow = fOverflow;
+}
+
+void ECScalarGetB32(uint8_t *p, const ec_scalar &a)
+{
+    StoreB32(p, a.d);
+}
+
+void ECScalarSetInt(ec_scalar &r, uint32_t v)
+{
+    r.d[0] = v; r.d[1] = r.d[2] = r.d[3] = 0;
+}
+
+void ECScalarAdd(ec_scalar &r, const ec_scalar &a, const ec_scalar &b)
+{
+    uint128_t t = 0;
+    for (int i = 0; i < 4; ++i)
+    {
+        t += (uint128_t)a.d[i] + b.d[i];
+        r.d[i] = (uint64_t)t;
+        t >>= 64;
+    };
+    ScalarReduceOnce(r.d, (uint64_t)t);
+}
+
+void ECScalarNegate(ec_scalar &r, const ec_scalar &a)
+{
+    // n - a, or 0 for a == 0
+    uint64_t mask = -(uint64_t)!ECScalarIsZero(a);
+    uint64_t borrow = 0;
+    for (int i = 0; i < 4; ++i)
+    {
+        uint128_t t = (uint128_t)SCALAR_N[i] - a.d[i] - borrow;
+        r.d[i] = (uint64_t)t & mask;
+        borrow = (uint64_t)(t >> 64) & 1;
+    };
+}
+
+void ECScalarSub(ec_scalar &r, const ec_scalar &a, const ec_scalar &b)
+{
+    ec_scalar nb;
+    ECScalarNegate(nb, b);
+    ECScalarAdd(r, a, nb);
+}
+
+void ECScalarMul(ec_scalar &r, const ec_scalar &a, const ec_scalar &b)
+{
+    uint64_t t[8] = {0};
+    for (int i = 0; i < 4; ++i)
+    {
+        uint64_t carry = 0;
+        for (int j = 0; j < 4; ++j)
+        {
+            uint128_t m = (uint128_t)a.d[i] * b.d[j] + t[i + j] + carry;
+            t[i + j] = (uint64_t)m;
+            carry = (uint64_t)(m >> 64);
+        };
+        t[i + 4] = carry;
+    };
+    ScalarReduce512(r, t);
+}
+
+bool ECScalarIsZero(const ec_scalar &a)
+{
+    return (a.d[0] | a.d[1] | a.d[2] | a.d[3]) == 0;
+}
+
+bool ECScalarEqual(const ec_scalar &a, const ec_scalar &b)
+{
+    return ((a.d[0] ^ b.d[0]) | (a.d[1] ^ b.d[1]) | (a.d[2] ^ b.d[2]) | (a.d[3] ^ b.d[3])) == 0;
+}
+
+static inline int ScalarGetBits(const ec_scalar &a, int offset, int count)
+{
+    // count <= 8, bits may straddle a limb boundary
+    int limb = offset / 64, shift = offset % 64;
+    uint64_t v = a.d[limb] >> shift;
+    if (shift + count > 64 && limb < 3)
+        v |= a.d[limb + 1] << (64 - shift);
+    return (int)(v & ((1u << count) - 1));
+}
+
+// width-w non adjacent form, returns the number of digits
+static int ScalarWNAF(int *wnaf, const ec_scalar &a, int w)
+{
+    // k is kept as 5 limbs as subtracting negative digits can carry past bit 256
+    uint64_t k[5] = { a.d[0], a.d[1], a.d[2], a.d[3], 0 };
+    const int64_t nMod = (int64_t)1 << w, nHalf = nMod >> 1;
+    int len = 0;
+
+    while (k[0] | k[1] | k[2] | k[3] | k[4])
+    {
+        int64_t digit = 0;
+        if (k[0] & 1)
+        {
+            digit = (int64_t)(k[0] & (nMod - 1));
+            if (digit >= nHalf)
+                digit -= nMod;
+
+            if (digit > 0)
+            {
+                uint64_t borrow = (uint64_t)digit;
+                for (int i = 0; i < 5 && borrow; ++i)
+                {
+                    uint64_t prev = k[i];
+                    k[i] -= borrow;
+                    borrow = prev < borrow ? 1 : 0;
+                };
+            } else
+            {
+                uint64_t carry = (uint64_t)(-digit);
+                for (int i = 0; i < 5 && carry; ++i)
+                {
+                    k[i] += carry;
+                    carry = k[i] < carry ? 1 : 0;
+                };
+            };
+        };
+        assert(len < WNAF_MAX);
+        wnaf[len++] = (int)digit;
+
+        for (int i = 0; i < 4; ++i)
+            k[i] = (k[i] >> 1) | (k[i + 1] << 63);
+        k[4] >>= 1;
+    };
+    return len;
+}
+
+
+/*
+ * Group
+ */
+
+static const ec_fe &CurveB()
+{
+    static const ec_fe b = {{ 7, 0, 0, 0 }};
+    return b;
+}
+
+bool ECPointSetXO(ec_ge &r, const ec_fe &x, bool fOdd)
+{
+    // y^2 = x^3 + 7
+    ec_fe x2, x3, y2, y;
+    FieldSqr(x2, x);
+    FieldMul(x3, x2, x);
+    FieldAdd(y2, x3, CurveB());
+    if (!FieldSqrt(y, y2))
+        return false;
+    if (FieldIsOdd(y) != fOdd)
+        FieldNegate(y, y);
+    r.x = x;
+    r.y = y;
+    r.infinity = false;
+    return true;
+}
+
+bool ECPointParse(ec_ge &r, const uint8_t *p, size_t len)
+{
+    if (len != 33 || (p[0] != 0x02 && p[0] != 0x03))
+        return false;
+
+    ec_fe x;
+    if (!ECFieldSetB32Check(x, p + 1))
+        return false;
+
+    return ECPointSetXO(r, x, p[0] == 0x03);
+}
+
+bool ECPointSerialize(uint8_t *p, const ec_ge &a)
+{
+    if (a.infinity)
+        return false;
+    p[0] = FieldIsOdd(a.y) ? 0x03 : 0x02;
+    ECFieldGetB32(p + 1, a.x);
+    return true;
+}
+
+bool ECPointSerialize(uint8_t *p, const ec_gej &a)
+{
+    ec_ge t;
+    ECPointSetGej(t, a);
+    return ECPointSerialize(p, t);
+}
+
+void ECPointSetGej(ec_ge &r, const ec_gej &a)
+{
+    if (a.infinity)
+    {
+        r.infinity = true;
+        return;
+    };
+    ec_fe zi, zi2, zi3;
+    FieldInv(zi, a.z);
+    FieldSqr(zi2, zi);
+    FieldMul(zi3, zi2, zi);
+    FieldMul(r.x, a.x, zi2);
+    FieldMul(r.y, a.y, zi3);
+    r.infinity = false;
+}
+
+void ECPointSetGejBatch(ec_ge *r, const ec_gej *a, size_t n)
+{
+    // Montgomery's trick, one inversion for all points
+    std::vector<ec_fe> acc(n);
+    ec_fe prod;
+    FieldSetInt(prod, 1);
+    for (size_t i = 0; i < n; ++i)
+    {
+        acc[i] = prod;
+        if (!a[i].infinity)
+            FieldMul(prod, prod, a[i].z);
+    };
+
+    ec_fe inv;
+    FieldInv(inv, prod);
+
+    for (size_t i = n; i-- > 0; )
+    {
+        if (a[i].infinity)
+        {
+            r[i].infinity = true;
+            continue;
+        };
+        ec_fe zi, zi2, zi3;
+        FieldMul(zi, inv, acc[i]);
+        FieldMul(inv, inv, a[i].z);
+        FieldSqr(zi2, zi);
+        FieldMul(zi3, zi2, zi);
+        FieldMul(r[i].x, a[i].x, zi2);
+        FieldMul(r[i].y, a[i].y, zi3);
+        r[i].infinity = false;
+    };
+}
+
+void ECPointGejSetGe(ec_gej &r, const ec_ge &a)
+{
+    r.infinity = a.infinity;
+    r.x = a.x;
+    r.y = a.y;
+    FieldSetInt(r.z, 1);
+}
+
+static inline void PointGeNegate(ec_ge &r, const ec_ge &a)
+{
+    r = a;
+    if (!a.infinity)
+        FieldNegate(r.y, a.y);
+}
+
+void ECPointGejNegate(ec_gej &r, const ec_gej &a)
+{
+    r = a;
+    if (!a.infinity)
+        FieldNegate(r.y, a.y);
+}
+
+void ECPointGejDouble(ec_gej &r, const ec_gej &a)
+{
+    // dbl-2009-l, a = 0
+    if (a.infinity || FieldIsZero(a.y))
+    {
+        r.infinity = true;
+        return;
+    };
+
+    ec_fe A, B, C, D, E, F, t;
+    FieldSqr(A, a.x);
+    FieldSqr(B, a.y);
+    FieldSqr(C, B);
+
+    FieldAdd(t, a.x, B);
+    FieldSqr(t, t);
+    FieldSub(t, t, A);
+    FieldSub(t, t, C);
+    FieldAdd(D, t, t);
+
+    FieldAdd(E, A, A);
+    FieldAdd(E, E, A);
+    FieldSqr(F, E);
+
+    ec_fe z3;
+    FieldMul(z3, a.y, a.z);
+    FieldAdd(r.z, z3, z3);
+
+    FieldSub(r.x, F, D);
+    FieldSub(r.x, r.x, D);
+
+    ec_fe c8;
+    FieldAdd(c8, C, C);
+    FieldAdd(c8, c8, c8);
+    FieldAdd(c8, c8, c8);
+
+    FieldSub(t, D, r.x);
+    FieldMul(t, E, t);
+    FieldSub(r.y, t, c8);
+    r.infinity = false;
+}
+
+void ECPointGejAddGe(ec_gej &r, const ec_gej &a, const ec_ge &b)
+{
+    // madd-2007-bl
+    if (a.infinity)
+    {
+        ECPointGejSetGe(r, b);
+        return;
+    };
+    if (b.infinity)
+    {
+        r = a;
+        return;
+    };
+
+    ec_fe z1z1, u2, s2, h, rr;
+    FieldSqr(z1z1, a.z);
+    FieldMul(u2, b.x, z1z1);
+    FieldMul(s2, b.y, a.z);
+    FieldMul(s2, s2, z1z1);
+    FieldSub(h, u2, a.x);
+    FieldSub(rr, s2, a.y);
+
+    if (FieldIsZero(h))
+    {
+        if (FieldIsZero(rr))
+            ECPointGejDouble(r, a);
+        else
+            r.infinity = true;
+        return;
+    };
+
+    ec_fe hh, hhh, v, t;
+    FieldSqr(hh, h);
+    FieldMul(hhh, h, hh);
+    FieldMul(v, a.x, hh);
+
+    ec_fe x3, y3;
+    FieldSqr(x3, rr);
+    FieldSub(x3, x3, hhh);
+    FieldSub(x3, x3, v);
+    FieldSub(x3, x3, v);
+
+    FieldSub(t, v, x3);
+    FieldMul(y3, rr, t);
+    FieldMul(t, a.y, hhh);
+    FieldSub(y3, y3, t);
+
+    FieldMul(r.z, a.z, h);
+    r.x = x3;
+    r.y = y3;
+    r.infinity = false;
+}
+
+void ECPointGejAdd(ec_gej &r, const ec_gej &a, const ec_gej &b)
+{
+    // add-2007-bl without the 2*Z trick
+    if (a.infinity)
+    {
+        r = b;
+        return;
+    };
+    if (b.infinity)
+    {
+        r = a;
+        return;
+    };
+
+    ec_fe z1z1, z2z2, u1, u2, s1, s2, h, rr;
+    FieldSqr(z1z1, a.z);
+    FieldSqr(z2z2, b.z);
+    FieldMul(u1, a.x, z2z2);
+    FieldMul(u2, b.x, z1z1);
+    FieldMul(s1, a.y, b.z);
+    FieldMul(s1, s1, z2z2);
+    FieldMul(s2, b.y, a.z);
+    FieldMul(s2, s2, z1z1);
+    FieldSub(h, u2, u1);
+    FieldSub(rr, s2, s1);
+
+    if (FieldIsZero(h))
+    {
+        if (FieldIsZero(rr))
+            ECPointGejDouble(r, a);
+        else
+            r.infinity = true;
+        return;
+    };
+
+    ec_fe hh, hhh, v, t;
+    FieldSqr(hh, h);
+    FieldMul(hhh, h, hh);
+    FieldMul(v, u1, hh);
+
+    ec_fe x3, y3, z3;
+    FieldSqr(x3, rr);
+    FieldSub(x3, x3, hhh);
+    FieldSub(x3, x3, v);
+    FieldSub(x3, x3, v);
+
+    FieldSub(t, v, x3);
+    FieldMul(y3, rr, t);
+    FieldMul(t, s1, hhh);
+    FieldSub(y3, y3, t);
+
+    FieldMul(z3, a.z, b.z);
+    FieldMul(z3, z3, h);
+
+    r.x = x3;
+    r.y = y3;
+    r.z = z3;
+    r.infinity = false;
+}
+
+
+/*
+ * Multiplication
+ */
+
+class CECMultContext
+{
+public:
+    ec_ge G;
+    ec_ge comb[64][15];             // comb[i][j] = (j+1) * 16^i * G
+    ec_ge oddG[TABLE_SIZE_G];       // (2i+1) * G
+
+    CECMultContext()
+    {
+        bool fOk = ECFieldSetB32Check(G.x, GENERATOR_X) && ECFieldSetB32Check(G.y, GENERATOR_Y);
+        assert(fOk);
+        (void)fOk;
+        G.infinity = false;
+
+        std::vector<ec_gej> vPoints(64 * 15);
+        ec_gej base;
+        ECPointGejSetGe(base, G);
+        for (int i = 0; i < 64; ++i)
+        {
+            ec_gej *row = &vPoints[i * 15];
+            row[0] = base;
+            for (int j = 1; j < 15; ++j)
+                ECPointGejAdd(row[j], row[j - 1], base);
+            for (int k = 0; k < 4; ++k)
+                ECPointGejDouble(base, base);
+        };
+        ECPointSetGejBatch(&comb[0][0], &vPoints[0], vPoints.size());
+
+        std::vector<ec_gej> vOdd(TABLE_SIZE_G);
+        ec_gej g2;
+        ECPointGejSetGe(vOdd[0], G);
+        ECPointGejDouble(g2, vOdd[0]);
+        for (int i = 1; i < TABLE_SIZE_G; ++i)
+            ECPointGejAdd(vOdd[i], vOdd[i - 1], g2);
+        ECPointSetGejBatch(oddG, &vOdd[0], vOdd.size());
+    };
+};
+
+static const CECMultContext &GetContext()
+{
+    static const CECMultContext *ctx = new CECMultContext(); // never freed, used until exit
+    return *ctx;
+}
+
+void ECMultInit()
+{
+    GetContext();
+}
+
+/*
+ * Constant time multiplication
+ *
+ * ECMultGen and ECMultConst take secret scalars. They run on homogeneous
+ * projective points (x = X/Z, y = Y/Z) with the complete formulas of
+ * Renes, Costello and Batina (2016), algorithms 7 and 9 for a = 0: no
+ * branches on infinity or on doubling. Every table entry is scanned and
+ * every window adds, a zero window moves the previous value back.
+ */
+
+// projective point, infinity is (0 : 1 : 0)
+typedef struct ec_gep { ec_fe x, y, z; } ec_gep;
+
+static const ec_fe &CurveB3()
+{
+    static const ec_fe b3 = {{ 21, 0, 0, 0 }};
+    return b3;
+}
+
+static inline void PointGepSetInfinity(ec_gep &r)
+{
+    FieldSetInt(r.x, 0);
+    FieldSetInt(r.y, 1);
+    FieldSetInt(r.z, 0);
+}
+
+static inline void PointGepSetGe(ec_gep &r, const ec_ge &a)
+{
+    // a is never infinity here, the table entries are multiples of a point of prime order
+    r.x = a.x;
+    r.y = a.y;
+    FieldSetInt(r.z, 1);
+}
+
+static inline void PointGepCMov(ec_gep &r, const ec_gep &a, uint64_t mask)
+{
+    FieldCMov(r.x, a.x, mask);
+    FieldCMov(r.y, a.y, mask);
+    FieldCMov(r.z, a.z, mask);
+}
+
+static void PointGepAdd(ec_gep &r, const ec_gep &a, const ec_gep &b)
+{
+    // algorithm 7, complete addition, r may alias a or b
+    ec_fe t0, t1, t2, t3, t4, x3, y3, z3;
+    FieldMul(t0, a.x, b.x);
+    FieldMul(t1, a.y, b.y);
+    FieldMul(t2, a.z, b.z);
+    FieldAdd(t3, a.x, a.y);
+    FieldAdd(t4, b.x, b.y);
+    FieldMul(t3, t3, t4);
+    FieldAdd(t4, t0, t1);
+    FieldSub(t3, t3, t4);
+    FieldAdd(t4, a.y, a.z);
+    FieldAdd(x3, b.y, b.z);
+    FieldMul(t4, t4, x3);
+    FieldAdd(x3, t1, t2);
+    FieldSub(t4, t4, x3);
+    FieldAdd(x3, a.x, a.z);
+    FieldAdd(y3, b.x, b.z);
+    FieldMul(x3, x3, y3);
+    FieldAdd(y3, t0, t2);
+    FieldSub(y3, x3, y3);
+    FieldAdd(x3, t0, t0);
+    FieldAdd(t0, x3, t0);
+    FieldMul(t2, CurveB3(), t2);
+    FieldAdd(z3, t1, t2);
+    FieldSub(t1, t1, t2);
+    FieldMul(y3, CurveB3(), y3);
+    FieldMul(x3, t4, y3);
+    FieldMul(t2, t3, t1);
+    FieldSub(x3, t2, x3);
+    FieldMul(y3, y3, t0);
+    FieldMul(t1, t1, z3);
+    FieldAdd(y3, t1, y3);
+    FieldMul(t0, t0, t3);
+    FieldMul(z3, z3, t4);
+    FieldAdd(z3, z3, t0);
+    r.x = x3;
+    r.y = y3;
+    r.z = z3;
+}
+
+static void PointGepDouble(ec_gep &r, const ec_gep &a)
+{
+    // algorithm 9, complete doubling, r may alias a
+    ec_fe t0, t1, t2, x3, y3, z3;
+    FieldSqr(t0, a.y);
+    FieldAdd(z3, t0, t0);
+    FieldAdd(z3, z3, z3);
+    FieldAdd(z3, z3, z3);
+    FieldMul(t1, a.y, a.z);
+    FieldSqr(t2, a.z);
+    FieldMul(t2, CurveB3(), t2);
+    FieldMul(x3, t2, z3);
+    FieldAdd(y3, t0, t2);
+    FieldMul(z3, t1, z3);
+    FieldAdd(t1, t2, t2);
+    FieldAdd(t2, t1, t2);
+    FieldSub(t0, t0, t2);
+    FieldMul(y3, t0, y3);
+    FieldAdd(y3, x3, y3);
+    FieldMul(t1, a.x, a.y);
+    FieldMul(x3, t0, t1);
+    FieldAdd(x3, x3, x3);
+    r.x = x3;
+    r.y = y3;
+    r.z = z3;
+}
+
+static void PointGejSetGep(ec_gej &r, const ec_gep &a)
+{
+    // (X : Y : Z) is (X*Z, Y*Z^2, Z) in jacobian coordinates, no inversion
+    ec_fe zz;
+    FieldSqr(zz, a.z);
+    FieldMul(r.x, a.x, a.z);
+    FieldMul(r.y, a.y, zz);
+    r.z = a.z;
+    r.infinity = FieldIsZero(a.z);
+}
+
+// t = table[nibble - 1], or table[0] for nibble 0, scanning all 15 entries
+// so the memory access pattern doesn't depend on the nibble
+static inline void PointGepLookup(ec_gep &t, const ec_ge *table, int nibble)
+{
+    ec_ge v = table[0];
+    for (int j = 1; j < 15; ++j)
+    {
+        uint64_t mask = -(uint64_t)(nibble == j + 1);
+        FieldCMov(v.x, table[j].x, mask);
+        FieldCMov(v.y, table[j].y, mask);
+    };
+    PointGepSetGe(t, v);
+}
+
+void ECMultGen(ec_gej &r, const ec_scalar &k)
+{
+    const CECMultContext &ctx = GetContext();
+
+    ec_gep acc, sum, t;
+    PointGepSetInfinity(acc);
+    for (int i = 0; i < 64; ++i)
+    {
+        int nibble = ScalarGetBits(k, i * 4, 4);
+        PointGepLookup(t, ctx.comb[i], nibble);
+
+        PointGepAdd(sum, acc, t);
+        PointGepCMov(acc, sum, -(uint64_t)(nibble != 0));
+    };
+    PointGejSetGep(r, acc);
+}
+
+void ECMultConst(ec_gej &r, const ec_ge &a, const ec_scalar &k)
+{
+    if (a.infinity)
+    {
+        r.infinity = true;
+        return;
+    };
+
+    // table[i] = (i+1) * A, A is public, the variable time formulas are fine here
+    ec_gej tj[15];
+    ec_ge table[15];
+    ECPointGejSetGe(tj[0], a);
+    ECPointGejDouble(tj[1], tj[0]);
+    for (int i = 2; i < 15; ++i)
+        ECPointGejAddGe(tj[i], tj[i - 1], a);
+    ECPointSetGejBatch(table, tj, 15);
+
+    ec_gep acc, sum, t;
+    PointGepSetInfinity(acc);
+    for (int i = 63; i >= 0; --i)
+    {
+        for (int d = 0; d < 4; ++d)
+            PointGepDouble(acc, acc);
+
+        int nibble = ScalarGetBits(k, i * 4, 4);
+        PointGepLookup(t, table, nibble);
+
+        PointGepAdd(sum, acc, t);
+        PointGepCMov(acc, sum, -(uint64_t)(nibble != 0));
+    };
+    PointGejSetGep(r, acc);
+}
+
+void ECMultMulti(ec_gej &r, const ec_ge *pts, const ec_scalar *scalars, size_t n, const ec_scalar *ng)
+{
+    const CECMultContext &ctx = GetContext();
+
+    // odd multiples A, 3A, .. of every point, converted to affine together
+    std::vector<ec_gej> vTableJ(n * TABLE_SIZE_A);
+    std::vector<ec_ge> vTable(n * TABLE_SIZE_A);
+    std::vector<int> vWnaf(n * WNAF_MAX);
+    std::vector<int> vLen(n);
+
+    int nMaxLen = 0;
+    for (size_t i = 0; i < n; ++i)
+    {
+        ec_gej *row = &vTableJ[i * TABLE_SIZE_A];
+        if (pts[i].infinity || ECScalarIsZero(scalars[i]))
+        {
+            vLen[i] = 0;
+            for (int k = 0; k < TABLE_SIZE_A; ++k)
+                row[k].infinity = true;
+            continue;
+        };
+
+        ec_gej a2;
+        ECPointGejSetGe(row[0], pts[i]);
+        ECPointGejDouble(a2, row[0]);
+        for (int k = 1; k < TABLE_SIZE_A; ++k)
+            ECPointGejAdd(row[k], row[k - 1], a2);
+
+        vLen[i] = ScalarWNAF(&vWnaf[i * WNAF_MAX], scalars[i], WINDOW_A);
+        if (vLen[i] > nMaxLen)
+            nMaxLen = vLen[i];
+    };
+    if (n)
+        ECPointSetGejBatch(&vTable[0], &vTableJ[0], vTableJ.size());
+
+    int wnafG[WNAF_MAX];
+    int nLenG = 0;
+    if (ng)
+    {
+        nLenG = ScalarWNAF(wnafG, *ng, WINDOW_G);
+        if (nLenG > nMaxLen)
+            nMaxLen = nLenG;
+    };
+
+    r.infinity = true;
+    ec_ge t;
+    for (int bit = nMaxLen - 1; bit >= 0; --bit)
+    {
+        if (!r.infinity)
+            ECPointGejDouble(r, r);
+
+        for (size_t i = 0; i < n; ++i)
+        {
+            if (bit >= vLen[i])
+                continue;
+            int d = vWnaf[i * WNAF_MAX + bit];
+            if (d > 0)
+                ECPointGejAddGe(r, r, vTable[i * TABLE_SIZE_A + (d - 1) / 2]);
+            else
+            if (d < 0)
+            {
+                PointGeNegate(t, vTable[i * TABLE_SIZE_A + (-d - 1) / 2]);
+                ECPointGejAddGe(r, r, t);
+            };
+        };
+
+        if (bit < nLenG)
+        {
+            int d = wnafG[bit];
+            if (d > 0)
+                ECPointGejAddGe(r, r, ctx.oddG[(d - 1) / 2]);
+            else
+            if (d < 0)
+            {
+                PointGeNegate(t, ctx.oddG[(-d - 1) / 2]);
+                ECPointGejAddGe(r, r, t);
+            };
+        };
+    };
+}
+
+void ECMult(ec_gej &r, const ec_ge &a, const ec_scalar &na, const ec_scalar *ng)
+{
+    ECMultMulti(r, &a, &na, 1, ng);
+}
+
+#endif // USE_NATIVE_SECP256K1
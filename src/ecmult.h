@@ -0,0 +1,94 @@
+// SPDX-FileCopyrightText: © 2020 Alias Developers
+//
+// SPDX-License-Identifier: MIT
+
+#ifndef SPEC_ECMULT_H
+#define SPEC_ECMULT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+// Native secp256k1 arithmetic, used by the ring signature code instead of the
+// generic OpenSSL EC_POINT/BN_CTX machinery.
+//
+// Field elements and scalars are 4x64 bit limbs (little endian limb order) and
+// need 128 bit products, so the backend is only available where the compiler
+// provides unsigned __int128. Build with -DDISABLE_NATIVE_SECP256K1 (cmake
+// -DENABLE_NATIVE_SECP256K1=OFF) to fall back to the OpenSSL reference path.
+//
+// ECMultGen and ECMultConst are constant time in the scalar: complete
+// projective formulas, full table scans and an add in every window, on
+// branch free field and scalar arithmetic. ECMult and ECMultMulti are
+// variable time and must only be fed public scalars.
+
+#if defined(__SIZEOF_INT128__) && !defined(DISABLE_NATIVE_SECP256K1)
+#define USE_NATIVE_SECP256K1 1
+#endif
+
+#ifdef USE_NATIVE_SECP256K1
+
+// field element mod p, always fully reduced
+typedef struct ec_fe { uint64_t n[4]; } ec_fe;
+
+// scalar mod n, always fully reduced
+typedef struct ec_scalar { uint64_t d[4]; } ec_scalar;
+
+// affine point
+typedef struct ec_ge { ec_fe x, y; bool infinity; } ec_ge;
+
+// jacobian point, x = X/Z^2, y = Y/Z^3
+typedef struct ec_gej { ec_fe x, y, z; bool infinity; } ec_gej;
+
+
+void ECFieldSetB32(ec_fe &r, const uint8_t *p);             // reduces mod p
+bool ECFieldSetB32Check(ec_fe &r, const uint8_t *p);        // fails if >= p
+void ECFieldGetB32(uint8_t *p, const ec_fe &a);
+void ECFieldAddInt(ec_fe &r, uint32_t v);
+
+void ECScalarSetB32(ec_scalar &r, const uint8_t *p, bool *pfOverflow = NULL); // reduces mod n
+void ECScalarGetB32(uint8_t *p, const ec_scalar &a);
+void ECScalarSetInt(ec_scalar &r, uint32_t v);
+void ECScalarAdd(ec_scalar &r, const ec_scalar &a, const ec_scalar &b);
+void ECScalarSub(ec_scalar &r, const ec_scalar &a, const ec_scalar &b);
+void ECScalarMul(ec_scalar &r, const ec_scalar &a, const ec_scalar &b);
+void ECScalarNegate(ec_scalar &r, const ec_scalar &a);
+bool ECScalarIsZero(const ec_scalar &a);
+bool ECScalarEqual(const ec_scalar &a, const ec_scalar &b);
+
+// recover the point with x coordinate x, fOdd selects the parity of y
+bool ECPointSetXO(ec_ge &r, const ec_fe &x, bool fOdd);
+
+// compressed (33 byte) encoding only, parse verifies the point is on the curve
+bool ECPointParse(ec_ge &r, const uint8_t *p, size_t len);
+bool ECPointSerialize(uint8_t *p, const ec_ge &a);
+bool ECPointSerialize(uint8_t *p, const ec_gej &a);
+
+void ECPointSetGej(ec_ge &r, const ec_gej &a);
+void ECPointSetGejBatch(ec_ge *r, const ec_gej *a, size_t n);   // single inversion
+void ECPointGejSetGe(ec_gej &r, const ec_ge &a);
+void ECPointGejAdd(ec_gej &r, const ec_gej &a, const ec_gej &b);
+void ECPointGejAddGe(ec_gej &r, const ec_gej &a, const ec_ge &b);
+void ECPointGejDouble(ec_gej &r, const ec_gej &a);
+void ECPointGejNegate(ec_gej &r, const ec_gej &a);
+
+// builds the generator tables, safe to call more than once (tables are
+// built on first use otherwise)
+void ECMultInit();
+
+// r = k*G, precomputed comb, constant time
+void ECMultGen(ec_gej &r, const ec_scalar &k);
+
+// r = k*A, fixed 4 bit window, constant time in k
+void ECMultConst(ec_gej &r, const ec_ge &a, const ec_scalar &k);
+
+// r = na*A + ng*G (ng may be NULL), Strauss with wNAF
+void ECMult(ec_gej &r, const ec_ge &a, const ec_scalar &na, const ec_scalar *ng);
+
+// r = sum(s[i]*P[i]) + ng*G (ng may be NULL), Strauss over all points with a
+// shared doubling chain
+void ECMultMulti(ec_gej &r, const ec_ge *pts, const ec_scalar *scalars, size_t n, const ec_scalar *ng);
+
+#endif // USE_NATIVE_SECP256K1
+
+#endif // SPEC_ECMULT_H
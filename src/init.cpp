@@ -6,6 +6,7 @@
 // SPDX-License-Identifier: MIT
 
 #include "txdb.h"
+#include "blockindexsnapshot.h"
 #include "walletdb.h"
 #include "rpcserver.h"
 #include "net.h"
@@ -106,24 +107,21 @@ bool Finalise()
 
     if (nNodeMode == NT_FULL)
     {
-        std::map<uint256, CBlockIndex*>::iterator it;
-
-        for (it = mapBlockIndex.begin(); it != mapBlockIndex.end(); ++it)
+        // - only a fully loaded index, pindexBest is set once all of it is read
+        if (fBlockIndexSnapshot && pindexBest && pindexBest->GetBlockHash() == hashBestChain)
         {
-            delete it->second;
+            LOCK(cs_main);
+            WriteBlockIndexSnapshot(mapBlockIndex, hashBestChain);
         };
+
         mapBlockIndex.clear();
+        blockIndexArena.Clear();
         if (fDebug)
             LogPrintf("mapBlockIndex cleared.\n");
     } else
     {
-        std::map<uint256, CBlockThinIndex*>::iterator it;
-
-        for (it = mapBlockThinIndex.begin(); it != mapBlockThinIndex.end(); ++it)
-        {
-            delete it->second;
-        };
         mapBlockThinIndex.clear();
+        blockThinIndexArena.Clear();
         if (fDebug)
             LogPrintf("mapBlockThinIndex cleared.\n");
     };
@@ -260,6 +258,7 @@ std::string HelpMessage()
     strUsage += "  -minstakeinterval=<n>  " + _("Minimum time in seconds between successful stakes (default: 30)") + "\n";
     strUsage += "  -stakingdonation=<n>   " + _("Percentage of staking rewards to donate to the developers (between 0 and 100 inclusive, default 5)") + "\n";
     strUsage += "  -minersleep=<n>        " + _("Milliseconds between stake attempts. Lowering this param will not result in more stakes. (default: 500)") + "\n";
+    strUsage += "  -stakethreads=<n>      " + strprintf(_("Set the number of threads searching for a stake kernel (up to %d, 0 = auto, default: 1)"), MAX_SCRIPTCHECK_THREADS) + "\n";
     strUsage += "  -synctime              " + _("Sync time with other nodes. Disable if time on your system is precise e.g. syncing with NTP (default: 1)") + "\n";
     strUsage += "  -banscore=<n>          " + _("Threshold for disconnecting misbehaving peers (default: 100)") + "\n";
     strUsage += "  -bantime=<n>           " + _("Number of seconds to keep misbehaving peers from reconnecting (default: 86400)") + "\n";
@@ -309,6 +308,7 @@ std::string HelpMessage()
     strUsage += "  -blocknotify=<cmd>     " + _("Execute command when the best block changes (%s in cmd is replaced by block hash)") + "\n";
     strUsage += "  -walletnotify=<cmd>    " + _("Execute command when a wallet transaction changes (%s in cmd is replaced by TxID)") + "\n";
     strUsage += "  -confchange            " + _("Require a confirmations for change (default: 0)") + "\n";
+    strUsage += "  -checkbalances         " + _("Check the wallet balances and unspent coins against a count of all transactions as they update (default: 0)") + "\n";
     strUsage += "  -enforcecanonical      " + _("Enforce transaction scripts to use canonical PUSH operators (default: 1)") + "\n";
     strUsage += "  -alertnotify=<cmd>     " + _("Execute command when a relevant alert is received (%s in cmd is replaced by message)") + "\n";
     strUsage += "  -upgradewallet         " + _("Upgrade wallet to latest format") + "\n";
@@ -317,7 +317,16 @@ std::string HelpMessage()
     strUsage += "  -salvagewallet         " + _("Attempt to recover private keys from a corrupt wallet.dat") + "\n";
     strUsage += "  -checkblocks=<n>       " + _("How many blocks to check at startup (default: 2500, 0 = all)") + "\n";
     strUsage += "  -checklevel=<n>        " + _("How thorough the block verification is (0-6, default: 1)") + "\n";
+    strUsage += "  -verifyanonstats       " + _("Recount the anon output stats at startup and check the persisted stats against them") + "\n";
+    strUsage += "  -par=<n>               " + strprintf(_("Set the number of signature verification threads (up to %d, 0 = auto, <0 = leave that many cores free, default: 0)"), MAX_SCRIPTCHECK_THREADS) + "\n";
+    strUsage += "  -maxringpointcache=<n> " + strprintf(_("Keep at most <n> ring member points in the signature verification cache (default: %u)"), DEFAULT_RING_POINT_CACHE_SIZE) + "\n";
+    strUsage += "  -maxringsigcachesize=<n> " + strprintf(_("Keep at most <n> verified ring signatures in memory (default: %d)"), DEFAULT_MAX_RINGSIG_CACHE_SIZE) + "\n";
+    strUsage += "  -maxblockfilemaps=<n>  " + strprintf(_("Read blocks through memory mappings of at most <n> block files, 0 to read with stdio (default: %d)"), DEFAULT_MAX_BLOCKFILE_MAPS) + "\n";
+    strUsage += "  -compressblocks        " + _("Store new blocks LZ4 compressed in the block files (default: 0)") + "\n";
+    strUsage += "  -convertblockfiles     " + _("Rewrite the blk000?.dat files in the format set by -compressblocks and rebuild the block chain index from them on startup") + "\n";
+    strUsage += "  -blockindexsnapshot    " + _("Write a snapshot of the block index at shutdown to load it faster on the next start (default: 1)") + "\n";
     strUsage += "  -loadblock=<file>      " + _("Imports blocks from external blk000?.dat file") + "\n";
+    strUsage += "  -stopafterblockimport  " + _("Stop after importing blocks, the time spent in each validation phase is logged") + "\n";
     strUsage += "  -maxorphanblocksmib=<n> " + strprintf(_("Keep at most <n> MiB of unconnectable blocks in memory (default: %u)"), DEFAULT_MAX_ORPHAN_BLOCKS) + "\n";
     strUsage += "  -reindex               " + _("Rebuild block chain index from current blk000?.dat files on startup") + "\n";
     strUsage += "  -version               " + _("Show version and exit") + "\n";
@@ -414,8 +423,23 @@ bool AppInit2(boost::thread_group& threadGroup)
     nStakingDonation = GetArg("-stakingdonation", 0);
     nMinerSleep = GetArg("-minersleep", 500);
 
+    nStakeThreads = GetArg("-stakethreads", 1);
+    if (nStakeThreads <= 0)
+        nStakeThreads = boost::thread::hardware_concurrency();
+    nStakeThreads = std::max(1, std::min(nStakeThreads, MAX_SCRIPTCHECK_THREADS));
+
     fUseFastIndex = GetBoolArg("-fastindex", true);
 
+    // -par=0 means autodetect, but nScriptCheckThreads==0 means no concurrency
+    nScriptCheckThreads = GetArg("-par", 0);
+    if (nScriptCheckThreads <= 0)
+        nScriptCheckThreads += boost::thread::hardware_concurrency();
+    if (nScriptCheckThreads <= 1)
+        nScriptCheckThreads = 0;
+    else
+    if (nScriptCheckThreads > MAX_SCRIPTCHECK_THREADS)
+        nScriptCheckThreads = MAX_SCRIPTCHECK_THREADS;
+
     // Largest block you're willing to create.
     // Limit to betweeen 1K and MAX_BLOCK_SIZE-1K for sanity:
     nBlockMaxSize = GetArg("-blockmaxsize", MAX_BLOCK_SIZE-1000);
@@ -537,6 +561,7 @@ bool AppInit2(boost::thread_group& threadGroup)
     };
 
     fConfChange = GetBoolArg("-confchange", false);
+    fCheckBalances = GetBoolArg("-checkbalances", false);
     fEnforceCanonical = GetBoolArg("-enforcecanonical", true);
 
     if (mapArgs.count("-mininput"))
@@ -663,6 +688,21 @@ bool AppInit2(boost::thread_group& threadGroup)
     if (initialiseRingSigs() != 0)
         return InitError("initialiseRingSigs() failed.");
 
+    SetRingPointCacheSize(GetArg("-maxringpointcache", DEFAULT_RING_POINT_CACHE_SIZE));
+    SetBlockFileMapLimit(GetArg("-maxblockfilemaps", DEFAULT_MAX_BLOCKFILE_MAPS));
+    fCompressBlocks = GetBoolArg("-compressblocks", false);
+    fBlockIndexSnapshot = GetBoolArg("-blockindexsnapshot", true);
+
+    if (nScriptCheckThreads)
+    {
+        LogPrintf("Using %u threads for signature verification\n", nScriptCheckThreads);
+        for (int i = 0; i < nScriptCheckThreads-1; i++)
+        {
+            threadGroup.create_thread(&ThreadScriptCheck);
+            threadGroup.create_thread(&ThreadAnonInputCheck);
+        };
+    };
+
     // ********************************************************* Step 5: verify database integrity
 
     uiInterface.InitMessage(_("Verifying database integrity..."));
@@ -830,6 +870,11 @@ bool AppInit2(boost::thread_group& threadGroup)
     LogPrintf("Loading block index...\n");
     nStart = GetTimeMillis();
 
+    // -- block positions change when the block files are rewritten, reindex from them
+    bool fConvertBlockFiles = GetBoolArg("-convertblockfiles", false) && nNodeMode == NT_FULL;
+    if (fConvertBlockFiles)
+        mapArgs["-reindex"] = "1";
+
     // -- wipe the txdb if a reindex is queued
     if (mapArgs.count("-reindex"))
     {
@@ -838,6 +883,13 @@ bool AppInit2(boost::thread_group& threadGroup)
         txdb.RecreateDB();
     };
 
+    if (fConvertBlockFiles)
+    {
+        uiInterface.InitMessage(_("Converting block files..."));
+        if (!ConvertBlockFiles(fCompressBlocks))
+            return InitError(_("Error converting the block files, see debug.log"));
+    };
+
     switch (LoadBlockIndex(true, [] (const unsigned mode, const uint32_t& nBlock) -> void {
                            if (mode == 0)
                                 uiInterface.InitMessage(strprintf(_("Loading block index... (%d)"), nBlock));
@@ -881,7 +933,7 @@ bool AppInit2(boost::thread_group& threadGroup)
     {
         std::string strMatch = mapArgs["-printblock"];
         int nFound = 0;
-        for (std::map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.begin(); mi != mapBlockIndex.end(); ++mi)
+        for (BlockMap::iterator mi = mapBlockIndex.begin(); mi != mapBlockIndex.end(); ++mi)
         {
             uint256 hash = (*mi).first;
             if (strncmp(hash.ToString().c_str(), strMatch.c_str(), strMatch.size()) == 0)
@@ -1067,7 +1119,15 @@ bool AppInit2(boost::thread_group& threadGroup)
     if (!fIsStakingEnabled && !fHaveGUI)
         LogPrintf("Staking disabled\n");
     else
+    {
+        if (nStakeThreads > 1)
+        {
+            LogPrintf("Using %u threads for the stake kernel search\n", nStakeThreads);
+            for (int i = 0; i < nStakeThreads-1; i++)
+                threadGroup.create_thread(&ThreadKernelSearch);
+        };
         threadGroup.create_thread(boost::bind(&TraceThread<void (*)(CWallet*), CWallet*>, "miner", &ThreadStakeMiner, pwalletMain));
+    };
 
     if (nNodeMode != NT_FULL)
         pwalletMain->InitBloomFilter();
@@ -452,7 +452,7 @@ static bool GetKernelStakeModifierThin(uint256 hashBlockFrom, uint64_t& nStakeMo
     int64_t nFoundTime;
     int64_t nStakeModifierSelectionInterval = GetStakeModifierSelectionInterval();
 
-    std::map<uint256, CBlockThinIndex*>::iterator mi = mapBlockThinIndex.find(hashBlockFrom);
+    BlockThinMap::iterator mi = mapBlockThinIndex.find(hashBlockFrom);
     if (mi == mapBlockThinIndex.end())
     {
         if (fThinFullIndex
@@ -549,12 +549,16 @@ static bool GetKernelStakeModifierThin(uint256 hashBlockFrom, uint64_t& nStakeMo
 //   quantities so as to generate blocks faster, degrading the system back into
 //   a proof-of-work situation.
 //
-static inline bool CheckStakeKernelHashV1(unsigned int nBits, const CBlock& blockFrom, unsigned int nTxPrevOffset, const CTransaction& txPrev, const COutPoint& prevout, unsigned int nTimeTx, uint256& hashProofOfStake, uint256& targetProofOfStake, bool fPrintProofOfStake)
+static inline bool CheckStakeKernelHashV1(unsigned int nBits, const CStakeCandidate& candidate, unsigned int nTimeTx, uint256& hashProofOfStake, uint256& targetProofOfStake, bool fPrintProofOfStake)
 {
-    if (nTimeTx < txPrev.nTime)  // Transaction timestamp violation
-        return error("CheckStakeKernelHash() : nTime violation");
+    const COutPoint& prevout = candidate.prevout;
+    unsigned int nTimeTxPrev = candidate.nTimeTxPrev;
+    unsigned int nTxPrevOffset = candidate.nTxPrevOffset;
+    const uint256& hashBlockFrom = candidate.hashBlockFrom;
+    unsigned int nTimeBlockFrom = candidate.nTimeBlockFrom;
 
-    unsigned int nTimeBlockFrom = blockFrom.GetBlockTime();
+    if (nTimeTx < nTimeTxPrev)  // Transaction timestamp violation
+        return error("CheckStakeKernelHash() : nTime violation");
 
     if (nTimeBlockFrom + nStakeMinAge > nTimeTx) // Min age requirement
         return error("CheckStakeKernelHash() : min age violation");
@@ -562,9 +566,7 @@ static inline bool CheckStakeKernelHashV1(unsigned int nBits, const CBlock& bloc
     CBigNum bnTargetPerCoinDay;
     bnTargetPerCoinDay.SetCompact(nBits);
 
-    uint256 hashBlockFrom = blockFrom.GetHash();
-
-    CBigNum bnCoinDayWeight = CBigNum(txPrev.vout[prevout.n].nValue) * GetWeight((int64_t)txPrev.nTime, (int64_t)nTimeTx) / COIN / (24 * 60 * 60);
+    CBigNum bnCoinDayWeight = CBigNum(candidate.nValue) * GetWeight((int64_t)nTimeTxPrev, (int64_t)nTimeTx) / COIN / (24 * 60 * 60);
     targetProofOfStake = (bnCoinDayWeight * bnTargetPerCoinDay).getuint256();
 
     // Calculate hash
@@ -585,7 +587,7 @@ static inline bool CheckStakeKernelHashV1(unsigned int nBits, const CBlock& bloc
 
     ss << nStakeModifier;
 
-    ss << nTimeBlockFrom << nTxPrevOffset << txPrev.nTime << prevout.n << nTimeTx;
+    ss << nTimeBlockFrom << nTxPrevOffset << nTimeTxPrev << prevout.n << nTimeTx;
     hashProofOfStake = Hash(ss.begin(), ss.end());
 
     if (fPrintProofOfStake)
@@ -601,10 +603,10 @@ static inline bool CheckStakeKernelHashV1(unsigned int nBits, const CBlock& bloc
             nStakeModifier, nStakeModifierHeight,
             DateTimeStrFormat(nStakeModifierTime).c_str(),
             nHeight,
-            DateTimeStrFormat(blockFrom.GetBlockTime()).c_str());
+            DateTimeStrFormat(nTimeBlockFrom).c_str());
         LogPrintf("CheckStakeKernelHash() : check modifier=0x%016x nTimeBlockFrom=%u nTxPrevOffset=%u nTimeTxPrev=%u nPrevout=%u nTimeTx=%u hashProof=%s\n",
             nStakeModifier,
-            nTimeBlockFrom, nTxPrevOffset, txPrev.nTime, prevout.n, nTimeTx,
+            nTimeBlockFrom, nTxPrevOffset, nTimeTxPrev, prevout.n, nTimeTx,
             hashProofOfStake.ToString().c_str());
 
         CBigNum nTry = CBigNum(hashProofOfStake);
@@ -626,10 +628,10 @@ static inline bool CheckStakeKernelHashV1(unsigned int nBits, const CBlock& bloc
             nStakeModifier, nStakeModifierHeight,
             DateTimeStrFormat(nStakeModifierTime),
             nHeight,
-            DateTimeStrFormat(blockFrom.GetBlockTime()));
+            DateTimeStrFormat(nTimeBlockFrom));
         LogPrintf("CheckStakeKernelHash() : pass modifier=0x%016x nTimeBlockFrom=%u nTxPrevOffset=%u nTimeTxPrev=%u nPrevout=%u nTimeTx=%u hashProof=%s\n",
             nStakeModifier,
-            nTimeBlockFrom, nTxPrevOffset, txPrev.nTime, prevout.n, nTimeTx,
+            nTimeBlockFrom, nTxPrevOffset, nTimeTxPrev, prevout.n, nTimeTx,
             hashProofOfStake.ToString());
     }
 
@@ -658,9 +660,13 @@ static inline bool CheckStakeKernelHashV1(unsigned int nBits, const CBlock& bloc
 //   quantities so as to generate blocks faster, degrading the system back into
 //   a proof-of-work situation.
 //
-static inline bool CheckStakeKernelHashV2(CStakeModifier* pStakeMod, unsigned int nBits, unsigned int nTimeBlockFrom, const CTransaction& txPrev, const COutPoint& prevout, unsigned int nTimeTx, uint256& hashProofOfStake, uint256& targetProofOfStake, bool fPrintProofOfStake)
+static inline bool CheckStakeKernelHashV2(CStakeModifier* pStakeMod, unsigned int nBits, const CStakeCandidate& candidate, unsigned int nTimeTx, uint256& hashProofOfStake, uint256& targetProofOfStake, bool fPrintProofOfStake)
 {
-    if (nTimeTx < txPrev.nTime)  // Transaction timestamp violation
+    const COutPoint& prevout = candidate.prevout;
+    unsigned int nTimeTxPrev = candidate.nTimeTxPrev;
+    unsigned int nTimeBlockFrom = candidate.nTimeBlockFrom;
+
+    if (nTimeTx < nTimeTxPrev)  // Transaction timestamp violation
         return error("CheckStakeKernelHash() : nTime violation");
 
     // Base target
@@ -668,7 +674,7 @@ static inline bool CheckStakeKernelHashV2(CStakeModifier* pStakeMod, unsigned in
     bnTarget.SetCompact(nBits);
 
     // Weighted target
-    CBigNum bnWeight = CBigNum(txPrev.vout[prevout.n].nValue);
+    CBigNum bnWeight = CBigNum(candidate.nValue);
     bnTarget *= bnWeight;
 
     targetProofOfStake = bnTarget.getuint256();
@@ -678,7 +684,7 @@ static inline bool CheckStakeKernelHashV2(CStakeModifier* pStakeMod, unsigned in
         ss << pStakeMod->bnModifierV2;
     else
         ss << pStakeMod->nModifier << nTimeBlockFrom;
-    ss << txPrev.nTime << prevout.hash << prevout.n << nTimeTx;
+    ss << nTimeTxPrev << prevout.hash << prevout.n << nTimeTx;
 
     hashProofOfStake = Hash(ss.begin(), ss.end());
 
@@ -692,13 +698,13 @@ static inline bool CheckStakeKernelHashV2(CStakeModifier* pStakeMod, unsigned in
             LogPrintf("CheckStakeKernelHash() : PoSv3 check=%b with modifierV2=%s at height=%d timestamp=%s, nTimeTxPrev=%u nPrevout=%u nTimeTx=%u, hashProof=%s target=%s\n",
                       foundHash,
                       pStakeMod->bnModifierV2.ToString(), pStakeMod->nHeight, DateTimeStrFormat(pStakeMod->nTime),
-                      txPrev.nTime, prevout.n, nTimeTx,
+                      nTimeTxPrev, prevout.n, nTimeTx,
                       hashProofOfStake.ToString(), bnTarget.ToString());
         else
             LogPrintf("CheckStakeKernelHash() : PoSv2 check=%b with modifier=0x%016x at height=%d timestamp=%s, nTimeBlockFrom=%u nTimeTxPrev=%u nPrevout=%u nTimeTx=%u, hashProof=%s target=%s\n",
                       foundHash,
                       pStakeMod->nModifier, pStakeMod->nHeight, DateTimeStrFormat(pStakeMod->nTime),
-                      nTimeBlockFrom, txPrev.nTime, prevout.n, nTimeTx,
+                      nTimeBlockFrom, nTimeTxPrev, prevout.n, nTimeTx,
                       hashProofOfStake.ToString(), bnTarget.ToString());
     }
 
@@ -706,11 +712,24 @@ static inline bool CheckStakeKernelHashV2(CStakeModifier* pStakeMod, unsigned in
 }
 
 
-bool CheckStakeKernelHash(int nPrevHeight, CStakeModifier* pStakeMod, unsigned int nBits, const CBlock& blockFrom, unsigned int nTxPrevOffset, const CTransaction& txPrev, const COutPoint& prevout, unsigned int nTimeTx, uint256& hashProofOfStake, uint256& targetProofOfStake, bool fPrintProofOfStake)
+bool CheckStakeKernelHash(int nPrevHeight, CStakeModifier* pStakeMod, unsigned int nBits, const CStakeCandidate& candidate, unsigned int nTimeTx, uint256& hashProofOfStake, uint256& targetProofOfStake, bool fPrintProofOfStake)
 {
     if (Params().IsProtocolV2(nPrevHeight+1))
-        return CheckStakeKernelHashV2(pStakeMod, nBits, blockFrom.GetBlockTime(), txPrev, prevout, nTimeTx, hashProofOfStake, targetProofOfStake, fPrintProofOfStake);
-    return CheckStakeKernelHashV1(nBits, blockFrom, nTxPrevOffset, txPrev, prevout, nTimeTx, hashProofOfStake, targetProofOfStake, fPrintProofOfStake);
+        return CheckStakeKernelHashV2(pStakeMod, nBits, candidate, nTimeTx, hashProofOfStake, targetProofOfStake, fPrintProofOfStake);
+    return CheckStakeKernelHashV1(nBits, candidate, nTimeTx, hashProofOfStake, targetProofOfStake, fPrintProofOfStake);
+}
+
+bool CheckStakeKernelHash(int nPrevHeight, CStakeModifier* pStakeMod, unsigned int nBits, const CBlock& blockFrom, unsigned int nTxPrevOffset, const CTransaction& txPrev, const COutPoint& prevout, unsigned int nTimeTx, uint256& hashProofOfStake, uint256& targetProofOfStake, bool fPrintProofOfStake)
+{
+    CStakeCandidate candidate;
+    candidate.prevout = prevout;
+    candidate.nValue = txPrev.vout[prevout.n].nValue;
+    candidate.nTimeTxPrev = txPrev.nTime;
+    candidate.nTxPrevOffset = nTxPrevOffset;
+    candidate.hashBlockFrom = blockFrom.GetHash();
+    candidate.nTimeBlockFrom = blockFrom.GetBlockTime();
+
+    return CheckStakeKernelHash(nPrevHeight, pStakeMod, nBits, candidate, nTimeTx, hashProofOfStake, targetProofOfStake, fPrintProofOfStake);
 }
 
 
@@ -737,7 +756,7 @@ bool CheckProofOfStake(CBlockIndex* pindexPrev, const CTransaction& tx, unsigned
         CBlock block;
         if (block.ReadFromDisk(txindex.vSpent[txin.prevout.n].nFile, txindex.vSpent[txin.prevout.n].nBlockPos, false))
         {
-            std::map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(block.GetHash());
+            BlockMap::iterator mi = mapBlockIndex.find(block.GetHash());
             if (fDebug)
                 LogPrintf("CheckProofOfStake() : block at height %d spends txPrev staked at height %d\n", mi->second->nHeight, pindexPrev->nHeight + 1);
             if (mi != mapBlockIndex.end() && mi->second->nHeight < pindexPrev->nHeight + 1) // only consider spends in blocks BEFORE current block
@@ -783,11 +802,8 @@ bool CheckCoinStakeTimestamp(int nHeight, int64_t nTimeBlock, int64_t nTimeTx)
         return (nTimeBlock == nTimeTx);
 }
 
-bool CheckKernel(CBlockIndex* pindexPrev, unsigned int nBits, int64_t nTime, const COutPoint& prevout, int64_t* pBlockTime)
+bool ReadStakeCandidate(CTxDB& txdb, const COutPoint& prevout, CStakeCandidate& candidate)
 {
-    uint256 hashProofOfStake, targetProofOfStake;
-
-    CTxDB txdb("r");
     CTransaction txPrev;
     CTxIndex txindex;
     if (!txPrev.ReadFromDisk(txdb, prevout, txindex))
@@ -798,21 +814,58 @@ bool CheckKernel(CBlockIndex* pindexPrev, unsigned int nBits, int64_t nTime, con
     if (!block.ReadFromDisk(txindex.pos.nFile, txindex.pos.nBlockPos, false))
         return false;
 
+    uint256 hashBlock = block.GetHash();
+    int nHeightBlockFrom;
+    {
+        // - the stake miner calls this without cs_main, an insert can rehash mapBlockIndex
+        LOCK(cs_main);
+        BlockMap::iterator mi = mapBlockIndex.find(hashBlock);
+        if (mi == mapBlockIndex.end())
+            return false;
+        nHeightBlockFrom = mi->second->nHeight;
+    }
+
+    candidate.prevout = prevout;
+    candidate.nValue = txPrev.vout[prevout.n].nValue;
+    candidate.nTimeTxPrev = txPrev.nTime;
+    candidate.nTxPrevOffset = txindex.pos.nTxPos - txindex.pos.nBlockPos;
+    candidate.hashBlockFrom = hashBlock;
+    candidate.nTimeBlockFrom = block.GetBlockTime();
+    candidate.nHeightBlockFrom = nHeightBlockFrom;
+    return true;
+}
+
+bool CheckKernel(CBlockIndex* pindexPrev, unsigned int nBits, int64_t nTime, const CStakeCandidate& candidate, int64_t* pBlockTime)
+{
+    uint256 hashProofOfStake, targetProofOfStake;
+
     if (Params().IsProtocolV3(pindexPrev->nHeight+1))
     {
-        int nDepth;
-        if (IsConfirmedInNPrevBlocks(txindex, pindexPrev, Params().GetStakeMinConfirmations(nTime) - 1, nDepth))
+        // - as IsConfirmedInNPrevBlocks, the block of the candidate is in the
+        //   chain of pindexPrev, the candidates are read for it
+        int nDepth = pindexPrev->nHeight - candidate.nHeightBlockFrom;
+        if (nDepth >= 0 && nDepth < Params().GetStakeMinConfirmations(nTime) - 1)
             return false;
     }
-    else if (block.GetBlockTime() + nStakeMinAge > nTime)
+    else if (candidate.nTimeBlockFrom + nStakeMinAge > nTime)
         return false; // only count coins meeting min age requirement
 
     if (pBlockTime)
-        *pBlockTime = block.GetBlockTime();
+        *pBlockTime = candidate.nTimeBlockFrom;
 
     // - workaround for thin mode
     CStakeModifier stakeMod(pindexPrev->nStakeModifier, pindexPrev->bnStakeModifierV2, pindexPrev->nHeight, pindexPrev->nTime);
-    return CheckStakeKernelHash(pindexPrev->nHeight, &stakeMod, nBits, block, txindex.pos.nTxPos - txindex.pos.nBlockPos, txPrev, prevout, nTime, hashProofOfStake, targetProofOfStake, fDebugPoS);
+    return CheckStakeKernelHash(pindexPrev->nHeight, &stakeMod, nBits, candidate, nTime, hashProofOfStake, targetProofOfStake, fDebugPoS);
+}
+
+bool CheckKernel(CBlockIndex* pindexPrev, unsigned int nBits, int64_t nTime, const COutPoint& prevout, int64_t* pBlockTime)
+{
+    CTxDB txdb("r");
+    CStakeCandidate candidate;
+    if (!ReadStakeCandidate(txdb, prevout, candidate))
+        return false;
+
+    return CheckKernel(pindexPrev, nBits, nTime, candidate, pBlockTime);
 }
 
 
@@ -29,6 +29,7 @@ uint256 ComputeStakeModifierV2(const CBlockIndex* pindexPrev, const uint256& ker
 // Check whether stake kernel meets hash target
 // Sets hashProofOfStake on success return
 bool CheckStakeKernelHash(int nPrevHeight, CStakeModifier* pStakeMod, unsigned int nBits, const CBlock& blockFrom, unsigned int nTxPrevOffset, const CTransaction& txPrev, const COutPoint& prevout, unsigned int nTimeTx, uint256& hashProofOfStake, uint256& targetProofOfStake, bool fPrintProofOfStake);
+bool CheckStakeKernelHash(int nPrevHeight, CStakeModifier* pStakeMod, unsigned int nBits, const CStakeCandidate& candidate, unsigned int nTimeTx, uint256& hashProofOfStake, uint256& targetProofOfStake, bool fPrintProofOfStake);
 
 // Check kernel hash target and coinstake signature
 // Sets hashProofOfStake on success return
@@ -45,6 +46,12 @@ int64_t GetWeight(int64_t nIntervalBeginning, int64_t nIntervalEnd); // TODO: po
 // Convenient for searching a kernel
 bool CheckKernel(CBlockIndex* pindexPrev, unsigned int nBits, int64_t nTime, const COutPoint& prevout, int64_t* pBlockTime = NULL);
 
+// Read what the kernel hash needs of prevout, its transaction and block
+bool ReadStakeCandidate(CTxDB& txdb, const COutPoint& prevout, CStakeCandidate& candidate);
+
+// CheckKernel() of a candidate read before, without reading from disk
+bool CheckKernel(CBlockIndex* pindexPrev, unsigned int nBits, int64_t nTime, const CStakeCandidate& candidate, int64_t* pBlockTime = NULL);
+
 
 // -- Stealth Staking
 // Check whether stake kernel meets hash target and ATXO maturity
@@ -33,8 +33,16 @@ CCriticalSection cs_main;
 CTxMemPool mempool;
 
 CChain chainActive;
-std::map<uint256, CBlockIndex*> mapBlockIndex;
-std::map<uint256, CBlockThinIndex*> mapBlockThinIndex;
+BlockMap mapBlockIndex;
+BlockThinMap mapBlockThinIndex;
+CArena<CBlockIndex> blockIndexArena;
+CArena<CBlockThinIndex> blockThinIndexArena;
+
+BlockHasher::BlockHasher()
+{
+    k0 = GetRand(std::numeric_limits<uint64_t>::max());
+    k1 = GetRand(std::numeric_limits<uint64_t>::max());
+}
 
 std::set<std::pair<COutPoint, unsigned int> > setStakeSeen;
 
@@ -94,6 +102,8 @@ const string strMessageMagic = "Alias Signed Message:\n";
 int64_t nTransactionFee = nMinTxFee;
 int64_t nReserveBalance = 0;
 int64_t nMinimumInputValue = 0;
+int nScriptCheckThreads = 0;
+CBlockTimings blockTimings;
 
 //////////////////////////////////////////////////////////////////////////////
 //
@@ -206,6 +216,13 @@ void static SetBestThinChain(const CBlockThinLocator& loc)
         pwallet->SetBestThinChain(loc);
 }
 
+// notify wallets about a new tip, of the best chain or of the headers of a thin node
+void static SetBestTip(int nHeight, const uint256& hash)
+{
+    BOOST_FOREACH(CWallet* pwallet, setpwalletRegistered)
+        pwallet->SetBestTip(nHeight, hash);
+}
+
 // notify wallets about an updated transaction
 void static UpdatedTransaction(const uint256& hashTx)
 {
@@ -403,7 +420,7 @@ bool GetCoinAgeThin(CTransaction txCoinStake, uint64_t& nCoinAge, std::vector<co
 
         int64_t nBlockTime = 0;
 
-        std::map<uint256, CBlockThinIndex*>::iterator mi = mapBlockThinIndex.find(txPrev->hashBlock);
+        BlockThinMap::iterator mi = mapBlockThinIndex.find(txPrev->hashBlock);
         if (mi == mapBlockThinIndex.end())
         {
             if (fThinFullIndex
@@ -782,7 +799,7 @@ int CMerkleTx::SetMerkleBranch(const CBlock* pblock)
     vMerkleBranch = pblock->GetMerkleBranch(nIndex);
 
     // Is the tx in a block that's in the main chain
-    map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(hashBlock);
+    BlockMap::iterator mi = mapBlockIndex.find(hashBlock);
 
     if (mi == mapBlockIndex.end())
         return 0;
@@ -919,6 +936,85 @@ int64_t CTransaction::GetMinFee(unsigned int nBlockSize, enum GetMinFee_mode mod
     return nMinFee;
 }
 
+static CCheckQueue<CAnonInputCheck> anonInputCheckQueue(16);
+
+void ThreadAnonInputCheck()
+{
+    RenameThread("alias-anoncheck");
+    anonInputCheckQueue.Thread();
+}
+
+static CCheckQueue<CScriptCheck> scriptCheckQueue(128);
+
+void ThreadScriptCheck()
+{
+    RenameThread("alias-scriptch");
+    scriptCheckQueue.Thread();
+}
+
+bool CScriptCheck::operator()() const
+{
+    return Verify(nFlags);
+}
+
+bool CScriptCheck::Verify(unsigned int nFlagsIn) const
+{
+    const CScript &scriptSig = ptxTo->vin[nIn].scriptSig;
+    return VerifyScript(scriptSig, scriptPubKey, *ptxTo, nIn, nFlagsIn, nHashType);
+}
+
+static const CScriptCheck *FirstFailedScriptCheck(const std::vector<CScriptCheck> &vChecks)
+{
+    // - the workers stop at the first failure they happen to see, report the first in block order
+    BOOST_FOREACH(const CScriptCheck &check, vChecks)
+        if (!check())
+            return &check;
+    return NULL;
+}
+
+bool CAnonInputCheck::operator()() const
+{
+    if (CRingSigBatch::VerifyEntry(entry) != 0)
+        return error("CAnonInputCheck() : tx %s input %d ring signature verification failed", entry.txnHash.ToString(), entry.nInput);
+    return true;
+}
+
+static bool QueueAnonInputChecks(CRingSigBatch &batch, CCheckQueueControl<CAnonInputCheck> &control)
+{
+    // - hand the queued rings to the -par workers, or verify them here in one batch
+    if (batch.empty())
+        return true;
+
+    if (nScriptCheckThreads > 0)
+    {
+        std::vector<CRingSigBatch::Entry> vEntries;
+        batch.TakeEntries(vEntries);
+
+        std::vector<CAnonInputCheck> vChecks;
+        vChecks.reserve(vEntries.size());
+        BOOST_FOREACH(const CRingSigBatch::Entry &e, vEntries)
+            vChecks.push_back(CAnonInputCheck(e));
+        control.Add(vChecks);
+        return true;
+    };
+
+    std::vector<size_t> vFailed;
+    if (batch.Verify(vFailed) != 0)
+    {
+        BOOST_FOREACH(size_t k, vFailed)
+        {
+            const CRingSigBatch::Entry &e = batch.Get(k);
+            LogPrintf("QueueAnonInputChecks() : tx %s input %d ring signature verification failed.\n", e.txnHash.ToString(), e.nInput);
+        };
+        return false;
+    };
+
+    if (fDebugRingSig)
+        LogPrintf("QueueAnonInputChecks() : verified %u ring signatures.\n", batch.size());
+
+    return true;
+}
+
 bool AcceptToMemoryPool(CTxMemPool &pool, CTransaction &tx, CTxDB &txdb, bool *pfMissingInputs)
 {
     AssertLockHeld(cs_main);
@@ -967,6 +1063,7 @@ bool AcceptToMemoryPool(CTxMemPool &pool, CTransaction &tx, CTxDB &txdb, bool *p
     {
         MapPrevTx mapInputs;
         std::map<uint256, CTxIndex> mapUnused;
+        CRingSigBatch ringSigBatch;
         bool fInvalid = false;
 
         int64_t nFees;
@@ -992,7 +1089,7 @@ bool AcceptToMemoryPool(CTxMemPool &pool, CTransaction &tx, CTxDB &txdb, bool *p
             if (tx.nVersion == ANON_TXN_VERSION)
             {
                 int64_t nSumAnon;
-                if (!tx.CheckAnonInputs(txdb, nSumAnon, fInvalid, true))
+                if (!tx.CheckAnonInputs(txdb, nSumAnon, fInvalid, true, &ringSigBatch))
                 {
                     if (fInvalid)
                         return error("AcceptToMemoryPool() : CheckAnonInputs found invalid tx %s", hash.ToString().substr(0,10).c_str());
@@ -1047,10 +1144,16 @@ bool AcceptToMemoryPool(CTxMemPool &pool, CTransaction &tx, CTxDB &txdb, bool *p
 
             // Check against previous transactions
             // This is done last to help prevent CPU exhaustion denial-of-service attacks.
-            if (!tx.ConnectInputs(txdb, mapInputs, mapUnused, CDiskTxPos(1,1,1), pindexBest, false, false, MANDATORY_SCRIPT_VERIFY_FLAGS))
+            if (!tx.ConnectInputs(txdb, mapInputs, mapUnused, CDiskTxPos(1,1,1), pindexBest, false, false, MANDATORY_SCRIPT_VERIFY_FLAGS, &ringSigBatch))
             {
                 return error("AcceptToMemoryPool() : ConnectInputs failed %s", hash.ToString().substr(0,10).c_str());
             };
+
+            // Ring signatures last, they are by far the most expensive check
+            CCheckQueueControl<CAnonInputCheck> control(nScriptCheckThreads > 0 ? &anonInputCheckQueue : NULL);
+            if (!QueueAnonInputChecks(ringSigBatch, control)
+                || !control.Wait())
+                return error("AcceptToMemoryPool() : CheckAnonInputs found invalid tx %s", hash.ToString().substr(0,10).c_str());
         };
     }
 
@@ -1098,7 +1201,7 @@ int CTxIndex::GetDepthInMainChainFromIndex() const
         if (!block.ReadBlockThinFromDisk(pos.nFile, pos.nBlockPos))
             return 0;
 
-        map<uint256, CBlockThinIndex*>::iterator mi = mapBlockThinIndex.find(block.GetHash());
+        BlockThinMap::iterator mi = mapBlockThinIndex.find(block.GetHash());
         if (mi == mapBlockThinIndex.end())
             return 0;
         CBlockThinIndex* pindex = (*mi).second;
@@ -1112,7 +1215,7 @@ int CTxIndex::GetDepthInMainChainFromIndex() const
     if (!block.ReadFromDisk(pos.nFile, pos.nBlockPos, false))
         return 0;
     // Find the block in the index
-    map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(block.GetHash());
+    BlockMap::iterator mi = mapBlockIndex.find(block.GetHash());
     if (mi == mapBlockIndex.end())
         return 0;
     CBlockIndex* pindex = (*mi).second;
@@ -1206,39 +1309,80 @@ bool TxnHashInSystem(CTxDB* ptxdb, uint256& txnHash)
 // CBlockThin and CBlockThinIndex
 //
 
-static CBlockThinIndex* pblockHeaderIndexFBBHLast = NULL;
-CBlockThinIndex* FindBlockThinByHeight(int nHeight)
+// - pskip of a block at nHeight points to the ancestor at GetSkipHeight(nHeight),
+//   heights with the lowest set bits cleared, so GetAncestor() takes O(log n)
+//   steps, as the skip list of bitcoin 0.10.
+static inline int InvertLowestOne(int n)
 {
-    CBlockThinIndex *pblockindex;
-    if (nHeight < nBestHeight / 2)
-        pblockindex = pindexGenesisBlockThin;
-    else
-        pblockindex = pindexBestHeader;
+    return n & (n - 1);
+}
+
+static inline int GetSkipHeight(int nHeight)
+{
+    if (nHeight < 2)
+        return 0;
+
+    // - odd heights skip back further, even ones are the targets of the
+    //   skips of others, so walks don't get stuck stepping pprev
+    return (nHeight & 1) ? InvertLowestOne(InvertLowestOne(nHeight - 1)) + 1 : InvertLowestOne(nHeight);
+}
 
-    if (!pblockindex)
+template<typename T>
+static T* GetAncestorOf(T* pindex, int nHeight)
+{
+    if (nHeight > pindex->nHeight || nHeight < 0)
         return NULL;
 
-    if (pblockHeaderIndexFBBHLast && abs(nHeight - pblockindex->nHeight) > abs(nHeight - pblockHeaderIndexFBBHLast->nHeight))
-        pblockindex = pblockHeaderIndexFBBHLast;
+    // - pskip is only followed when its height, known from GetSkipHeight(),
+    //   isn't below nHeight
+    T* pindexWalk = pindex;
+    int nHeightWalk = pindex->nHeight;
+    while (pindexWalk && nHeightWalk > nHeight)
+    {
+        int nHeightSkip = GetSkipHeight(nHeightWalk);
+        int nHeightSkipPrev = GetSkipHeight(nHeightWalk - 1);
+        if (pindexWalk->pskip
+            && (nHeightSkip == nHeight
+                || (nHeightSkip > nHeight
+                    && !(nHeightSkipPrev < nHeightSkip - 2 && nHeightSkipPrev >= nHeight))))
+        {
+            pindexWalk = pindexWalk->pskip;
+            nHeightWalk = nHeightSkip;
+        } else
+        {
+            pindexWalk = pindexWalk->pprev;
+            nHeightWalk--;
+        };
+    };
 
-    while (pblockindex
-        && pblockindex->nHeight > nHeight
-        && pblockindex->pprev)
-        pblockindex = pblockindex->pprev;
+    return pindexWalk;
+}
 
-    while (pblockindex
-        && pblockindex->nHeight < nHeight
-        && pblockindex->pnext)
-        pblockindex = pblockindex->pnext;
+void CBlockThinIndex::BuildSkip()
+{
+    if (pprev)
+        pskip = pprev->GetAncestor(GetSkipHeight(nHeight));
+}
 
-    if (!pblockindex)
+CBlockThinIndex* CBlockThinIndex::GetAncestor(int nHeightIn)
+{
+    // - entries below pindexRear are gone, pskip may still point at them
+    if (!fThinFullIndex && pindexRear && nHeightIn < pindexRear->nHeight)
         return NULL;
+    return GetAncestorOf(this, nHeightIn);
+}
 
-    if (pblockindex->nHeight != nHeight)
+const CBlockThinIndex* CBlockThinIndex::GetAncestor(int nHeightIn) const
+{
+    return const_cast<CBlockThinIndex*>(this)->GetAncestor(nHeightIn);
+}
+
+CBlockThinIndex* FindBlockThinByHeight(int nHeight)
+{
+    if (!pindexBestHeader)
         return NULL;
 
-    pblockHeaderIndexFBBHLast = pblockindex;
-    return pblockindex;
+    return pindexBestHeader->GetAncestor(nHeight);
 }
 
 void static InvalidHeaderChainFound(CBlockThinIndex* pindexNew)
@@ -1274,9 +1418,9 @@ bool static ReorganizeHeaders(CTxDB& txdb, CBlockThinIndex* pindexNew)
     CBlockThinIndex* plonger = pindexNew;
     while (pfork != plonger)
     {
-        while (plonger->nHeight > pfork->nHeight)
-            if (!(plonger = plonger->pprev))
-                return error("ReorganizeHeaders() : plonger->pprev is null");
+        if (plonger->nHeight > pfork->nHeight
+            && !(plonger = plonger->GetAncestor(pfork->nHeight)))
+            return error("ReorganizeHeaders() : plonger->pprev is null");
 
         if (pfork == plonger)
             break;
@@ -1411,7 +1555,7 @@ bool CBlockThin::AcceptBlockThin()
         return error("AcceptBlockThin() : header already in mapBlockThinIndex");
 
     // Get prev block index
-    map<uint256, CBlockThinIndex*>::iterator mi = mapBlockThinIndex.find(hashPrevBlock);
+    BlockThinMap::iterator mi = mapBlockThinIndex.find(hashPrevBlock);
 
     if (mi == mapBlockThinIndex.end())
         return error("AcceptBlockThin() : prev header not found");
@@ -1462,16 +1606,17 @@ bool CBlockThin::AddToBlockThinIndex(unsigned int nFile, unsigned int nBlockPos,
         return error("AddToBlockThinIndex() : %s already exists", hash.ToString().substr(0,20).c_str());
 
     // Construct new block index object
-    CBlockThinIndex* pindexNew = new CBlockThinIndex(nFile, nBlockPos, *this);
+    CBlockThinIndex* pindexNew = blockThinIndexArena.New(nFile, nBlockPos, *this);
     if (!pindexNew)
         return error("AddToBlockThinIndex() : new CBlockThinIndex failed");
 
     pindexNew->phashBlock = &hash;
-    map<uint256, CBlockThinIndex*>::iterator miPrev = mapBlockThinIndex.find(hashPrevBlock);
+    BlockThinMap::iterator miPrev = mapBlockThinIndex.find(hashPrevBlock);
     if (miPrev != mapBlockThinIndex.end())
     {
         pindexNew->pprev = (*miPrev).second;
         pindexNew->nHeight = pindexNew->pprev->nHeight + 1;
+        pindexNew->BuildSkip();
     };
 
     // Record proof hash value
@@ -1489,7 +1634,7 @@ bool CBlockThin::AddToBlockThinIndex(unsigned int nFile, unsigned int nBlockPos,
     pindexNew->SetStakeModifier(nStakeModifier, fGeneratedStakeModifier);
 
     // Add to mapBlockThinIndex
-    std::map<uint256, CBlockThinIndex*>::iterator mi = mapBlockThinIndex.insert(make_pair(hash, pindexNew)).first;
+    BlockThinMap::iterator mi = mapBlockThinIndex.insert(make_pair(hash, pindexNew)).first;
     //if (pindexNew->IsProofOfStake())
     //    setStakeSeen.insert(make_pair(pindexNew->prevoutStake, pindexNew->nStakeTime));
     pindexNew->phashBlock = &((*mi).first);
@@ -1521,11 +1666,11 @@ bool CBlockThin::AddToBlockThinIndex(unsigned int nFile, unsigned int nBlockPos,
         pindexRear = pindexRear->pnext;
         pindexRear->pprev = NULL;
 
-        std::map<uint256, CBlockThinIndex*>::iterator mi = mapBlockThinIndex.find(*pRemHash);
+        BlockThinMap::iterator mi = mapBlockThinIndex.find(*pRemHash);
 
         if (mi != mapBlockThinIndex.end())
         {
-            delete mi->second;
+            blockThinIndexArena.Delete(mi->second);
             mapBlockThinIndex.erase(mi);
         };
     };
@@ -1723,9 +1868,9 @@ bool CBlockThin::SetBestThinChain(CTxDB& txdb, CBlockThinIndex* pindexNew)
     // New best block
     hashBestChain = hash;
     pindexBestHeader = pindexNew;
-    //pblockindexFBBHLast = NULL;
     nBestHeight = pindexBestHeader->nHeight;
     nBestChainTrust = pindexBestHeader->nChainTrust;
+    ::SetBestTip(nBestHeight, hashBestChain);
     nTimeBestReceived = GetTime();
     mempool.AddTransactionsUpdated(1);
 
@@ -1757,28 +1902,28 @@ bool CBlockThin::SetBestThinChain(CTxDB& txdb, CBlockThinIndex* pindexNew)
 //
 // CBlock and CBlockIndex
 //
-static CBlockIndex* pblockindexFBBHLast;
-CBlockIndex* FindBlockByHeight(int nHeight)
+void CBlockIndex::BuildSkip()
 {
-    CBlockIndex *pblockindex;
-    if (nHeight < nBestHeight / 2)
-        pblockindex = pindexGenesisBlock;
-    else
-        pblockindex = pindexBest;
-    if (pblockindexFBBHLast && abs(nHeight - pblockindex->nHeight) > abs(nHeight - pblockindexFBBHLast->nHeight))
-        pblockindex = pblockindexFBBHLast;
+    if (pprev)
+        pskip = pprev->GetAncestor(GetSkipHeight(nHeight));
+}
 
-    while (pblockindex->pprev && pblockindex->nHeight > nHeight)
-        pblockindex = pblockindex->pprev;
+CBlockIndex* CBlockIndex::GetAncestor(int nHeightIn)
+{
+    return GetAncestorOf(this, nHeightIn);
+}
 
-    while (pblockindex->pnext && pblockindex->nHeight < nHeight)
-        pblockindex = pblockindex->pnext;
+const CBlockIndex* CBlockIndex::GetAncestor(int nHeightIn) const
+{
+    return GetAncestorOf(this, nHeightIn);
+}
 
-    if (pblockindex->nHeight != nHeight)
+CBlockIndex* FindBlockByHeight(int nHeight)
+{
+    if (!pindexBest)
         return NULL;
 
-    pblockindexFBBHLast = pblockindex;
-    return pblockindex;
+    return pindexBest->GetAncestor(nHeight);
 }
 
 bool CBlock::ReadFromDisk(const CBlockIndex* pindex, bool fReadTransactions)
@@ -2075,7 +2220,7 @@ void static InvalidChainFound(CBlockIndex* pindexNew)
       nBestBlockTrust.Get64(),
       DateTimeStrFormat("%x %H:%M:%S", pindexBest->GetBlockTime()).c_str());
 
-    pwalletMain->CacheAnonStats(nBestHeight);
+    pwalletMain->CacheAnonStats(nBestHeight, hashBestChain);
 }
 
 
@@ -2225,7 +2370,8 @@ bool CTransaction::FetchInputs(CTxDB& txdb, const map<uint256, CTxIndex>& mapTes
     return true;
 }
 
-bool CTransaction::CheckAnonInputAB(CTxDB &txdb, const CTxIn &txin, int i, int nRingSize, const std::vector<uint8_t> &vchImage, int64_t &nCoinValue) const
+bool CTransaction::CheckAnonInputAB(CTxDB &txdb, const CTxIn &txin, int i, int nRingSize, const std::vector<uint8_t> &vchImage, int64_t &nCoinValue,
+                                    CRingSigBatch *pRingSigBatch) const
 {
     const CScript &s = txin.scriptSig;
 
@@ -2283,6 +2429,13 @@ bool CTransaction::CheckAnonInputAB(CTxDB &txdb, const CTxIn &txin, int i, int n
                       GetHash().ToString(), i, ri, ao.nValue, ao.nBlockHeight, nCompromisedHeight);
     };
 
+    if (pRingSigBatch)
+    {
+        // - verified with the rest of the block in ConnectBlock
+        pRingSigBatch->Add(vchImage, nRingSize, pPubkeys, pSigC, pSigS, GetHash(), i);
+        return true;
+    };
+
     if (verifyRingSignatureAB(vchImage, nRingSize, pPubkeys, pSigC, pSigS) != 0)
     {
         LogPrintf("CheckAnonInputsAB(): Error input %d verifyRingSignatureAB() failed.\n", i);
@@ -2292,7 +2445,7 @@ bool CTransaction::CheckAnonInputAB(CTxDB &txdb, const CTxIn &txin, int i, int n
     return true;
 };
 
-bool CTransaction::CheckAnonInputs(CTxDB& txdb, int64_t& nSumValue, bool& fInvalid, bool fCheckExists)
+bool CTransaction::CheckAnonInputs(CTxDB& txdb, int64_t& nSumValue, bool& fInvalid, bool fCheckExists, CRingSigBatch *pRingSigBatch)
 {
     AssertLockHeld(cs_main);
     // - fCheckExists should only run for anonInputs entering this node
@@ -2362,7 +2515,7 @@ bool CTransaction::CheckAnonInputs(CTxDB& txdb, int64_t& nSumValue, bool& fInval
         if (nRingSize > 1 && s.size() == 2 + EC_SECRET_SIZE + (EC_SECRET_SIZE + EC_COMPRESSED_SIZE) * nRingSize)
         {
             // ringsig AB
-            if (!CheckAnonInputAB(txdb, txin, i, nRingSize, vchImage, nCoinValue))
+            if (!CheckAnonInputAB(txdb, txin, i, nRingSize, vchImage, nCoinValue, pRingSigBatch))
             {
                 fInvalid = true; return false;
             };
@@ -2410,6 +2563,10 @@ bool CTransaction::CheckAnonInputs(CTxDB& txdb, int64_t& nSumValue, bool& fInval
                 };
             };
 
+            if (pRingSigBatch)
+            {
+                pRingSigBatch->AddLegacy(vchImage, preimage, nRingSize, pPubkeys, pSigc, pSigr, txnHash, i);
+            } else
             if (verifyRingSignature(vchImage, preimage, nRingSize, pPubkeys, pSigc, pSigr) != 0)
             {
                 LogPrintf("CheckAnonInputs(): Error input %d verifyRingSignature() failed.\n", i);
@@ -2473,7 +2630,7 @@ unsigned int CTransaction::GetP2SHSigOpCount(const MapPrevTx& inputs) const
 }
 
 bool CTransaction::ConnectInputs(CTxDB& txdb, MapPrevTx inputs, map<uint256, CTxIndex>& mapTestPool, const CDiskTxPos& posThisTx,
-    const CBlockIndex* pindexBlock, bool fBlock, bool fMiner, unsigned int flags)
+    const CBlockIndex* pindexBlock, bool fBlock, bool fMiner, unsigned int flags, CRingSigBatch *pRingSigBatch, std::vector<CScriptCheck> *pvChecks)
 {
     // Take over previous transactions' spent pointers
     // fBlock is true when this is called from AcceptBlock when a new best-block is added to the blockchain
@@ -2545,8 +2702,14 @@ bool CTransaction::ConnectInputs(CTxDB& txdb, MapPrevTx inputs, map<uint256, CTx
             // still computed and checked, and any change will be caught at the next checkpoint.
             if (!(fBlock && (nBestHeight < Checkpoints::GetTotalBlocksEstimate())))
             {
-                // Verify signature
-                if (!VerifySignature(txPrev, *this, i, flags, 0))
+                if (pvChecks)
+                {
+                    // verified by the script check threads, see ConnectBlock
+                    if (prevout.hash != txPrev.GetHash())
+                        return DoS(100, error("ConnectInputs() : %s prev tx hash mismatch", GetHash().ToString()));
+                    pvChecks->push_back(CScriptCheck(txPrev, *this, i, flags, 0));
+                } else
+                if (!VerifySignature(txPrev, *this, i, flags, 0)) // Verify signature
                 {
                     if (flags & STANDARD_NOT_MANDATORY_VERIFY_FLAGS) {
                         // Check whether the failure was caused by a
@@ -2583,7 +2746,7 @@ bool CTransaction::ConnectInputs(CTxDB& txdb, MapPrevTx inputs, map<uint256, CTx
         {
             int64_t nSumAnon;
             bool fInvalid;
-            if (!CheckAnonInputs(txdb, nSumAnon, fInvalid, true))
+            if (!CheckAnonInputs(txdb, nSumAnon, fInvalid, true, pRingSigBatch))
             {
                 if (fInvalid)
                     return DoS(100, error("ConnectInputs() : CheckAnonInputs found invalid tx %s", GetHash().ToString().substr(0,10).c_str()));
@@ -2640,45 +2803,70 @@ bool CBlock::DisconnectBlock(CTxDB& txdb, CBlockIndex* pindex)
         SyncWithWallets(tx, this, false, false);
 
     if (!pwalletMain->RemoveAnonStats(txdb, pindex->nHeight))
-        return error("DiconnectBlock() : RemoveAnonStats failed.");
+        return error("DisconnectBlock() : RemoveAnonStats failed.");
+    if (!pwalletMain->WriteAnonStats(txdb, hashPrevBlock))
+        return error("DisconnectBlock() : WriteAnonStats failed.");
 
     return true;
 }
 
-void static validateAnonCache(int nBlockHeight)
+bool static validateAnonCache(int nBlockHeight)
 {
     // -- validate cache against persisted data
     std::list<CAnonOutputCount> lOutputCounts;
     if (pwalletMain->CountAllAnonOutputs(lOutputCounts, nBlockHeight) != 0)
     {
         LogPrintf("RemoveAnonStats(%d) Error: CountAllAnonOutputs() failed.\n", nBlockHeight);
+        return false;
     };
+    bool fValid = true;
     for (const auto & anonOutputStat : lOutputCounts)
     {
         if (mapAnonOutputStats[anonOutputStat.nValue].nExists != anonOutputStat.nExists)
+        {
             LogPrintf("ConnectBlock(%d) [%d] Cache Stale: nExists cache %d <> %d persisted.\n",
                       nBestHeight, anonOutputStat.nValue, mapAnonOutputStats[anonOutputStat.nValue].nExists, anonOutputStat.nExists);
+            fValid = false;
+        };
         if (mapAnonOutputStats[anonOutputStat.nValue].nSpends != anonOutputStat.nSpends)
+        {
             LogPrintf("ConnectBlock(%d) [%d] Cache Stale: nSpends cache %d <> %d persisted.\n",
                       nBestHeight, anonOutputStat.nValue, mapAnonOutputStats[anonOutputStat.nValue].nSpends, anonOutputStat.nSpends);
+            fValid = false;
+        };
         if (mapAnonOutputStats[anonOutputStat.nValue].nMature != anonOutputStat.nMature)
+        {
             LogPrintf("ConnectBlock(%d) [%d] Cache Stale: nMature cache %d <> %d persisted.\n",
                       nBestHeight, anonOutputStat.nValue, mapAnonOutputStats[anonOutputStat.nValue].nMature, anonOutputStat.nMature);
+            fValid = false;
+        };
         if (mapAnonOutputStats[anonOutputStat.nValue].nMixins != anonOutputStat.nMixins)
+        {
             LogPrintf("ConnectBlock(%d) [%d] Cache Stale: nMixins cache %d <> %d persisted.\n",
                       nBestHeight, anonOutputStat.nValue, mapAnonOutputStats[anonOutputStat.nValue].nMixins, anonOutputStat.nMixins);
+            fValid = false;
+        };
         if (mapAnonOutputStats[anonOutputStat.nValue].nMixinsStaking != anonOutputStat.nMixinsStaking)
+        {
             LogPrintf("ConnectBlock(%d) [%d] Cache Stale: nMixinsStaking cache %d <> %d persisted.\n",
                       nBestHeight, anonOutputStat.nValue, mapAnonOutputStats[anonOutputStat.nValue].nMixinsStaking, anonOutputStat.nMixinsStaking);
+            fValid = false;
+        };
     }
+    return fValid;
 }
 
 bool CBlock::ConnectBlock(CTxDB& txdb, CBlockIndex* pindex, bool fJustCheck)
 {
+    int64_t nStart = GetTimeMicros();
+
     // Check it again in case a previous version let a bad block in, but skip BlockSig checking
     if (!CheckBlock(!fJustCheck, !fJustCheck, false))
         return false;
 
+    int64_t nTimeChecked = GetTimeMicros();
+    blockTimings.nRecheckBlock += nTimeChecked - nStart;
+
     unsigned int flags = SCRIPT_VERIFY_NOCACHE;
 
     if (Params().IsProtocolV3(pindex->nHeight))
@@ -2703,13 +2891,17 @@ bool CBlock::ConnectBlock(CTxDB& txdb, CBlockIndex* pindex, bool fJustCheck)
     if (fStaleAnonCache)
     {
         LogPrintf("ConnectBlock() : Stale anon cache => rebuild.\n");
-        if (!pwalletMain->CacheAnonStats(pindex->pprev->nHeight))
+        if (!pwalletMain->CacheAnonStats(pindex->pprev->nHeight, pindex->pprev->GetBlockHash()))
             LogPrintf("CacheAnonStats() failed.\n");
     }
     if (fDebugRingSig)
         validateAnonCache(pindex->pprev->nHeight);
 
     map<uint256, CTxIndex> mapQueuedChanges;
+    CRingSigBatch ringSigBatch;
+    CCheckQueueControl<CAnonInputCheck> control(nScriptCheckThreads > 0 ? &anonInputCheckQueue : NULL);
+    CCheckQueueControl<CScriptCheck> scriptControl(nScriptCheckThreads > 0 ? &scriptCheckQueue : NULL);
+    std::vector<CScriptCheck> vScriptChecks; // kept to find the failing input
     int64_t nFees = 0;
     int64_t nAnonIn = 0;
     int64_t nAnonOut = 0;
@@ -2755,8 +2947,11 @@ bool CBlock::ConnectBlock(CTxDB& txdb, CBlockIndex* pindex, bool fJustCheck)
         else
         {
             bool fInvalid;
+            int64_t nTimeTx = GetTimeMicros();
             if (!tx.FetchInputs(txdb, mapQueuedChanges, true, false, mapInputs, fInvalid))
                 return false;
+            int64_t nTimeFetched = GetTimeMicros();
+            blockTimings.nFetchInputs += nTimeFetched - nTimeTx;
 
             // Add in sigops done by pay-to-script-hash inputs;
             // this is to prevent a "rogue miner" from creating
@@ -2776,12 +2971,13 @@ bool CBlock::ConnectBlock(CTxDB& txdb, CBlockIndex* pindex, bool fJustCheck)
                     if (txout.IsAnonOutput())
                         nAnonOut += txout.nValue;
 
-                if (!tx.CheckAnonInputs(txdb, nTxAnonIn, fInvalid, true))
+                if (!tx.CheckAnonInputs(txdb, nTxAnonIn, fInvalid, true, &ringSigBatch))
                 {
                     if (fInvalid)
                         return error("ConnectBlock() : CheckAnonInputs found invalid tx %s", tx.GetHash().ToString().substr(0,10).c_str());
                     return false;
                 }
+                blockTimings.nAnonInputs += GetTimeMicros() - nTimeFetched;
 
                 nAnonIn += nTxAnonIn;
                 nTxValueIn += nTxAnonIn;
@@ -2796,13 +2992,48 @@ bool CBlock::ConnectBlock(CTxDB& txdb, CBlockIndex* pindex, bool fJustCheck)
             if (tx.IsCoinStake())
                 nStakeReward = nTxValueOut - nTxValueIn;
 
-            if (!tx.ConnectInputs(txdb, mapInputs, mapQueuedChanges, posThisTx, pindex, true, false, flags))
+            int64_t nTimeConnect = GetTimeMicros();
+            std::vector<CScriptCheck> vChecks;
+            if (!tx.ConnectInputs(txdb, mapInputs, mapQueuedChanges, posThisTx, pindex, true, false, flags, &ringSigBatch,
+                                  nScriptCheckThreads > 0 ? &vChecks : NULL))
                 return false;
+            if (!vChecks.empty())
+            {
+                vScriptChecks.insert(vScriptChecks.end(), vChecks.begin(), vChecks.end());
+                scriptControl.Add(vChecks);
+            };
+            blockTimings.nConnectInputs += GetTimeMicros() - nTimeConnect;
+
+            // hand the rings of this txn to the workers while the next one is read from the db
+            if (nScriptCheckThreads > 0
+                && !ringSigBatch.empty())
+                QueueAnonInputChecks(ringSigBatch, control);
         }
 
         mapQueuedChanges[hashTx] = CTxIndex(posThisTx, tx.vout.size());
     }
 
+    int64_t nTimeScripts = GetTimeMicros();
+    if (!scriptControl.Wait())
+    {
+        const CScriptCheck *pcheck = FirstFailedScriptCheck(vScriptChecks);
+        if (!pcheck)
+            return DoS(100, error("ConnectBlock() : script verification failed"));
+
+        std::string strTx = pcheck->GetTx()->GetHash().ToString();
+        if ((flags & STANDARD_NOT_MANDATORY_VERIFY_FLAGS)
+            && pcheck->Verify(flags & ~STANDARD_NOT_MANDATORY_VERIFY_FLAGS))
+            return error("ConnectBlock() : %s input %u non-mandatory VerifySignature failed", strTx, pcheck->GetInput());
+        return DoS(100, error("ConnectBlock() : %s input %u VerifySignature failed", strTx, pcheck->GetInput()));
+    };
+    blockTimings.nConnectInputs += GetTimeMicros() - nTimeScripts;
+
+    int64_t nTimeRingSigs = GetTimeMicros();
+    if (!QueueAnonInputChecks(ringSigBatch, control)
+        || !control.Wait())
+        return DoS(100, error("ConnectBlock() : ring signature verification failed"));
+    blockTimings.nRingSigs += GetTimeMicros() - nTimeRingSigs;
+
     if (IsProofOfWork())
     {
         int64_t nReward = Params().GetProofOfWorkReward(pindex->nHeight, nFees);
@@ -2877,12 +3108,19 @@ bool CBlock::ConnectBlock(CTxDB& txdb, CBlockIndex* pindex, bool fJustCheck)
     }
 
     // Watch for transactions paying to me
+    int64_t nTimeSync = GetTimeMicros();
     BOOST_FOREACH(CTransaction& tx, vtx)
         SyncWithWallets(tx, this, true); // calls ProcessAnonTransaction() which persists anons also in txDB
 
     // Update anon cache with stats of connected block (added in ProcessAnonTransaction())
     if (!pwalletMain->UpdateAnonStats(txdb, pindex->nHeight))
         return error("ConnectBlock() : UpdateAnonStats failed.");
+    if (!pwalletMain->WriteAnonStats(txdb, pindex->GetBlockHash()))
+        return error("ConnectBlock() : WriteAnonStats failed.");
+    blockTimings.nWalletSync += GetTimeMicros() - nTimeSync;
+
+    blockTimings.nBlocks++;
+    blockTimings.nTx += vtx.size();
 
     return true;
 }
@@ -2896,9 +3134,9 @@ bool static Reorganize(CTxDB& txdb, CBlockIndex* pindexNew)
     CBlockIndex* plonger = pindexNew;
     while (pfork != plonger)
     {
-        while (plonger->nHeight > pfork->nHeight)
-            if (!(plonger = plonger->pprev))
-                return error("Reorganize() : plonger->pprev is null");
+        if (plonger->nHeight > pfork->nHeight
+            && !(plonger = plonger->GetAncestor(pfork->nHeight)))
+            return error("Reorganize() : plonger->pprev is null");
         if (pfork == plonger)
             break;
         if (!(pfork = pfork->pprev))
@@ -3000,8 +3238,10 @@ bool CBlock::SetBestChainInner(CTxDB& txdb, CBlockIndex *pindexNew)
         InvalidChainFound(pindexNew);
         return false;
     }
+    int64_t nTimeCommit = GetTimeMicros();
     if (!txdb.TxnCommit())
         return error("SetBestChain() : TxnCommit failed");
+    blockTimings.nTxDBCommit += GetTimeMicros() - nTimeCommit;
 
     // Add to current best branch
     pindexNew->pprev->pnext = pindexNew;
@@ -3089,9 +3329,9 @@ bool CBlock::SetBestChain(CTxDB& txdb, CBlockIndex* pindexNew)
     // New best block
     hashBestChain = hash;
     pindexBest = pindexNew;
-    pblockindexFBBHLast = NULL;
     nBestHeight = pindexBest->nHeight;
     nBestChainTrust = pindexNew->nChainTrust;
+    ::SetBestTip(nBestHeight, hashBestChain);
     nTimeBestReceived = GetTime();
     mempool.AddTransactionsUpdated(1);
     chainActive.SetTip(pindexNew);
@@ -3099,7 +3339,7 @@ bool CBlock::SetBestChain(CTxDB& txdb, CBlockIndex* pindexNew)
     if (fStaleAnonCache)
     {
         LogPrintf("SetBestChain() : Stale anon cache => rebuild.\n");
-        if (!pwalletMain->CacheAnonStats(nBestHeight))
+        if (!pwalletMain->CacheAnonStats(nBestHeight, hashBestChain))
             LogPrintf("CacheAnonStats() failed.\n");
     }
 
@@ -3148,7 +3388,7 @@ std::pair<int, int> CMerkleTx::GetDepthAndHeightInMainChainINTERNAL(CBlockIndex*
     AssertLockHeld(cs_main);
 
     // Find the block it claims to be in
-    map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(hashBlock);
+    BlockMap::iterator mi = mapBlockIndex.find(hashBlock);
     if (mi == mapBlockIndex.end())
         return std::make_pair(0, -1);
     CBlockIndex* pindex = (*mi).second;
@@ -3186,7 +3426,7 @@ std::pair<int, int> CMerkleTx::GetDepthAndHeightInMainChainINTERNAL(CBlockThinIn
     AssertLockHeld(cs_main);
 
     // Find the block it claims to be in
-    map<uint256, CBlockThinIndex*>::iterator mi = mapBlockThinIndex.find(hashBlock);
+    BlockThinMap::iterator mi = mapBlockThinIndex.find(hashBlock);
     if (mi == mapBlockThinIndex.end())
     {
         pindexRet = NULL;
@@ -3507,16 +3747,17 @@ bool CBlock::AddToBlockIndex(unsigned int nFile, unsigned int nBlockPos, const u
         return error("AddToBlockIndex() : %s already exists", hash.ToString());
 
     // Construct new block index object
-    CBlockIndex* pindexNew = new CBlockIndex(nFile, nBlockPos, *this);
+    CBlockIndex* pindexNew = blockIndexArena.New(nFile, nBlockPos, *this);
     if (!pindexNew)
         return error("AddToBlockIndex() : new CBlockIndex failed");
 
     pindexNew->phashBlock = &hash;
-    map<uint256, CBlockIndex*>::iterator miPrev = mapBlockIndex.find(hashPrevBlock);
+    BlockMap::iterator miPrev = mapBlockIndex.find(hashPrevBlock);
     if (miPrev != mapBlockIndex.end())
     {
         pindexNew->pprev = (*miPrev).second;
         pindexNew->nHeight = pindexNew->pprev->nHeight + 1;
+        pindexNew->BuildSkip();
     }
 
     // ppcoin: compute chain trust score
@@ -3539,7 +3780,7 @@ bool CBlock::AddToBlockIndex(unsigned int nFile, unsigned int nBlockPos, const u
     pindexNew->bnStakeModifierV2 = ComputeStakeModifierV2(pindexNew->pprev, IsProofOfWork() ? hash : vtx[1].vin[0].prevout.hash);
 
     // Add to mapBlockIndex
-    map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.insert(make_pair(hash, pindexNew)).first;
+    BlockMap::iterator mi = mapBlockIndex.insert(make_pair(hash, pindexNew)).first;
     if (pindexNew->IsProofOfStake())
         setStakeSeen.insert(make_pair(pindexNew->prevoutStake, pindexNew->nStakeTime));
     pindexNew->phashBlock = &((*mi).first);
@@ -3673,7 +3914,7 @@ bool CBlock::AcceptBlock()
         return error("AcceptBlock() : block already in mapBlockIndex");
 
     // Get prev block index
-    map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(hashPrevBlock);
+    BlockMap::iterator mi = mapBlockIndex.find(hashPrevBlock);
     if (mi == mapBlockIndex.end())
         return DoS(10, error("AcceptBlock() : prev block not found"));
     CBlockIndex* pindexPrev = (*mi).second;
@@ -3859,10 +4100,21 @@ void CChain::SetTip(CBlockIndex *pindex) {
 }
 
 
+static bool ProcessBlockInner(CNode* pfrom, CBlock* pblock, uint256& hash);
+
 bool ProcessBlock(CNode* pfrom, CBlock* pblock, uint256& hash)
 {
     AssertLockHeld(cs_main);
 
+    int64_t nStart = GetTimeMicros();
+    bool fRet = ProcessBlockInner(pfrom, pblock, hash);
+    blockTimings.nProcessBlock += GetTimeMicros() - nStart;
+
+    return fRet;
+}
+
+static bool ProcessBlockInner(CNode* pfrom, CBlock* pblock, uint256& hash)
+{
     // Check for duplicate
     //uint256 hash = pblock->GetHash();
     std::string strHash = fDebug ? hash.ToString() : hash.ToString().substr(0,20);
@@ -3892,8 +4144,10 @@ bool ProcessBlock(CNode* pfrom, CBlock* pblock, uint256& hash)
     }
 
     // Preliminary checks
+    int64_t nTimeCheck = GetTimeMicros();
     if (!pblock->CheckBlock())
         return error("ProcessBlock() : CheckBlock FAILED");
+    blockTimings.nCheckBlock += GetTimeMicros() - nTimeCheck;
 
     // If don't already have its previous block, shunt it off to holding area until we get it
     if (!mapBlockIndex.count(pblock->hashPrevBlock)) // || pblock->hashPrevBlock != hashBestChain)
@@ -4192,7 +4446,7 @@ bool CBlock::GetHashProof(uint256& hashProof)
     };
 
     // Get prev block index
-    map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(hashPrevBlock);
+    BlockMap::iterator mi = mapBlockIndex.find(hashPrevBlock);
     if (mi == mapBlockIndex.end())
         return DoS(10, error("GetHashProof() : prev block not found"));
     CBlockIndex* pindexPrev = (*mi).second;
@@ -4275,6 +4529,28 @@ FILE* AppendBlockFile(bool fHeaderFile, unsigned int& nFileRet, const char* fmod
 }
 
 
+template<typename M, typename T>
+static void LogIndexMemoryUsage(const char *pszName, const M &map, const CArena<T> &arena)
+{
+    // - a hash map node is the entry and the bucket link, the std::map node
+    //   the block index was in before had three links and the colour, and
+    //   each entry was a heap block of its own
+    size_t nMap = map.bucket_count() * sizeof(void*) + map.size() * MallocUsage(sizeof(void*) + sizeof(typename M::value_type));
+    size_t nTree = map.size() * (MallocUsage(4 * sizeof(void*) + sizeof(typename M::value_type)) + MallocUsage(sizeof(T)));
+    LogPrintf("%s: %u entries, %u KiB in the map, %u KiB in the arena, ~%u KiB as std::map of heap entries.\n",
+        pszName, map.size(), nMap / 1024, arena.DynamicUsage() / 1024, nTree / 1024);
+}
+
+void LogBlockIndexMemoryUsage()
+{
+    AssertLockHeld(cs_main);
+
+    if (nNodeMode == NT_FULL)
+        LogIndexMemoryUsage("mapBlockIndex", mapBlockIndex, blockIndexArena);
+    else
+        LogIndexMemoryUsage("mapBlockThinIndex", mapBlockThinIndex, blockThinIndexArena);
+}
+
 int LoadBlockIndex(bool fAllowNew, std::function<void (const unsigned mode, const uint32_t&)> funcProgress)
 {
     LOCK(cs_main);
@@ -4290,6 +4566,10 @@ int LoadBlockIndex(bool fAllowNew, std::function<void (const unsigned mode, cons
 
     if (nNodeMode == NT_FULL)
     {
+        // -- databases from before the anon output index get it built once
+        if (!txdb.BuildAnonOutputIndex())
+            return 1;
+
         int res = 1;
         if (!txdb.LoadBlockIndex([&res] (const CBlockIndex* const pBlockIndex) -> bool {
                     // Check that the block matches the known checkpoint blocks
@@ -4303,7 +4583,15 @@ int LoadBlockIndex(bool fAllowNew, std::function<void (const unsigned mode, cons
             }, funcProgress))
             return res;
 
-        if (!pwalletMain->CacheAnonStats(nBestHeight, [] (const unsigned mode, const uint32_t& nOutpus) -> void {
+        // -- the anon stats persisted with the best block save the recount, -verifyanonstats recounts to check them
+        bool fLoadedAnonStats = pwalletMain->LoadAnonStats(txdb, nBestHeight, hashBestChain);
+        if (fLoadedAnonStats && GetBoolArg("-verifyanonstats", false) && !validateAnonCache(nBestHeight))
+        {
+            LogPrintf("LoadBlockIndex() : Persisted anon stats differ from the recount => rebuild.\n");
+            fLoadedAnonStats = false;
+        };
+        if (!fLoadedAnonStats
+            && !pwalletMain->CacheAnonStats(nBestHeight, hashBestChain, [] (const unsigned mode, const uint32_t& nOutpus) -> void {
                                             if (mode == 0)
                                                 uiInterface.InitMessage(strprintf(_("Read ATXOs... (%d)"), nOutpus));
                                             else
@@ -4354,6 +4642,8 @@ int LoadBlockIndex(bool fAllowNew, std::function<void (const unsigned mode, cons
 
     }
 
+    LogBlockIndexMemoryUsage();
+
     return tryReindex ? 2 : 0;
 }
 
@@ -4364,7 +4654,7 @@ void PrintBlockTree()
     AssertLockHeld(cs_main);
     // pre-compute tree structure
     map<CBlockIndex*, vector<CBlockIndex*> > mapNext;
-    for (map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.begin(); mi != mapBlockIndex.end(); ++mi)
+    for (BlockMap::iterator mi = mapBlockIndex.begin(); mi != mapBlockIndex.end(); ++mi)
     {
         CBlockIndex* pindex = (*mi).second;
         mapNext[pindex->pprev].push_back(pindex);
@@ -4488,10 +4778,13 @@ bool LoadExternalBlockFile(int nFile, FILE* fileIn, std::function<void (const ui
                 blkdat >> nSize;
                 if (nSize > 0 && nSize <= MAX_BLOCK_SIZE)
                 {
+                    int64_t nTimeRead = GetTimeMicros();
                     CBlock block;
-                    blkdat >> block;
+                    ReadBlockRecord(blkdat, 0, block);
                     uint256 hashblock = block.GetHash();
+                    int64_t nTimeReadEnd = GetTimeMicros();
                     LOCK(cs_main);
+                    blockTimings.nDeserialize += nTimeReadEnd - nTimeRead;
                     if (ProcessBlock(NULL, &block, hashblock))
                     {
                         uint256 hashProof;
@@ -4519,6 +4812,31 @@ bool LoadExternalBlockFile(int nFile, FILE* fileIn, std::function<void (const ui
     return nLoaded > 0;
 }
 
+void CBlockTimings::Log() const
+{
+    if (nBlocks == 0)
+        return;
+
+    // - phases are cumulative, ProcessBlock includes everything but deserialize
+    double fBlocks = nBlocks;
+    auto LogPhase = [fBlocks](const char *pszPhase, int64_t nMicros)
+    {
+        LogPrintf("  %-14s %10.2fms %8.3fms/blk\n", pszPhase, nMicros * 0.001, nMicros * 0.001 / fBlocks);
+    };
+
+    LogPrintf("Block validation timings, %d blocks, %d transactions:\n", nBlocks, nTx);
+    LogPhase("deserialize", nDeserialize);
+    LogPhase("processblock", nProcessBlock);
+    LogPhase("checkblock", nCheckBlock);
+    LogPhase("recheckblock", nRecheckBlock);
+    LogPhase("fetchinputs", nFetchInputs);
+    LogPhase("anoninputs", nAnonInputs);
+    LogPhase("scripts", nConnectInputs);
+    LogPhase("ringsigs", nRingSigs);
+    LogPhase("txdbcommit", nTxDBCommit);
+    LogPhase("walletsync", nWalletSync);
+}
+
 struct CImportingNow
 {
     CImportingNow() {
@@ -4537,6 +4855,12 @@ void ThreadImport(std::vector<boost::filesystem::path> vImportFiles)
     RenameThread("alias-loadblk");
     CImportingNow imp;
 
+    if (!vImportFiles.empty())
+    {
+        LOCK(cs_main);
+        blockTimings.SetNull();
+    };
+
     // -loadblock=
     BOOST_FOREACH(boost::filesystem::path &path, vImportFiles) {
         FILE *file = fopen(path.string().c_str(), "rb");
@@ -4562,6 +4886,12 @@ void ThreadImport(std::vector<boost::filesystem::path> vImportFiles)
         }
     }
 
+    if (!vImportFiles.empty())
+    {
+        LOCK(cs_main);
+        blockTimings.Log();
+    };
+
     if (GetBoolArg("-stopafterblockimport", false)) {
         LogPrintf("Stopping after block import\n");
         StartShutdown();
@@ -4716,7 +5046,7 @@ static void ProcessGetData(CNode* pfrom)
             bool send = false;
             CBlockIndex *pBlockIndex;
 
-            std::map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(inv.hash);
+            BlockMap::iterator mi = mapBlockIndex.find(inv.hash);
 
             if (mi != mapBlockIndex.end())
             {
@@ -4930,7 +5260,7 @@ static int ProcessMerkleBlock(CNode* pfrom, CMerkleBlockIncoming& merkleBlock, s
     bool fAlloc = false;
 
     CBlockThinIndex *pBlockThinIndex = NULL;
-    std::map<uint256, CBlockThinIndex*>::iterator mi = mapBlockThinIndex.find(hashBlock);
+    BlockThinMap::iterator mi = mapBlockThinIndex.find(hashBlock);
 
     if (mi != mapBlockThinIndex.end())
     {
@@ -5670,7 +6000,7 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
         if (locator.IsNull())
         {
             // If locator is null, return the hashStop block
-            map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(hashStop);
+            BlockMap::iterator mi = mapBlockIndex.find(hashStop);
             if (mi == mapBlockIndex.end())
                 return true;
             pindex = (*mi).second;
@@ -6700,7 +7030,7 @@ bool SendMessages(CNode* pto, std::vector<CNode*> &vNodesCopy, bool fSendTrickle
                     if (fDebugNet)
                         LogPrintf("Timeout: Re-requesting chunk, starting from %s\n", it->startHash.ToString().c_str());
 
-                    std::map<uint256, CBlockThinIndex*>::iterator mi = mapBlockThinIndex.find(it->startHash);
+                    BlockThinMap::iterator mi = mapBlockThinIndex.find(it->startHash);
 
                     if (mi != mapBlockThinIndex.end())
                     {
@@ -13,6 +13,8 @@
 #endif
 
 #include "core.h"
+#include "blockfile.h"
+#include "checkqueue.h"
 #include "bignum.h"
 #include "sync.h"
 #include "txmempool.h"
@@ -20,6 +22,8 @@
 #include "script.h"
 #include "scrypt.h"
 #include "state.h"
+#include "arena.h"
+#include "blockmap.h"
 
 #include <list>
 
@@ -34,6 +38,7 @@ class CBlockThinIndex;
 class CChain;
 class CKeyItem;
 class CReserveKey;
+class CScriptCheck;
 
 class CAddress;
 class CInv;
@@ -46,6 +51,8 @@ static const unsigned int MAX_BLOCK_SIGOPS = MAX_BLOCK_SIZE/50;
 static const unsigned int MAX_ORPHAN_TRANSACTIONS = MAX_BLOCK_SIZE/100;
 /** Default for -maxorphanblocksmib, maximum number of memory to keep orphan blocks */
 static const unsigned int DEFAULT_MAX_ORPHAN_BLOCKS = 40;
+/** Maximum number of signature check threads, -par */
+static const int MAX_SCRIPTCHECK_THREADS = 16;
 static const unsigned int MAX_INV_SZ = 50000;
 static const unsigned int MAX_GETHEADERS_SZ = 2000;
 
@@ -81,8 +88,8 @@ inline std::pair<uint32_t, uint32_t> GetRingSizeMinMax(int64_t nTime = 0) {
 extern CScript COINBASE_FLAGS;
 extern CCriticalSection cs_main;
 extern CChain chainActive;
-extern std::map<uint256, CBlockIndex*> mapBlockIndex;
-extern std::map<uint256, CBlockThinIndex*> mapBlockThinIndex;
+extern BlockMap mapBlockIndex;
+extern BlockThinMap mapBlockThinIndex;
 extern std::set<std::pair<COutPoint, unsigned int> > setStakeSeen;
 extern std::set<std::pair<COutPoint, unsigned int> > setStakeSeenOrphan;
 extern CBlockIndex* pindexGenesisBlock;
@@ -125,10 +132,61 @@ extern std::map<int64_t, CAnonOutputCount> mapAnonOutputStats;
 
 struct CAnonBlockStat {
     uint16_t nSpends, nOutputs, nStakingOutputs, nCompromisedOutputs;
+
+    IMPLEMENT_SERIALIZE
+    (
+        READWRITE(nSpends);
+        READWRITE(nOutputs);
+        READWRITE(nStakingOutputs);
+        READWRITE(nCompromisedOutputs);
+    )
 };
 extern int nMaxAnonBlockCache;
 extern std::map<int, std::map<int64_t, CAnonBlockStat>> mapAnonBlockStats;
 
+/** Time spent in the phases of block validation in microseconds, guarded by cs_main.
+ *  Reset when a -loadblock import starts and logged when it is done, replaying a
+ *  blk0001.dat into an empty datadir measures validation without the network. */
+struct CBlockTimings
+{
+    int64_t nBlocks;
+    int64_t nTx;
+    int64_t nDeserialize;       // LoadExternalBlockFile
+    int64_t nProcessBlock;      // all of ProcessBlock, includes the phases below
+    int64_t nCheckBlock;        // ProcessBlock
+    int64_t nRecheckBlock;      // ConnectBlock, without the signature checks when fJustCheck
+    int64_t nFetchInputs;
+    int64_t nAnonInputs;        // CheckAnonInputs, ring member and key image lookups
+    int64_t nConnectInputs;     // scripts
+    int64_t nRingSigs;          // ring signatures not verified by the -par workers already
+    int64_t nTxDBCommit;
+    int64_t nWalletSync;        // SyncWithWallets and UpdateAnonStats
+
+    CBlockTimings()
+    {
+        SetNull();
+    }
+
+    void SetNull()
+    {
+        nBlocks = 0;
+        nTx = 0;
+        nDeserialize = 0;
+        nProcessBlock = 0;
+        nCheckBlock = 0;
+        nRecheckBlock = 0;
+        nFetchInputs = 0;
+        nAnonInputs = 0;
+        nConnectInputs = 0;
+        nRingSigs = 0;
+        nTxDBCommit = 0;
+        nWalletSync = 0;
+    }
+
+    void Log() const;
+};
+extern CBlockTimings blockTimings;
+
 
 extern CTxMemPool mempool;
 
@@ -138,6 +196,7 @@ extern int64_t nTransactionFee;
 extern int64_t nReserveBalance;
 extern int64_t nMinimumInputValue;
 extern bool fUseFastIndex;
+extern int nScriptCheckThreads;
 
 extern bool fEnforceCanonical;
 
@@ -164,6 +223,10 @@ bool SendMessages(CNode* pto, std::vector<CNode*> &vNodesCopy, bool fSendTrickle
 
 bool LoadExternalBlockFile(int nFile, FILE* fileIn, std::function<void (const uint32_t&)> funcProgress = nullptr);
 void ThreadImport(std::vector<boost::filesystem::path> vImportFiles);
+/** Run an instance of the anon input check thread */
+void ThreadAnonInputCheck();
+/** Run an instance of the script checking thread */
+void ThreadScriptCheck();
 
 bool CheckProofOfWork(uint256 hash, unsigned int nBits);
 unsigned int GetNextTargetRequired(const CBlockIndex* pindexLast, bool fProofOfStake);
@@ -428,16 +491,23 @@ public:
 
     bool ReadFromDisk(CDiskTxPos pos, FILE** pfileRet=NULL)
     {
+        if (pos.nTxPos < pos.nBlockPos)
+            return error("CTransaction::ReadFromDisk() : bad position %s", pos.ToString());
+
+        if (!pfileRet && ReadFromBlockFile(false, pos.nFile, pos.nBlockPos, pos.nTxPos - pos.nBlockPos, *this, SER_DISK, CLIENT_VERSION))
+            return true;
+
         CAutoFile filein = CAutoFile(OpenBlockFile(false, pos.nFile, 0, pfileRet ? "rb+" : "rb"), SER_DISK, CLIENT_VERSION);
         if (!filein)
             return error("CTransaction::ReadFromDisk() : OpenBlockFile failed");
 
         // Read transaction
-        if (fseek(filein, pos.nTxPos, SEEK_SET) != 0)
+        if (fseek(filein, pos.nBlockPos, SEEK_SET) != 0)
             return error("CTransaction::ReadFromDisk() : fseek failed");
 
         try {
-            filein >> *this;
+            if (ReadBlockRecord(filein, pos.nTxPos - pos.nBlockPos, *this) && pfileRet)
+                return error("CTransaction::ReadFromDisk() : no file position in a compressed block record");
         } catch (std::exception &e)
         {
             return error("%s() : deserialize or I/O error", __PRETTY_FUNCTION__);
@@ -508,8 +578,12 @@ public:
     bool FetchInputs(CTxDB& txdb, const std::map<uint256, CTxIndex>& mapTestPool,
                      bool fBlock, bool fMiner, MapPrevTx& inputsRet, bool& fInvalid);
 
-    bool CheckAnonInputAB(CTxDB &txdb, const CTxIn &txin, int iVin, int nRingSize, const std::vector<uint8_t> &vchImage, int64_t &nCoinValue) const;
-    bool CheckAnonInputs(CTxDB& txdb, int64_t& nSumValue, bool& fInvalid, bool fCheckExists);
+    /** Check the anon inputs of this transaction, AB ring signatures are queued
+        in pRingSigBatch instead of being verified when a batch is passed.
+     */
+    bool CheckAnonInputAB(CTxDB &txdb, const CTxIn &txin, int iVin, int nRingSize, const std::vector<uint8_t> &vchImage, int64_t &nCoinValue,
+                          CRingSigBatch *pRingSigBatch = NULL) const;
+    bool CheckAnonInputs(CTxDB& txdb, int64_t& nSumValue, bool& fInvalid, bool fCheckExists, CRingSigBatch *pRingSigBatch = NULL);
 
     /** Sanity check previous transactions, then, if all checks succeed,
         mark them as spent by this transaction.
@@ -520,11 +594,14 @@ public:
         @param[in] pindexBlock
         @param[in] fBlock	true if called from ConnectBlock
         @param[in] fMiner	true if called from CreateNewBlock
+        @param[in] pRingSigBatch	if set AB ring signatures are queued for block level verification
+        @param[out] pvChecks	if set script checks are appended instead of being run
         @return Returns true if all checks succeed
      */
     bool ConnectInputs(CTxDB& txdb, MapPrevTx inputs,
                        std::map<uint256, CTxIndex>& mapTestPool, const CDiskTxPos& posThisTx,
-                       const CBlockIndex* pindexBlock, bool fBlock, bool fMiner, unsigned int flags = STANDARD_SCRIPT_VERIFY_FLAGS);
+                       const CBlockIndex* pindexBlock, bool fBlock, bool fMiner, unsigned int flags = STANDARD_SCRIPT_VERIFY_FLAGS,
+                       CRingSigBatch *pRingSigBatch = NULL, std::vector<CScriptCheck> *pvChecks = NULL);
     bool CheckTransaction() const;
     bool GetCoinAge(CTxDB& txdb, const CBlockIndex* pindexPrev, uint64_t& nCoinAge) const;
 
@@ -536,6 +613,64 @@ protected:
 
 bool AcceptToMemoryPool(CTxMemPool &pool, CTransaction &tx, CTxDB& txdb, bool *pfMissingInputs=NULL);
 
+/** Closure representing one anon input ring signature check, the database
+ *  side of the input has already been checked by CheckAnonInputs.
+ */
+class CAnonInputCheck
+{
+private:
+    CRingSigBatch::Entry entry;
+
+public:
+    CAnonInputCheck() {}
+    CAnonInputCheck(const CRingSigBatch::Entry &entryIn) : entry(entryIn) {}
+
+    bool operator()() const;
+
+    void swap(CAnonInputCheck &check)
+    {
+        std::swap(entry, check.entry);
+    }
+};
+
+/** Closure representing one script verification.
+ *  Note that this stores references to the spending transaction, which must
+ *  outlive the check.
+ */
+class CScriptCheck
+{
+private:
+    CScript scriptPubKey;
+    const CTransaction *ptxTo;
+    unsigned int nIn;
+    unsigned int nFlags;
+    int nHashType;
+
+public:
+    CScriptCheck() : ptxTo(NULL), nIn(0), nFlags(0), nHashType(0) {}
+    CScriptCheck(const CTransaction& txFromIn, const CTransaction& txToIn, unsigned int nInIn, unsigned int nFlagsIn, int nHashTypeIn) :
+        scriptPubKey(txFromIn.vout[txToIn.vin[nInIn].prevout.n].scriptPubKey),
+        ptxTo(&txToIn), nIn(nInIn), nFlags(nFlagsIn), nHashType(nHashTypeIn) {}
+
+    bool operator()() const;
+
+    // verify with different flags, used to classify a failure
+    bool Verify(unsigned int nFlagsIn) const;
+
+    const CTransaction *GetTx() const { return ptxTo; }
+    unsigned int GetInput() const { return nIn; }
+    unsigned int GetFlags() const { return nFlags; }
+
+    void swap(CScriptCheck &check)
+    {
+        scriptPubKey.swap(check.scriptPubKey);
+        std::swap(ptxTo, check.ptxTo);
+        std::swap(nIn, check.nIn);
+        std::swap(nFlags, check.nFlags);
+        std::swap(nHashType, check.nHashType);
+    }
+};
+
 
 
 /** A transaction with a merkle branch linking it to the block chain. */
@@ -920,13 +1055,23 @@ public:
 
     bool WriteToDisk(unsigned int& nFileRet, unsigned int& nBlockPosRet)
     {
+        // Compress the block when it saves space
+        std::vector<char> vRecord;
+        if (fCompressBlocks)
+        {
+            CDataStream ssBlock(SER_DISK, CLIENT_VERSION);
+            ssBlock << *this;
+            if (!CompressBlockRecord(&ssBlock[0], ssBlock.size(), vRecord))
+                vRecord.clear();
+        };
+
         // Open history file to append
         CAutoFile fileout = CAutoFile(AppendBlockFile(false, nFileRet), SER_DISK, CLIENT_VERSION);
         if (!fileout)
             return error("CBlock::WriteToDisk() : AppendBlockFile failed");
 
         // Write index header
-        unsigned int nSize = fileout.GetSerializeSize(*this);
+        unsigned int nSize = vRecord.empty() ? fileout.GetSerializeSize(*this) : vRecord.size();
         fileout << FLATDATA(Params().MessageStart()) << nSize;
 
         // Write block
@@ -934,7 +1079,10 @@ public:
         if (fileOutPos < 0)
             return error("CBlock::WriteToDisk() : ftell failed");
         nBlockPosRet = fileOutPos;
-        fileout << *this;
+        if (vRecord.empty())
+            fileout << *this;
+        else
+            fileout.write(&vRecord[0], vRecord.size());
 
         // Flush stdio buffers and commit to disk before returning
         fflush(fileout);
@@ -948,20 +1096,23 @@ public:
     {
         SetNull();
 
-        // Open history file to read
-        CAutoFile filein = CAutoFile(OpenBlockFile(false, nFile, nBlockPos, "rb"), SER_DISK, CLIENT_VERSION);
-        if (!filein)
-            return error("CBlock::ReadFromDisk() : OpenBlockFile failed");
-        if (!fReadTransactions)
-            filein.nType |= SER_BLOCKHEADERONLY;
-
-        // Read block
-        try {
-            filein >> *this;
-        }
-        catch (std::exception &e) {
-            return error("%s() : deserialize or I/O error", __PRETTY_FUNCTION__);
-        }
+        if (!ReadFromBlockFile(false, nFile, nBlockPos, 0, *this, SER_DISK | (fReadTransactions ? 0 : SER_BLOCKHEADERONLY), CLIENT_VERSION))
+        {
+            // Open history file to read
+            CAutoFile filein = CAutoFile(OpenBlockFile(false, nFile, nBlockPos, "rb"), SER_DISK, CLIENT_VERSION);
+            if (!filein)
+                return error("CBlock::ReadFromDisk() : OpenBlockFile failed");
+            if (!fReadTransactions)
+                filein.nType |= SER_BLOCKHEADERONLY;
+
+            // Read block
+            try {
+                ReadBlockRecord(filein, 0, *this);
+            }
+            catch (std::exception &e) {
+                return error("%s() : deserialize or I/O error", __PRETTY_FUNCTION__);
+            }
+        };
 
         // Check the header
         if (fReadTransactions && IsProofOfWork() && !CheckProofOfWork(GetHash(), nBits))
@@ -1115,6 +1266,9 @@ public:
     {
         SetHdrNull();
 
+        if (ReadFromBlockFile(false, nFile, nBlockPos, 0, *this, SER_DISK, CLIENT_VERSION))
+            return true;
+
         // Open history file to read
         CAutoFile filein = CAutoFile(OpenBlockFile(false, nFile, nBlockPos, "rb"), SER_DISK, CLIENT_VERSION);
         if (!filein)
@@ -1124,7 +1278,7 @@ public:
 
         // Read block
         try {
-            filein >> *this;
+            ReadBlockRecord(filein, 0, *this);
         } catch (std::exception &e)
         {
             return error("%s() : deserialize or I/O error", __PRETTY_FUNCTION__);
@@ -1162,6 +1316,7 @@ public:
     const uint256* phashBlock;
     CBlockIndex* pprev;
     CBlockIndex* pnext;
+    CBlockIndex* pskip;     // an ancestor further back, see BuildSkip()
     unsigned int nFile;
     unsigned int nBlockPos;
     uint256 nChainTrust; // ppcoin: trust score of block chain
@@ -1194,6 +1349,7 @@ public:
         phashBlock = NULL;
         pprev = NULL;
         pnext = NULL;
+        pskip = NULL;
         nFile = 0;
         nBlockPos = 0;
         nHeight = 0;
@@ -1220,6 +1376,7 @@ public:
         phashBlock = NULL;
         pprev = NULL;
         pnext = NULL;
+        pskip = NULL;
         nFile = nFileIn;
         nBlockPos = nBlockPosIn;
         nHeight = 0;
@@ -1294,6 +1451,14 @@ public:
 
     uint256 GetBlockTrust() const;
 
+    // Sets pskip, pprev must be set and have its own pskip already.
+    void BuildSkip();
+
+    // The ancestor of this block at nHeightIn, NULL if nHeightIn is out of range.
+    // O(log n) through pskip.
+    CBlockIndex* GetAncestor(int nHeightIn);
+    const CBlockIndex* GetAncestor(int nHeightIn) const;
+
     bool IsInMainChain() const
     {
         return (pnext || this == pindexBest);
@@ -1401,6 +1566,7 @@ public:
     const uint256* phashBlock;
     CBlockThinIndex* pprev;
     CBlockThinIndex* pnext;
+    CBlockThinIndex* pskip;
     unsigned int nFile;
     unsigned int nBlockPos;
     int nHeight;
@@ -1417,6 +1583,7 @@ public:
         phashBlock = NULL;
         pprev = NULL;
         pnext = NULL;
+        pskip = NULL;
         nFile = 0;
         nBlockPos = 0;
         nHeight = 0;
@@ -1443,6 +1610,7 @@ public:
         phashBlock = NULL;
         pprev = NULL;
         pnext = NULL;
+        pskip = NULL;
         nFile = nFileIn;
         nBlockPos = nBlockPosIn;
         nHeight = 0;
@@ -1503,6 +1671,11 @@ public:
 
     uint256 GetBlockTrust() const;
 
+    // As CBlockIndex, pindexRear has no pprev so nothing below it is reachable.
+    void BuildSkip();
+    CBlockThinIndex* GetAncestor(int nHeightIn);
+    const CBlockThinIndex* GetAncestor(int nHeightIn) const;
+
     bool IsInMainChain() const
     {
         return (pnext || this == pindexBestHeader);
@@ -1579,6 +1752,12 @@ public:
     }
 };
 
+/** The entries of mapBlockIndex and mapBlockThinIndex, guarded by cs_main. */
+extern CArena<CBlockIndex> blockIndexArena;
+extern CArena<CBlockThinIndex> blockThinIndexArena;
+
+// Logs the memory used by the block index.
+void LogBlockIndexMemoryUsage();
 
 
 /** Used to marshal pointers into hashes for db storage. */
@@ -1792,7 +1971,7 @@ public:
 
     explicit CBlockLocator(uint256 hashBlock)
     {
-        std::map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(hashBlock);
+        BlockMap::iterator mi = mapBlockIndex.find(hashBlock);
         if (mi != mapBlockIndex.end())
             Set((*mi).second);
     }
@@ -1854,7 +2033,7 @@ public:
         int nStep = 1;
         BOOST_FOREACH(const uint256& hash, vHave)
         {
-            std::map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(hash);
+            BlockMap::iterator mi = mapBlockIndex.find(hash);
             if (mi != mapBlockIndex.end())
             {
                 CBlockIndex* pindex = (*mi).second;
@@ -1873,7 +2052,7 @@ public:
         // Find the first block the caller has in the main chain
         BOOST_FOREACH(const uint256& hash, vHave)
         {
-            std::map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(hash);
+            BlockMap::iterator mi = mapBlockIndex.find(hash);
             if (mi != mapBlockIndex.end())
             {
                 CBlockIndex* pindex = (*mi).second;
@@ -1889,7 +2068,7 @@ public:
         // Find the first block the caller has in the main chain
         BOOST_FOREACH(const uint256& hash, vHave)
         {
-            std::map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(hash);
+            BlockMap::iterator mi = mapBlockIndex.find(hash);
             if (mi != mapBlockIndex.end())
             {
                 CBlockIndex* pindex = (*mi).second;
@@ -1931,7 +2110,7 @@ public:
 
     explicit CBlockThinLocator(uint256 hashBlock)
     {
-        std::map<uint256, CBlockThinIndex*>::iterator mi = mapBlockThinIndex.find(hashBlock);
+        BlockThinMap::iterator mi = mapBlockThinIndex.find(hashBlock);
         if (mi != mapBlockThinIndex.end())
             Set((*mi).second);
     }
@@ -1982,7 +2161,7 @@ public:
         int nStep = 1;
         BOOST_FOREACH(const uint256& hash, vHave)
         {
-            std::map<uint256, CBlockThinIndex*>::iterator mi = mapBlockThinIndex.find(hash);
+            BlockThinMap::iterator mi = mapBlockThinIndex.find(hash);
             if (mi != mapBlockThinIndex.end())
             {
                 CBlockThinIndex* pindex = (*mi).second;
@@ -2001,7 +2180,7 @@ public:
         // Find the first block the caller has in the main chain
         BOOST_FOREACH(const uint256& hash, vHave)
         {
-            std::map<uint256, CBlockThinIndex*>::iterator mi = mapBlockThinIndex.find(hash);
+            BlockThinMap::iterator mi = mapBlockThinIndex.find(hash);
             if (mi != mapBlockThinIndex.end())
             {
                 CBlockThinIndex* pindex = (*mi).second;
@@ -2017,7 +2196,7 @@ public:
         // Find the first block the caller has in the main chain
         BOOST_FOREACH(const uint256& hash, vHave)
         {
-            std::map<uint256, CBlockThinIndex*>::iterator mi = mapBlockThinIndex.find(hash);
+            BlockThinMap::iterator mi = mapBlockThinIndex.find(hash);
             if (mi != mapBlockThinIndex.end())
             {
                 CBlockThinIndex* pindex = (*mi).second;
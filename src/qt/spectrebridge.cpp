@@ -1034,7 +1034,7 @@ void SpectreBridge::findBlock(QString searchID)
 
         // -- look for a block or transaction
         //    Note: only finds transactions in the block chain
-        std::map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(hash);
+        BlockMap::iterator mi = mapBlockIndex.find(hash);
         if (mi != mapBlockIndex.end()
             || (GetTransactionBlockHash(hash, hashBlock)
                 && (mi = mapBlockIndex.find(hashBlock)) != mapBlockIndex.end()))
@@ -1083,7 +1083,7 @@ void SpectreBridge::blockDetails(QString blkHash)
     CBlockIndex* blkIndex;
     CBlock block;
 
-    std::map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(hash);
+    BlockMap::iterator mi = mapBlockIndex.find(hash);
     if (mi == mapBlockIndex.end())
     {
         blockDetail.insert("error_msg", "Block not found.");
@@ -1167,7 +1167,7 @@ void SpectreBridge::listTransactionsForBlock(QString blkHash)
     CBlockIndex* selectedBlkIndex;
     CBlock block;
 
-    std::map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(hash);
+    BlockMap::iterator mi = mapBlockIndex.find(hash);
     if (mi == mapBlockIndex.end())
     {
         blkTransactions.insert("error_msg", "Block not found.");
@@ -1216,7 +1216,7 @@ void SpectreBridge::txnDetails(QString blkHash, QString txnHash)
     CBlockIndex* selectedBlkIndex;
     CBlock block;
 
-    std::map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(hash);
+    BlockMap::iterator mi = mapBlockIndex.find(hash);
     if (mi == mapBlockIndex.end())
     {
         txnDetail.insert("error_msg", "Block not found.");
@@ -5,11 +5,19 @@
 // SPDX-License-Identifier: MIT
 
 #include "ringsig.h"
+#include "ecmult.h"
 #include "base58.h"
 #include "key.h"
 #include "main.h"
 #include "chainparams.h"
 
+#include <atomic>
+#include <list>
+#include <map>
+
+#include <boost/thread/locks.hpp>
+#include <boost/thread/shared_mutex.hpp>
+
 #include <openssl/err.h>
 #include <openssl/rand.h>
 #include <openssl/ec.h>
@@ -18,34 +26,66 @@
 #include <openssl/obj_mac.h>
 
 
-static EC_GROUP *ecGrp   = NULL;
-static BN_CTX   *bnCtx   = NULL;
-static BIGNUM   *bnOrder = NULL;
+CRingSigContext::CRingSigContext()
+{
+    ecGrp   = NULL;
+    bnCtx   = NULL;
+    bnOrder = NULL;
 
+    if (!(ecGrp = EC_GROUP_new_by_curve_name(NID_secp256k1))
+        || !(bnCtx = BN_CTX_new())
+        || !(bnOrder = BN_new())
+        || !EC_GROUP_get_order(ecGrp, bnOrder, bnCtx))
+    {
+        Free();
+        throw std::runtime_error("CRingSigContext : OpenSSL setup failed");
+    };
+}
 
-int initialiseRingSigs()
+CRingSigContext::~CRingSigContext()
 {
-    int rv = 0;
+    Free();
+}
 
-    if (fDebugRingSig)
-        LogPrintf("initialiseRingSigs()\n");
+void CRingSigContext::Free()
+{
+    BN_free(bnOrder);
+    BN_CTX_free(bnCtx);
+    EC_GROUP_clear_free(ecGrp);
+
+    ecGrp   = NULL;
+    bnCtx   = NULL;
+    bnOrder = NULL;
+}
 
-    if (!(ecGrp = EC_GROUP_new_by_curve_name(NID_secp256k1)))
-        return errorN(1, "initialiseRingSigs(): EC_GROUP_new_by_curve_name failed.");
+static boost::thread_specific_ptr<CRingSigContext> ptrRingSigContext;
 
-    if (!(bnCtx = BN_CTX_new()))
-        return errorN(1, "initialiseRingSigs(): BN_CTX_new failed.");
+CRingSigContext &GetRingSigContext()
+{
+    CRingSigContext *pctx = ptrRingSigContext.get();
+    if (!pctx)
+    {
+        pctx = new CRingSigContext();
+        ptrRingSigContext.reset(pctx);
+    };
+    return *pctx;
+}
 
-    BN_CTX_start(bnCtx);
+int initialiseRingSigs()
+{
+    if (fDebugRingSig)
+        LogPrintf("initialiseRingSigs()\n");
 
-    // get order and cofactor
-    bnOrder = BN_new();
-    if (!EC_GROUP_get_order(ecGrp, bnOrder, bnCtx))
-        return errorN(1, "initialiseRingSigs(): EC_GROUP_get_order failed.");
+    try { GetRingSigContext(); } catch (std::exception &e)
+    {
+        return errorN(1, "initialiseRingSigs(): %s.", e.what());
+    }
 
-    BN_CTX_end(bnCtx);
+#ifdef USE_NATIVE_SECP256K1
+    ECMultInit();
+#endif
 
-    return rv;
+    return 0;
 }
 
 int finaliseRingSigs()
@@ -53,13 +93,8 @@ int finaliseRingSigs()
     if (fDebugRingSig)
         LogPrintf("finaliseRingSigs()\n");
 
-    BN_free(bnOrder);
-    BN_CTX_free(bnCtx);
-    EC_GROUP_clear_free(ecGrp);
-
-    ecGrp   = NULL;
-    bnCtx   = NULL;
-    bnOrder = NULL;
+    // - contexts of other threads are freed when those threads exit
+    ptrRingSigContext.reset();
 
     return 0;
 }
@@ -115,6 +150,11 @@ int splitAmount(int64_t nValue, std::vector<int64_t>& vOut, int64_t maxAnonOutpu
 
 
 int getOldKeyImage(const CPubKey &publicKey, ec_point &keyImage)
+{
+    return getOldKeyImage(GetRingSigContext(), publicKey, keyImage);
+}
+
+int getOldKeyImage(CRingSigContext &ctx, const CPubKey &publicKey, ec_point &keyImage)
 {
     // - PublicKey * Hash(PublicKey)
     if (publicKey.size() != EC_COMPRESSED_SIZE)
@@ -124,8 +164,8 @@ int getOldKeyImage(const CPubKey &publicKey, ec_point &keyImage)
 
     uint256 pkHash = publicKey.GetHash();
 
-    BN_CTX_start(bnCtx);
-    BIGNUM *bnTmp = BN_CTX_get(bnCtx);
+    BN_CTX_start(ctx.bnCtx);
+    BIGNUM *bnTmp = BN_CTX_get(ctx.bnCtx);
     EC_POINT *ptPk = NULL;
 
     // Hash to BIGNUM
@@ -134,16 +174,16 @@ int getOldKeyImage(const CPubKey &publicKey, ec_point &keyImage)
         goto End;
 
     // PublicKey point
-    if (!(ptPk = EC_POINT_new(ecGrp))
+    if (!(ptPk = EC_POINT_new(ctx.ecGrp))
     && (rv = errorN(1, "%s: EC_POINT_new failed.", __func__)))
         goto End;
 
-    if (!EC_POINT_oct2point(ecGrp, ptPk, publicKey.begin(), EC_COMPRESSED_SIZE, bnCtx)
+    if (!EC_POINT_oct2point(ctx.ecGrp, ptPk, publicKey.begin(), EC_COMPRESSED_SIZE, ctx.bnCtx)
     && (rv = errorN(1, "%s: EC_POINT_oct2point failed.", __func__)))
         goto End;
 
     // PublicKey * Hash(PublicKey)
-    if (!EC_POINT_mul(ecGrp, ptPk, NULL, ptPk, bnTmp, bnCtx)
+    if (!EC_POINT_mul(ctx.ecGrp, ptPk, NULL, ptPk, bnTmp, ctx.bnCtx)
     && (rv = errorN(1, "%s: EC_POINT_mul failed.", __func__)))
         goto End;
 
@@ -154,31 +194,31 @@ int getOldKeyImage(const CPubKey &publicKey, ec_point &keyImage)
     }
 
     // Point to BIGNUM to bin
-    if (!(EC_POINT_point2bn(ecGrp, ptPk, POINT_CONVERSION_COMPRESSED, bnTmp, bnCtx))
+    if (!(EC_POINT_point2bn(ctx.ecGrp, ptPk, POINT_CONVERSION_COMPRESSED, bnTmp, ctx.bnCtx))
      ||BN_num_bytes(bnTmp) != (int) EC_COMPRESSED_SIZE
      ||BN_bn2bin(bnTmp, &keyImage[0]) != (int) EC_COMPRESSED_SIZE)
         rv = errorN(1, "%s: point -> keyImage failed.", __func__);
 
     End:
     EC_POINT_free(ptPk);
-    BN_CTX_end(bnCtx);
+    BN_CTX_end(ctx.bnCtx);
 
     return 0;
 }
 
-static int hashToEC(const uint8_t *p, uint32_t len, BIGNUM *bnTmp, EC_POINT *ptRet, bool fNew=false)
+static int hashToEC(CRingSigContext &ctx, const uint8_t *p, uint32_t len, BIGNUM *bnTmp, EC_POINT *ptRet, bool fNew=false)
 {
     // - bn(hash(data)) * (G + bn1)
     int count = 0;
     uint256 pkHash = Hash(p, p + len);
-    BIGNUM *bnOne = BN_CTX_get(bnCtx);
+    BIGNUM *bnOne = BN_CTX_get(ctx.bnCtx);
     BN_one(bnOne);
 
     if (!bnTmp || !BN_bin2bn(pkHash.begin(), EC_SECRET_SIZE, bnTmp))
         return errorN(1, "%s: BN_bin2bn failed.", __func__);
 
     if (fNew || Params().IsProtocolV3(nBestHeight))
-        while(!EC_POINT_set_compressed_coordinates_GFp(ecGrp, ptRet, bnTmp, 0, bnCtx) && count < 100)
+        while(!EC_POINT_set_compressed_coordinates_GFp(ctx.ecGrp, ptRet, bnTmp, 0, ctx.bnCtx) && count < 100)
         {
             count += 1;
 
@@ -188,31 +228,31 @@ static int hashToEC(const uint8_t *p, uint32_t len, BIGNUM *bnTmp, EC_POINT *ptR
             BN_add(bnTmp, bnTmp, bnOne);
         }
     else
-        if (!EC_POINT_mul(ecGrp, ptRet, bnTmp, NULL, NULL, bnCtx))
+        if (!EC_POINT_mul(ctx.ecGrp, ptRet, bnTmp, NULL, NULL, ctx.bnCtx))
             return errorN(1, "%s: EC_POINT_mul failed.", __func__);
 
     return 0;
 }
 
 
-int generateKeyImage(const ec_point &publicKey, ec_secret secret, ec_point &keyImage)
+int generateKeyImageOpenSSL(CRingSigContext &ctx, const ec_point &publicKey, ec_secret secret, ec_point &keyImage)
 {
     // - keyImage = secret * hash(publicKey) * G
 
     if (publicKey.size() != EC_COMPRESSED_SIZE)
         return errorN(1, "%s: Invalid publicKey.", __func__);
 
-    BN_CTX_start(bnCtx);
+    BN_CTX_start(ctx.bnCtx);
     int rv = 0;
-    BIGNUM *bnTmp = BN_CTX_get(bnCtx);
-    BIGNUM *bnSec = BN_CTX_get(bnCtx);
+    BIGNUM *bnTmp = BN_CTX_get(ctx.bnCtx);
+    BIGNUM *bnSec = BN_CTX_get(ctx.bnCtx);
     EC_POINT *hG  = NULL;
 
-    if (!(hG = EC_POINT_new(ecGrp))
+    if (!(hG = EC_POINT_new(ctx.ecGrp))
     && (rv = errorN(1, "%s: EC_POINT_new failed.", __func__)))
         goto End;
 
-    if (hashToEC(&publicKey[0], publicKey.size(), bnTmp, hG, true)
+    if (hashToEC(ctx, &publicKey[0], publicKey.size(), bnTmp, hG, true)
     && (rv = errorN(1, "%s: hashToEC failed.", __func__)))
         goto End;
 
@@ -220,7 +260,7 @@ int generateKeyImage(const ec_point &publicKey, ec_secret secret, ec_point &keyI
     && (rv = errorN(1, "%s: BN_bin2bn failed.", __func__)))
         goto End;
 
-    if (!EC_POINT_mul(ecGrp, hG, NULL, hG, bnSec, bnCtx)
+    if (!EC_POINT_mul(ctx.ecGrp, hG, NULL, hG, bnSec, ctx.bnCtx)
     && (rv = errorN(1, "%s: kimg EC_POINT_mul failed.", __func__)))
         goto End;
 
@@ -230,7 +270,7 @@ int generateKeyImage(const ec_point &publicKey, ec_secret secret, ec_point &keyI
         rv = 1; goto End;
     }
 
-    if ((!(EC_POINT_point2bn(ecGrp, hG, POINT_CONVERSION_COMPRESSED, bnTmp, bnCtx))
+    if ((!(EC_POINT_point2bn(ctx.ecGrp, hG, POINT_CONVERSION_COMPRESSED, bnTmp, ctx.bnCtx))
         || BN_num_bytes(bnTmp) != (int) EC_COMPRESSED_SIZE
         || BN_bn2bin(bnTmp, &keyImage[0]) != (int) EC_COMPRESSED_SIZE)
     && (rv = errorN(1, "%s: point -> keyImage failed.", __func__)))
@@ -241,13 +281,13 @@ int generateKeyImage(const ec_point &publicKey, ec_secret secret, ec_point &keyI
 
     End:
     EC_POINT_free(hG);
-    BN_CTX_end(bnCtx);
+    BN_CTX_end(ctx.bnCtx);
 
     return rv;
 }
 
 
-int generateRingSignature(const data_chunk &keyImage, const uint256 &txnHash, int nRingSize, int nSecretOffset, ec_secret secret, const uint8_t *pPubkeys, uint8_t *pSigc, uint8_t *pSigr)
+int generateRingSignatureOpenSSL(CRingSigContext &ctx, const data_chunk &keyImage, const uint256 &txnHash, int nRingSize, int nSecretOffset, ec_secret secret, const uint8_t *pPubkeys, uint8_t *pSigc, uint8_t *pSigr)
 {
     if (fDebugRingSig)
         LogPrintf("%s: Ring size %d.\n", __func__, nRingSize);
@@ -255,14 +295,14 @@ int generateRingSignature(const data_chunk &keyImage, const uint256 &txnHash, in
     int rv = 0;
     int nBytes;
 
-    BN_CTX_start(bnCtx);
+    BN_CTX_start(ctx.bnCtx);
 
-    BIGNUM   *bnKS  = BN_CTX_get(bnCtx);
-    BIGNUM   *bnK1  = BN_CTX_get(bnCtx);
-    BIGNUM   *bnK2  = BN_CTX_get(bnCtx);
-    BIGNUM   *bnT   = BN_CTX_get(bnCtx);
-    BIGNUM   *bnH   = BN_CTX_get(bnCtx);
-    BIGNUM   *bnSum = BN_CTX_get(bnCtx);
+    BIGNUM   *bnKS  = BN_CTX_get(ctx.bnCtx);
+    BIGNUM   *bnK1  = BN_CTX_get(ctx.bnCtx);
+    BIGNUM   *bnK2  = BN_CTX_get(ctx.bnCtx);
+    BIGNUM   *bnT   = BN_CTX_get(ctx.bnCtx);
+    BIGNUM   *bnH   = BN_CTX_get(ctx.bnCtx);
+    BIGNUM   *bnSum = BN_CTX_get(ctx.bnCtx);
     EC_POINT *ptT1  = NULL;
     EC_POINT *ptT2  = NULL;
     EC_POINT *ptT3  = NULL;
@@ -298,20 +338,20 @@ int generateRingSignature(const data_chunk &keyImage, const uint256 &txnHash, in
     // zero sum
     BN_zero(bnSum);
 
-    if (   !(ptT1 = EC_POINT_new(ecGrp))
-        || !(ptT2 = EC_POINT_new(ecGrp))
-        || !(ptT3 = EC_POINT_new(ecGrp))
-        || !(ptPk = EC_POINT_new(ecGrp))
-        || !(ptKi = EC_POINT_new(ecGrp))
-        || !(ptL  = EC_POINT_new(ecGrp))
-        || !(ptR  = EC_POINT_new(ecGrp)))
+    if (   !(ptT1 = EC_POINT_new(ctx.ecGrp))
+        || !(ptT2 = EC_POINT_new(ctx.ecGrp))
+        || !(ptT3 = EC_POINT_new(ctx.ecGrp))
+        || !(ptPk = EC_POINT_new(ctx.ecGrp))
+        || !(ptKi = EC_POINT_new(ctx.ecGrp))
+        || !(ptL  = EC_POINT_new(ctx.ecGrp))
+        || !(ptR  = EC_POINT_new(ctx.ecGrp)))
     {
         LogPrintf("%s: EC_POINT_new failed.\n", __func__);
         rv = 1; goto End;
     }
 
     // get keyimage as point
-    if (!EC_POINT_oct2point(ecGrp, ptKi, &keyImage[0], EC_COMPRESSED_SIZE, bnCtx)
+    if (!EC_POINT_oct2point(ctx.ecGrp, ptKi, &keyImage[0], EC_COMPRESSED_SIZE, ctx.bnCtx)
       &&(rv = errorN(1, "%s: extract ptKi failed.", __func__)))
         goto End;
 
@@ -323,19 +363,19 @@ int generateRingSignature(const data_chunk &keyImage, const uint256 &txnHash, in
             // L = k * G
             // R = k * HashToEC(PKi)
 
-            if (!EC_POINT_mul(ecGrp, ptL, bnKS, NULL, NULL, bnCtx))
+            if (!EC_POINT_mul(ctx.ecGrp, ptL, bnKS, NULL, NULL, ctx.bnCtx))
             {
                 LogPrintf("%s: EC_POINT_mul failed.\n", __func__);
                 rv = 1; goto End;
             }
 
-            if (hashToEC(&pPubkeys[i * EC_COMPRESSED_SIZE], EC_COMPRESSED_SIZE, bnT, ptT1) != 0)
+            if (hashToEC(ctx, &pPubkeys[i * EC_COMPRESSED_SIZE], EC_COMPRESSED_SIZE, bnT, ptT1) != 0)
             {
                 LogPrintf("%s: hashToEC failed.\n", __func__);
                 rv = 1; goto End;
             }
 
-            if (!EC_POINT_mul(ecGrp, ptR, NULL, ptT1, bnKS, bnCtx))
+            if (!EC_POINT_mul(ctx.ecGrp, ptR, NULL, ptT1, bnKS, ctx.bnCtx))
             {
                 LogPrintf("%s: EC_POINT_mul failed.\n", __func__);
                 rv = 1; goto End;
@@ -361,56 +401,56 @@ int generateRingSignature(const data_chunk &keyImage, const uint256 &txnHash, in
 
             // get Pk i as point
             if (!(bnT = BN_bin2bn(&pPubkeys[i * EC_COMPRESSED_SIZE], EC_COMPRESSED_SIZE, bnT))
-                || !(ptPk) || !(ptPk = EC_POINT_bn2point(ecGrp, bnT, ptPk, bnCtx)))
+                || !(ptPk) || !(ptPk = EC_POINT_bn2point(ctx.ecGrp, bnT, ptPk, ctx.bnCtx)))
             {
                 LogPrintf("%s: extract ptPk failed.\n", __func__);
                 rv = 1; goto End;
             }
 
             // ptT1 = k1 * Pi
-            if (!EC_POINT_mul(ecGrp, ptT1, NULL, ptPk, bnK1, bnCtx))
+            if (!EC_POINT_mul(ctx.ecGrp, ptT1, NULL, ptPk, bnK1, ctx.bnCtx))
             {
                 LogPrintf("%s: EC_POINT_mul failed.\n", __func__);
                 rv = 1; goto End;
             }
 
             // ptT2 = k2 * G
-            if (!EC_POINT_mul(ecGrp, ptT2, bnK2, NULL, NULL, bnCtx))
+            if (!EC_POINT_mul(ctx.ecGrp, ptT2, bnK2, NULL, NULL, ctx.bnCtx))
             {
                 LogPrintf("%s: EC_POINT_mul failed.\n", __func__);
                 rv = 1; goto End;
             }
 
             // ptL = ptT1 + ptT2
-            if (!EC_POINT_add(ecGrp, ptL, ptT1, ptT2, bnCtx))
+            if (!EC_POINT_add(ctx.ecGrp, ptL, ptT1, ptT2, ctx.bnCtx))
             {
                 LogPrintf("%s: EC_POINT_add failed.\n", __func__);
                 rv = 1; goto End;
             }
 
             // ptT3 = Hp(Pi)
-            if (hashToEC(&pPubkeys[i * EC_COMPRESSED_SIZE], EC_COMPRESSED_SIZE, bnT, ptT3) != 0)
+            if (hashToEC(ctx, &pPubkeys[i * EC_COMPRESSED_SIZE], EC_COMPRESSED_SIZE, bnT, ptT3) != 0)
             {
                 LogPrintf("%s: hashToEC failed.\n", __func__);
                 rv = 1; goto End;
             }
 
             // ptT1 = k1 * I
-            if (!EC_POINT_mul(ecGrp, ptT1, NULL, ptKi, bnK1, bnCtx))
+            if (!EC_POINT_mul(ctx.ecGrp, ptT1, NULL, ptKi, bnK1, ctx.bnCtx))
             {
                 LogPrintf("%s: EC_POINT_mul failed.\n", __func__);
                 rv = 1; goto End;
             }
 
             // ptT2 = k2 * ptT3
-            if (!EC_POINT_mul(ecGrp, ptT2, NULL, ptT3, bnK2, bnCtx))
+            if (!EC_POINT_mul(ctx.ecGrp, ptT2, NULL, ptT3, bnK2, ctx.bnCtx))
             {
                 LogPrintf("%s: EC_POINT_mul failed.\n", __func__);
                 rv = 1; goto End;
             }
 
             // ptR = ptT1 + ptT2
-            if (!EC_POINT_add(ecGrp, ptR, ptT1, ptT2, bnCtx))
+            if (!EC_POINT_add(ctx.ecGrp, ptR, ptT1, ptT2, ctx.bnCtx))
             {
                 LogPrintf("%s: EC_POINT_add failed.\n", __func__);
                 rv = 1; goto End;
@@ -420,7 +460,7 @@ int generateRingSignature(const data_chunk &keyImage, const uint256 &txnHash, in
             memcpy(&pSigr[i * EC_SECRET_SIZE], &scData2.e[0], EC_SECRET_SIZE);
 
             // sum = (sum + sigc) % N , sigc == bnK1
-            if (!BN_mod_add(bnSum, bnSum, bnK1, bnOrder, bnCtx))
+            if (!BN_mod_add(bnSum, bnSum, bnK1, ctx.bnOrder, ctx.bnCtx))
             {
                 LogPrintf("%s: BN_mod_add failed.\n", __func__);
                 rv = 1; goto End;
@@ -428,8 +468,8 @@ int generateRingSignature(const data_chunk &keyImage, const uint256 &txnHash, in
         }
 
         // -- add ptL and ptR to hash
-        if (   !(EC_POINT_point2oct(ecGrp, ptL, POINT_CONVERSION_COMPRESSED, &tempData[0],  33, bnCtx) == (int) EC_COMPRESSED_SIZE)
-            || !(EC_POINT_point2oct(ecGrp, ptR, POINT_CONVERSION_COMPRESSED, &tempData[33], 33, bnCtx) == (int) EC_COMPRESSED_SIZE))
+        if (   !(EC_POINT_point2oct(ctx.ecGrp, ptL, POINT_CONVERSION_COMPRESSED, &tempData[0],  33, ctx.bnCtx) == (int) EC_COMPRESSED_SIZE)
+            || !(EC_POINT_point2oct(ctx.ecGrp, ptR, POINT_CONVERSION_COMPRESSED, &tempData[33], 33, ctx.bnCtx) == (int) EC_COMPRESSED_SIZE))
         {
             LogPrintf("%s: extract ptL and ptR failed.\n", __func__);
             rv = 1; goto End;
@@ -447,14 +487,14 @@ int generateRingSignature(const data_chunk &keyImage, const uint256 &txnHash, in
     }
 
 
-    if (!BN_mod(bnH, bnH, bnOrder, bnCtx)) // this is necessary
+    if (!BN_mod(bnH, bnH, ctx.bnOrder, ctx.bnCtx)) // this is necessary
     {
         LogPrintf("%s: BN_mod failed.\n", __func__);
         rv = 1; goto End;
     }
 
     // sigc[nSecretOffset] = (bnH - bnSum) % N
-    if (!BN_mod_sub(bnT, bnH, bnSum, bnOrder, bnCtx))
+    if (!BN_mod_sub(bnT, bnH, bnSum, ctx.bnOrder, ctx.bnCtx))
     {
         LogPrintf("%s: BN_mod_sub failed.\n", __func__);
         rv = 1; goto End;
@@ -476,13 +516,13 @@ int generateRingSignature(const data_chunk &keyImage, const uint256 &txnHash, in
     }
 
     // bnT = sigc[nSecretOffset] * bnSecret , TODO: mod N ?
-    if (!BN_mul(bnT, bnT, bnH, bnCtx))
+    if (!BN_mul(bnT, bnT, bnH, ctx.bnCtx))
     {
         LogPrintf("%s: BN_mul failed.\n", __func__);
         rv = 1; goto End;
     }
 
-    if (!BN_mod_sub(bnT, bnKS, bnT, bnOrder, bnCtx))
+    if (!BN_mod_sub(bnT, bnKS, bnT, ctx.bnOrder, ctx.bnCtx))
     {
         LogPrintf("%s: BN_mod_sub failed.\n", __func__);
         rv = 1; goto End;
@@ -504,22 +544,22 @@ int generateRingSignature(const data_chunk &keyImage, const uint256 &txnHash, in
     EC_POINT_free(ptL);
     EC_POINT_free(ptR);
 
-    BN_CTX_end(bnCtx);
+    BN_CTX_end(ctx.bnCtx);
 
     return rv;
 }
 
-int verifyRingSignature(const data_chunk &keyImage, const uint256 &txnHash, int nRingSize, const uint8_t *pPubkeys, const uint8_t *pSigc, const uint8_t *pSigr)
+int verifyRingSignatureOpenSSL(CRingSigContext &ctx, const data_chunk &keyImage, const uint256 &txnHash, int nRingSize, const uint8_t *pPubkeys, const uint8_t *pSigc, const uint8_t *pSigr)
 {
     int rv = 0;
 
-    BN_CTX_start(bnCtx);
+    BN_CTX_start(ctx.bnCtx);
 
-    BIGNUM   *bnT   = BN_CTX_get(bnCtx);
-    BIGNUM   *bnH   = BN_CTX_get(bnCtx);
-    BIGNUM   *bnC   = BN_CTX_get(bnCtx);
-    BIGNUM   *bnR   = BN_CTX_get(bnCtx);
-    BIGNUM   *bnSum = BN_CTX_get(bnCtx);
+    BIGNUM   *bnT   = BN_CTX_get(ctx.bnCtx);
+    BIGNUM   *bnH   = BN_CTX_get(ctx.bnCtx);
+    BIGNUM   *bnC   = BN_CTX_get(ctx.bnCtx);
+    BIGNUM   *bnR   = BN_CTX_get(ctx.bnCtx);
+    BIGNUM   *bnSum = BN_CTX_get(ctx.bnCtx);
     EC_POINT *ptT1  = NULL;
     EC_POINT *ptT2  = NULL;
     EC_POINT *ptT3  = NULL;
@@ -537,20 +577,20 @@ int verifyRingSignature(const data_chunk &keyImage, const uint256 &txnHash, int
     // zero sum
     BN_zero(bnSum);
 
-    if (   !(ptT1 = EC_POINT_new(ecGrp))
-        || !(ptT2 = EC_POINT_new(ecGrp))
-        || !(ptT3 = EC_POINT_new(ecGrp))
-        || !(ptPk = EC_POINT_new(ecGrp))
-        || !(ptKi = EC_POINT_new(ecGrp))
-        || !(ptL  = EC_POINT_new(ecGrp))
-        || !(ptR  = EC_POINT_new(ecGrp)))
+    if (   !(ptT1 = EC_POINT_new(ctx.ecGrp))
+        || !(ptT2 = EC_POINT_new(ctx.ecGrp))
+        || !(ptT3 = EC_POINT_new(ctx.ecGrp))
+        || !(ptPk = EC_POINT_new(ctx.ecGrp))
+        || !(ptKi = EC_POINT_new(ctx.ecGrp))
+        || !(ptL  = EC_POINT_new(ctx.ecGrp))
+        || !(ptR  = EC_POINT_new(ctx.ecGrp)))
     {
         LogPrintf("%s: EC_POINT_new failed.\n", __func__);
         rv = 1; goto End;
     }
 
     // get keyimage as point
-    if (!EC_POINT_oct2point(ecGrp, ptKi, &keyImage[0], EC_COMPRESSED_SIZE, bnCtx)
+    if (!EC_POINT_oct2point(ctx.ecGrp, ptKi, &keyImage[0], EC_COMPRESSED_SIZE, ctx.bnCtx)
       &&(rv = errorN(1, "%s: extract ptKi failed.", __func__)))
         goto End;
 
@@ -568,71 +608,71 @@ int verifyRingSignature(const data_chunk &keyImage, const uint256 &txnHash, int
 
         // get Pk i as point
         if (!(bnT = BN_bin2bn(&pPubkeys[i * EC_COMPRESSED_SIZE], EC_COMPRESSED_SIZE, bnT))
-            || !(ptPk) || !(ptPk = EC_POINT_bn2point(ecGrp, bnT, ptPk, bnCtx)))
+            || !(ptPk) || !(ptPk = EC_POINT_bn2point(ctx.ecGrp, bnT, ptPk, ctx.bnCtx)))
         {
             LogPrintf("%s: extract ptPk failed.\n", __func__);
             rv = 1; goto End;
         }
 
         // ptT1 = ci * Pi
-        if (!EC_POINT_mul(ecGrp, ptT1, NULL, ptPk, bnC, bnCtx))
+        if (!EC_POINT_mul(ctx.ecGrp, ptT1, NULL, ptPk, bnC, ctx.bnCtx))
         {
             LogPrintf("%s: EC_POINT_mul failed.\n", __func__);
             rv = 1; goto End;
         }
 
         // ptT2 = ri * G
-        if (!EC_POINT_mul(ecGrp, ptT2, bnR, NULL, NULL, bnCtx))
+        if (!EC_POINT_mul(ctx.ecGrp, ptT2, bnR, NULL, NULL, ctx.bnCtx))
         {
             LogPrintf("%s: EC_POINT_mul failed.\n", __func__);
             rv = 1; goto End;
         }
 
         // ptL = ptT1 + ptT2
-        if (!EC_POINT_add(ecGrp, ptL, ptT1, ptT2, bnCtx))
+        if (!EC_POINT_add(ctx.ecGrp, ptL, ptT1, ptT2, ctx.bnCtx))
         {
             LogPrintf("%s: EC_POINT_add failed.\n", __func__);
             rv = 1; goto End;
         }
 
         // ptT3 = Hp(Pi)
-        if (hashToEC(&pPubkeys[i * EC_COMPRESSED_SIZE], EC_COMPRESSED_SIZE, bnT, ptT3) != 0)
+        if (hashToEC(ctx, &pPubkeys[i * EC_COMPRESSED_SIZE], EC_COMPRESSED_SIZE, bnT, ptT3) != 0)
         {
             LogPrintf("%s: hashToEC failed.\n", __func__);
             rv = 1; goto End;
         }
 
         // ptT1 = k1 * I
-        if (!EC_POINT_mul(ecGrp, ptT1, NULL, ptKi, bnC, bnCtx))
+        if (!EC_POINT_mul(ctx.ecGrp, ptT1, NULL, ptKi, bnC, ctx.bnCtx))
         {
             LogPrintf("%s: EC_POINT_mul failed.\n", __func__);
             rv = 1; goto End;
         }
 
         // ptT2 = k2 * ptT3
-        if (!EC_POINT_mul(ecGrp, ptT2, NULL, ptT3, bnR, bnCtx))
+        if (!EC_POINT_mul(ctx.ecGrp, ptT2, NULL, ptT3, bnR, ctx.bnCtx))
         {
             LogPrintf("%s: EC_POINT_mul failed.\n", __func__);
             rv = 1; goto End;
         }
 
         // ptR = ptT1 + ptT2
-        if (!EC_POINT_add(ecGrp, ptR, ptT1, ptT2, bnCtx))
+        if (!EC_POINT_add(ctx.ecGrp, ptR, ptT1, ptT2, ctx.bnCtx))
         {
             LogPrintf("%s: EC_POINT_add failed.\n", __func__);
             rv = 1; goto End;
         }
 
         // sum = (sum + ci) % N
-        if (!BN_mod_add(bnSum, bnSum, bnC, bnOrder, bnCtx))
+        if (!BN_mod_add(bnSum, bnSum, bnC, ctx.bnOrder, ctx.bnCtx))
         {
             LogPrintf("%s: BN_mod_add failed.\n", __func__);
             rv = 1; goto End;
         }
 
         // -- add ptL and ptR to hash
-        if (!(EC_POINT_point2oct(ecGrp, ptL, POINT_CONVERSION_COMPRESSED, &tempData[0],  33, bnCtx) == (int) EC_COMPRESSED_SIZE)
-          ||!(EC_POINT_point2oct(ecGrp, ptR, POINT_CONVERSION_COMPRESSED, &tempData[33], 33, bnCtx) == (int) EC_COMPRESSED_SIZE))
+        if (!(EC_POINT_point2oct(ctx.ecGrp, ptL, POINT_CONVERSION_COMPRESSED, &tempData[0],  33, ctx.bnCtx) == (int) EC_COMPRESSED_SIZE)
+          ||!(EC_POINT_point2oct(ctx.ecGrp, ptR, POINT_CONVERSION_COMPRESSED, &tempData[33], 33, ctx.bnCtx) == (int) EC_COMPRESSED_SIZE))
         {
             LogPrintf("%s: extract ptL and ptR failed.\n", __func__);
             rv = 1; goto End;
@@ -649,14 +689,14 @@ int verifyRingSignature(const data_chunk &keyImage, const uint256 &txnHash, int
         rv = 1; goto End;
     }
 
-    if (!BN_mod(bnH, bnH, bnOrder, bnCtx))
+    if (!BN_mod(bnH, bnH, ctx.bnOrder, ctx.bnCtx))
     {
         LogPrintf("%s: BN_mod failed.\n", __func__);
         rv = 1; goto End;
     }
 
     // bnT = (bnH - bnSum) % N
-    if (!BN_mod_sub(bnT, bnH, bnSum, bnOrder, bnCtx))
+    if (!BN_mod_sub(bnT, bnH, bnSum, ctx.bnOrder, ctx.bnCtx))
     {
         LogPrintf("%s: BN_mod_sub failed.\n", __func__);
         rv = 1; goto End;
@@ -679,13 +719,13 @@ int verifyRingSignature(const data_chunk &keyImage, const uint256 &txnHash, int
     EC_POINT_free(ptL);
     EC_POINT_free(ptR);
 
-    BN_CTX_end(bnCtx);
+    BN_CTX_end(ctx.bnCtx);
 
     return rv;
 }
 
 
-int generateRingSignatureAB(const data_chunk &keyImage, int nRingSize, int nSecretOffset, ec_secret secret, const uint8_t *pPubkeys, data_chunk &sigC, uint8_t *pSigS)
+int generateRingSignatureABOpenSSL(CRingSigContext &ctx, const data_chunk &keyImage, int nRingSize, int nSecretOffset, ec_secret secret, const uint8_t *pPubkeys, data_chunk &sigC, uint8_t *pSigS)
 {
     // https://bitcointalk.org/index.php?topic=972541.msg10619684
 
@@ -739,13 +779,13 @@ int generateRingSignatureAB(const data_chunk &keyImage, int nRingSize, int nSecr
 
     tmpPkHash = ssPkHash.GetHash();
 
-    BN_CTX_start(bnCtx);
-    BIGNUM   *bnT  = BN_CTX_get(bnCtx);
-    BIGNUM   *bnT2 = BN_CTX_get(bnCtx);
-    BIGNUM   *bnS  = BN_CTX_get(bnCtx);
-    BIGNUM   *bnC  = BN_CTX_get(bnCtx);
-    BIGNUM   *bnCj = BN_CTX_get(bnCtx);
-    BIGNUM   *bnA  = BN_CTX_get(bnCtx);
+    BN_CTX_start(ctx.bnCtx);
+    BIGNUM   *bnT  = BN_CTX_get(ctx.bnCtx);
+    BIGNUM   *bnT2 = BN_CTX_get(ctx.bnCtx);
+    BIGNUM   *bnS  = BN_CTX_get(ctx.bnCtx);
+    BIGNUM   *bnC  = BN_CTX_get(ctx.bnCtx);
+    BIGNUM   *bnCj = BN_CTX_get(ctx.bnCtx);
+    BIGNUM   *bnA  = BN_CTX_get(ctx.bnCtx);
     EC_POINT *ptKi = NULL;
     EC_POINT *ptPk = NULL;
     EC_POINT *ptT1 = NULL;
@@ -753,19 +793,19 @@ int generateRingSignatureAB(const data_chunk &keyImage, int nRingSize, int nSecr
     EC_POINT *ptT3 = NULL;
     EC_POINT *ptT4 = NULL;
 
-    if (!(ptKi = EC_POINT_new(ecGrp))
-      ||!(ptPk = EC_POINT_new(ecGrp))
-      ||!(ptT1 = EC_POINT_new(ecGrp))
-      ||!(ptT2 = EC_POINT_new(ecGrp))
-      ||!(ptT3 = EC_POINT_new(ecGrp))
-      ||!(ptT4 = EC_POINT_new(ecGrp)))
+    if (!(ptKi = EC_POINT_new(ctx.ecGrp))
+      ||!(ptPk = EC_POINT_new(ctx.ecGrp))
+      ||!(ptT1 = EC_POINT_new(ctx.ecGrp))
+      ||!(ptT2 = EC_POINT_new(ctx.ecGrp))
+      ||!(ptT3 = EC_POINT_new(ctx.ecGrp))
+      ||!(ptT4 = EC_POINT_new(ctx.ecGrp)))
     {
         LogPrintf("%s: EC_POINT_new failed.\n", __func__);
         rv = 1; goto End;
     }
 
     // get keyimage as point
-    if (!EC_POINT_oct2point(ecGrp, ptKi, &keyImage[0], EC_COMPRESSED_SIZE, bnCtx)
+    if (!EC_POINT_oct2point(ctx.ecGrp, ptKi, &keyImage[0], EC_COMPRESSED_SIZE, ctx.bnCtx)
       &&(rv = errorN(1, "%s: extract ptKi failed.", __func__)))
         goto End;
 
@@ -777,7 +817,7 @@ int generateRingSignatureAB(const data_chunk &keyImage, int nRingSize, int nSecr
     }
 
     // ptT1 = alpha * G
-    if (!EC_POINT_mul(ecGrp, ptT1, bnA, NULL, NULL, bnCtx))
+    if (!EC_POINT_mul(ctx.ecGrp, ptT1, bnA, NULL, NULL, ctx.bnCtx))
     {
         LogPrintf("%s: EC_POINT_mul failed.\n", __func__);
         rv = 1; goto End;
@@ -785,7 +825,7 @@ int generateRingSignatureAB(const data_chunk &keyImage, int nRingSize, int nSecr
 
     // ptT3 = H(Pj)
 
-    if (hashToEC(&pPubkeys[nSecretOffset * EC_COMPRESSED_SIZE], EC_COMPRESSED_SIZE, bnT2, ptT3) != 0)
+    if (hashToEC(ctx, &pPubkeys[nSecretOffset * EC_COMPRESSED_SIZE], EC_COMPRESSED_SIZE, bnT2, ptT3) != 0)
     {
         LogPrintf("%s: hashToEC failed.\n", __func__);
         rv = 1; goto End;
@@ -795,14 +835,14 @@ int generateRingSignatureAB(const data_chunk &keyImage, int nRingSize, int nSecr
 
     // ptT2 = alpha * H(P_j)
     // ptT2 = alpha * ptT3
-    if (!EC_POINT_mul(ecGrp, ptT2, NULL, ptT3, bnA, bnCtx))
+    if (!EC_POINT_mul(ctx.ecGrp, ptT2, NULL, ptT3, bnA, ctx.bnCtx))
     {
         LogPrintf("%s: EC_POINT_mul failed.\n", __func__);
         rv = 1; goto End;
     }
 
-    if (   !(EC_POINT_point2oct(ecGrp, ptT1, POINT_CONVERSION_COMPRESSED, &tempData[0],  33, bnCtx) == (int) EC_COMPRESSED_SIZE)
-        || !(EC_POINT_point2oct(ecGrp, ptT2, POINT_CONVERSION_COMPRESSED, &tempData[33], 33, bnCtx) == (int) EC_COMPRESSED_SIZE))
+    if (   !(EC_POINT_point2oct(ctx.ecGrp, ptT1, POINT_CONVERSION_COMPRESSED, &tempData[0],  33, ctx.bnCtx) == (int) EC_COMPRESSED_SIZE)
+        || !(EC_POINT_point2oct(ctx.ecGrp, ptT2, POINT_CONVERSION_COMPRESSED, &tempData[33], 33, ctx.bnCtx) == (int) EC_COMPRESSED_SIZE))
     {
         LogPrintf("%s: extract ptL and ptR failed.\n", __func__);
         rv = 1; goto End;
@@ -812,7 +852,7 @@ int generateRingSignatureAB(const data_chunk &keyImage, int nRingSize, int nSecr
     tmpHash = ssCjHash.GetHash();
 
     if (!bnC || !(BN_bin2bn(tmpHash.begin(), EC_SECRET_SIZE, bnC)) // bnC lags i by 1
-        || !BN_mod(bnC, bnC, bnOrder, bnCtx))
+        || !BN_mod(bnC, bnC, ctx.bnOrder, ctx.bnCtx))
     {
         LogPrintf("%s: hash -> bnC failed.\n", __func__);
         rv = 1; goto End;
@@ -833,13 +873,13 @@ int generateRingSignatureAB(const data_chunk &keyImage, int nRingSize, int nSecr
                 rv = 1; goto End;
             }
 
-            if (!BN_mul(bnT2, bnCj, bnT, bnCtx))
+            if (!BN_mul(bnT2, bnCj, bnT, ctx.bnCtx))
             {
                 LogPrintf("%s: BN_mul failed.\n", __func__);
                 rv = 1; goto End;
             }
 
-            if (!BN_mod_sub(bnS, bnA, bnT2, bnOrder, bnCtx))
+            if (!BN_mod_sub(bnS, bnA, bnT2, ctx.bnOrder, ctx.bnCtx))
             {
                 LogPrintf("%s: BN_mod_sub failed.\n", __func__);
                 rv = 1; goto End;
@@ -863,14 +903,14 @@ int generateRingSignatureAB(const data_chunk &keyImage, int nRingSize, int nSecr
         }
 
         // bnC is from last round (ib)
-        if (!EC_POINT_oct2point(ecGrp, ptPk, &pPubkeys[ib * EC_COMPRESSED_SIZE], EC_COMPRESSED_SIZE, bnCtx))
+        if (!EC_POINT_oct2point(ctx.ecGrp, ptPk, &pPubkeys[ib * EC_COMPRESSED_SIZE], EC_COMPRESSED_SIZE, ctx.bnCtx))
         {
             LogPrintf("%s: EC_POINT_oct2point failed.\n", __func__);
             rv = 1; goto End;
         }
 
         // ptT1 = s_{j+1}*G+c_{j+1}*P_{j+1}
-        if (!EC_POINT_mul(ecGrp, ptT1, bnS, ptPk, bnC, bnCtx))
+        if (!EC_POINT_mul(ctx.ecGrp, ptT1, bnS, ptPk, bnC, ctx.bnCtx))
         {
             LogPrintf("%s: EC_POINT_mul failed.\n", __func__);
             rv = 1; goto End;
@@ -878,35 +918,35 @@ int generateRingSignatureAB(const data_chunk &keyImage, int nRingSize, int nSecr
 
         //s_{j+1}*H(P_{j+1})+c_{j+1}*I_j
 
-        if (hashToEC(&pPubkeys[ib * EC_COMPRESSED_SIZE], EC_COMPRESSED_SIZE, bnT2, ptT2) != 0)
+        if (hashToEC(ctx, &pPubkeys[ib * EC_COMPRESSED_SIZE], EC_COMPRESSED_SIZE, bnT2, ptT2) != 0)
         {
             LogPrintf("%s: hashToEC failed.\n", __func__);
             rv = 1; goto End;
         }
 
         // ptT3 = s_{j+1}*H(P_{j+1})
-        if (!EC_POINT_mul(ecGrp, ptT3, NULL, ptT2, bnS, bnCtx))
+        if (!EC_POINT_mul(ctx.ecGrp, ptT3, NULL, ptT2, bnS, ctx.bnCtx))
         {
             LogPrintf("%s: EC_POINT_mul failed.\n", __func__);
             rv = 1; goto End;
         }
 
         // ptT4 = c_{j+1}*I_j
-        if (!EC_POINT_mul(ecGrp, ptT4, NULL, ptKi, bnC, bnCtx))
+        if (!EC_POINT_mul(ctx.ecGrp, ptT4, NULL, ptKi, bnC, ctx.bnCtx))
         {
             LogPrintf("%s: EC_POINT_mul failed.\n", __func__);
             rv = 1; goto End;
         }
 
         // ptT2 = ptT3 + ptT4
-        if (!EC_POINT_add(ecGrp, ptT2, ptT3, ptT4, bnCtx))
+        if (!EC_POINT_add(ctx.ecGrp, ptT2, ptT3, ptT4, ctx.bnCtx))
         {
             LogPrintf("%s: EC_POINT_add failed.\n", __func__);
             rv = 1; goto End;
         }
 
-        if (!(EC_POINT_point2oct(ecGrp, ptT1, POINT_CONVERSION_COMPRESSED, &tempData[0],  33, bnCtx) == (int) EC_COMPRESSED_SIZE)
-          ||!(EC_POINT_point2oct(ecGrp, ptT2, POINT_CONVERSION_COMPRESSED, &tempData[33], 33, bnCtx) == (int) EC_COMPRESSED_SIZE))
+        if (!(EC_POINT_point2oct(ctx.ecGrp, ptT1, POINT_CONVERSION_COMPRESSED, &tempData[0],  33, ctx.bnCtx) == (int) EC_COMPRESSED_SIZE)
+          ||!(EC_POINT_point2oct(ctx.ecGrp, ptT2, POINT_CONVERSION_COMPRESSED, &tempData[33], 33, ctx.bnCtx) == (int) EC_COMPRESSED_SIZE))
         {
             LogPrintf("%s: extract ptL and ptR failed.\n", __func__);
             rv = 1; goto End;
@@ -919,7 +959,7 @@ int generateRingSignatureAB(const data_chunk &keyImage, int nRingSize, int nSecr
 
         if ((!bnC
            ||!BN_bin2bn(tmpHash.begin(), EC_SECRET_SIZE, bnC) // bnC lags i by 1
-           ||!BN_mod(bnC, bnC, bnOrder, bnCtx))
+           ||!BN_mod(bnC, bnC, ctx.bnOrder, ctx.bnCtx))
           && (rv = errorN(1, "%s: hash -> bnC failed.", __func__)))
             goto End;
 
@@ -954,13 +994,13 @@ int generateRingSignatureAB(const data_chunk &keyImage, int nRingSize, int nSecr
     EC_POINT_free(ptT3);
     EC_POINT_free(ptT4);
 
-    BN_CTX_end(bnCtx);
+    BN_CTX_end(ctx.bnCtx);
 
     return rv;
 }
 
 
-int verifyRingSignatureAB(const data_chunk &keyImage, int nRingSize, const uint8_t *pPubkeys, const data_chunk &sigC, const uint8_t *pSigS)
+int verifyRingSignatureABOpenSSL(CRingSigContext &ctx, const data_chunk &keyImage, int nRingSize, const uint8_t *pPubkeys, const data_chunk &sigC, const uint8_t *pSigS)
 {
     // https://bitcointalk.org/index.php?topic=972541.msg10619684
 
@@ -988,12 +1028,12 @@ int verifyRingSignatureAB(const data_chunk &keyImage, int nRingSize, const uint8
 
     tmpPkHash = ssPkHash.GetHash();
 
-    BN_CTX_start(bnCtx);
+    BN_CTX_start(ctx.bnCtx);
 
-    BIGNUM   *bnC  = BN_CTX_get(bnCtx);
-    BIGNUM   *bnC1 = BN_CTX_get(bnCtx);
-    BIGNUM   *bnT  = BN_CTX_get(bnCtx);
-    BIGNUM   *bnS  = BN_CTX_get(bnCtx);
+    BIGNUM   *bnC  = BN_CTX_get(ctx.bnCtx);
+    BIGNUM   *bnC1 = BN_CTX_get(ctx.bnCtx);
+    BIGNUM   *bnT  = BN_CTX_get(ctx.bnCtx);
+    BIGNUM   *bnS  = BN_CTX_get(ctx.bnCtx);
     EC_POINT *ptKi = NULL;
     EC_POINT *ptT1 = NULL;
     EC_POINT *ptT2 = NULL;
@@ -1001,28 +1041,28 @@ int verifyRingSignatureAB(const data_chunk &keyImage, int nRingSize, const uint8
     EC_POINT *ptT4 = NULL;
     EC_POINT *ptPk = NULL;
 
-    if (!(ptKi = EC_POINT_new(ecGrp))
-      ||!(ptT1 = EC_POINT_new(ecGrp))
-      ||!(ptT2 = EC_POINT_new(ecGrp))
-      ||!(ptT3 = EC_POINT_new(ecGrp))
-      ||!(ptT4 = EC_POINT_new(ecGrp))
-      ||!(ptPk = EC_POINT_new(ecGrp)))
+    if (!(ptKi = EC_POINT_new(ctx.ecGrp))
+      ||!(ptT1 = EC_POINT_new(ctx.ecGrp))
+      ||!(ptT2 = EC_POINT_new(ctx.ecGrp))
+      ||!(ptT3 = EC_POINT_new(ctx.ecGrp))
+      ||!(ptT4 = EC_POINT_new(ctx.ecGrp))
+      ||!(ptPk = EC_POINT_new(ctx.ecGrp)))
     {
         LogPrintf("%s: EC_POINT_new failed.\n", __func__);
         rv = 1; goto End;
     }
 
     // get keyimage as point
-    if (!EC_POINT_oct2point(ecGrp, ptKi, &keyImage[0], EC_COMPRESSED_SIZE, bnCtx)
+    if (!EC_POINT_oct2point(ctx.ecGrp, ptKi, &keyImage[0], EC_COMPRESSED_SIZE, ctx.bnCtx)
       &&(rv = errorN(1, "%s: extract ptKi failed.", __func__)))
         goto End;
 
     // test ECC validity with: keyimage * order == infinity/identity
-    if (!EC_POINT_mul(ecGrp, ptT4, NULL, ptKi, bnOrder, bnCtx)
+    if (!EC_POINT_mul(ctx.ecGrp, ptT4, NULL, ptKi, ctx.bnOrder, ctx.bnCtx)
             &&(rv = errorN(1, "%s: EC_POINT_mul failed.\n", __func__)))
         goto End;
-    if (!EC_POINT_is_at_infinity(ecGrp, ptT4)
-            &&(rv = errorN(1, "%s: keyImage not valid (ptKi * bnOrder != infinity).\n", __func__)))
+    if (!EC_POINT_is_at_infinity(ctx.ecGrp, ptT4)
+            &&(rv = errorN(1, "%s: keyImage not valid (ptKi * ctx.bnOrder != infinity).\n", __func__)))
         goto End;
 
     if (!bnC1 || !BN_bin2bn(&sigC[0], EC_SECRET_SIZE, bnC1))
@@ -1046,20 +1086,20 @@ int verifyRingSignatureAB(const data_chunk &keyImage, int nRingSize, const uint8
         }
 
         // ptT2 <- pk
-        if (!EC_POINT_oct2point(ecGrp, ptPk, &pPubkeys[i * EC_COMPRESSED_SIZE], EC_COMPRESSED_SIZE, bnCtx))
+        if (!EC_POINT_oct2point(ctx.ecGrp, ptPk, &pPubkeys[i * EC_COMPRESSED_SIZE], EC_COMPRESSED_SIZE, ctx.bnCtx))
         {
             LogPrintf("%s: EC_POINT_oct2point failed.\n", __func__);
             rv = 1; goto End;
         }
 
         // ptT1 = e_i=s_i*G+c_i*P_i
-        if (!EC_POINT_mul(ecGrp, ptT1, bnS, ptPk, bnC, bnCtx))
+        if (!EC_POINT_mul(ctx.ecGrp, ptT1, bnS, ptPk, bnC, ctx.bnCtx))
         {
             LogPrintf("%s: EC_POINT_mul failed.\n", __func__);
             rv = 1; goto End;
         }
 
-        if (!(EC_POINT_point2oct(ecGrp, ptT1, POINT_CONVERSION_COMPRESSED, &tempData[0],  33, bnCtx) == (int) EC_COMPRESSED_SIZE))
+        if (!(EC_POINT_point2oct(ctx.ecGrp, ptT1, POINT_CONVERSION_COMPRESSED, &tempData[0],  33, ctx.bnCtx) == (int) EC_COMPRESSED_SIZE))
         {
             LogPrintf("%s: extract ptT1 failed.\n", __func__);
             rv = 1; goto End;
@@ -1068,34 +1108,34 @@ int verifyRingSignatureAB(const data_chunk &keyImage, int nRingSize, const uint8
         // ptT2 =E_i=s_i*H(P_i)+c_i*I_j
 
         // ptT2 =H(P_i)
-        if (hashToEC(&pPubkeys[i * EC_COMPRESSED_SIZE], EC_COMPRESSED_SIZE, bnT, ptT2) != 0)
+        if (hashToEC(ctx, &pPubkeys[i * EC_COMPRESSED_SIZE], EC_COMPRESSED_SIZE, bnT, ptT2) != 0)
         {
             LogPrintf("%s: hashToEC failed.\n", __func__);
             rv = 1; goto End;
         }
 
         // ptT3 = s_i*ptT2
-        if (!EC_POINT_mul(ecGrp, ptT3, NULL, ptT2, bnS, bnCtx))
+        if (!EC_POINT_mul(ctx.ecGrp, ptT3, NULL, ptT2, bnS, ctx.bnCtx))
         {
             LogPrintf("%s: EC_POINT_mul failed.\n", __func__);
             rv = 1; goto End;
         }
 
         // ptT1 = c_i*I_j
-        if (!EC_POINT_mul(ecGrp, ptT1, NULL, ptKi, bnC, bnCtx))
+        if (!EC_POINT_mul(ctx.ecGrp, ptT1, NULL, ptKi, bnC, ctx.bnCtx))
         {
             LogPrintf("%s: EC_POINT_mul failed.\n", __func__);
             rv = 1; goto End;
         }
 
         // ptT2 = ptT3 + ptT1
-        if (!EC_POINT_add(ecGrp, ptT2, ptT3, ptT1, bnCtx))
+        if (!EC_POINT_add(ctx.ecGrp, ptT2, ptT3, ptT1, ctx.bnCtx))
         {
             LogPrintf("%s: EC_POINT_add failed.\n", __func__);
             rv = 1; goto End;
         }
 
-        if (!(EC_POINT_point2oct(ecGrp, ptT2, POINT_CONVERSION_COMPRESSED, &tempData[33], 33, bnCtx) == (int) EC_COMPRESSED_SIZE))
+        if (!(EC_POINT_point2oct(ctx.ecGrp, ptT2, POINT_CONVERSION_COMPRESSED, &tempData[33], 33, ctx.bnCtx) == (int) EC_COMPRESSED_SIZE))
         {
             LogPrintf("%s: extract ptT2 failed.\n", __func__);
             rv = 1; goto End;
@@ -1107,7 +1147,7 @@ int verifyRingSignatureAB(const data_chunk &keyImage, int nRingSize, const uint8
         tmpHash = ssCHash.GetHash();
 
         if (!bnC || !(BN_bin2bn(tmpHash.begin(), EC_SECRET_SIZE, bnC))
-            || !BN_mod(bnC, bnC, bnOrder, bnCtx))
+            || !BN_mod(bnC, bnC, ctx.bnOrder, ctx.bnCtx))
         {
             LogPrintf("%s: tmpHash -> bnC failed.\n", __func__);
             rv = 1; goto End;
@@ -1115,7 +1155,7 @@ int verifyRingSignatureAB(const data_chunk &keyImage, int nRingSize, const uint8
     }
 
     // bnT = (bnC - bnC1) % N
-    if (!BN_mod_sub(bnT, bnC, bnC1, bnOrder, bnCtx))
+    if (!BN_mod_sub(bnT, bnC, bnC1, ctx.bnOrder, ctx.bnCtx))
     {
         LogPrintf("%s: BN_mod_sub failed.\n", __func__);
         rv = 1; goto End;
@@ -1130,7 +1170,7 @@ int verifyRingSignatureAB(const data_chunk &keyImage, int nRingSize, const uint8
 
     End:
 
-    BN_CTX_end(bnCtx);
+    BN_CTX_end(ctx.bnCtx);
 
     EC_POINT_free(ptKi);
     EC_POINT_free(ptT1);
@@ -1142,3 +1182,952 @@ int verifyRingSignatureAB(const data_chunk &keyImage, int nRingSize, const uint8
     return rv;
 }
 
+
+
+// Valid ring signature cache, analogous to CSignatureCache in script.cpp
+class CRingSigCache
+{
+private:
+    std::set<uint256> setValid;
+    boost::shared_mutex cs_ringsigcache;
+    std::atomic<uint64_t> nHits;
+    std::atomic<uint64_t> nMisses;
+
+public:
+    CRingSigCache() : nHits(0), nMisses(0) {};
+
+    bool Get(const uint256 &key)
+    {
+        boost::shared_lock<boost::shared_mutex> lock(cs_ringsigcache);
+
+        bool fFound = setValid.count(key) > 0;
+        if (fFound)
+            nHits++;
+        else
+            nMisses++;
+        return fFound;
+    };
+
+    void Set(const uint256 &key)
+    {
+        int64_t nMaxCacheSize = GetArg("-maxringsigcachesize", DEFAULT_MAX_RINGSIG_CACHE_SIZE);
+        if (nMaxCacheSize <= 0)
+            return;
+
+        boost::unique_lock<boost::shared_mutex> lock(cs_ringsigcache);
+
+        while (static_cast<int64_t>(setValid.size()) >= nMaxCacheSize)
+        {
+            // evict a random entry, see CSignatureCache
+            std::set<uint256>::iterator it = setValid.lower_bound(GetRandHash());
+            if (it == setValid.end())
+                it = setValid.begin();
+            setValid.erase(it);
+        };
+
+        setValid.insert(key);
+    };
+
+    void GetStats(CRingCacheStats &stats)
+    {
+        boost::shared_lock<boost::shared_mutex> lock(cs_ringsigcache);
+        stats.nHits = nHits;
+        stats.nMisses = nMisses;
+        stats.nEntries = setValid.size();
+        stats.nMaxEntries = std::max(GetArg("-maxringsigcachesize", DEFAULT_MAX_RINGSIG_CACHE_SIZE), (int64_t)0);
+    };
+};
+
+static CRingSigCache ringSigCache;
+
+void GetRingSigCacheStats(CRingCacheStats &stats)
+{
+    ringSigCache.GetStats(stats);
+}
+
+static void SetRingSigVerified(const CRingSigBatch::Entry &e)
+{
+    ringSigCache.Set(CRingSigBatch::CacheKey(e));
+}
+
+uint256 CRingSigBatch::CacheKey(const Entry &e)
+{
+    // - everything the verification depends on, the preimage is only signed by RING_SIG_1,
+    //   the hashToEC mapping changes at the V3 boundary as in the CRingPointCache key
+    CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
+    uint8_t nMapping = Params().IsProtocolV3(nBestHeight) ? 1 : 0;
+    ss << nMapping;
+    ss << e.nType;
+    ss << e.vchImage;
+    ss << e.preimage;
+    ss << Hash(e.vchPubkeys.begin(), e.vchPubkeys.end());
+    ss << e.vchSigC;
+    ss << e.vchSigS;
+    return ss.GetHash();
+}
+
+#ifdef USE_NATIVE_SECP256K1
+
+static int hashToECNative(const uint8_t *p, uint32_t len, ec_ge &ptRet, bool fNew=false)
+{
+    // - same mapping as hashToEC()
+    uint256 pkHash = Hash(p, p + len);
+
+    if (fNew || Params().IsProtocolV3(nBestHeight))
+    {
+        // first x = hash + count with a point on the curve, even y
+        ec_fe x;
+        ECFieldSetB32(x, pkHash.begin());
+        for (int count = 0; count < 100; ++count)
+        {
+            if (ECPointSetXO(ptRet, x, false))
+                return 0;
+            ECFieldAddInt(x, 1);
+        };
+        return errorN(1, "%s: Failed to find a valid point for public key.", __func__);
+    };
+
+    ec_scalar scHash;
+    ec_gej ptT;
+    ECScalarSetB32(scHash, pkHash.begin());
+    ECMultGen(ptT, scHash);
+    ECPointSetGej(ptRet, ptT);
+
+    return 0;
+}
+
+// LRU cache of the parsed public key and hashToEC point of ring members,
+// popular anon outputs are picked as mixins for many rings
+class CRingPointCache
+{
+public:
+    struct Key
+    {
+        uint8_t v[EC_COMPRESSED_SIZE + 1]; // public key, hashToEC mode
+        bool operator<(const Key &o) const { return memcmp(v, o.v, sizeof(v)) < 0; };
+    };
+
+    struct Value
+    {
+        ec_ge ptPk;
+        ec_ge ptH;
+    };
+
+    CRingPointCache() : nMaxSize(DEFAULT_RING_POINT_CACHE_SIZE), nHits(0), nMisses(0) {};
+
+    bool Get(const Key &key, Value &value)
+    {
+        LOCK(cs);
+        std::map<Key, list_t::iterator>::iterator mi = mapEntries.find(key);
+        if (mi == mapEntries.end())
+        {
+            nMisses++;
+            return false;
+        };
+        nHits++;
+        lru.splice(lru.begin(), lru, mi->second);
+        value = mi->second->second;
+        return true;
+    };
+
+    void Put(const Key &key, const Value &value)
+    {
+        LOCK(cs);
+        if (nMaxSize == 0
+            || mapEntries.count(key))
+            return;
+        lru.push_front(std::make_pair(key, value));
+        mapEntries[key] = lru.begin();
+        Trim();
+    };
+
+    void SetMaxSize(size_t nMaxSizeIn)
+    {
+        LOCK(cs);
+        nMaxSize = nMaxSizeIn;
+        Trim();
+    };
+
+    void GetStats(CRingCacheStats &stats)
+    {
+        LOCK(cs);
+        stats.nHits = nHits;
+        stats.nMisses = nMisses;
+        stats.nEntries = mapEntries.size();
+        stats.nMaxEntries = nMaxSize;
+    };
+
+private:
+    typedef std::list<std::pair<Key, Value> > list_t;
+
+    void Trim()
+    {
+        while (mapEntries.size() > nMaxSize)
+        {
+            mapEntries.erase(lru.back().first);
+            lru.pop_back();
+        };
+    };
+
+    CCriticalSection cs;
+    list_t lru;                                 // most recently used first
+    std::map<Key, list_t::iterator> mapEntries;
+    size_t nMaxSize;
+    uint64_t nHits;
+    uint64_t nMisses;
+};
+
+static CRingPointCache ringPointCache;
+
+static int GetRingMemberPoints(const uint8_t *pPubkey, ec_ge *pptPk, ec_ge &ptH, bool fNew=false)
+{
+    // - P and hashToEC(P) for a compressed public key, pptPk is NULL when only H(P) is needed
+    CRingPointCache::Key key;
+    CRingPointCache::Value value;
+
+    memcpy(key.v, pPubkey, EC_COMPRESSED_SIZE);
+    key.v[EC_COMPRESSED_SIZE] = (fNew || Params().IsProtocolV3(nBestHeight)) ? 1 : 0;
+
+    if (ringPointCache.Get(key, value))
+    {
+        if (pptPk)
+            *pptPk = value.ptPk;
+        ptH = value.ptH;
+        return 0;
+    };
+
+    if (hashToECNative(pPubkey, EC_COMPRESSED_SIZE, ptH, key.v[EC_COMPRESSED_SIZE] == 1) != 0)
+        return 1;
+
+    if (!ECPointParse(value.ptPk, pPubkey, EC_COMPRESSED_SIZE))
+    {
+        if (pptPk)
+            return errorN(1, "%s: ECPointParse failed.", __func__);
+        return 0; // H(P) doesn't need a valid P, but don't cache it
+    };
+
+    if (pptPk)
+        *pptPk = value.ptPk;
+    value.ptH = ptH;
+    ringPointCache.Put(key, value);
+
+    return 0;
+}
+
+void SetRingPointCacheSize(size_t nMaxEntries)
+{
+    ringPointCache.SetMaxSize(nMaxEntries);
+}
+
+void GetRingPointCacheStats(CRingCacheStats &stats)
+{
+    ringPointCache.GetStats(stats);
+}
+
+int generateKeyImage(const ec_point &publicKey, ec_secret secret, ec_point &keyImage)
+{
+    // - keyImage = secret * hash(publicKey) * G
+
+    if (publicKey.size() != EC_COMPRESSED_SIZE)
+        return errorN(1, "%s: Invalid publicKey.", __func__);
+
+    ec_ge ptH;
+    ec_gej ptKi;
+    ec_scalar scSecret;
+
+    if (GetRingMemberPoints(&publicKey[0], NULL, ptH, true) != 0)
+        return errorN(1, "%s: hashToEC failed.", __func__);
+
+    ECScalarSetB32(scSecret, &secret.e[0]);
+    ECMultConst(ptKi, ptH, scSecret);
+
+    try { keyImage.resize(EC_COMPRESSED_SIZE); } catch (std::exception& e)
+    {
+        LogPrintf("%s: keyImage.resize threw: %s.\n", __func__, e.what());
+        return 1;
+    }
+
+    if (!ECPointSerialize(&keyImage[0], ptKi))
+        return errorN(1, "%s: point -> keyImage failed.", __func__);
+
+    if (fDebugRingSig)
+        LogPrintf("keyImage %s\n", HexStr(keyImage).c_str());
+
+    return 0;
+}
+
+int generateRingSignature(const data_chunk &keyImage, const uint256 &txnHash, int nRingSize, int nSecretOffset, ec_secret secret, const uint8_t *pPubkeys, uint8_t *pSigc, uint8_t *pSigr)
+{
+    if (fDebugRingSig)
+        LogPrintf("%s: Ring size %d.\n", __func__, nRingSize);
+
+    if (keyImage.size() != EC_COMPRESSED_SIZE)
+        return errorN(1, "%s: keyImage size !=  EC_COMPRESSED_SIZE.", __func__);
+
+    uint8_t tempData[66]; // hold raw point data to hash
+    uint256 commitHash;
+    ec_secret scData1, scData2;
+
+    ec_scalar scKS, scK1, scK2, scSum, scT;
+    ec_ge ptKi, ptPk, ptH;
+    ec_gej ptL, ptR;
+    ec_ge pts[2];
+    ec_scalar scs[2];
+
+    CHashWriter ssCommitHash(SER_GETHASH, PROTOCOL_VERSION);
+
+    ssCommitHash << txnHash;
+
+    // zero signature
+    memset(pSigc, 0, EC_SECRET_SIZE * nRingSize);
+    memset(pSigr, 0, EC_SECRET_SIZE * nRingSize);
+
+    // ks = random 256 bit int mod P
+    if (GenerateRandomSecret(scData1))
+        return errorN(1, "%s: GenerateRandomSecret failed.", __func__);
+    ECScalarSetB32(scKS, &scData1.e[0]);
+
+    // zero sum
+    ECScalarSetInt(scSum, 0);
+
+    // get keyimage as point
+    if (!ECPointParse(ptKi, &keyImage[0], EC_COMPRESSED_SIZE))
+        return errorN(1, "%s: extract ptKi failed.", __func__);
+
+    for (int i = 0; i < nRingSize; ++i)
+    {
+        if (GetRingMemberPoints(&pPubkeys[i * EC_COMPRESSED_SIZE], &ptPk, ptH) != 0)
+            return errorN(1, "%s: hashToEC failed.", __func__);
+
+        if (i == nSecretOffset)
+        {
+            // L = k * G
+            // R = k * HashToEC(PKi)
+            ECMultGen(ptL, scKS);
+            ECMultConst(ptR, ptH, scKS);
+        } else
+        {
+            // Li = k1 * Pi + k2 * G
+            // Ri = k1 * I + k2 * Hp(Pi)
+            // ci = k1
+            // ri = k2
+
+            if (GenerateRandomSecret(scData1) != 0
+                || GenerateRandomSecret(scData2) != 0)
+                return errorN(1, "%s: k1 and k2 failed.", __func__);
+
+            ECScalarSetB32(scK1, &scData1.e[0]);
+            ECScalarSetB32(scK2, &scData2.e[0]);
+
+            ECMult(ptL, ptPk, scK1, &scK2);
+
+            pts[0] = ptKi; scs[0] = scK1;
+            pts[1] = ptH;  scs[1] = scK2;
+            ECMultMulti(ptR, pts, scs, 2, NULL);
+
+            memcpy(&pSigc[i * EC_SECRET_SIZE], &scData1.e[0], EC_SECRET_SIZE);
+            memcpy(&pSigr[i * EC_SECRET_SIZE], &scData2.e[0], EC_SECRET_SIZE);
+
+            // sum = (sum + sigc) % N , sigc == k1
+            ECScalarAdd(scSum, scSum, scK1);
+        };
+
+        // -- add ptL and ptR to hash
+        if (!ECPointSerialize(&tempData[0], ptL)
+            || !ECPointSerialize(&tempData[33], ptR))
+            return errorN(1, "%s: extract ptL and ptR failed.", __func__);
+
+        ssCommitHash.write((const char*)&tempData[0], 66);
+    };
+
+    commitHash = ssCommitHash.GetHash();
+
+    // sigc[nSecretOffset] = (H - sum) % N
+    ECScalarSetB32(scT, commitHash.begin());
+    ECScalarSub(scT, scT, scSum);
+    ECScalarGetB32(&pSigc[nSecretOffset * EC_SECRET_SIZE], scT);
+
+    // sigr[nSecretOffset] = (ks - sigc[nSecretOffset] * secret) % N
+    ECScalarSetB32(scK1, &secret.e[0]);
+    ECScalarMul(scT, scT, scK1);
+    ECScalarSub(scT, scKS, scT);
+    ECScalarGetB32(&pSigr[nSecretOffset * EC_SECRET_SIZE], scT);
+
+    return 0;
+}
+
+int verifyRingSignature(const data_chunk &keyImage, const uint256 &txnHash, int nRingSize, const uint8_t *pPubkeys, const uint8_t *pSigc, const uint8_t *pSigr)
+{
+    if (keyImage.size() != EC_COMPRESSED_SIZE)
+        return errorN(1, "%s: keyImage size !=  EC_COMPRESSED_SIZE.", __func__);
+
+    uint8_t tempData[66]; // hold raw point data to hash
+    uint256 commitHash;
+
+    ec_scalar scC, scR, scSum, scH;
+    ec_ge ptKi, ptPk;
+    ec_gej ptL, ptR;
+    ec_ge pts[2];
+    ec_scalar scs[2];
+
+    CHashWriter ssCommitHash(SER_GETHASH, PROTOCOL_VERSION);
+
+    ssCommitHash << txnHash;
+
+    // zero sum
+    ECScalarSetInt(scSum, 0);
+
+    // get keyimage as point
+    if (!ECPointParse(ptKi, &keyImage[0], EC_COMPRESSED_SIZE))
+        return errorN(1, "%s: extract ptKi failed.", __func__);
+
+    for (int i = 0; i < nRingSize; ++i)
+    {
+        // Li = ci * Pi + ri * G
+        // Ri = ci * I + ri * Hp(Pi)
+
+        ECScalarSetB32(scC, &pSigc[i * EC_SECRET_SIZE]);
+        ECScalarSetB32(scR, &pSigr[i * EC_SECRET_SIZE]);
+
+        if (GetRingMemberPoints(&pPubkeys[i * EC_COMPRESSED_SIZE], &ptPk, pts[1]) != 0)
+            return errorN(1, "%s: extract ptPk failed.", __func__);
+
+        ECMult(ptL, ptPk, scC, &scR);
+
+        pts[0] = ptKi; scs[0] = scC;
+        scs[1] = scR;
+        ECMultMulti(ptR, pts, scs, 2, NULL);
+
+        // sum = (sum + ci) % N
+        ECScalarAdd(scSum, scSum, scC);
+
+        // -- add ptL and ptR to hash
+        if (!ECPointSerialize(&tempData[0], ptL)
+            || !ECPointSerialize(&tempData[33], ptR))
+            return errorN(1, "%s: extract ptL and ptR failed.", __func__);
+
+        ssCommitHash.write((const char*)&tempData[0], 66);
+    };
+
+    commitHash = ssCommitHash.GetHash();
+
+    // test (H % N) == sum
+    ECScalarSetB32(scH, commitHash.begin());
+    if (!ECScalarEqual(scH, scSum))
+    {
+        LogPrintf("%s: signature does not verify.\n", __func__);
+        return 2;
+    };
+
+    return 0;
+}
+
+int generateRingSignatureAB(const data_chunk &keyImage, int nRingSize, int nSecretOffset, ec_secret secret, const uint8_t *pPubkeys, data_chunk &sigC, uint8_t *pSigS)
+{
+    // https://bitcointalk.org/index.php?topic=972541.msg10619684
+
+    if (fDebugRingSig)
+        LogPrintf("%s: Ring size %d.\n", __func__, nRingSize);
+
+    assert(nRingSize < 200);
+
+    if (keyImage.size() != EC_COMPRESSED_SIZE)
+        return errorN(1, "%s: keyImage size !=  EC_COMPRESSED_SIZE.", __func__);
+
+    RandAddSeedPerfmon();
+
+    memset(pSigS, 0, EC_SECRET_SIZE * nRingSize);
+
+    uint256 tmpPkHash;
+    uint256 tmpHash;
+
+    uint8_t tempData[66]; // hold raw point data to hash
+    ec_secret sAlpha;
+
+    if (0 != GenerateRandomSecret(sAlpha))
+        return errorN(1, "%s: GenerateRandomSecret failed.", __func__);
+
+    CHashWriter ssPkHash(SER_GETHASH, PROTOCOL_VERSION);
+    CHashWriter ssCjHash(SER_GETHASH, PROTOCOL_VERSION);
+
+    uint256 test;
+    for (int i = 0; i < nRingSize; ++i)
+    {
+        ssPkHash.write((const char*)&pPubkeys[i * EC_COMPRESSED_SIZE], EC_COMPRESSED_SIZE);
+
+        if (i == nSecretOffset)
+            continue;
+
+        int k;
+        // NOTE: necessary to clamp?
+        for (k = 0; k < 32; ++k)
+        {
+            if (1 != RAND_bytes(&pSigS[i * EC_SECRET_SIZE], 32))
+                return errorN(1, "%s: RAND_bytes ERR_get_error %u.", __func__, ERR_get_error());
+
+            memcpy(test.begin(), &pSigS[i * EC_SECRET_SIZE], 32);
+            if (test > MIN_SECRET && test < MAX_SECRET)
+                break;
+        }
+
+        if (k > 31)
+            return errorN(1, "%s: Failed to generate a valid key.", __func__);
+    }
+
+    tmpPkHash = ssPkHash.GetHash();
+
+    ec_scalar scA, scS, scC, scCj, scT;
+    ec_ge ptKi, ptPk;
+    ec_gej ptT1, ptT2;
+    ec_ge pts[2];
+    ec_scalar scs[2];
+
+    // get keyimage as point
+    if (!ECPointParse(ptKi, &keyImage[0], EC_COMPRESSED_SIZE))
+        return errorN(1, "%s: extract ptKi failed.", __func__);
+
+    // c_{j+1} = h(P_1,...,P_n,alpha*G,alpha*H(P_j))
+    ECScalarSetB32(scA, &sAlpha.e[0]);
+
+    // ptT1 = alpha * G
+    ECMultGen(ptT1, scA);
+
+    // pts[0] = H(Pj)
+    if (GetRingMemberPoints(&pPubkeys[nSecretOffset * EC_COMPRESSED_SIZE], NULL, pts[0]) != 0)
+        return errorN(1, "%s: hashToEC failed.", __func__);
+
+    // ptT2 = alpha * H(P_j)
+    ECMultConst(ptT2, pts[0], scA);
+
+    if (!ECPointSerialize(&tempData[0], ptT1)
+        || !ECPointSerialize(&tempData[33], ptT2))
+        return errorN(1, "%s: extract ptL and ptR failed.", __func__);
+
+    ssCjHash.write((const char*)tmpPkHash.begin(), 32);
+    ssCjHash.write((const char*)&tempData[0], 66);
+    tmpHash = ssCjHash.GetHash();
+
+    ECScalarSetB32(scC, tmpHash.begin()); // scC lags i by 1
+    ECScalarSetInt(scCj, 0);
+
+    // c_{j+2} = h(P_1,...,P_n,s_{j+1}*G+c_{j+1}*P_{j+1},s_{j+1}*H(P_{j+1})+c_{j+1}*I_j)
+    for (int k = 0, ib = (nSecretOffset + 1) % nRingSize, i = (nSecretOffset + 2) % nRingSize;
+        k < nRingSize;
+        ++k, ib=i, i=(i+1) % nRingSize)
+    {
+        if (k == nRingSize - 1)
+        {
+            // s_j = alpha - c_j*x_j mod n.
+            ECScalarSetB32(scT, &secret.e[0]);
+            ECScalarMul(scT, scCj, scT);
+            ECScalarSub(scS, scA, scT);
+            ECScalarGetB32(&pSigS[nSecretOffset * EC_SECRET_SIZE], scS);
+
+            if (nSecretOffset != nRingSize - 1)
+                break;
+        };
+
+        ECScalarSetB32(scS, &pSigS[ib * EC_SECRET_SIZE]);
+
+        // scC is from last round (ib)
+        if (GetRingMemberPoints(&pPubkeys[ib * EC_COMPRESSED_SIZE], &ptPk, pts[0]) != 0)
+            return errorN(1, "%s: ECPointParse failed.", __func__);
+
+        // ptT1 = s_{j+1}*G+c_{j+1}*P_{j+1}
+        ECMult(ptT1, ptPk, scC, &scS);
+
+        // ptT2 = s_{j+1}*H(P_{j+1})+c_{j+1}*I_j
+
+        scs[0] = scS;
+        pts[1] = ptKi; scs[1] = scC;
+        ECMultMulti(ptT2, pts, scs, 2, NULL);
+
+        if (!ECPointSerialize(&tempData[0], ptT1)
+            || !ECPointSerialize(&tempData[33], ptT2))
+            return errorN(1, "%s: extract ptL and ptR failed.", __func__);
+
+        CHashWriter ssCHash(SER_GETHASH, PROTOCOL_VERSION);
+        ssCHash.write((const char*)tmpPkHash.begin(), 32);
+        ssCHash.write((const char*)&tempData[0], 66);
+        tmpHash = ssCHash.GetHash();
+
+        ECScalarSetB32(scC, tmpHash.begin()); // scC lags i by 1
+
+        if (i == nSecretOffset)
+            scCj = scC;
+
+        if (i == 0)
+        {
+            try { sigC.resize(EC_SECRET_SIZE); } catch (std::exception& e)
+            {
+                LogPrintf("%s: sigC.resize failed.\n", __func__);
+                return 1;
+            }
+            ECScalarGetB32(&sigC[0], scC);
+        };
+    };
+
+    return 0;
+}
+
+int verifyRingSignatureAB(const data_chunk &keyImage, int nRingSize, const uint8_t *pPubkeys, const data_chunk &sigC, const uint8_t *pSigS)
+{
+    // https://bitcointalk.org/index.php?topic=972541.msg10619684
+
+    // forall_{i=1..n} compute e_i=s_i*G+c_i*P_i and E_i=s_i*H(P_i)+c_i*I_j and c_{i+1}=h(P_1,...,P_n,e_i,E_i)
+    // check c_{n+1}=c_1
+
+    if (sigC.size() != EC_SECRET_SIZE)
+        return errorN(1, "%s: sigC size !=  EC_SECRET_SIZE.", __func__);
+    if (keyImage.size() != EC_COMPRESSED_SIZE)
+        return errorN(1, "%s: keyImage size !=  EC_COMPRESSED_SIZE.", __func__);
+
+    uint256 tmpPkHash;
+    uint256 tmpHash;
+
+    uint8_t tempData[66]; // hold raw point data to hash
+    CHashWriter ssPkHash(SER_GETHASH, PROTOCOL_VERSION);
+
+    for (int i = 0; i < nRingSize; ++i)
+    {
+        ssPkHash.write((const char*)&pPubkeys[i * EC_COMPRESSED_SIZE], EC_COMPRESSED_SIZE);
+    }
+
+    tmpPkHash = ssPkHash.GetHash();
+
+    ec_scalar scC, scC1, scS;
+    ec_ge ptKi, ptPk;
+    ec_gej ptT1, ptT2;
+    ec_ge pts[2];
+    ec_scalar scs[2];
+
+    // get keyimage as point, parsing checks the point is on the curve, as the
+    // cofactor is 1 that also covers the (keyimage * order == infinity) test
+    if (!ECPointParse(ptKi, &keyImage[0], EC_COMPRESSED_SIZE))
+        return errorN(1, "%s: extract ptKi failed.", __func__);
+
+    ECScalarSetB32(scC1, &sigC[0]);
+    scC = scC1;
+
+    for (int i = 0; i < nRingSize; ++i)
+    {
+        ECScalarSetB32(scS, &pSigS[i * EC_SECRET_SIZE]);
+
+        if (GetRingMemberPoints(&pPubkeys[i * EC_COMPRESSED_SIZE], &ptPk, pts[0]) != 0)
+            return errorN(1, "%s: ECPointParse failed.", __func__);
+
+        // ptT1 = e_i=s_i*G+c_i*P_i
+        ECMult(ptT1, ptPk, scC, &scS);
+
+        if (!ECPointSerialize(&tempData[0], ptT1))
+            return errorN(1, "%s: extract ptT1 failed.", __func__);
+
+        // ptT2 = E_i=s_i*H(P_i)+c_i*I_j
+
+        scs[0] = scS;
+        pts[1] = ptKi; scs[1] = scC;
+        ECMultMulti(ptT2, pts, scs, 2, NULL);
+
+        if (!ECPointSerialize(&tempData[33], ptT2))
+            return errorN(1, "%s: extract ptT2 failed.", __func__);
+
+        CHashWriter ssCHash(SER_GETHASH, PROTOCOL_VERSION);
+        ssCHash.write((const char*)tmpPkHash.begin(), 32);
+        ssCHash.write((const char*)&tempData[0], 66);
+        tmpHash = ssCHash.GetHash();
+
+        ECScalarSetB32(scC, tmpHash.begin());
+    };
+
+    // test scC == scC1
+    if (!ECScalarEqual(scC, scC1))
+    {
+        LogPrintf("%s: signature does not verify.\n", __func__);
+        return 2;
+    };
+
+    return 0;
+}
+
+int CRingSigBatch::Verify(std::vector<size_t> &vFailed) const
+{
+    vFailed.clear();
+
+    size_t nEntries = vEntries.size();
+    if (nEntries == 0)
+        return 0;
+
+    struct State
+    {
+        uint256 pkHash;
+        ec_ge ptKi;
+        ec_scalar scC, scC1;
+        bool fActive;
+    };
+
+    std::vector<State> vState(nEntries);
+    int nMaxRingSize = 0;
+
+    for (size_t k = 0; k < nEntries; ++k)
+    {
+        const Entry &e = vEntries[k];
+        State &st = vState[k];
+        st.fActive = false;
+
+        if (e.nType == RING_SIG_1)
+        {
+            if (VerifyEntry(e) != 0)
+                vFailed.push_back(k);
+            continue;
+        };
+
+        if (e.vchSigC.size() != EC_SECRET_SIZE
+            || e.vchImage.size() != EC_COMPRESSED_SIZE
+            || e.nRingSize < 1
+            || e.vchPubkeys.size() != (size_t)e.nRingSize * EC_COMPRESSED_SIZE
+            || e.vchSigS.size() != (size_t)e.nRingSize * EC_SECRET_SIZE)
+        {
+            LogPrintf("%s: entry %u malformed.\n", __func__, k);
+            vFailed.push_back(k);
+            continue;
+        };
+
+        if (!ECPointParse(st.ptKi, &e.vchImage[0], EC_COMPRESSED_SIZE))
+        {
+            LogPrintf("%s: entry %u extract ptKi failed.\n", __func__, k);
+            vFailed.push_back(k);
+            continue;
+        };
+
+        st.pkHash = Hash(e.vchPubkeys.begin(), e.vchPubkeys.end());
+        ECScalarSetB32(st.scC1, &e.vchSigC[0]);
+        st.scC = st.scC1;
+        st.fActive = true;
+
+        if (e.nRingSize > nMaxRingSize)
+            nMaxRingSize = e.nRingSize;
+    };
+
+    std::vector<ec_gej> vPtsJ(2 * nEntries);
+    std::vector<ec_ge> vPts(2 * nEntries);
+    std::vector<size_t> vStep;
+    vStep.reserve(nEntries);
+
+    uint8_t tempData[66]; // hold raw point data to hash
+    ec_ge ptPk;
+    ec_scalar scS;
+    ec_ge pts[2];
+    ec_scalar scs[2];
+
+    for (int i = 0; i < nMaxRingSize; ++i)
+    {
+        // e_i=s_i*G+c_i*P_i and E_i=s_i*H(P_i)+c_i*I_j for every ring still running
+        vStep.clear();
+        for (size_t k = 0; k < nEntries; ++k)
+        {
+            const Entry &e = vEntries[k];
+            State &st = vState[k];
+            if (!st.fActive || i >= e.nRingSize)
+                continue;
+
+            const uint8_t *pPk = &e.vchPubkeys[i * EC_COMPRESSED_SIZE];
+            if (GetRingMemberPoints(pPk, &ptPk, pts[0]) != 0)
+            {
+                LogPrintf("%s: entry %u element %d invalid public key.\n", __func__, k, i);
+                st.fActive = false;
+                vFailed.push_back(k);
+                continue;
+            };
+
+            ECScalarSetB32(scS, &e.vchSigS[i * EC_SECRET_SIZE]);
+
+            size_t n = vStep.size();
+            ECMult(vPtsJ[2 * n], ptPk, st.scC, &scS);
+
+            scs[0] = scS;
+            pts[1] = st.ptKi; scs[1] = st.scC;
+            ECMultMulti(vPtsJ[2 * n + 1], pts, scs, 2, NULL);
+
+            vStep.push_back(k);
+        };
+
+        if (vStep.empty())
+            continue;
+
+        ECPointSetGejBatch(&vPts[0], &vPtsJ[0], 2 * vStep.size());
+
+        for (size_t n = 0; n < vStep.size(); ++n)
+        {
+            size_t k = vStep[n];
+            State &st = vState[k];
+
+            if (!ECPointSerialize(&tempData[0], vPts[2 * n])
+                || !ECPointSerialize(&tempData[33], vPts[2 * n + 1]))
+            {
+                LogPrintf("%s: entry %u element %d point at infinity.\n", __func__, k, i);
+                st.fActive = false;
+                vFailed.push_back(k);
+                continue;
+            };
+
+            CHashWriter ssCHash(SER_GETHASH, PROTOCOL_VERSION);
+            ssCHash.write((const char*)st.pkHash.begin(), 32);
+            ssCHash.write((const char*)&tempData[0], 66);
+            uint256 tmpHash = ssCHash.GetHash();
+
+            ECScalarSetB32(st.scC, tmpHash.begin());
+        };
+    };
+
+    for (size_t k = 0; k < nEntries; ++k)
+    {
+        if (!vState[k].fActive)
+            continue;
+
+        if (!ECScalarEqual(vState[k].scC, vState[k].scC1))
+        {
+            LogPrintf("%s: entry %u signature does not verify.\n", __func__, k);
+            vFailed.push_back(k);
+        } else
+        {
+            SetRingSigVerified(vEntries[k]);
+        };
+    };
+
+    std::sort(vFailed.begin(), vFailed.end());
+
+    return vFailed.empty() ? 0 : 2;
+}
+
+#else // USE_NATIVE_SECP256K1
+
+int generateKeyImage(const ec_point &publicKey, ec_secret secret, ec_point &keyImage)
+{
+    return generateKeyImageOpenSSL(GetRingSigContext(), publicKey, secret, keyImage);
+}
+
+int generateRingSignature(const data_chunk &keyImage, const uint256 &txnHash, int nRingSize, int nSecretOffset, ec_secret secret, const uint8_t *pPubkeys, uint8_t *pSigc, uint8_t *pSigr)
+{
+    return generateRingSignatureOpenSSL(GetRingSigContext(), keyImage, txnHash, nRingSize, nSecretOffset, secret, pPubkeys, pSigc, pSigr);
+}
+
+int verifyRingSignature(const data_chunk &keyImage, const uint256 &txnHash, int nRingSize, const uint8_t *pPubkeys, const uint8_t *pSigc, const uint8_t *pSigr)
+{
+    return verifyRingSignatureOpenSSL(GetRingSigContext(), keyImage, txnHash, nRingSize, pPubkeys, pSigc, pSigr);
+}
+
+int generateRingSignatureAB(const data_chunk &keyImage, int nRingSize, int nSecretOffset, ec_secret secret, const uint8_t *pPubkeys, data_chunk &sigC, uint8_t *pSigS)
+{
+    return generateRingSignatureABOpenSSL(GetRingSigContext(), keyImage, nRingSize, nSecretOffset, secret, pPubkeys, sigC, pSigS);
+}
+
+int verifyRingSignatureAB(const data_chunk &keyImage, int nRingSize, const uint8_t *pPubkeys, const data_chunk &sigC, const uint8_t *pSigS)
+{
+    return verifyRingSignatureABOpenSSL(GetRingSigContext(), keyImage, nRingSize, pPubkeys, sigC, pSigS);
+}
+
+void SetRingPointCacheSize(size_t nMaxEntries)
+{
+}
+
+void GetRingPointCacheStats(CRingCacheStats &stats)
+{
+    stats.nHits = 0;
+    stats.nMisses = 0;
+    stats.nEntries = 0;
+    stats.nMaxEntries = 0;
+}
+
+int CRingSigBatch::Verify(std::vector<size_t> &vFailed) const
+{
+    vFailed.clear();
+
+    for (size_t k = 0; k < vEntries.size(); ++k)
+    {
+        if (VerifyEntry(vEntries[k]) != 0)
+            vFailed.push_back(k);
+    };
+
+    return vFailed.empty() ? 0 : 2;
+}
+
+#endif // USE_NATIVE_SECP256K1
+
+bool CRingSigBatch::Add(const data_chunk &keyImage, int nRingSize, const uint8_t *pPubkeys, const data_chunk &sigC, const uint8_t *pSigS,
+                        const uint256 &txnHash, int nInput)
+{
+    // - ConnectBlock and ConnectInputs both run CheckAnonInputs, queue each input once,
+    //   the txn hash commits to the scriptSig
+    if (!setQueued.insert(std::make_pair(txnHash, nInput)).second)
+        return false;
+
+    vEntries.push_back(Entry());
+    Entry &e = vEntries.back();
+    e.nType = RING_SIG_2;
+    e.nRingSize = nRingSize;
+    e.vchImage = keyImage;
+    e.vchPubkeys.assign(pPubkeys, pPubkeys + EC_COMPRESSED_SIZE * nRingSize);
+    e.vchSigC = sigC;
+    e.vchSigS.assign(pSigS, pSigS + EC_SECRET_SIZE * nRingSize);
+    e.txnHash = txnHash;
+    e.nInput = nInput;
+
+    if (ringSigCache.Get(CacheKey(e)))
+    {
+        vEntries.pop_back();
+        return false;
+    };
+
+    return true;
+}
+
+bool CRingSigBatch::AddLegacy(const data_chunk &keyImage, const uint256 &preimage, int nRingSize, const uint8_t *pPubkeys, const uint8_t *pSigc, const uint8_t *pSigr,
+                              const uint256 &txnHash, int nInput)
+{
+    if (!setQueued.insert(std::make_pair(txnHash, nInput)).second)
+        return false;
+
+    vEntries.push_back(Entry());
+    Entry &e = vEntries.back();
+    e.nType = RING_SIG_1;
+    e.nRingSize = nRingSize;
+    e.vchImage = keyImage;
+    e.vchPubkeys.assign(pPubkeys, pPubkeys + EC_COMPRESSED_SIZE * nRingSize);
+    e.vchSigC.assign(pSigc, pSigc + EC_SECRET_SIZE * nRingSize);
+    e.vchSigS.assign(pSigr, pSigr + EC_SECRET_SIZE * nRingSize);
+    e.preimage = preimage;
+    e.txnHash = txnHash;
+    e.nInput = nInput;
+
+    if (ringSigCache.Get(CacheKey(e)))
+    {
+        vEntries.pop_back();
+        return false;
+    };
+
+    return true;
+}
+
+int CRingSigBatch::VerifyEntry(const Entry &e)
+{
+    if (e.nRingSize < 1
+        || e.vchPubkeys.size() != (size_t)e.nRingSize * EC_COMPRESSED_SIZE
+        || e.vchSigS.size() != (size_t)e.nRingSize * EC_SECRET_SIZE)
+        return errorN(1, "%s: entry malformed.", __func__);
+
+    int rv;
+    if (e.nType == RING_SIG_1)
+    {
+        if (e.vchSigC.size() != (size_t)e.nRingSize * EC_SECRET_SIZE)
+            return errorN(1, "%s: entry malformed.", __func__);
+        rv = verifyRingSignature(e.vchImage, e.preimage, e.nRingSize, &e.vchPubkeys[0], &e.vchSigC[0], &e.vchSigS[0]);
+    } else
+    {
+        rv = verifyRingSignatureAB(e.vchImage, e.nRingSize, &e.vchPubkeys[0], e.vchSigC, &e.vchSigS[0]);
+    };
+
+    if (rv == 0)
+        SetRingSigVerified(e);
+
+    return rv;
+}
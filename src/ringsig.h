@@ -11,6 +11,12 @@
 #include "state.h"
 #include "types.h"
 
+#include <set>
+#include <vector>
+
+#include <openssl/bn.h>
+#include <openssl/ec.h>
+
 class CPubKey;
 
 enum ringsigType
@@ -30,12 +36,59 @@ const int ANON_TXN_VERSION = 1000;
 
 // MAX_MONEY = 200000000000000000; most complex possible value can be represented by 36 outputs
 
+// OpenSSL state used by the reference ring signature code. A context must
+// only be used by one thread at a time, GetRingSigContext() returns the one
+// owned by the calling thread (created on first use, freed at thread exit).
+// The native secp256k1 functions keep no mutable state and need no context.
+class CRingSigContext
+{
+public:
+    CRingSigContext();
+    ~CRingSigContext();
+
+    EC_GROUP *ecGrp;
+    BN_CTX   *bnCtx;
+    BIGNUM   *bnOrder;
+
+private:
+    CRingSigContext(const CRingSigContext&);
+    CRingSigContext &operator=(const CRingSigContext&);
+    void Free();
+};
+
+CRingSigContext &GetRingSigContext();
+
+// sets up the calling thread's context and the native generator tables
 int initialiseRingSigs();
+// frees the calling thread's context
 int finaliseRingSigs();
 
+struct CRingCacheStats
+{
+    uint64_t nHits;
+    uint64_t nMisses;
+    uint64_t nEntries;
+    uint64_t nMaxEntries;
+};
+
+// LRU cache of the decompressed public key and hashToEC point of ring
+// members, used by the native key image and ring signature functions.
+static const size_t DEFAULT_RING_POINT_CACHE_SIZE = 20000;
+
+void SetRingPointCacheSize(size_t nMaxEntries);
+void GetRingPointCacheStats(CRingCacheStats &stats);
+
+// Ring signatures that verified, so inputs accepted into the mempool are not
+// verified again when the transaction is connected in a block.
+// Bounded by -maxringsigcachesize entries.
+static const int64_t DEFAULT_MAX_RINGSIG_CACHE_SIZE = 50000;
+
+void GetRingSigCacheStats(CRingCacheStats &stats);
+
 int splitAmount(int64_t nValue, std::vector<int64_t> &vOut, int64_t maxAnonOutput = nMaxAnonOutput);
 
 int getOldKeyImage(const CPubKey &pubkey, ec_point &keyImage);
+int getOldKeyImage(CRingSigContext &ctx, const CPubKey &pubkey, ec_point &keyImage);
 
 int generateKeyImage(const ec_point &publicKey, ec_secret secret, ec_point &keyImage);
 
@@ -45,6 +98,68 @@ int verifyRingSignature(const data_chunk &keyImage, const uint256 &txnHash, int
 int generateRingSignatureAB(const data_chunk &keyImage, int nRingSize, int nSecretOffset, ec_secret secret, const uint8_t *pPubkeys, data_chunk &sigC, uint8_t *pSigS);
 int verifyRingSignatureAB(const data_chunk &keyImage, int nRingSize, const uint8_t *pPubkeys, const data_chunk &sigC, const uint8_t *pSigS);
 
+// Collects the ring signatures of a block and verifies them together.
+// The c_i chain of an AB signature can't be folded into one multi-scalar
+// equation (each c_{i+1} hashes the points of step i), so the AB signatures
+// are walked in lockstep instead: step i of every queued ring is computed,
+// then all 2*n points are normalised with a single field inversion before
+// hashing. Legacy (RING_SIG_1) entries are verified one by one.
+// Failures are reported per entry, so no re-verification is needed to find
+// the bad input.
+class CRingSigBatch
+{
+public:
+    struct Entry
+    {
+        int nType;              // ringsigType
+        int nRingSize;
+        data_chunk vchImage;
+        data_chunk vchPubkeys;
+        data_chunk vchSigC;     // RING_SIG_2: c_1, RING_SIG_1: c_i
+        data_chunk vchSigS;     // RING_SIG_2: s_i, RING_SIG_1: r_i
+        uint256 preimage;       // RING_SIG_1 only
+        uint256 txnHash;
+        int nInput;
+    };
+
+    // returns false if the input is already queued or its signature is in the
+    // verified cache
+    bool Add(const data_chunk &keyImage, int nRingSize, const uint8_t *pPubkeys, const data_chunk &sigC, const uint8_t *pSigS,
+             const uint256 &txnHash, int nInput);
+    bool AddLegacy(const data_chunk &keyImage, const uint256 &preimage, int nRingSize, const uint8_t *pPubkeys, const uint8_t *pSigc, const uint8_t *pSigr,
+                   const uint256 &txnHash, int nInput);
+
+    // 0 if all signatures verify, vFailed receives the indices of bad entries
+    int Verify(std::vector<size_t> &vFailed) const;
+
+    // verify a single entry, 0 if the signature verifies
+    static int VerifyEntry(const Entry &e);
+
+    // key of the entry in the verified signature cache
+    static uint256 CacheKey(const Entry &e);
+
+    // move the queued entries out, inputs stay marked as queued
+    void TakeEntries(std::vector<Entry> &vOut) { vOut.clear(); vOut.swap(vEntries); };
+
+    const Entry &Get(size_t i) const { return vEntries[i]; };
+    size_t size() const { return vEntries.size(); };
+    bool empty() const { return vEntries.empty(); };
+    void clear() { vEntries.clear(); setQueued.clear(); };
+
+private:
+    std::vector<Entry> vEntries;
+    std::set<std::pair<uint256, int> > setQueued;
+};
+
+// OpenSSL EC_POINT implementations, kept as reference for the native secp256k1 backend (ecmult.h)
+int generateKeyImageOpenSSL(CRingSigContext &ctx, const ec_point &publicKey, ec_secret secret, ec_point &keyImage);
+
+int generateRingSignatureOpenSSL(CRingSigContext &ctx, const data_chunk &keyImage, const uint256 &txnHash, int nRingSize, int nSecretOffset, ec_secret secret, const uint8_t *pPubkeys, uint8_t *pSigc, uint8_t *pSigr);
+int verifyRingSignatureOpenSSL(CRingSigContext &ctx, const data_chunk &keyImage, const uint256 &txnHash, int nRingSize, const uint8_t *pPubkeys, const uint8_t *pSigc, const uint8_t *pSigr);
+
+int generateRingSignatureABOpenSSL(CRingSigContext &ctx, const data_chunk &keyImage, int nRingSize, int nSecretOffset, ec_secret secret, const uint8_t *pPubkeys, data_chunk &sigC, uint8_t *pSigS);
+int verifyRingSignatureABOpenSSL(CRingSigContext &ctx, const data_chunk &keyImage, int nRingSize, const uint8_t *pPubkeys, const data_chunk &sigC, const uint8_t *pSigS);
+
 
 #endif  // SPEC_RINGSIG_H
 
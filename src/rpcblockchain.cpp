@@ -6,11 +6,13 @@
 // SPDX-License-Identifier: MIT
 
 #include "main.h"
+#include "blockfile.h"
 #include "rpcserver.h"
 #include "init.h"
 #include "txdb.h"
 #include "kernel.h"
 #include "checkpoints.h"
+#include "ringsig.h"
 #include <errno.h>
 #ifdef _MSC_BUILD
 #include "win/unistd.h"
@@ -469,14 +471,12 @@ Value getblockbynumber(const Array& params, bool fHelp)
 
 
         CBlockThin block;
-        std::map<uint256, CBlockThinIndex*>::iterator mi = mapBlockThinIndex.find(hashBestChain);
+        BlockThinMap::iterator mi = mapBlockThinIndex.find(hashBestChain);
         if (mi != mapBlockThinIndex.end())
         {
-            CBlockThinIndex* pblockindex = mi->second;
-            while (pblockindex->pprev && pblockindex->nHeight > nHeight)
-                pblockindex = pblockindex->pprev;
+            CBlockThinIndex* pblockindex = mi->second->GetAncestor(nHeight);
 
-            if (nHeight != pblockindex->nHeight)
+            if (!pblockindex)
             {
                 throw runtime_error("block not in chain index.");
             }
@@ -490,13 +490,7 @@ Value getblockbynumber(const Array& params, bool fHelp)
     }
 
     CBlock block;
-    CBlockIndex* pblockindex = mapBlockIndex[hashBestChain];
-    while (pblockindex->nHeight > nHeight)
-        pblockindex = pblockindex->pprev;
-
-    uint256 hash = *pblockindex->phashBlock;
-
-    pblockindex = mapBlockIndex[hash];
+    CBlockIndex* pblockindex = mapBlockIndex[hashBestChain]->GetAncestor(nHeight);
     block.ReadFromDisk(pblockindex, true);
 
     return blockToJSON(block, pblockindex, params.size() > 1 ? params[1].get_bool() : false);
@@ -519,13 +513,7 @@ Value setbestblockbyheight(const Array& params, bool fHelp)
     };
 
     CBlock block;
-    CBlockIndex* pblockindex = mapBlockIndex[hashBestChain];
-    while (pblockindex->nHeight > nHeight)
-        pblockindex = pblockindex->pprev;
-
-    uint256 hash = *pblockindex->phashBlock;
-
-    pblockindex = mapBlockIndex[hash];
+    CBlockIndex* pblockindex = mapBlockIndex[hashBestChain]->GetAncestor(nHeight);
     block.ReadFromDisk(pblockindex, true);
 
 
@@ -682,11 +670,11 @@ Value rewindchain(const Array& params, bool fHelp)
         };
 
         CBlock block;
-        blkdat >> block;
+        ReadBlockRecord(blkdat, 0, block);
         uint256 hashblock = block.GetHash();
         LogPrintf("hashblock %s .\n", hashblock.ToString().c_str());
 
-        std::map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(hashblock);
+        BlockMap::iterator mi = mapBlockIndex.find(hashblock);
         if (mi != mapBlockIndex.end() && (*mi).second)
         {
             LogPrintf("block is in main chain.\n");
@@ -713,7 +701,7 @@ Value rewindchain(const Array& params, bool fHelp)
                 mi->second->pprev->pnext = NULL;
             };
 
-            delete mi->second;
+            blockIndexArena.Delete(mi->second);
             mapBlockIndex.erase(mi);
         };
 
@@ -734,11 +722,16 @@ Value rewindchain(const Array& params, bool fHelp)
         LogPrintf("EraseBlockIndex().\n");
         txdb.EraseBlockIndex(hashblock);
 
-        errno = 0;
-        if (ftruncate(fileno(fp), fpos+foundPos-MESSAGE_START_SIZE) != 0)
         {
-            LogPrintf("ftruncate failed: %s\n", strerror(errno));
-        };
+            // - no reader may hold a mapping past the new end of the file
+            CBlockFileUnmapped unmapped(false, nFileRet);
+
+            errno = 0;
+            if (ftruncate(fileno(fp), fpos+foundPos-MESSAGE_START_SIZE) != 0)
+            {
+                LogPrintf("ftruncate failed: %s\n", strerror(errno));
+            };
+        }
 
         LogPrintf("hashBestChain %s, nBestHeight %d\n", hashBestChain.ToString().c_str(), nBestHeight);
 
@@ -933,6 +926,58 @@ Value getcheckpoint(const Array& params, bool fHelp)
     return result;
 }
 
+Value getringsiginfo(const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "getringsiginfo\n"
+            "Show ring signature cache statistics.\n");
+
+    Object result;
+    CRingCacheStats stats;
+    GetRingPointCacheStats(stats);
+
+    Object pointCache;
+    pointCache.push_back(Pair("hits", stats.nHits));
+    pointCache.push_back(Pair("misses", stats.nMisses));
+    pointCache.push_back(Pair("entries", stats.nEntries));
+    pointCache.push_back(Pair("maxentries", stats.nMaxEntries));
+    result.push_back(Pair("pointcache", pointCache));
+
+    GetRingSigCacheStats(stats);
+
+    Object sigCache;
+    sigCache.push_back(Pair("hits", stats.nHits));
+    sigCache.push_back(Pair("misses", stats.nMisses));
+    sigCache.push_back(Pair("entries", stats.nEntries));
+    sigCache.push_back(Pair("maxentries", stats.nMaxEntries));
+    result.push_back(Pair("sigcache", sigCache));
+
+    return result;
+}
+
+Value getblockfileinfo(const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "getblockfileinfo\n"
+            "Show memory mapped and compressed block file statistics.\n");
+
+    CBlockFileStats stats;
+    GetBlockFileStats(stats);
+
+    Object result;
+    result.push_back(Pair("mappings", stats.nMappings));
+    result.push_back(Pair("mappedbytes", stats.nMapped));
+    result.push_back(Pair("mapcalls", stats.nMapCalls));
+    result.push_back(Pair("reads", stats.nReads));
+    result.push_back(Pair("bytesread", stats.nBytesRead));
+    result.push_back(Pair("fallbacks", stats.nFallbacks));
+    result.push_back(Pair("decompressed", stats.nDecompressed));
+
+    return result;
+}
+
 
 
 Value thinscanmerkleblocks(const Array& params, bool fHelp)
@@ -1052,7 +1097,7 @@ Value gettxout(const Array& params, bool fHelp)
     }
     else
     {
-        map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(hashBlock);
+        BlockMap::iterator mi = mapBlockIndex.find(hashBlock);
         if (mi != mapBlockIndex.end() && (*mi).second)
         {
             CBlockIndex* pindex = (*mi).second;
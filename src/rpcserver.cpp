@@ -345,6 +345,8 @@ static const CRPCCommand vRPCCommands[] =
     { "signrawtransaction",     &signrawtransaction,     false,     false,     false },
     { "sendrawtransaction",     &sendrawtransaction,     false,     false,     false },
     { "getcheckpoint",          &getcheckpoint,          true,      false,     false },
+    { "getringsiginfo",         &getringsiginfo,         true,      true,      false },
+    { "getblockfileinfo",       &getblockfileinfo,       true,      true,      false },
     { "reservebalance",         &reservebalance,         false,     true,      false },
     { "checkwallet",            &checkwallet,            false,     true,      false },
     { "repairwallet",           &repairwallet,           false,     true,      false },
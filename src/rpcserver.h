@@ -212,6 +212,8 @@ extern json_spirit::Value rewindchain(const json_spirit::Array& params, bool fHe
 extern json_spirit::Value nextorphan(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value getorphans(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value getcheckpoint(const json_spirit::Array& params, bool fHelp);
+extern json_spirit::Value getringsiginfo(const json_spirit::Array& params, bool fHelp);
+extern json_spirit::Value getblockfileinfo(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value gettxout(const json_spirit::Array& params, bool fHelp);
 
 extern json_spirit::Value getnewprivateaddress(const json_spirit::Array& params, bool fHelp);
@@ -68,7 +68,7 @@ void WalletTxToJSON(const CWalletTx& wtx, Object& entry, bool listNarrations=tru
             nTime = mapBlockIndex[wtx.hashBlock]->nTime;
         } else
         {
-            std::map<uint256, CBlockThinIndex*>::iterator mi = mapBlockThinIndex.find(wtx.hashBlock);
+            BlockThinMap::iterator mi = mapBlockThinIndex.find(wtx.hashBlock);
             if (mi != mapBlockThinIndex.end())
                 nTime = (*mi).second->nTime;
         };
@@ -1569,7 +1569,7 @@ Value gettransaction(const Array& params, bool fHelp)
             } else
             {
                 entry.push_back(Pair("blockhash", hashBlock.GetHex()));
-                std::map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(hashBlock);
+                BlockMap::iterator mi = mapBlockIndex.find(hashBlock);
                 if (mi != mapBlockIndex.end() && (*mi).second)
                 {
                     CBlockIndex* pindex = (*mi).second;
@@ -2294,9 +2294,8 @@ Value scanforalltxns(const Array& params, bool fHelp)
     if (nFromHeight > 0)
     {
         pindex = mapBlockIndex[hashBestChain];
-        while (pindex->nHeight > nFromHeight
-            && pindex->pprev)
-            pindex = pindex->pprev;
+        if (pindex->nHeight > nFromHeight)
+            pindex = pindex->GetAncestor(nFromHeight);
     };
 
     if (pindex == NULL)
@@ -88,20 +88,27 @@ HEADERS += \
     $$PWD/alert.h \
     $$PWD/allocators.h \
     $$PWD/anonymize.h \
+    $$PWD/arena.h \
     $$PWD/base58.h \
     $$PWD/bignum.h \
+    $$PWD/blockfile.h \
+    $$PWD/blockindexsnapshot.h \
+    $$PWD/blockmap.h \
     $$PWD/bloom.h \
     $$PWD/chainparams.h \
     $$PWD/chainparamsseeds.h \
     $$PWD/checkpoints.h \
+    $$PWD/checkqueue.h \
     $$PWD/clientversion.h \
     $$PWD/coincontrol.h \
+    $$PWD/coinselection.h \
     $$PWD/compat.h \
     $$PWD/core.h \
     $$PWD/crypter.h \
     $$PWD/currency.h \
     $$PWD/db.h \
     $$PWD/eckey.h \
+    $$PWD/ecmult.h \
     $$PWD/extkey.h \
     $$PWD/hash.h \
     $$PWD/init.h \
@@ -216,13 +223,17 @@ SOURCES += \
 #    $$PWD/test/wallet_tests.cpp \
     $$PWD/alert.cpp \
     $$PWD/anonymize.cpp \
+    $$PWD/blockfile.cpp \
+    $$PWD/blockindexsnapshot.cpp \
     $$PWD/bloom.cpp \
     $$PWD/chainparams.cpp \
     $$PWD/checkpoints.cpp \
+    $$PWD/coinselection.cpp \
     $$PWD/core.cpp \
     $$PWD/crypter.cpp \
     $$PWD/db.cpp \
     $$PWD/eckey.cpp \
+    $$PWD/ecmult.cpp \
     $$PWD/extkey.cpp \
     $$PWD/hash.cpp \
     $$PWD/init.cpp \
@@ -50,6 +50,7 @@ bool fUseFastIndex;
 unsigned int nNodeLifespan;
 unsigned int nDerivationMethodIndex;
 unsigned int nMinerSleep;
+int nStakeThreads = 1;
 unsigned int nBlockMaxSize;
 unsigned int nBlockPrioritySize;
 unsigned int nBlockMinSize;
@@ -111,6 +111,7 @@ extern bool fEnforceCanonical;
 extern unsigned int nNodeLifespan;
 extern unsigned int nDerivationMethodIndex;
 extern unsigned int nMinerSleep;
+extern int nStakeThreads;
 extern unsigned int nBlockMaxSize;
 extern unsigned int nBlockPrioritySize;
 extern unsigned int nBlockMinSize;
@@ -5,6 +5,7 @@
 // SPDX-License-Identifier: MIT
 
 #include "stealth.h"
+#include "ecmult.h"
 #include "base58.h"
 #include "state.h"
 
@@ -14,6 +15,8 @@
 #include <openssl/ecdsa.h>
 #include <openssl/obj_mac.h>
 
+#include <boost/thread/tss.hpp>
+
 
 bool CStealthAddress::SetEncoded(const std::string& encodedAddress)
 {
@@ -99,6 +102,52 @@ int CStealthAddress::SetScanPubKey(CPubKey pk)
 };
 
 
+CStealthContext::CStealthContext()
+{
+    ecGrp   = NULL;
+    bnCtx   = NULL;
+    bnOrder = NULL;
+
+    if (!(ecGrp = EC_GROUP_new_by_curve_name(NID_secp256k1))
+        || !(bnCtx = BN_CTX_new())
+        || !(bnOrder = BN_new())
+        || !EC_GROUP_get_order(ecGrp, bnOrder, bnCtx))
+    {
+        Free();
+        throw std::runtime_error("CStealthContext : OpenSSL setup failed");
+    };
+}
+
+CStealthContext::~CStealthContext()
+{
+    Free();
+}
+
+void CStealthContext::Free()
+{
+    BN_free(bnOrder);
+    BN_CTX_free(bnCtx);
+    EC_GROUP_clear_free(ecGrp);
+
+    ecGrp   = NULL;
+    bnCtx   = NULL;
+    bnOrder = NULL;
+}
+
+static boost::thread_specific_ptr<CStealthContext> ptrStealthContext;
+
+CStealthContext &GetStealthContext()
+{
+    CStealthContext *pctx = ptrStealthContext.get();
+    if (!pctx)
+    {
+        pctx = new CStealthContext();
+        ptrStealthContext.reset(pctx);
+    };
+    return *pctx;
+}
+
+
 int GenerateRandomSecret(ec_secret& out)
 {
     RandAddSeedPerfmon();
@@ -124,29 +173,23 @@ int GenerateRandomSecret(ec_secret& out)
     return 0;
 };
 
-int SecretToPublicKey(const ec_secret& secret, ec_point& out)
+int SecretToPublicKeyOpenSSL(CStealthContext &ctx, const ec_secret& secret, ec_point& out)
 {
     // -- public key = private * G
     int rv = 0;
 
-    EC_GROUP* ecgrp = EC_GROUP_new_by_curve_name(NID_secp256k1);
-
-    if (!ecgrp)
-        return errorN(1, "%s: EC_GROUP_new_by_curve_name failed.", __func__);
+    EC_GROUP* ecgrp = ctx.ecGrp;
 
     BIGNUM* bnIn = BN_bin2bn(&secret.e[0], EC_SECRET_SIZE, BN_new());
     if (!bnIn)
-    {
-        EC_GROUP_free(ecgrp);
         return errorN(1, "%s: BN_bin2bn failed.", __func__);
-    };
 
     EC_POINT* pub = EC_POINT_new(ecgrp);
 
 
-    EC_POINT_mul(ecgrp, pub, bnIn, NULL, NULL, NULL);
+    EC_POINT_mul(ecgrp, pub, bnIn, NULL, NULL, ctx.bnCtx);
 
-    BIGNUM* bnOut = EC_POINT_point2bn(ecgrp, pub, POINT_CONVERSION_COMPRESSED, BN_new(), NULL);
+    BIGNUM* bnOut = EC_POINT_point2bn(ecgrp, pub, POINT_CONVERSION_COMPRESSED, BN_new(), ctx.bnCtx);
     if (!bnOut)
     {
         LogPrintf("%s: point2bn failed.\n", __func__);
@@ -166,13 +209,12 @@ int SecretToPublicKey(const ec_secret& secret, ec_point& out)
 
     EC_POINT_free(pub);
     BN_free(bnIn);
-    EC_GROUP_free(ecgrp);
 
     return rv;
 };
 
 
-int StealthSecret(ec_secret& secret, ec_point& pubkey, const ec_point& pkSpend, ec_secret& sharedSOut, ec_point& pkOut)
+int StealthSecretOpenSSL(CStealthContext &ctx, ec_secret& secret, ec_point& pubkey, const ec_point& pkSpend, ec_secret& sharedSOut, ec_point& pkOut)
 {
     /*
 
@@ -207,7 +249,7 @@ int StealthSecret(ec_secret& secret, ec_point& pubkey, const ec_point& pkSpend,
     int rv = 0;
     std::vector<uint8_t> vchOutQ;
 
-    BN_CTX* bnCtx   = NULL;
+    BN_CTX* bnCtx   = ctx.bnCtx;
     BIGNUM* bnEphem = NULL;
     BIGNUM* bnQ     = NULL;
     EC_POINT* Q     = NULL;
@@ -219,17 +261,7 @@ int StealthSecret(ec_secret& secret, ec_point& pubkey, const ec_point& pkSpend,
     EC_POINT* Rout  = NULL;
     BIGNUM* bnOutR  = NULL;
 
-    EC_GROUP* ecgrp = EC_GROUP_new_by_curve_name(NID_secp256k1);
-
-    if (!ecgrp)
-        return errorN(1, "%s: EC_GROUP_new_by_curve_name failed.", __func__);
-
-    if (!(bnCtx = BN_CTX_new()))
-    {
-        LogPrintf("%s: BN_CTX_new failed.\n", __func__);
-        rv = 1;
-        goto End;
-    };
+    EC_GROUP* ecgrp = ctx.ecGrp;
 
     if (!(bnEphem = BN_bin2bn(&secret.e[0], EC_SECRET_SIZE, BN_new())))
     {
@@ -367,14 +399,12 @@ int StealthSecret(ec_secret& secret, ec_point& pubkey, const ec_point& pkSpend,
     if (Q)          EC_POINT_free(Q);
     if (bnQ)        BN_free(bnQ);
     if (bnEphem)    BN_free(bnEphem);
-    if (bnCtx)      BN_CTX_free(bnCtx);
-    EC_GROUP_free(ecgrp);
 
     return rv;
 };
 
 
-int StealthSecretSpend(ec_secret& scanSecret, ec_point& ephemPubkey, ec_secret& spendSecret, ec_secret& secretOut)
+int StealthSecretSpendOpenSSL(CStealthContext &ctx, ec_secret& scanSecret, ec_point& ephemPubkey, ec_secret& spendSecret, ec_secret& secretOut)
 {
     /*
 
@@ -387,26 +417,16 @@ int StealthSecretSpend(ec_secret& scanSecret, ec_point& ephemPubkey, ec_secret&
     int rv = 0;
     std::vector<uint8_t> vchOutP;
 
-    BN_CTX* bnCtx           = NULL;
+    BN_CTX* bnCtx           = ctx.bnCtx;
     BIGNUM* bnScanSecret    = NULL;
     BIGNUM* bnP             = NULL;
     EC_POINT* P             = NULL;
     BIGNUM* bnOutP          = NULL;
     BIGNUM* bnc             = NULL;
-    BIGNUM* bnOrder         = NULL;
+    BIGNUM* bnOrder         = ctx.bnOrder;
     BIGNUM* bnSpend         = NULL;
 
-    EC_GROUP* ecgrp = EC_GROUP_new_by_curve_name(NID_secp256k1);
-
-    if (!ecgrp)
-        return errorN(1, "%s: EC_GROUP_new_by_curve_name failed.", __func__);
-
-    if (!(bnCtx = BN_CTX_new()))
-    {
-        LogPrintf("%s: BN_CTX_new failed.\n", __func__);
-        rv = 1;
-        goto End;
-    };
+    EC_GROUP* ecgrp = ctx.ecGrp;
 
     if (!(bnScanSecret = BN_bin2bn(&scanSecret.e[0], EC_SECRET_SIZE, BN_new())))
     {
@@ -465,14 +485,6 @@ int StealthSecretSpend(ec_secret& scanSecret, ec_point& ephemPubkey, ec_secret&
         goto End;
     };
 
-    if (!(bnOrder = BN_new())
-        || !EC_GROUP_get_order(ecgrp, bnOrder, bnCtx))
-    {
-        LogPrintf("%s: EC_GROUP_get_order failed.\n", __func__);
-        rv = 1;
-        goto End;
-    };
-
     if (!(bnSpend = BN_bin2bn(&spendSecret.e[0], EC_SECRET_SIZE, BN_new())))
     {
         LogPrintf("%s: bnSpend BN_bin2bn failed.\n", __func__);
@@ -508,41 +520,26 @@ int StealthSecretSpend(ec_secret& scanSecret, ec_point& ephemPubkey, ec_secret&
 
     End:
     if (bnSpend)        BN_free(bnSpend);
-    if (bnOrder)        BN_free(bnOrder);
     if (bnc)            BN_free(bnc);
     if (bnOutP)         BN_free(bnOutP);
     if (P)              EC_POINT_free(P);
     if (bnP)            BN_free(bnP);
     if (bnScanSecret)   BN_free(bnScanSecret);
-    if (bnCtx)          BN_CTX_free(bnCtx);
-    EC_GROUP_free(ecgrp);
 
     return rv;
 };
 
 
-int StealthSharedToSecretSpend(const ec_secret& sharedS, const ec_secret& spendSecret, ec_secret& secretOut)
+int StealthSharedToSecretSpendOpenSSL(CStealthContext &ctx, const ec_secret& sharedS, const ec_secret& spendSecret, ec_secret& secretOut)
 {
     int rv = 0;
     std::vector<uint8_t> vchOutP;
 
-    BN_CTX* bnCtx           = NULL;
+    BN_CTX* bnCtx           = ctx.bnCtx;
     BIGNUM* bnc             = NULL;
-    BIGNUM* bnOrder         = NULL;
+    BIGNUM* bnOrder         = ctx.bnOrder;
     BIGNUM* bnSpend         = NULL;
 
-    EC_GROUP* ecgrp = EC_GROUP_new_by_curve_name(NID_secp256k1);
-
-    if (!ecgrp)
-        return errorN(1, "%s: EC_GROUP_new_by_curve_name failed.", __func__);
-
-    if (!(bnCtx = BN_CTX_new()))
-    {
-        LogPrintf("%s: BN_CTX_new failed.\n", __func__);
-        rv = 1;
-        goto End;
-    };
-
     if (!(bnc = BN_bin2bn(&sharedS.e[0], EC_SECRET_SIZE, BN_new())))
     {
         LogPrintf("%s: BN_bin2bn failed.\n", __func__);
@@ -550,14 +547,6 @@ int StealthSharedToSecretSpend(const ec_secret& sharedS, const ec_secret& spendS
         goto End;
     };
 
-    if (!(bnOrder = BN_new())
-        || !EC_GROUP_get_order(ecgrp, bnOrder, bnCtx))
-    {
-        LogPrintf("%s: EC_GROUP_get_order failed.\n", __func__);
-        rv = 1;
-        goto End;
-    };
-
     if (!(bnSpend = BN_bin2bn(&spendSecret.e[0], EC_SECRET_SIZE, BN_new())))
     {
         LogPrintf("%s: bnSpend BN_bin2bn failed.\n", __func__);
@@ -593,20 +582,17 @@ int StealthSharedToSecretSpend(const ec_secret& sharedS, const ec_secret& spendS
 
     End:
     if (bnSpend)        BN_free(bnSpend);
-    if (bnOrder)        BN_free(bnOrder);
     if (bnc)            BN_free(bnc);
-    if (bnCtx)          BN_CTX_free(bnCtx);
-    EC_GROUP_free(ecgrp);
 
     return rv;
 };
 
-int StealthSharedToPublicKey(const ec_point& pkSpend, const ec_secret &sharedS, ec_point &pkOut)
+int StealthSharedToPublicKeyOpenSSL(CStealthContext &ctx, const ec_point& pkSpend, const ec_secret &sharedS, ec_point &pkOut)
 {
     int rv = 0;
     std::vector<uint8_t> vchOutQ;
 
-    BN_CTX *bnCtx   = NULL;
+    BN_CTX *bnCtx   = ctx.bnCtx;
     BIGNUM *bnc     = NULL;
     EC_POINT *C     = NULL;
     BIGNUM *bnR     = NULL;
@@ -614,17 +600,7 @@ int StealthSharedToPublicKey(const ec_point& pkSpend, const ec_secret &sharedS,
     EC_POINT *Rout  = NULL;
     BIGNUM *bnOutR  = NULL;
 
-    EC_GROUP *ecgrp = EC_GROUP_new_by_curve_name(NID_secp256k1);
-
-    if (!ecgrp)
-        return errorN(1, "%s: EC_GROUP_new_by_curve_name failed.", __func__);
-
-    if (!(bnCtx = BN_CTX_new()))
-    {
-        LogPrintf("%s: BN_CTX_new failed.\n", __func__);
-        rv = 1;
-        goto End;
-    };
+    EC_GROUP *ecgrp = ctx.ecGrp;
 
     if (!(bnc = BN_bin2bn(&sharedS.e[0], EC_SECRET_SIZE, BN_new())))
     {
@@ -708,12 +684,152 @@ int StealthSharedToPublicKey(const ec_point& pkSpend, const ec_secret &sharedS,
     if (bnR)        BN_free(bnR);
     if (C)          EC_POINT_free(C);
     if (bnc)        BN_free(bnc);
-    if (bnCtx)      BN_CTX_free(bnCtx);
-    EC_GROUP_free(ecgrp);
 
     return rv;
 };
 
+#ifdef USE_NATIVE_SECP256K1
+
+// Native versions, cG comes from the precomputed generator comb of ecmult and
+// the ECDH step runs the constant time window ladder; no group, BN_CTX or
+// bignums are set up per call. Keys that are not 33 byte compressed points
+// take the OpenSSL path.
+
+static int SharedToPublicKeyNative(const ec_point &pkSpend, const ec_scalar &c, ec_point &pkOut)
+{
+    ec_ge R;
+    if (!ECPointParse(R, &pkSpend[0], pkSpend.size()))
+        return errorN(1, "%s: R parse failed.", __func__);
+
+    // -- R' = R + cG
+    ec_gej cG, Rout;
+    ECMultGen(cG, c);
+    ECPointGejAddGe(Rout, cG, R);
+
+    pkOut.resize(EC_COMPRESSED_SIZE);
+    if (!ECPointSerialize(&pkOut[0], Rout))
+        return errorN(1, "%s: Rout is infinity.", __func__);
+
+    return 0;
+}
+
+static int SharedSecretNative(const ec_secret &secret, const ec_point &pubkey, ec_secret &sharedSOut)
+{
+    ec_ge P;
+    if (!ECPointParse(P, &pubkey[0], pubkey.size()))
+        return errorN(1, "%s: P parse failed.", __func__);
+
+    ec_scalar k;
+    ECScalarSetB32(k, &secret.e[0]);
+    if (ECScalarIsZero(k))
+        return errorN(1, "%s: secret is zero.", __func__);
+
+    // -- c = H(kP)
+    ec_gej kP;
+    uint8_t vchOut[EC_COMPRESSED_SIZE];
+    ECMultConst(kP, P, k);
+    if (!ECPointSerialize(vchOut, kP))
+        return errorN(1, "%s: kP is infinity.", __func__);
+
+    SHA256(vchOut, EC_COMPRESSED_SIZE, &sharedSOut.e[0]);
+    return 0;
+}
+
+int SecretToPublicKey(const ec_secret& secret, ec_point& out)
+{
+    ec_scalar k;
+    ECScalarSetB32(k, &secret.e[0]);
+
+    ec_gej pub;
+    ECMultGen(pub, k);
+
+    out.resize(EC_COMPRESSED_SIZE);
+    if (!ECPointSerialize(&out[0], pub))
+        return errorN(1, "%s: public key is infinity.", __func__);
+
+    return 0;
+};
+
+int StealthSecret(ec_secret& secret, ec_point& pubkey, const ec_point& pkSpend, ec_secret& sharedSOut, ec_point& pkOut)
+{
+    if (pubkey.size() != EC_COMPRESSED_SIZE || pkSpend.size() != EC_COMPRESSED_SIZE)
+        return StealthSecretOpenSSL(GetStealthContext(), secret, pubkey, pkSpend, sharedSOut, pkOut);
+
+    if (SharedSecretNative(secret, pubkey, sharedSOut) != 0)
+        return 1;
+
+    ec_scalar c;
+    ECScalarSetB32(c, &sharedSOut.e[0]);
+    return SharedToPublicKeyNative(pkSpend, c, pkOut);
+};
+
+int StealthSecretSpend(ec_secret& scanSecret, ec_point& ephemPubkey, ec_secret& spendSecret, ec_secret& secretOut)
+{
+    if (ephemPubkey.size() != EC_COMPRESSED_SIZE)
+        return StealthSecretSpendOpenSSL(GetStealthContext(), scanSecret, ephemPubkey, spendSecret, secretOut);
+
+    ec_secret sShared;
+    if (SharedSecretNative(scanSecret, ephemPubkey, sShared) != 0)
+        return 1;
+
+    return StealthSharedToSecretSpend(sShared, spendSecret, secretOut);
+};
+
+int StealthSharedToSecretSpend(const ec_secret& sharedS, const ec_secret& spendSecret, ec_secret& secretOut)
+{
+    // -- f + c mod n
+    ec_scalar c, f;
+    ECScalarSetB32(c, &sharedS.e[0]);
+    ECScalarSetB32(f, &spendSecret.e[0]);
+    ECScalarAdd(f, f, c);
+
+    if (ECScalarIsZero(f))
+        return errorN(1, "%s: bnSpend is zero.", __func__);
+
+    ECScalarGetB32(&secretOut.e[0], f);
+    return 0;
+};
+
+int StealthSharedToPublicKey(const ec_point& pkSpend, const ec_secret &sharedS, ec_point &pkOut)
+{
+    if (pkSpend.size() != EC_COMPRESSED_SIZE)
+        return StealthSharedToPublicKeyOpenSSL(GetStealthContext(), pkSpend, sharedS, pkOut);
+
+    ec_scalar c;
+    ECScalarSetB32(c, &sharedS.e[0]);
+    return SharedToPublicKeyNative(pkSpend, c, pkOut);
+};
+
+#else // USE_NATIVE_SECP256K1
+
+int SecretToPublicKey(const ec_secret& secret, ec_point& out)
+{
+    return SecretToPublicKeyOpenSSL(GetStealthContext(), secret, out);
+};
+
+int StealthSecret(ec_secret& secret, ec_point& pubkey, const ec_point& pkSpend, ec_secret& sharedSOut, ec_point& pkOut)
+{
+    return StealthSecretOpenSSL(GetStealthContext(), secret, pubkey, pkSpend, sharedSOut, pkOut);
+};
+
+int StealthSecretSpend(ec_secret& scanSecret, ec_point& ephemPubkey, ec_secret& spendSecret, ec_secret& secretOut)
+{
+    return StealthSecretSpendOpenSSL(GetStealthContext(), scanSecret, ephemPubkey, spendSecret, secretOut);
+};
+
+int StealthSharedToSecretSpend(const ec_secret& sharedS, const ec_secret& spendSecret, ec_secret& secretOut)
+{
+    return StealthSharedToSecretSpendOpenSSL(GetStealthContext(), sharedS, spendSecret, secretOut);
+};
+
+int StealthSharedToPublicKey(const ec_point& pkSpend, const ec_secret &sharedS, ec_point &pkOut)
+{
+    return StealthSharedToPublicKeyOpenSSL(GetStealthContext(), pkSpend, sharedS, pkOut);
+};
+
+#endif // USE_NATIVE_SECP256K1
+
+
 bool IsStealthAddress(const std::string& encodedAddress)
 {
     if (encodedAddress.length() < 76)
@@ -18,6 +18,9 @@
 #include "hash.h"
 #include "types.h"
 
+#include <openssl/bn.h>
+#include <openssl/ec.h>
+
 const uint32_t MAX_STEALTH_NARRATION_SIZE = 48;
 
 typedef uint32_t stealth_bitfield;
@@ -79,8 +82,32 @@ public:
 
 };
 
+// OpenSSL state used by the reference stealth functions, one per thread like
+// CRingSigContext. GetStealthContext() returns the calling thread's context
+// (created on first use, freed at thread exit) so the group and BN_CTX are not
+// set up again for every output a wallet scan looks at.
+class CStealthContext
+{
+public:
+    CStealthContext();
+    ~CStealthContext();
+
+    EC_GROUP *ecGrp;
+    BN_CTX   *bnCtx;
+    BIGNUM   *bnOrder;
+
+private:
+    CStealthContext(const CStealthContext&);
+    CStealthContext &operator=(const CStealthContext&);
+    void Free();
+};
+
+CStealthContext &GetStealthContext();
+
 int GenerateRandomSecret(ec_secret& out);
 
+// These use the native secp256k1 backend when it is built, otherwise the
+// OpenSSL versions below with the calling thread's context.
 int SecretToPublicKey(const ec_secret& secret, ec_point& out);
 
 int StealthSecret(ec_secret& secret, ec_point& pubkey, const ec_point& pkSpend, ec_secret& sharedSOut, ec_point& pkOut);
@@ -89,6 +116,12 @@ int StealthSharedToSecretSpend(const ec_secret& sharedS, const ec_secret& spendS
 
 int StealthSharedToPublicKey(const ec_point& pkSpend, const ec_secret &sharedS, ec_point &pkOut);
 
+int SecretToPublicKeyOpenSSL(CStealthContext &ctx, const ec_secret& secret, ec_point& out);
+int StealthSecretOpenSSL(CStealthContext &ctx, ec_secret& secret, ec_point& pubkey, const ec_point& pkSpend, ec_secret& sharedSOut, ec_point& pkOut);
+int StealthSecretSpendOpenSSL(CStealthContext &ctx, ec_secret& scanSecret, ec_point& ephemPubkey, ec_secret& spendSecret, ec_secret& secretOut);
+int StealthSharedToSecretSpendOpenSSL(CStealthContext &ctx, const ec_secret& sharedS, const ec_secret& spendSecret, ec_secret& secretOut);
+int StealthSharedToPublicKeyOpenSSL(CStealthContext &ctx, const ec_point& pkSpend, const ec_secret &sharedS, ec_point &pkOut);
+
 bool IsStealthAddress(const std::string& encodedAddress);
 
 
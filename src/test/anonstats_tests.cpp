@@ -0,0 +1,53 @@
+// SPDX-FileCopyrightText: © 2020 Alias Developers
+//
+// SPDX-License-Identifier: MIT
+
+#include <boost/test/unit_test.hpp>
+
+#include "main.h"
+#include "ringsig.h"
+#include "txdb.h"
+#include "wallet.h"
+
+// test_spectre --log_level=all  --run_test=anonstats_tests
+
+extern CWallet *pwalletMain;
+
+BOOST_AUTO_TEST_SUITE(anonstats_tests)
+
+BOOST_AUTO_TEST_CASE(anonstats_recount_reload)
+{
+    LOCK(cs_main);
+
+    // - above the stake maturity, the next block looks up the blocks maturing
+    //   for spending and for staking in the window
+    const int nHeight = Params().GetAnonStakeMinConfirmations() + MIN_ANON_SPEND_DEPTH + 10;
+    BOOST_REQUIRE(nHeight < nMaxAnonBlockCache);
+    uint256 hashBlock = GetRandHash();
+
+    BOOST_REQUIRE(pwalletMain->CacheAnonStats(nHeight, hashBlock));
+    BOOST_CHECK(!fStaleAnonCache);
+
+    // - a restart loads the recount, the window has no gaps
+    mapAnonOutputStats.clear();
+    mapAnonBlockStats.clear();
+    fStaleAnonCache = true;
+
+    CTxDB txdb("r+");
+    BOOST_REQUIRE(pwalletMain->LoadAnonStats(txdb, nHeight, hashBlock));
+    BOOST_CHECK(!fStaleAnonCache);
+    BOOST_CHECK(mapAnonBlockStats.count(nHeight + 1 - MIN_ANON_SPEND_DEPTH + 1));
+    BOOST_CHECK(mapAnonBlockStats.count(nHeight + 1 - Params().GetAnonStakeMinConfirmations() + 1));
+
+    // - and connecting the next block needs no recount
+    BOOST_CHECK(pwalletMain->UpdateAnonStats(txdb, nHeight + 1));
+    BOOST_CHECK(!fStaleAnonCache);
+
+    for (int i = 0; i <= nHeight + 1; ++i)
+        txdb.EraseAnonBlockStats(i);
+    txdb.EraseAnonStats();
+
+    BOOST_CHECK(pwalletMain->CacheAnonStats(nBestHeight, hashBestChain));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,188 @@
+// SPDX-FileCopyrightText: © 2020 Alias Developers
+//
+// SPDX-License-Identifier: MIT
+
+#include <boost/test/unit_test.hpp>
+
+#include "blockfile.h"
+#include "main.h"
+#include "util.h"
+
+// test_spectre --log_level=all  --run_test=blockfile_tests
+
+static const unsigned int TEST_BLOCK_FILE = 9999;
+
+static CTransaction MakeTestTx(int n)
+{
+    CTransaction tx;
+    tx.nTime = 1600000000 + n;
+    tx.vin.push_back(CTxIn(COutPoint(GetRandHash(), n), CScript() << std::vector<uint8_t>(72, 0x30)));
+    tx.vout.push_back(CTxOut(COIN * n, CScript() << OP_TRUE));
+    return tx;
+}
+
+static unsigned int AppendTestTx(const CTransaction &tx)
+{
+    CAutoFile fileout(OpenBlockFile(false, TEST_BLOCK_FILE, 0, "ab"), SER_DISK, CLIENT_VERSION);
+    BOOST_REQUIRE(!!fileout);
+    fseek(fileout, 0, SEEK_END);
+    unsigned int nPos = ftell(fileout);
+    fileout << tx;
+    fflush(fileout);
+    return nPos;
+}
+
+static unsigned int AppendTestRecord(const std::vector<char> &vRecord)
+{
+    CAutoFile fileout(OpenBlockFile(false, TEST_BLOCK_FILE, 0, "ab"), SER_DISK, CLIENT_VERSION);
+    BOOST_REQUIRE(!!fileout);
+    unsigned int nSize = vRecord.size();
+    fileout << FLATDATA(Params().MessageStart()) << nSize;
+    fseek(fileout, 0, SEEK_END);
+    unsigned int nPos = ftell(fileout);
+    fileout.write(&vRecord[0], vRecord.size());
+    fflush(fileout);
+    return nPos;
+}
+
+BOOST_AUTO_TEST_SUITE(blockfile_tests)
+
+BOOST_AUTO_TEST_CASE(blockfile_mapped_read)
+{
+    boost::filesystem::path path = GetDataDir() / strprintf("blk%04u.dat", TEST_BLOCK_FILE);
+    boost::filesystem::remove(path);
+    ReleaseBlockFileMap(false, TEST_BLOCK_FILE);
+
+    CBlockFileStats statsStart, stats;
+    GetBlockFileStats(statsStart);
+
+    CTransaction tx1 = MakeTestTx(1), txRead;
+    unsigned int nPos1 = AppendTestTx(tx1);
+
+#ifndef WIN32
+    BOOST_CHECK(ReadFromBlockFile(false, TEST_BLOCK_FILE, nPos1, 0, txRead, SER_DISK, CLIENT_VERSION));
+    BOOST_CHECK(txRead.GetHash() == tx1.GetHash());
+
+    GetBlockFileStats(stats);
+    BOOST_CHECK(stats.nReads == statsStart.nReads + 1);
+    BOOST_CHECK(stats.nBytesRead == statsStart.nBytesRead + ::GetSerializeSize(tx1, SER_DISK, CLIENT_VERSION));
+    BOOST_CHECK(stats.nMapCalls == statsStart.nMapCalls + 1);
+
+    // - appended after the file was mapped, read maps it again
+    CTransaction tx2 = MakeTestTx(2);
+    unsigned int nPos2 = AppendTestTx(tx2);
+    BOOST_CHECK(ReadFromBlockFile(false, TEST_BLOCK_FILE, nPos2, 0, txRead, SER_DISK, CLIENT_VERSION));
+    BOOST_CHECK(txRead.GetHash() == tx2.GetHash());
+
+    // - mapping covers both now
+    BOOST_CHECK(ReadFromBlockFile(false, TEST_BLOCK_FILE, nPos1, 0, txRead, SER_DISK, CLIENT_VERSION));
+    BOOST_CHECK(txRead.GetHash() == tx1.GetHash());
+
+    GetBlockFileStats(stats);
+    BOOST_CHECK(stats.nReads == statsStart.nReads + 3);
+    BOOST_CHECK(stats.nMapCalls == statsStart.nMapCalls + 2);
+#endif
+
+    // - past the end and cut off objects are left to the FILE* path
+    BOOST_CHECK(!ReadFromBlockFile(false, TEST_BLOCK_FILE, nPos2 + 1000, 0, txRead, SER_DISK, CLIENT_VERSION));
+    BOOST_CHECK(!ReadFromBlockFile(false, TEST_BLOCK_FILE, nPos2 + 10, 0, txRead, SER_DISK, CLIENT_VERSION));
+
+    // - CTransaction::ReadFromDisk gives the same result either way
+    SetBlockFileMapLimit(0);
+    BOOST_CHECK(!ReadFromBlockFile(false, TEST_BLOCK_FILE, nPos1, 0, txRead, SER_DISK, CLIENT_VERSION));
+    BOOST_CHECK(txRead.ReadFromDisk(CDiskTxPos(TEST_BLOCK_FILE, 0, nPos1)));
+    BOOST_CHECK(txRead.GetHash() == tx1.GetHash());
+    SetBlockFileMapLimit(DEFAULT_MAX_BLOCKFILE_MAPS);
+    BOOST_CHECK(txRead.ReadFromDisk(CDiskTxPos(TEST_BLOCK_FILE, 0, nPos2)));
+    BOOST_CHECK(txRead.GetHash() == tx2.GetHash());
+
+    GetBlockFileStats(stats);
+    BOOST_CHECK(stats.nFallbacks >= statsStart.nFallbacks + 3);
+
+    ReleaseBlockFileMap(false, TEST_BLOCK_FILE);
+    boost::filesystem::remove(path);
+}
+
+BOOST_AUTO_TEST_CASE(blockfile_compressed_read)
+{
+    boost::filesystem::path path = GetDataDir() / strprintf("blk%04u.dat", TEST_BLOCK_FILE);
+    boost::filesystem::remove(path);
+    ReleaseBlockFileMap(false, TEST_BLOCK_FILE);
+
+    CBlock block;
+    block.nVersion = CBlock::CURRENT_VERSION;
+    block.nTime = 1600000000;
+    for (int i = 0; i < 20; ++i)
+        block.vtx.push_back(MakeTestTx(i + 1));
+
+    CDataStream ssBlock(SER_DISK, CLIENT_VERSION);
+    ssBlock << block;
+    std::vector<char> vRecord, vRaw;
+    BOOST_REQUIRE(CompressBlockRecord(&ssBlock[0], ssBlock.size(), vRecord));
+    BOOST_CHECK(vRecord.size() < ssBlock.size());
+    BOOST_CHECK(IsCompressedBlockRecord(&vRecord[0], vRecord.size()));
+    BOOST_CHECK(!IsCompressedBlockRecord(&ssBlock[0], ssBlock.size()));
+
+    DecompressBlockRecord(&vRecord[0], vRecord.size(), vRaw);
+    BOOST_CHECK(vRaw.size() == ssBlock.size() && memcmp(&vRaw[0], &ssBlock[0], vRaw.size()) == 0);
+    BOOST_CHECK_THROW(DecompressBlockRecord(&vRecord[0], vRecord.size() - 1, vRaw), std::ios_base::failure);
+
+    // - a plain record before and after, files can hold both
+    unsigned int nPosPlain = AppendTestTx(MakeTestTx(100));
+    unsigned int nBlockPos = AppendTestRecord(vRecord);
+    CTransaction txLast = MakeTestTx(101);
+    unsigned int nPosLast = AppendTestTx(txLast);
+
+    // - offset of a transaction in the raw block, as ConnectBlock sets nTxPos
+    unsigned int nTxOffset = ::GetSerializeSize(CBlock(), SER_DISK, CLIENT_VERSION) - (2 * GetSizeOfCompactSize(0)) + GetSizeOfCompactSize(block.vtx.size());
+    for (int i = 0; i < 5; ++i)
+        nTxOffset += ::GetSerializeSize(block.vtx[i], SER_DISK, CLIENT_VERSION);
+    CDiskTxPos posTx(TEST_BLOCK_FILE, nBlockPos, nBlockPos + nTxOffset);
+
+    CBlock blockRead;
+    CTransaction txRead;
+    for (int nMaps = DEFAULT_MAX_BLOCKFILE_MAPS; nMaps >= 0; nMaps -= DEFAULT_MAX_BLOCKFILE_MAPS)
+    {
+        SetBlockFileMapLimit(nMaps);
+        ReleaseBlockFileMap(false, TEST_BLOCK_FILE);
+
+        BOOST_CHECK(txRead.ReadFromDisk(posTx));
+        BOOST_CHECK(txRead.GetHash() == block.vtx[5].GetHash());
+        BOOST_CHECK(txRead.ReadFromDisk(CDiskTxPos(TEST_BLOCK_FILE, nPosLast, nPosLast)));
+        BOOST_CHECK(txRead.GetHash() == txLast.GetHash());
+
+        CAutoFile filein(OpenBlockFile(false, TEST_BLOCK_FILE, nBlockPos, "rb"), SER_DISK, CLIENT_VERSION);
+        BOOST_REQUIRE(!!filein);
+        BOOST_CHECK(ReadBlockRecord(filein, 0, blockRead));
+        BOOST_CHECK(blockRead.GetHash() == block.GetHash());
+        BOOST_CHECK(blockRead.vtx.size() == block.vtx.size());
+
+        CAutoFile fileinPlain(OpenBlockFile(false, TEST_BLOCK_FILE, nPosPlain, "rb"), SER_DISK, CLIENT_VERSION);
+        BOOST_REQUIRE(!!fileinPlain);
+        BOOST_CHECK(!ReadBlockRecord(fileinPlain, 0, txRead));
+    };
+
+#ifndef WIN32
+    // - mapped reads of the block and its transactions decompress it once
+    SetBlockFileMapLimit(DEFAULT_MAX_BLOCKFILE_MAPS);
+    CBlockFileStats statsStart, stats;
+    GetBlockFileStats(statsStart);
+    BOOST_CHECK(ReadFromBlockFile(false, TEST_BLOCK_FILE, nBlockPos, 0, blockRead, SER_DISK, CLIENT_VERSION));
+    BOOST_CHECK(blockRead.GetHash() == block.GetHash());
+    BOOST_CHECK(txRead.ReadFromDisk(posTx));
+    BOOST_CHECK(txRead.GetHash() == block.vtx[5].GetHash());
+    GetBlockFileStats(stats);
+    BOOST_CHECK(stats.nDecompressed == statsStart.nDecompressed + 1);
+    BOOST_CHECK(stats.nReads == statsStart.nReads + 2);
+#endif
+
+    // - flipped byte fails the checksum
+    vRecord[vRecord.size() - 1] ^= 1;
+    BOOST_CHECK_THROW(DecompressBlockRecord(&vRecord[0], vRecord.size(), vRaw), std::ios_base::failure);
+
+    SetBlockFileMapLimit(DEFAULT_MAX_BLOCKFILE_MAPS);
+    ReleaseBlockFileMap(false, TEST_BLOCK_FILE);
+    boost::filesystem::remove(path);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,220 @@
+// SPDX-FileCopyrightText: © 2020 Alias Developers
+//
+// SPDX-License-Identifier: MIT
+
+#include <boost/test/unit_test.hpp>
+
+#include "blockindexsnapshot.h"
+#include "main.h"
+#include "txdb.h"
+#include "util.h"
+
+// test_spectre --log_level=all  --run_test=blockindexsnapshot_tests
+
+// - a chain of nBlocks with a one block side branch at height 2
+static void MakeTestIndex(BlockMap &mapIndex, std::vector<CBlockIndex*> &vIndex, int nBlocks)
+{
+    CBlockIndex *pindexPrev = NULL;
+    for (int i = 0; i <= nBlocks; ++i)
+    {
+        CBlockIndex *pindex = new CBlockIndex();
+        pindex->pprev = (i == nBlocks) ? vIndex[1] : pindexPrev;
+        pindex->nHeight = pindex->pprev ? pindex->pprev->nHeight + 1 : 0;
+        pindex->nFile = 1;
+        pindex->nBlockPos = 1000 * i;
+        pindex->nMint = i * COIN;
+        pindex->nMoneySupply = i * 10 * COIN;
+        pindex->nStakeModifier = i * 0x0123456789ULL;
+        pindex->bnStakeModifierV2 = GetRandHash();
+        pindex->prevoutStake = COutPoint(GetRandHash(), i);
+        pindex->nStakeTime = 1600000000 + i;
+        pindex->hashMerkleRoot = GetRandHash();
+        pindex->nTime = 1600000000 + i;
+        pindex->nBits = 0x1e0fffff;
+        pindex->nChainTrust = (pindex->pprev ? pindex->pprev->nChainTrust : 0) + 1 + i;
+        if (pindexPrev && i != nBlocks)
+            pindexPrev->pnext = pindex;
+
+        BlockMap::iterator mi = mapIndex.insert(std::make_pair(GetRandHash(), pindex)).first;
+        pindex->phashBlock = &mi->first;
+        vIndex.push_back(pindex);
+        if (i != nBlocks)
+            pindexPrev = pindex;
+    };
+}
+
+BOOST_AUTO_TEST_SUITE(blockindexsnapshot_tests)
+
+BOOST_AUTO_TEST_CASE(blockindexsnapshot_roundtrip)
+{
+    BlockMap mapIndex;
+    std::vector<CBlockIndex*> vIndex;
+    MakeTestIndex(mapIndex, vIndex, 50);
+    uint256 hashBest = vIndex[49]->GetBlockHash();
+
+    BOOST_CHECK(WriteBlockIndexSnapshot(mapIndex, hashBest));
+
+    CBlockIndexSnapshot snapshot;
+    BOOST_CHECK(!snapshot.Open(vIndex[48]->GetBlockHash()));
+    BOOST_REQUIRE(snapshot.Open(hashBest));
+    BOOST_REQUIRE_EQUAL(snapshot.size(), mapIndex.size());
+    BOOST_CHECK(snapshot[snapshot.GetBestRecord()].hashBlock == hashBest);
+
+    std::map<uint256, uint32_t> mapRecord;
+    for (uint32_t i = 0; i < snapshot.size(); ++i)
+    {
+        mapRecord[snapshot[i].hashBlock] = i;
+        if (i > 0)
+            BOOST_CHECK(snapshot[i].nHeight >= snapshot[i - 1].nHeight);
+        // - links only go back, apart from pnext
+        BOOST_CHECK(snapshot[i].nPrev < (int32_t)i);
+    };
+
+    for (size_t n = 0; n < vIndex.size(); ++n)
+    {
+        const CBlockIndex *pindex = vIndex[n];
+        BOOST_REQUIRE(mapRecord.count(pindex->GetBlockHash()));
+        const CBlockIndexRecord &record = snapshot[mapRecord[pindex->GetBlockHash()]];
+
+        CBlockIndex indexRead;
+        record.ToBlockIndex(&indexRead);
+        BOOST_CHECK_EQUAL(indexRead.nHeight, pindex->nHeight);
+        BOOST_CHECK_EQUAL(indexRead.nBlockPos, pindex->nBlockPos);
+        BOOST_CHECK_EQUAL(indexRead.nMoneySupply, pindex->nMoneySupply);
+        BOOST_CHECK_EQUAL(indexRead.nStakeModifier, pindex->nStakeModifier);
+        BOOST_CHECK(indexRead.bnStakeModifierV2 == pindex->bnStakeModifierV2);
+        BOOST_CHECK(indexRead.prevoutStake == pindex->prevoutStake);
+        BOOST_CHECK(indexRead.hashMerkleRoot == pindex->hashMerkleRoot);
+        BOOST_CHECK(indexRead.nChainTrust == pindex->nChainTrust);
+
+        if (pindex->pprev)
+            BOOST_CHECK(snapshot[record.nPrev].hashBlock == pindex->pprev->GetBlockHash());
+        else
+            BOOST_CHECK_EQUAL(record.nPrev, -1);
+        if (pindex->pnext)
+            BOOST_CHECK(snapshot[record.nNext].hashBlock == pindex->pnext->GetBlockHash());
+        else
+            BOOST_CHECK_EQUAL(record.nNext, -1);
+    };
+    snapshot.Close();
+
+    // - a damaged record fails the checksum
+    boost::filesystem::path path = GetDataDir() / "blkindex.snp";
+    FILE *file = fopen(path.string().c_str(), "r+b");
+    BOOST_REQUIRE(file);
+    fseek(file, sizeof(CBlockIndexSnapshotHeader) + sizeof(CBlockIndexRecord) * 3 + 40, SEEK_SET);
+    fputc(0x55, file);
+    fclose(file);
+    BOOST_CHECK(!snapshot.Open(hashBest));
+
+    RemoveBlockIndexSnapshot();
+    BOOST_CHECK(!boost::filesystem::exists(path));
+    BOOST_CHECK(!snapshot.Open(hashBest));
+
+    BOOST_FOREACH(CBlockIndex *pindex, vIndex)
+        delete pindex;
+}
+
+BOOST_AUTO_TEST_CASE(blockindexsnapshot_load_orphan)
+{
+    LOCK(cs_main);
+
+    // - a chain from the genesis block, with an orphan record and two
+    //   descendants of it below the best block
+    BlockMap mapIndex;
+    std::vector<CBlockIndex*> vIndex;
+    MakeTestIndex(mapIndex, vIndex, 20);
+    mapIndex.erase(vIndex[0]->GetBlockHash());
+    vIndex[0]->phashBlock = &mapIndex.insert(std::make_pair(Params().HashGenesisBlock(), vIndex[0])).first->first;
+    uint256 hashBest = vIndex[19]->GetBlockHash();
+
+    std::vector<CBlockIndex*> vOrphan;
+    CBlockIndex *pindexPrev = NULL;
+    for (int i = 0; i < 3; ++i)
+    {
+        CBlockIndex *pindex = new CBlockIndex();
+        pindex->pprev = pindexPrev;
+        pindex->nHeight = 5 + i;
+        pindex->nFile = 1;
+        pindex->nBlockPos = 100000 + 1000 * i;
+        pindex->nBits = 0x1e0fffff;
+        pindex->nChainTrust = 1 + i;
+        BlockMap::iterator mi = mapIndex.insert(std::make_pair(GetRandHash(), pindex)).first;
+        pindex->phashBlock = &mi->first;
+        vOrphan.push_back(pindex);
+        pindexPrev = pindex;
+    };
+
+    BOOST_REQUIRE(WriteBlockIndexSnapshot(mapIndex, hashBest));
+
+    // - LoadBlockIndex only runs on an empty index, the one of the fixture
+    //   is put aside, and there are no blocks on disk to verify
+    BlockMap mapBlockIndexSaved;
+    mapBlockIndexSaved.swap(mapBlockIndex);
+    CBlockIndex *pindexGenesisSaved = pindexGenesisBlock;
+    CBlockIndex *pindexBestSaved = pindexBest;
+    uint256 hashBestSaved = hashBestChain;
+    int nBestHeightSaved = nBestHeight;
+    uint256 nBestChainTrustSaved = nBestChainTrust;
+    uint256 nBestInvalidTrustSaved = nBestInvalidTrust;
+    std::string strCheckBlocksSaved = mapArgs.count("-checkblocks") ? mapArgs["-checkblocks"] : "";
+    mapArgs["-checkblocks"] = "-1";
+    pindexGenesisBlock = NULL;
+    fBlockIndexSnapshot = true;
+
+    CTxDB txdb("r+");
+    BOOST_REQUIRE(txdb.WriteHashBestChain(hashBest));
+    bool fLoaded = txdb.LoadBlockIndex();
+
+    BOOST_CHECK(fLoaded);
+    BOOST_CHECK(!boost::filesystem::exists(GetDataDir() / "blkindex.snp"));
+    BOOST_CHECK_EQUAL(mapBlockIndex.size(), vIndex.size());
+    BOOST_FOREACH(CBlockIndex *pindex, vOrphan)
+        BOOST_CHECK(!mapBlockIndex.count(pindex->GetBlockHash()));
+
+    // - pprev and pskip are rebuilt from the records
+    BOOST_FOREACH(CBlockIndex *pindexOld, vIndex)
+    {
+        BlockMap::iterator mi = mapBlockIndex.find(pindexOld->GetBlockHash());
+        BOOST_REQUIRE(mi != mapBlockIndex.end());
+        const CBlockIndex *pindex = mi->second;
+        BOOST_CHECK(pindex != pindexOld);
+        BOOST_CHECK_EQUAL(pindex->nHeight, pindexOld->nHeight);
+        if (!pindexOld->pprev)
+        {
+            BOOST_CHECK(!pindex->pprev);
+            continue;
+        };
+        BOOST_REQUIRE(pindex->pprev);
+        BOOST_CHECK(pindex->pprev->GetBlockHash() == pindexOld->pprev->GetBlockHash());
+        BOOST_REQUIRE(pindex->pskip);
+        BOOST_CHECK(pindex->pskip->nHeight < pindex->nHeight);
+        BOOST_CHECK(mapBlockIndex.count(pindex->pskip->GetBlockHash()));
+    };
+    BOOST_REQUIRE(pindexBest && pindexBest->GetBlockHash() == hashBest);
+    for (int i = 0; i < 20; ++i)
+        BOOST_CHECK(pindexBest->GetAncestor(i)->GetBlockHash() == vIndex[i]->GetBlockHash());
+
+    // - the loaded entries are in the arena, only the map is dropped
+    mapBlockIndex.clear();
+    mapBlockIndex.swap(mapBlockIndexSaved);
+    pindexGenesisBlock = pindexGenesisSaved;
+    pindexBest = pindexBestSaved;
+    hashBestChain = hashBestSaved;
+    nBestHeight = nBestHeightSaved;
+    nBestChainTrust = nBestChainTrustSaved;
+    nBestInvalidTrust = nBestInvalidTrustSaved;
+    chainActive.SetTip(pindexBest);
+    if (strCheckBlocksSaved.empty())
+        mapArgs.erase("-checkblocks");
+    else
+        mapArgs["-checkblocks"] = strCheckBlocksSaved;
+    BOOST_CHECK(txdb.WriteHashBestChain(hashBestChain));
+
+    BOOST_FOREACH(CBlockIndex *pindex, vIndex)
+        delete pindex;
+    BOOST_FOREACH(CBlockIndex *pindex, vOrphan)
+        delete pindex;
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,124 @@
+// SPDX-FileCopyrightText: © 2020 Alias Developers
+//
+// SPDX-License-Identifier: MIT
+
+#include <boost/test/unit_test.hpp>
+
+#include "coinselection.h"
+#include "state.h"
+
+#include <algorithm>
+#include <functional>
+
+// test_spectre --log_level=all  --run_test=coinselection_tests
+
+static std::vector<int64_t> SortedValues(std::vector<int64_t> vValue)
+{
+    std::sort(vValue.begin(), vValue.end(), std::greater<int64_t>());
+    return vValue;
+}
+
+static int CountSelected(const std::vector<char> &vfSelected)
+{
+    return std::count(vfSelected.begin(), vfSelected.end(), true);
+}
+
+BOOST_AUTO_TEST_SUITE(coinselection_tests)
+
+BOOST_AUTO_TEST_CASE(coinselection_bnb)
+{
+    std::vector<char> vfSelected;
+    int64_t nValueRet;
+
+    std::vector<int64_t> vValue = SortedValues({1 * CENT, 2 * CENT, 3 * CENT, 4 * CENT});
+
+    // - exact matches
+    BOOST_CHECK(SelectCoinsBnB(vValue, 1 * CENT, 0, vfSelected, nValueRet));
+    BOOST_CHECK_EQUAL(nValueRet, 1 * CENT);
+    BOOST_CHECK_EQUAL(CountSelected(vfSelected), 1);
+
+    BOOST_CHECK(SelectCoinsBnB(vValue, 10 * CENT, 0, vfSelected, nValueRet));
+    BOOST_CHECK_EQUAL(nValueRet, 10 * CENT);
+    BOOST_CHECK_EQUAL(CountSelected(vfSelected), 4);
+
+    // - of two exact matches the one of fewer inputs, 3 + 4 over 1 + 2 + 4
+    BOOST_CHECK(SelectCoinsBnB(vValue, 7 * CENT, 0, vfSelected, nValueRet));
+    BOOST_CHECK_EQUAL(nValueRet, 7 * CENT);
+    BOOST_CHECK_EQUAL(CountSelected(vfSelected), 2);
+
+    // - nothing in the window, and more than there is
+    BOOST_CHECK(!SelectCoinsBnB(vValue, 11 * CENT, 0, vfSelected, nValueRet));
+    BOOST_CHECK(!SelectCoinsBnB(vValue, 10 * CENT + 1, CENT / 2, vfSelected, nValueRet));
+
+    // - the least excess within the cost of change
+    vValue = SortedValues({5 * CENT, 7 * CENT, 10 * CENT + 400, 10 * CENT + 300});
+    BOOST_CHECK(SelectCoinsBnB(vValue, 10 * CENT, 500, vfSelected, nValueRet));
+    BOOST_CHECK_EQUAL(nValueRet, 10 * CENT + 300);
+    BOOST_CHECK(!SelectCoinsBnB(vValue, 10 * CENT, 200, vfSelected, nValueRet));
+
+    // - the selection refers to the sorted values
+    vValue = SortedValues({40 * CENT, 30 * CENT, 20 * CENT, 10 * CENT, 5 * CENT});
+    BOOST_CHECK(SelectCoinsBnB(vValue, 35 * CENT, 0, vfSelected, nValueRet));
+    BOOST_REQUIRE_EQUAL(vfSelected.size(), vValue.size());
+    int64_t nTotal = 0;
+    for (size_t i = 0; i < vValue.size(); ++i)
+        if (vfSelected[i])
+            nTotal += vValue[i];
+    BOOST_CHECK_EQUAL(nTotal, nValueRet);
+    BOOST_CHECK_EQUAL(CountSelected(vfSelected), 2);
+
+    // - many equal coins don't blow up the search
+    vValue.assign(10000, COIN);
+    vValue.push_back(3 * CENT);
+    vValue = SortedValues(vValue);
+    BOOST_CHECK(SelectCoinsBnB(vValue, 5000 * COIN + 3 * CENT, 0, vfSelected, nValueRet));
+    BOOST_CHECK_EQUAL(nValueRet, 5000 * COIN + 3 * CENT);
+    BOOST_CHECK_EQUAL(CountSelected(vfSelected), 5001);
+
+    // - a search cut short finds nothing
+    BOOST_CHECK(!SelectCoinsBnB(vValue, 5000 * COIN + 3 * CENT, 0, vfSelected, nValueRet, 100));
+}
+
+BOOST_AUTO_TEST_CASE(coinselection_knapsack)
+{
+    std::vector<char> vfBest;
+    int64_t nBest;
+
+    std::vector<int64_t> vValue = SortedValues({1 * CENT, 2 * CENT, 5 * CENT, 10 * CENT});
+
+    ApproximateBestSubset(vValue, 18 * CENT, 8 * CENT, vfBest, nBest);
+    BOOST_CHECK_EQUAL(nBest, 8 * CENT);
+
+    // - nothing reaches more than all coins
+    ApproximateBestSubset(vValue, 18 * CENT, 20 * CENT, vfBest, nBest);
+    BOOST_CHECK_EQUAL(nBest, 18 * CENT);
+    BOOST_CHECK_EQUAL(CountSelected(vfBest), 4);
+}
+
+BOOST_AUTO_TEST_CASE(coinselection_waste)
+{
+    BOOST_CHECK_EQUAL(GetSelectionWaste(10 * CENT, 10 * CENT), 0);
+    BOOST_CHECK_EQUAL(GetSelectionWaste(10 * CENT + 5, 10 * CENT), 5);
+    BOOST_CHECK_EQUAL(GetCostOfChange(10000), 1820);
+}
+
+BOOST_AUTO_TEST_CASE(coinselection_change_to_fee_high_rate)
+{
+    // - at a low fee rate the change to the fee is its cost
+    BOOST_CHECK_EQUAL(GetMaxChangeToFee(10000), GetCostOfChange(10000));
+
+    // - at a high fee rate the cost of change is above a CENT, no more than
+    //   a CENT is given up to the fee
+    const int64_t nFeePerKB = 1 * COIN;
+    BOOST_CHECK(GetCostOfChange(nFeePerKB) > CENT);
+    BOOST_CHECK_EQUAL(GetMaxChangeToFee(nFeePerKB), CENT);
+
+    // - so a set of the target and 5 CENT excess leaves change
+    std::vector<char> vfSelected;
+    int64_t nValueRet;
+    std::vector<int64_t> vValue = SortedValues({15 * CENT, 30 * CENT});
+    BOOST_CHECK(!SelectCoinsBnB(vValue, 10 * CENT, GetMaxChangeToFee(nFeePerKB), vfSelected, nValueRet));
+    BOOST_CHECK(SelectCoinsBnB(vValue, 10 * CENT, GetCostOfChange(nFeePerKB), vfSelected, nValueRet));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -17,7 +17,9 @@
 #include <ctime>
 
 #include "ringsig.h"
+#include "ecmult.h"
 #include "chainparams.h"
+#include "main.h"
 
 using namespace boost::chrono;
 
@@ -125,12 +127,12 @@ void testRingSigABs(int nRingSize)
     BOOST_REQUIRE(0 == generateKeyImage(pkSpend, sSpend, keyImage));
 
     start = clock();
-    BOOST_REQUIRE(0 == generateRingSignatureAB(keyImage, preimage, nRingSize, iSender, sSpend, pPubkeys, pSigC, pSigS));
+    BOOST_REQUIRE(0 == generateRingSignatureAB(keyImage, nRingSize, iSender, sSpend, pPubkeys, pSigC, pSigS));
     stop = clock();
     totalGenerate += stop - start;
 
     start = clock();
-    BOOST_REQUIRE(0 == verifyRingSignatureAB(keyImage, preimage, nRingSize, pPubkeys, pSigC, pSigS));
+    BOOST_REQUIRE(0 == verifyRingSignatureAB(keyImage, nRingSize, pPubkeys, pSigC, pSigS));
     stop = clock();
     totalVerify += stop - start;
 
@@ -145,6 +147,77 @@ void testRingSigABs(int nRingSize)
 
 };
 
+#ifdef USE_NATIVE_SECP256K1
+clock_t totalVerifyOpenSSL;
+
+void testRingSigNativeCrossCheck(int nRingSize)
+{
+    std::vector<uint8_t> vPubkeys(EC_COMPRESSED_SIZE * nRingSize);
+    std::vector<uint8_t> vSigS(EC_SECRET_SIZE * nRingSize);
+    std::vector<uint8_t> vSigc(EC_SECRET_SIZE * nRingSize);
+    std::vector<uint8_t> vSigr(EC_SECRET_SIZE * nRingSize);
+
+    std::vector<CKey> vKeys(nRingSize);
+    for (int i = 0; i < nRingSize; ++i)
+    {
+        vKeys[i].MakeNewKey(true);
+        CPubKey pk = vKeys[i].GetPubKey();
+        memcpy(&vPubkeys[i * EC_COMPRESSED_SIZE], pk.begin(), EC_COMPRESSED_SIZE);
+    };
+
+    int iSender = GetRandInt(nRingSize);
+
+    ec_secret sSpend;
+    ec_point pkSpend;
+    ec_point keyImage, keyImageOpenSSL;
+
+    memcpy(&sSpend.e[0], vKeys[iSender].begin(), EC_SECRET_SIZE);
+    BOOST_REQUIRE(0 == SecretToPublicKey(sSpend, pkSpend));
+
+    // key images must be bit identical
+    BOOST_REQUIRE(0 == generateKeyImage(pkSpend, sSpend, keyImage));
+    BOOST_REQUIRE(0 == generateKeyImageOpenSSL(GetRingSigContext(), pkSpend, sSpend, keyImageOpenSSL));
+    BOOST_CHECK(keyImage == keyImageOpenSSL);
+
+    // AB: native signature verified by both, OpenSSL signature verified by both
+    ec_point sigC;
+    BOOST_REQUIRE(0 == generateRingSignatureAB(keyImage, nRingSize, iSender, sSpend, &vPubkeys[0], sigC, &vSigS[0]));
+
+    start = clock();
+    BOOST_CHECK(0 == verifyRingSignatureAB(keyImage, nRingSize, &vPubkeys[0], sigC, &vSigS[0]));
+    stop = clock();
+    totalVerify += stop - start;
+
+    start = clock();
+    BOOST_CHECK(0 == verifyRingSignatureABOpenSSL(GetRingSigContext(), keyImage, nRingSize, &vPubkeys[0], sigC, &vSigS[0]));
+    stop = clock();
+    totalVerifyOpenSSL += stop - start;
+
+    BOOST_REQUIRE(0 == generateRingSignatureABOpenSSL(GetRingSigContext(), keyImage, nRingSize, iSender, sSpend, &vPubkeys[0], sigC, &vSigS[0]));
+    BOOST_CHECK(0 == verifyRingSignatureAB(keyImage, nRingSize, &vPubkeys[0], sigC, &vSigS[0]));
+
+    // both must reject the same tampered signature
+    vSigS[0] ^= 1;
+    BOOST_CHECK(2 == verifyRingSignatureAB(keyImage, nRingSize, &vPubkeys[0], sigC, &vSigS[0]));
+    BOOST_CHECK(2 == verifyRingSignatureABOpenSSL(GetRingSigContext(), keyImage, nRingSize, &vPubkeys[0], sigC, &vSigS[0]));
+
+    // legacy format
+    uint256 preimage;
+    BOOST_CHECK(1 == RAND_bytes((uint8_t*) preimage.begin(), 32));
+
+    BOOST_REQUIRE(0 == generateRingSignature(keyImage, preimage, nRingSize, iSender, sSpend, &vPubkeys[0], &vSigc[0], &vSigr[0]));
+    BOOST_CHECK(0 == verifyRingSignature(keyImage, preimage, nRingSize, &vPubkeys[0], &vSigc[0], &vSigr[0]));
+    BOOST_CHECK(0 == verifyRingSignatureOpenSSL(GetRingSigContext(), keyImage, preimage, nRingSize, &vPubkeys[0], &vSigc[0], &vSigr[0]));
+
+    BOOST_REQUIRE(0 == generateRingSignatureOpenSSL(GetRingSigContext(), keyImage, preimage, nRingSize, iSender, sSpend, &vPubkeys[0], &vSigc[0], &vSigr[0]));
+    BOOST_CHECK(0 == verifyRingSignature(keyImage, preimage, nRingSize, &vPubkeys[0], &vSigc[0], &vSigr[0]));
+
+    vSigr[0] ^= 1;
+    BOOST_CHECK(2 == verifyRingSignature(keyImage, preimage, nRingSize, &vPubkeys[0], &vSigc[0], &vSigr[0]));
+    BOOST_CHECK(2 == verifyRingSignatureOpenSSL(GetRingSigContext(), keyImage, preimage, nRingSize, &vPubkeys[0], &vSigc[0], &vSigr[0]));
+};
+#endif
+
 BOOST_AUTO_TEST_SUITE(ringsig_tests)
 
 BOOST_AUTO_TEST_CASE(ringsig)
@@ -186,4 +259,223 @@ BOOST_AUTO_TEST_CASE(ringsig)
     SelectParams(CChainParams::MAIN);
 }
 
+#ifdef USE_NATIVE_SECP256K1
+BOOST_AUTO_TEST_CASE(ringsig_native_crosscheck)
+{
+    SelectParams(CChainParams::REGTEST);
+
+    BOOST_REQUIRE(0 == initialiseRingSigs());
+
+    totalVerify = 0;
+    totalVerifyOpenSSL = 0;
+
+    for (int nRingSize = (int)MIN_RING_SIZE; nRingSize <= (int)MAX_RING_SIZE; ++nRingSize)
+        testRingSigNativeCrossCheck(nRingSize);
+
+    BOOST_TEST_MESSAGE("verify native  " << (double(totalVerify)        / CLOCKS_PER_SEC));
+    BOOST_TEST_MESSAGE("verify OpenSSL " << (double(totalVerifyOpenSSL) / CLOCKS_PER_SEC));
+
+    BOOST_CHECK(0 == finaliseRingSigs());
+
+    SelectParams(CChainParams::MAIN);
+}
+
+BOOST_AUTO_TEST_CASE(ringsig_native_crosscheck_pre_v3)
+{
+    // - below the V3 height of main net hashToEC maps to h*G, regtest is V3 from genesis
+    SelectParams(CChainParams::MAIN);
+    BOOST_REQUIRE(!Params().IsProtocolV3(nBestHeight));
+
+    BOOST_REQUIRE(0 == initialiseRingSigs());
+
+    for (int nRingSize = (int)MIN_RING_SIZE; nRingSize <= (int)MIN_RING_SIZE + 4; ++nRingSize)
+        testRingSigNativeCrossCheck(nRingSize);
+
+    BOOST_CHECK(0 == finaliseRingSigs());
+}
+#endif
+
+BOOST_AUTO_TEST_CASE(ringsig_point_cache)
+{
+    SelectParams(CChainParams::REGTEST);
+
+    BOOST_REQUIRE(0 == initialiseRingSigs());
+
+    int nRingSize = MIN_RING_SIZE;
+    std::vector<uint8_t> vPubkeys(EC_COMPRESSED_SIZE * nRingSize);
+    std::vector<uint8_t> vSigS(EC_SECRET_SIZE * nRingSize);
+    std::vector<CKey> vKeys(nRingSize);
+    for (int i = 0; i < nRingSize; ++i)
+    {
+        vKeys[i].MakeNewKey(true);
+        CPubKey pk = vKeys[i].GetPubKey();
+        memcpy(&vPubkeys[i * EC_COMPRESSED_SIZE], pk.begin(), EC_COMPRESSED_SIZE);
+    };
+
+    ec_secret sSpend;
+    ec_point pkSpend;
+    ec_point keyImage;
+    ec_point pSigC;
+
+    memcpy(&sSpend.e[0], vKeys[0].begin(), EC_SECRET_SIZE);
+    BOOST_CHECK(0 == SecretToPublicKey(sSpend, pkSpend));
+    BOOST_REQUIRE(0 == generateKeyImage(pkSpend, sSpend, keyImage));
+    BOOST_REQUIRE(0 == generateRingSignatureAB(keyImage, nRingSize, 0, sSpend, &vPubkeys[0], pSigC, &vSigS[0]));
+
+    CRingCacheStats before, after;
+    GetRingPointCacheStats(before);
+    BOOST_CHECK(0 == verifyRingSignatureAB(keyImage, nRingSize, &vPubkeys[0], pSigC, &vSigS[0]));
+    GetRingPointCacheStats(after);
+
+#ifdef USE_NATIVE_SECP256K1
+    // every member was looked up while signing
+    BOOST_CHECK(after.nHits - before.nHits == (uint64_t)nRingSize);
+    BOOST_CHECK(after.nMisses == before.nMisses);
+
+    SetRingPointCacheSize(2);
+    GetRingPointCacheStats(after);
+    BOOST_CHECK(after.nEntries <= 2);
+    BOOST_CHECK(0 == verifyRingSignatureAB(keyImage, nRingSize, &vPubkeys[0], pSigC, &vSigS[0]));
+    SetRingPointCacheSize(DEFAULT_RING_POINT_CACHE_SIZE);
+#endif
+
+    BOOST_CHECK(0 == finaliseRingSigs());
+
+    SelectParams(CChainParams::MAIN);
+}
+
+BOOST_AUTO_TEST_CASE(ringsig_batch)
+{
+    SelectParams(CChainParams::REGTEST);
+
+    BOOST_REQUIRE(0 == initialiseRingSigs());
+
+    CRingSigBatch batch;
+    std::vector<size_t> vExpectFailed;
+
+    for (int k = 0; k < 12; ++k)
+    {
+        int nRingSize = MIN_RING_SIZE + k % 3;
+
+        std::vector<uint8_t> vPubkeys(EC_COMPRESSED_SIZE * nRingSize);
+        std::vector<uint8_t> vSigS(EC_SECRET_SIZE * nRingSize);
+        std::vector<CKey> vKeys(nRingSize);
+        for (int i = 0; i < nRingSize; ++i)
+        {
+            vKeys[i].MakeNewKey(true);
+            CPubKey pk = vKeys[i].GetPubKey();
+            memcpy(&vPubkeys[i * EC_COMPRESSED_SIZE], pk.begin(), EC_COMPRESSED_SIZE);
+        };
+
+        int iSender = GetRandInt(nRingSize);
+
+        ec_secret sSpend;
+        ec_point pkSpend;
+        ec_point keyImage;
+        ec_point pSigC;
+
+        memcpy(&sSpend.e[0], vKeys[iSender].begin(), EC_SECRET_SIZE);
+        BOOST_CHECK(0 == SecretToPublicKey(sSpend, pkSpend));
+        BOOST_REQUIRE(0 == generateKeyImage(pkSpend, sSpend, keyImage));
+        BOOST_REQUIRE(0 == generateRingSignatureAB(keyImage, nRingSize, iSender, sSpend, &vPubkeys[0], pSigC, &vSigS[0]));
+
+        if (k % 5 == 2)
+        {
+            vSigS[EC_SECRET_SIZE * (k % nRingSize)] ^= 1;
+            vExpectFailed.push_back(k);
+        };
+
+        uint256 txnHash = k;
+        BOOST_CHECK(batch.Add(keyImage, nRingSize, &vPubkeys[0], pSigC, &vSigS[0], txnHash, 0));
+        BOOST_CHECK(!batch.Add(keyImage, nRingSize, &vPubkeys[0], pSigC, &vSigS[0], txnHash, 0));
+    };
+
+    BOOST_CHECK(batch.size() == 12);
+
+    std::vector<size_t> vFailed;
+    BOOST_CHECK(0 != batch.Verify(vFailed));
+    BOOST_CHECK(vFailed == vExpectFailed);
+
+    // signatures that verified are cached, only the bad ones are queued again
+    CRingSigBatch batchAgain;
+    for (size_t k = 0; k < batch.size(); ++k)
+    {
+        const CRingSigBatch::Entry &e = batch.Get(k);
+        bool fFailed = std::find(vFailed.begin(), vFailed.end(), k) != vFailed.end();
+        BOOST_CHECK(fFailed == batchAgain.Add(e.vchImage, e.nRingSize, &e.vchPubkeys[0], e.vchSigC, &e.vchSigS[0], e.txnHash, e.nInput));
+    };
+    BOOST_CHECK(batchAgain.size() == vExpectFailed.size());
+
+    BOOST_CHECK(0 == finaliseRingSigs());
+
+    SelectParams(CChainParams::MAIN);
+}
+
+
+struct CRingSigTestSig
+{
+    ec_point keyImage;
+    std::vector<uint8_t> vPubkeys;
+    ec_point sigC;
+    std::vector<uint8_t> vSigS;
+};
+
+static void verifyRingSigsThread(const std::vector<CRingSigTestSig> *pvSigs, boost::atomic<int> *pnFailed)
+{
+    // - each thread gets its own OpenSSL context
+    CRingSigContext &ctx = GetRingSigContext();
+    for (size_t k = 0; k < pvSigs->size(); ++k)
+    {
+        const CRingSigTestSig &sig = (*pvSigs)[k];
+        int nRingSize = sig.vSigS.size() / EC_SECRET_SIZE;
+        if (verifyRingSignatureABOpenSSL(ctx, sig.keyImage, nRingSize, &sig.vPubkeys[0], sig.sigC, &sig.vSigS[0]) != 0
+            || verifyRingSignatureAB(sig.keyImage, nRingSize, &sig.vPubkeys[0], sig.sigC, &sig.vSigS[0]) != 0)
+            (*pnFailed)++;
+    };
+}
+
+BOOST_AUTO_TEST_CASE(ringsig_threads)
+{
+    SelectParams(CChainParams::REGTEST);
+
+    BOOST_REQUIRE(0 == initialiseRingSigs());
+
+    int nRingSize = MIN_RING_SIZE;
+    std::vector<CRingSigTestSig> vSigs(8);
+    for (size_t k = 0; k < vSigs.size(); ++k)
+    {
+        CRingSigTestSig &sig = vSigs[k];
+        sig.vPubkeys.resize(EC_COMPRESSED_SIZE * nRingSize);
+        sig.vSigS.resize(EC_SECRET_SIZE * nRingSize);
+
+        std::vector<CKey> vKeys(nRingSize);
+        for (int i = 0; i < nRingSize; ++i)
+        {
+            vKeys[i].MakeNewKey(true);
+            CPubKey pk = vKeys[i].GetPubKey();
+            memcpy(&sig.vPubkeys[i * EC_COMPRESSED_SIZE], pk.begin(), EC_COMPRESSED_SIZE);
+        };
+
+        int iSender = GetRandInt(nRingSize);
+        ec_secret sSpend;
+        ec_point pkSpend;
+        memcpy(&sSpend.e[0], vKeys[iSender].begin(), EC_SECRET_SIZE);
+        BOOST_CHECK(0 == SecretToPublicKey(sSpend, pkSpend));
+        BOOST_REQUIRE(0 == generateKeyImage(pkSpend, sSpend, sig.keyImage));
+        BOOST_REQUIRE(0 == generateRingSignatureAB(sig.keyImage, nRingSize, iSender, sSpend, &sig.vPubkeys[0], sig.sigC, &sig.vSigS[0]));
+    };
+
+    boost::atomic<int> nFailed(0);
+    boost::thread_group threads;
+    for (int i = 0; i < 4; ++i)
+        threads.create_thread(boost::bind(&verifyRingSigsThread, &vSigs, &nFailed));
+    threads.join_all();
+
+    BOOST_CHECK(nFailed == 0);
+
+    BOOST_CHECK(0 == finaliseRingSigs());
+
+    SelectParams(CChainParams::MAIN);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
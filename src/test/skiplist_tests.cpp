@@ -0,0 +1,83 @@
+// SPDX-FileCopyrightText: © 2020 Alias Developers
+//
+// SPDX-License-Identifier: MIT
+
+#include <boost/test/unit_test.hpp>
+
+#include "main.h"
+#include "util.h"
+
+// test_spectre --log_level=all  --run_test=skiplist_tests
+
+#define SKIPLIST_LENGTH 100000
+
+BOOST_AUTO_TEST_SUITE(skiplist_tests)
+
+BOOST_AUTO_TEST_CASE(skiplist_ancestor)
+{
+    std::vector<CBlockIndex> vIndex(SKIPLIST_LENGTH);
+
+    for (int i = 0; i < SKIPLIST_LENGTH; i++)
+    {
+        vIndex[i].nHeight = i;
+        vIndex[i].pprev = (i == 0) ? NULL : &vIndex[i - 1];
+        vIndex[i].BuildSkip();
+    };
+
+    for (int i = 0; i < SKIPLIST_LENGTH; i++)
+    {
+        if (i > 0)
+        {
+            BOOST_CHECK(vIndex[i].pskip == &vIndex[vIndex[i].pskip->nHeight]);
+            BOOST_CHECK(vIndex[i].pskip->nHeight < i);
+        } else
+        {
+            BOOST_CHECK(vIndex[i].pskip == NULL);
+        };
+    };
+
+    for (int i = 0; i < 1000; i++)
+    {
+        int from = GetRandInt(SKIPLIST_LENGTH);
+        int to = GetRandInt(from + 1);
+
+        BOOST_CHECK(vIndex[SKIPLIST_LENGTH - 1].GetAncestor(from) == &vIndex[from]);
+        BOOST_CHECK(vIndex[from].GetAncestor(to) == &vIndex[to]);
+        BOOST_CHECK(vIndex[from].GetAncestor(0) == &vIndex[0]);
+    };
+
+    BOOST_CHECK(vIndex[10].GetAncestor(11) == NULL);
+    BOOST_CHECK(vIndex[10].GetAncestor(-1) == NULL);
+}
+
+BOOST_AUTO_TEST_CASE(skiplist_branch)
+{
+    // - a branch off the chain at 50000 shares the ancestors below it
+    std::vector<CBlockIndex> vChain(SKIPLIST_LENGTH);
+    std::vector<CBlockIndex> vBranch(SKIPLIST_LENGTH / 2);
+
+    for (int i = 0; i < SKIPLIST_LENGTH; i++)
+    {
+        vChain[i].nHeight = i;
+        vChain[i].pprev = (i == 0) ? NULL : &vChain[i - 1];
+        vChain[i].BuildSkip();
+    };
+
+    for (int i = 0; i < SKIPLIST_LENGTH / 2; i++)
+    {
+        vBranch[i].nHeight = SKIPLIST_LENGTH / 2 + i;
+        vBranch[i].pprev = (i == 0) ? &vChain[SKIPLIST_LENGTH / 2 - 1] : &vBranch[i - 1];
+        vBranch[i].BuildSkip();
+    };
+
+    for (int i = 0; i < 1000; i++)
+    {
+        int nHeight = GetRandInt(SKIPLIST_LENGTH);
+        const CBlockIndex *pindexExpect = nHeight < SKIPLIST_LENGTH / 2
+            ? &vChain[nHeight] : &vBranch[nHeight - SKIPLIST_LENGTH / 2];
+        BOOST_CHECK(vBranch.back().GetAncestor(nHeight) == pindexExpect);
+        BOOST_CHECK(vChain.back().GetAncestor(nHeight) == &vChain[nHeight]);
+    };
+}
+
+BOOST_AUTO_TEST_SUITE_END()
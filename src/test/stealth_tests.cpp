@@ -8,6 +8,7 @@
 #include <boost/atomic.hpp>
 
 #include "stealth.h"
+#include "ecmult.h"
 
 // test_spectre --log_level=all  --run_test=stealth_tests
 
@@ -31,4 +32,81 @@ BOOST_AUTO_TEST_CASE(stealth_key)
     
 }
 
+BOOST_AUTO_TEST_CASE(stealth_secret)
+{
+    // - sender and recipient derive the same one time key
+    ec_secret sScan, sSpend, sEphem, sShared, sSharedR, sSpendOut;
+    ec_point pkScan, pkSpend, pkEphem, pkOut, pkOutR, pkSpendOut;
+
+    BOOST_REQUIRE(0 == GenerateRandomSecret(sScan));
+    BOOST_REQUIRE(0 == GenerateRandomSecret(sSpend));
+    BOOST_REQUIRE(0 == GenerateRandomSecret(sEphem));
+    BOOST_REQUIRE(0 == SecretToPublicKey(sScan, pkScan));
+    BOOST_REQUIRE(0 == SecretToPublicKey(sSpend, pkSpend));
+    BOOST_REQUIRE(0 == SecretToPublicKey(sEphem, pkEphem));
+
+    BOOST_CHECK(0 == StealthSecret(sEphem, pkScan, pkSpend, sShared, pkOut));
+    BOOST_CHECK(0 == StealthSecret(sScan, pkEphem, pkSpend, sSharedR, pkOutR));
+    BOOST_CHECK(memcmp(sShared.e, sSharedR.e, EC_SECRET_SIZE) == 0);
+    BOOST_CHECK(pkOut == pkOutR);
+
+    BOOST_CHECK(0 == StealthSharedToPublicKey(pkSpend, sShared, pkOutR));
+    BOOST_CHECK(pkOut == pkOutR);
+
+    BOOST_CHECK(0 == StealthSecretSpend(sScan, pkEphem, sSpend, sSpendOut));
+    BOOST_CHECK(0 == SecretToPublicKey(sSpendOut, pkSpendOut));
+    BOOST_CHECK(pkSpendOut == pkOut);
+
+    BOOST_CHECK(0 == StealthSharedToSecretSpend(sShared, sSpend, sSpendOut));
+    BOOST_CHECK(0 == SecretToPublicKey(sSpendOut, pkSpendOut));
+    BOOST_CHECK(pkSpendOut == pkOut);
+}
+
+#ifdef USE_NATIVE_SECP256K1
+BOOST_AUTO_TEST_CASE(stealth_native_crosscheck)
+{
+    CStealthContext &ctx = GetStealthContext();
+
+    for (int i = 0; i < 32; ++i)
+    {
+        ec_secret sScan, sSpend, sEphem, sShared, sSharedRef, sOut, sOutRef;
+        ec_point pkScan, pkScanRef, pkSpend, pkEphem, pkOut, pkOutRef;
+
+        BOOST_REQUIRE(0 == GenerateRandomSecret(sScan));
+        BOOST_REQUIRE(0 == GenerateRandomSecret(sSpend));
+        BOOST_REQUIRE(0 == GenerateRandomSecret(sEphem));
+
+        BOOST_CHECK(0 == SecretToPublicKey(sScan, pkScan));
+        BOOST_CHECK(0 == SecretToPublicKeyOpenSSL(ctx, sScan, pkScanRef));
+        BOOST_CHECK(pkScan == pkScanRef);
+
+        BOOST_REQUIRE(0 == SecretToPublicKey(sSpend, pkSpend));
+        BOOST_REQUIRE(0 == SecretToPublicKey(sEphem, pkEphem));
+
+        BOOST_CHECK(0 == StealthSecret(sScan, pkEphem, pkSpend, sShared, pkOut));
+        BOOST_CHECK(0 == StealthSecretOpenSSL(ctx, sScan, pkEphem, pkSpend, sSharedRef, pkOutRef));
+        BOOST_CHECK(memcmp(sShared.e, sSharedRef.e, EC_SECRET_SIZE) == 0);
+        BOOST_CHECK(pkOut == pkOutRef);
+
+        BOOST_CHECK(0 == StealthSharedToPublicKey(pkSpend, sShared, pkOut));
+        BOOST_CHECK(0 == StealthSharedToPublicKeyOpenSSL(ctx, pkSpend, sShared, pkOutRef));
+        BOOST_CHECK(pkOut == pkOutRef);
+
+        BOOST_CHECK(0 == StealthSecretSpend(sScan, pkEphem, sSpend, sOut));
+        BOOST_CHECK(0 == StealthSecretSpendOpenSSL(ctx, sScan, pkEphem, sSpend, sOutRef));
+        BOOST_CHECK(memcmp(sOut.e, sOutRef.e, EC_SECRET_SIZE) == 0);
+
+        BOOST_CHECK(0 == StealthSharedToSecretSpend(sShared, sSpend, sOut));
+        BOOST_CHECK(0 == StealthSharedToSecretSpendOpenSSL(ctx, sShared, sSpend, sOutRef));
+        BOOST_CHECK(memcmp(sOut.e, sOutRef.e, EC_SECRET_SIZE) == 0);
+    };
+
+    // - not a point
+    ec_secret sScan, sShared;
+    ec_point pkBad(EC_COMPRESSED_SIZE, 0xff), pkOut;
+    BOOST_REQUIRE(0 == GenerateRandomSecret(sScan));
+    BOOST_CHECK(0 != StealthSecret(sScan, pkBad, pkBad, sShared, pkOut));
+}
+#endif
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -87,19 +87,26 @@ HEADERS += \
     $$PWD/alert.h \
     $$PWD/allocators.h \
     $$PWD/anonymize.h \
+    $$PWD/arena.h \
     $$PWD/base58.h \
     $$PWD/bignum.h \
+    $$PWD/blockfile.h \
+    $$PWD/blockindexsnapshot.h \
+    $$PWD/blockmap.h \
     $$PWD/bloom.h \
     $$PWD/chainparams.h \
     $$PWD/chainparamsseeds.h \
     $$PWD/checkpoints.h \
+    $$PWD/checkqueue.h \
     $$PWD/clientversion.h \
     $$PWD/coincontrol.h \
+    $$PWD/coinselection.h \
     $$PWD/compat.h \
     $$PWD/core.h \
     $$PWD/crypter.h \
     $$PWD/db.h \
     $$PWD/eckey.h \
+    $$PWD/ecmult.h \
     $$PWD/extkey.h \
     $$PWD/hash.h \
     $$PWD/init.h \
@@ -181,13 +188,17 @@ SOURCES += \
     $$PWD/test/other/transaction_tests.cpp \
     $$PWD/test/accounting_tests.cpp \
     $$PWD/test/allocator_tests.cpp \
+    $$PWD/test/anonstats_tests.cpp \
     $$PWD/test/base32_tests.cpp \
     $$PWD/test/base58_tests.cpp \
     $$PWD/test/base64_tests.cpp \
     $$PWD/test/basic_tests.cpp \
     $$PWD/test/bignum_tests.cpp \
     $$PWD/test/bip32_tests.cpp \
+    $$PWD/test/blockfile_tests.cpp \
+    $$PWD/test/blockindexsnapshot_tests.cpp \
     $$PWD/test/Checkpoints_tests.cpp \
+    $$PWD/test/coinselection_tests.cpp \
     $$PWD/test/extkey_tests.cpp \
     $$PWD/test/getarg_tests.cpp \
     $$PWD/test/hash_tests.cpp \
@@ -202,6 +213,7 @@ SOURCES += \
     $$PWD/test/script_P2SH_tests.cpp \
     $$PWD/test/script_tests.cpp \
     $$PWD/test/sigopcount_tests.cpp \
+    $$PWD/test/skiplist_tests.cpp \
     $$PWD/test/smsg_tests.cpp \
     $$PWD/test/stealth_tests.cpp \
 #    $$PWD/test/test_shadow.cpp \
@@ -211,13 +223,17 @@ SOURCES += \
     $$PWD/test/wallet_tests.cpp \
     $$PWD/alert.cpp \
     $$PWD/anonymize.cpp \
+    $$PWD/blockfile.cpp \
+    $$PWD/blockindexsnapshot.cpp \
     $$PWD/bloom.cpp \
     $$PWD/chainparams.cpp \
     $$PWD/checkpoints.cpp \
+    $$PWD/coinselection.cpp \
     $$PWD/core.cpp \
     $$PWD/crypter.cpp \
     $$PWD/db.cpp \
     $$PWD/eckey.cpp \
+    $$PWD/ecmult.cpp \
     $$PWD/extkey.cpp \
     $$PWD/hash.cpp \
     $$PWD/init.cpp \
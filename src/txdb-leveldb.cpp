@@ -18,6 +18,8 @@
 #include "kernel.h"
 #include "checkpoints.h"
 #include "txdb.h"
+#include "blockindexsnapshot.h"
+#include "checkqueue.h"
 #include "util.h"
 #include "main.h"
 
@@ -80,6 +82,7 @@ void CTxDB::Close()
         delete activeBatch;
         activeBatch = NULL;
     }
+    mapBatchOverlay.clear();
 
     if (openOptions.block_cache)
     {
@@ -107,6 +110,7 @@ bool CTxDB::TxnCommit()
     leveldb::Status status = pdb->Write(GetWriteOptions(), activeBatch);
     delete activeBatch;
     activeBatch = NULL;
+    mapBatchOverlay.clear();
     if (!status.ok()) {
         LogPrintf("LevelDB batch commit failure: %s\n", status.ToString());
         return false;
@@ -114,48 +118,22 @@ bool CTxDB::TxnCommit()
     return true;
 }
 
-class CBatchScanner : public leveldb::WriteBatch::Handler {
-public:
-    std::string needle;
-    bool *deleted;
-    std::string *foundValue;
-    bool foundEntry;
-
-    CBatchScanner() : foundEntry(false) {}
-
-    virtual void Put(const leveldb::Slice& key, const leveldb::Slice& value) {
-        if (key.ToString() == needle) {
-            foundEntry = true;
-            *deleted = false;
-            *foundValue = value.ToString();
-        }
-    }
-
-    virtual void Delete(const leveldb::Slice& key) {
-        if (key.ToString() == needle) {
-            foundEntry = true;
-            *deleted = true;
-        }
-    }
-};
-
 // When performing a read, if we have an active batch we need to check it first
 // before reading from the database, as the rest of the code assumes that once
-// a database transaction begins reads are consistent with it. It would be good
-// to change that assumption in future and avoid the performance hit, though in
-// practice it does not appear to be large.
+// a database transaction begins reads are consistent with it. The overlay
+// holds the last write of each key in the batch, so this is a hash lookup
+// rather than a scan of the whole batch, which grew with every anon output
+// and spent input a block connects.
 bool CTxDB::ScanBatch(const CDataStream &key, string *value, bool *deleted) const {
     assert(activeBatch);
     *deleted = false;
-    CBatchScanner scanner;
-    scanner.needle = key.str();
-    scanner.deleted = deleted;
-    scanner.foundValue = value;
-    leveldb::Status status = activeBatch->Iterate(&scanner);
-    if (!status.ok()) {
-        throw runtime_error(status.ToString());
-    }
-    return scanner.foundEntry;
+    std::unordered_map<std::string, std::pair<bool, std::string> >::const_iterator mi = mapBatchOverlay.find(key.str());
+    if (mi == mapBatchOverlay.end())
+        return false;
+    *deleted = mi->second.first;
+    if (!*deleted)
+        *value = mi->second.second;
+    return true;
 }
 
 int CTxDB::CheckVersion()
@@ -195,6 +173,7 @@ int CTxDB::RecreateDB()
         delete activeBatch;
         activeBatch = NULL;
     }
+    mapBatchOverlay.clear();
 
     if (openOptions.block_cache) {
         delete openOptions.block_cache;
@@ -234,7 +213,20 @@ bool CTxDB::EraseKeyImage(ec_point& keyImage)
 
 bool CTxDB::WriteAnonOutput(CPubKey& pkCoin, CAnonOutput& ao)
 {
-    return Write(make_pair(string("ao"), pkCoin), ao);
+    // - the index entry moves when the output is confirmed, or reconfirmed in another block
+    bool fTxn = !activeBatch;
+    if (fTxn)
+        TxnBegin();
+
+    CAnonOutput aoOld;
+    if (Read(make_pair(string("ao"), pkCoin), aoOld)
+        && (aoOld.nValue != ao.nValue || aoOld.nBlockHeight != ao.nBlockHeight))
+        Erase(make_pair(string("aoi"), CAnonOutputIndexKey(aoOld.nValue, aoOld.nBlockHeight, pkCoin)));
+
+    Write(make_pair(string("aoi"), CAnonOutputIndexKey(ao.nValue, ao.nBlockHeight, pkCoin)), ao);
+    Write(make_pair(string("ao"), pkCoin), ao);
+
+    return fTxn ? TxnCommit() : true;
 };
 
 bool CTxDB::ReadAnonOutput(CPubKey& pkCoin, CAnonOutput& ao)
@@ -244,7 +236,123 @@ bool CTxDB::ReadAnonOutput(CPubKey& pkCoin, CAnonOutput& ao)
 
 bool CTxDB::EraseAnonOutput(CPubKey& pkCoin)
 {
-    return Erase(make_pair(string("ao"), pkCoin));
+    bool fTxn = !activeBatch;
+    if (fTxn)
+        TxnBegin();
+
+    CAnonOutput ao;
+    if (Read(make_pair(string("ao"), pkCoin), ao))
+        Erase(make_pair(string("aoi"), CAnonOutputIndexKey(ao.nValue, ao.nBlockHeight, pkCoin)));
+    Erase(make_pair(string("ao"), pkCoin));
+
+    return fTxn ? TxnCommit() : true;
+};
+
+bool CTxDB::ReadAnonOutputIndex(int64_t nMinValue, int64_t nMaxValue, int nMinHeight, int nMaxHeight,
+    std::function<bool (const CPubKey&, const CAnonOutput&)> funcOutput)
+{
+    if (nMinValue > nMaxValue || nMinHeight > nMaxHeight)
+        return true;
+
+    leveldb::Iterator *iterator = pdb->NewIterator(GetReadOptions());
+
+    CDataStream ssStartKey(SER_DISK, CLIENT_VERSION);
+    ssStartKey << make_pair(string("aoi"), CAnonOutputIndexKey(nMinValue, nMinHeight));
+    iterator->Seek(ssStartKey.str());
+
+    CAnonOutputIndexKey key;
+    CAnonOutput ao;
+    while (iterator->Valid())
+    {
+        CDataStream ssKey(iterator->key().data(), iterator->key().data() + iterator->key().size(), SER_DISK, CLIENT_VERSION);
+        string strType;
+        ssKey >> strType;
+        if (strType != "aoi")
+            break;
+
+        ssKey >> key;
+        if (key.nValue > nMaxValue)
+            break;
+
+        if (key.nBlockHeight < nMinHeight || key.nBlockHeight > nMaxHeight)
+        {
+            // - skip to the height range of this or the next denomination
+            if (key.nBlockHeight > nMaxHeight && key.nValue == nMaxValue)
+                break;
+            ssStartKey.clear();
+            ssStartKey << make_pair(string("aoi"), CAnonOutputIndexKey(key.nBlockHeight < nMinHeight ? key.nValue : key.nValue + 1, nMinHeight));
+            iterator->Seek(ssStartKey.str());
+            continue;
+        };
+
+        CDataStream ssValue(iterator->value().data(), iterator->value().data() + iterator->value().size(), SER_DISK, CLIENT_VERSION);
+        ssValue >> ao;
+
+        if (!funcOutput(key.pkCoin, ao))
+            break;
+
+        iterator->Next();
+    };
+
+    delete iterator;
+    return true;
+};
+
+bool CTxDB::BuildAnonOutputIndex()
+{
+    if (Exists(string("aoindex")))
+        return true;
+
+    LogPrintf("Building the anon output index...\n");
+    int64_t nStart = GetTimeMillis();
+
+    leveldb::Iterator *iterator = pdb->NewIterator(GetReadOptions());
+
+    CPubKey pkZero;
+    pkZero.SetZero();
+
+    CDataStream ssStartKey(SER_DISK, CLIENT_VERSION);
+    ssStartKey << make_pair(string("ao"), pkZero);
+    iterator->Seek(ssStartKey.str());
+
+    // - written in batches, the index is only used once the marker is set
+    uint32_t nIndexed = 0;
+    TxnBegin();
+    CPubKey pkCoin;
+    CAnonOutput ao;
+    while (iterator->Valid())
+    {
+        CDataStream ssKey(iterator->key().data(), iterator->key().data() + iterator->key().size(), SER_DISK, CLIENT_VERSION);
+        string strType;
+        ssKey >> strType;
+        if (strType != "ao")
+            break;
+
+        CDataStream ssValue(iterator->value().data(), iterator->value().data() + iterator->value().size(), SER_DISK, CLIENT_VERSION);
+        ssKey >> pkCoin;
+        ssValue >> ao;
+
+        Write(make_pair(string("aoi"), CAnonOutputIndexKey(ao.nValue, ao.nBlockHeight, pkCoin)), ao);
+        if (++nIndexed % 10000 == 0)
+        {
+            if (!TxnCommit())
+            {
+                delete iterator;
+                return error("BuildAnonOutputIndex() : TxnCommit failed");
+            };
+            TxnBegin();
+        };
+
+        iterator->Next();
+    };
+    delete iterator;
+
+    Write(string("aoindex"), 1);
+    if (!TxnCommit())
+        return error("BuildAnonOutputIndex() : TxnCommit failed");
+
+    LogPrintf("Indexed %u anon outputs in %dms.\n", nIndexed, GetTimeMillis() - nStart);
+    return true;
 };
 
 bool CTxDB::WriteCompromisedAnonHeights(std::map<int64_t, std::vector<int>>& mapCompromisedHeights)
@@ -262,6 +370,41 @@ bool CTxDB::EraseCompromisedAnonHeights()
     return Erase(string("compromisedanonheights"));
 };
 
+bool CTxDB::WriteAnonStats(const uint256& hashBlock, const std::map<int64_t, CAnonOutputCount>& mapOutputStats)
+{
+    return Write(string("anonstats"), make_pair(hashBlock, mapOutputStats));
+};
+
+bool CTxDB::ReadAnonStats(uint256& hashBlock, std::map<int64_t, CAnonOutputCount>& mapOutputStats)
+{
+    std::pair<uint256, std::map<int64_t, CAnonOutputCount> > snapshot;
+    if (!Read(string("anonstats"), snapshot))
+        return false;
+    hashBlock = snapshot.first;
+    mapOutputStats.swap(snapshot.second);
+    return true;
+};
+
+bool CTxDB::EraseAnonStats()
+{
+    return Erase(string("anonstats"));
+};
+
+bool CTxDB::WriteAnonBlockStats(int nBlockHeight, const std::map<int64_t, CAnonBlockStat>& mapBlockStats)
+{
+    return Write(make_pair(string("abs"), nBlockHeight), mapBlockStats);
+};
+
+bool CTxDB::ReadAnonBlockStats(int nBlockHeight, std::map<int64_t, CAnonBlockStat>& mapBlockStats)
+{
+    return Read(make_pair(string("abs"), nBlockHeight), mapBlockStats);
+};
+
+bool CTxDB::EraseAnonBlockStats(int nBlockHeight)
+{
+    return Erase(make_pair(string("abs"), nBlockHeight));
+};
+
 bool CTxDB::EraseRange(const std::string &sPrefix, uint32_t &nAffected, std::function<void (const uint32_t&)> funcProgress)
 {
 
@@ -425,12 +568,12 @@ static CBlockIndex *InsertBlockIndex(uint256 hash)
         return NULL;
 
     // Return existing
-    map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(hash);
+    BlockMap::iterator mi = mapBlockIndex.find(hash);
     if (mi != mapBlockIndex.end())
         return (*mi).second;
 
     // Create new
-    CBlockIndex* pindexNew = new CBlockIndex();
+    CBlockIndex* pindexNew = blockIndexArena.New();
     if (!pindexNew)
         throw runtime_error("LoadBlockIndex() : new CBlockIndex failed");
     mi = mapBlockIndex.insert(make_pair(hash, pindexNew)).first;
@@ -439,6 +582,193 @@ static CBlockIndex *InsertBlockIndex(uint256 hash)
     return pindexNew;
 }
 
+typedef map<pair<unsigned int, unsigned int>, int> BlockPosMap;
+
+// A block of the -checkblocks verification, read and checked by a worker.
+struct CBlockVerify
+{
+    CBlockIndex *pindex;
+    bool fBad;
+};
+
+// Check levels of LoadBlockIndex for a single block, sets fBad when the block
+// fails one. mapBlockPos holds the file position and height of all blocks
+// being verified. False only if the block can't be read.
+static bool VerifyBlock(CTxDB &txdb, CBlockVerify &verify, int nCheckLevel, const BlockPosMap &mapBlockPos)
+{
+    CBlockIndex *pindex = verify.pindex;
+
+    CBlock block;
+    if (!block.ReadFromDisk(pindex))
+        return error("LoadBlockIndex() : block.ReadFromDisk failed at %d", pindex->nHeight);
+    // check level 1: verify block validity
+    // check level 7: verify block signature too
+    if (nCheckLevel>0 && !block.CheckBlock(true, true, (nCheckLevel>6)))
+    {
+        LogPrintf("LoadBlockIndex() : *** found bad block at %d, hash=%s\n", pindex->nHeight, pindex->GetBlockHash().ToString());
+        verify.fBad = true;
+    }
+    // check level 2: verify transaction index validity
+    if (nCheckLevel>1)
+    {
+        BOOST_FOREACH(const CTransaction &tx, block.vtx)
+        {
+            uint256 hashTx = tx.GetHash();
+            CTxIndex txindex;
+            if (txdb.ReadTxIndex(hashTx, txindex))
+            {
+                // check level 3: checker transaction hashes
+                if (nCheckLevel>2 || pindex->nFile != txindex.pos.nFile || pindex->nBlockPos != txindex.pos.nBlockPos)
+                {
+                    // either an error or a duplicate transaction
+                    CTransaction txFound;
+                    if (!txFound.ReadFromDisk(txindex.pos))
+                    {
+                        LogPrintf("LoadBlockIndex() : *** cannot read mislocated transaction %s\n", hashTx.ToString());
+                        verify.fBad = true;
+                    }
+                    else
+                        if (txFound.GetHash() != hashTx) // not a duplicate tx
+                        {
+                            LogPrintf("LoadBlockIndex(): *** invalid tx position for %s\n", hashTx.ToString());
+                            verify.fBad = true;
+                        }
+                }
+                // check level 4: check whether spent txouts were spent within the main chain
+                unsigned int nOutput = 0;
+                if (nCheckLevel>3)
+                {
+                    BOOST_FOREACH(const CDiskTxPos &txpos, txindex.vSpent)
+                    {
+                        if (!txpos.IsNull())
+                        {
+                            pair<unsigned int, unsigned int> posFind = make_pair(txpos.nFile, txpos.nBlockPos);
+                            // - spent within the verified blocks at or above this one
+                            BlockPosMap::const_iterator mi = mapBlockPos.find(posFind);
+                            if (mi == mapBlockPos.end() || mi->second < pindex->nHeight)
+                            {
+                                LogPrintf("LoadBlockIndex(): *** found bad spend at %d, hashBlock=%s, hashTx=%s\n", pindex->nHeight, pindex->GetBlockHash().ToString(), hashTx.ToString());
+                                verify.fBad = true;
+                            }
+                            // check level 6: check whether spent txouts were spent by a valid transaction that consume them
+                            if (nCheckLevel>5)
+                            {
+                                CTransaction txSpend;
+                                if (!txSpend.ReadFromDisk(txpos))
+                                {
+                                    LogPrintf("LoadBlockIndex(): *** cannot read spending transaction of %s:%i from disk\n", hashTx.ToString(), nOutput);
+                                    verify.fBad = true;
+                                }
+                                else if (!txSpend.CheckTransaction())
+                                {
+                                    LogPrintf("LoadBlockIndex(): *** spending transaction of %s:%i is invalid\n", hashTx.ToString(), nOutput);
+                                    verify.fBad = true;
+                                }
+                                else
+                                {
+                                    bool fFound = false;
+                                    BOOST_FOREACH(const CTxIn &txin, txSpend.vin)
+                                        if (txin.prevout.hash == hashTx && txin.prevout.n == nOutput)
+                                            fFound = true;
+                                    if (!fFound)
+                                    {
+                                        LogPrintf("LoadBlockIndex(): *** spending transaction of %s:%i does not spend it\n", hashTx.ToString(), nOutput);
+                                        verify.fBad = true;
+                                    }
+                                }
+                            }
+                        }
+                        nOutput++;
+                    }
+                }
+            }
+            // check level 5: check whether all prevouts are marked spent
+            if (nCheckLevel>4)
+            {
+                 BOOST_FOREACH(const CTxIn &txin, tx.vin)
+                 {
+                      CTxIndex txindex;
+                      if (txdb.ReadTxIndex(txin.prevout.hash, txindex))
+                          if (txindex.vSpent.size()-1 < txin.prevout.n || txindex.vSpent[txin.prevout.n].IsNull())
+                          {
+                              LogPrintf("LoadBlockIndex(): *** found unspent prevout %s:%i in %s\n", txin.prevout.hash.ToString(), txin.prevout.n, hashTx.ToString());
+                              verify.fBad = true;
+                          }
+                 }
+            }
+        }
+    }
+
+    return true;
+}
+
+class CBlockVerifyCheck
+{
+private:
+    CTxDB *ptxdb;
+    CBlockVerify *pverify;
+    int nCheckLevel;
+    const BlockPosMap *pmapBlockPos;
+
+public:
+    CBlockVerifyCheck() : ptxdb(NULL), pverify(NULL), nCheckLevel(0), pmapBlockPos(NULL) {}
+    CBlockVerifyCheck(CTxDB *ptxdbIn, CBlockVerify *pverifyIn, int nCheckLevelIn, const BlockPosMap *pmapBlockPosIn)
+        : ptxdb(ptxdbIn), pverify(pverifyIn), nCheckLevel(nCheckLevelIn), pmapBlockPos(pmapBlockPosIn) {}
+
+    bool operator()()
+    {
+        return VerifyBlock(*ptxdb, *pverify, nCheckLevel, *pmapBlockPos);
+    }
+
+    void swap(CBlockVerifyCheck &check)
+    {
+        std::swap(ptxdb, check.ptxdb);
+        std::swap(pverify, check.pverify);
+        std::swap(nCheckLevel, check.nCheckLevel);
+        std::swap(pmapBlockPos, check.pmapBlockPos);
+    }
+};
+
+static void ThreadVerifyBlocks(CCheckQueue<CBlockVerifyCheck> *pqueue)
+{
+    RenameThread("alias-verify");
+    pqueue->Thread();
+}
+
+// -par workers for the -checkblocks verification, the caller joins them
+// while waiting for a window of blocks.
+class CBlockVerifier
+{
+private:
+    CCheckQueue<CBlockVerifyCheck> queue;
+    boost::thread_group threadGroup;
+
+public:
+    CBlockVerifier(int nThreads) : queue(1)
+    {
+        for (int i = 0; i < nThreads-1; i++)
+            threadGroup.create_thread(boost::bind(&ThreadVerifyBlocks, &queue));
+    }
+
+    ~CBlockVerifier()
+    {
+        queue.Wait();
+        queue.Quit();
+        threadGroup.join_all();
+    }
+
+    // Verifies the blocks in [first, last), false if one can't be read.
+    bool Verify(CTxDB &txdb, CBlockVerify *first, CBlockVerify *last, int nCheckLevel, const BlockPosMap &mapBlockPos)
+    {
+        std::vector<CBlockVerifyCheck> vChecks;
+        vChecks.reserve(last - first);
+        for (CBlockVerify *p = first; p != last; ++p)
+            vChecks.push_back(CBlockVerifyCheck(&txdb, p, nCheckLevel, &mapBlockPos));
+        queue.Add(vChecks);
+        return queue.Wait();
+    }
+};
+
 bool CTxDB::LoadBlockIndex(std::function<bool (const CBlockIndex* const)> funcValidate, std::function<void (const unsigned mode, const uint32_t&)> funcProgress)
 {
     if (nNodeMode != NT_FULL)
@@ -452,6 +782,87 @@ bool CTxDB::LoadBlockIndex(std::function<bool (const CBlockIndex* const)> funcVa
     };
 
 
+    // - a snapshot written at the last clean shutdown replaces reading the
+    //   "bidx" records, it's stale as soon as the index is written again
+    CBlockIndexSnapshot snapshot;
+    uint256 hashSnapshotBest;
+    bool fSnapshot = fBlockIndexSnapshot
+        && ReadHashBestChain(hashSnapshotBest)
+        && snapshot.Open(hashSnapshotBest);
+    RemoveBlockIndexSnapshot();
+
+    uint32_t count = 0;
+    if (fSnapshot)
+    {
+        int64_t nStart = GetTimeMillis();
+
+        mapBlockIndex.reserve(snapshot.size());
+        std::vector<CBlockIndex*> vIndex(snapshot.size());
+        for (uint32_t i = 0; i < snapshot.size(); ++i)
+            vIndex[i] = blockIndexArena.New();
+
+        // - records left out of mapBlockIndex, their descendants are left out too
+        //   so no entry in the map links to one
+        std::vector<char> vSkipped(snapshot.size(), false);
+
+        int nSnapshotBestHeight = snapshot[snapshot.GetBestRecord()].nHeight;
+        for (uint32_t i = 0; i < snapshot.size(); ++i)
+        {
+            if (funcProgress && count != 0 && count % 10000 == 0) funcProgress(0, count);
+            count++;
+            if (i % 10000 == 0)
+                boost::this_thread::interruption_point();
+
+            const CBlockIndexRecord &record = snapshot[i];
+            CBlockIndex* pindexNew = vIndex[i];
+            record.ToBlockIndex(pindexNew);
+            pindexNew->pprev = record.nPrev >= 0 ? vIndex[record.nPrev] : NULL;
+            pindexNew->pnext = record.nNext >= 0 ? vIndex[record.nNext] : NULL;
+
+            // - records are by height, nChainTrust of pprev is set already
+            if ((!pindexNew->pprev && record.hashBlock != Params().HashGenesisBlock())
+                || (record.nPrev >= 0 && vSkipped[record.nPrev])
+                || pindexNew->nHeight > nSnapshotBestHeight)
+            {
+                vSkipped[i] = true;
+                pindexNew->phashBlock = &record.hashBlock;
+                if (fDebug)
+                    LogPrintf("LoadBlockIndex(): Warning - Found orphaned block, height %d, hash %s. Suggest rewindchain, reindex.\n", pindexNew->nHeight, record.hashBlock.ToString().c_str());
+                if (pindexNew->nHeight > nSnapshotBestHeight)
+                {
+                    CBlock block;
+                    if (block.ReadFromDisk(pindexNew))
+                        AddOrphanBlock(&block);
+                }
+                pindexNew->phashBlock = NULL;
+                continue;
+            };
+
+            pindexNew->BuildSkip();
+
+            BlockMap::iterator mi = mapBlockIndex.insert(make_pair(record.hashBlock, pindexNew)).first;
+            pindexNew->phashBlock = &((*mi).first);
+
+            // Watch for genesis block
+            if (pindexGenesisBlock == NULL && record.hashBlock == Params().HashGenesisBlock())
+                pindexGenesisBlock = pindexNew;
+
+            if (!pindexNew->CheckIndex())
+                return error("LoadBlockIndex() : CheckIndex failed at %d", pindexNew->nHeight);
+
+            if (funcValidate && !funcValidate(pindexNew))
+                return false;
+
+            // NovaCoin: build setStakeSeen
+            if (pindexNew->IsProofOfStake())
+                setStakeSeen.insert(make_pair(pindexNew->prevoutStake, pindexNew->nStakeTime));
+        };
+        snapshot.Close();
+        if (funcProgress) funcProgress(0, count);
+
+        LogPrintf("Loaded %u blocks from the block index snapshot in %dms.\n", mapBlockIndex.size(), GetTimeMillis() - nStart);
+    };
+
     // The block index is an in-memory structure that maps hashes to on-disk
     // locations where the contents of the block can be found. Here, we scan it
     // out of the DB and into mapBlockIndex.
@@ -461,9 +872,8 @@ bool CTxDB::LoadBlockIndex(std::function<bool (const CBlockIndex* const)> funcVa
     ssStartKey << make_pair(string("bidx"), uint256(0));
     iterator->Seek(ssStartKey.str());
 
-    uint32_t count = 0;
     // Now read each entry.
-    while (iterator->Valid())
+    while (!fSnapshot && iterator->Valid())
     {
         if (funcProgress && count != 0 && count % 10000 == 0) funcProgress(0, count);
         count++;
@@ -545,15 +955,18 @@ bool CTxDB::LoadBlockIndex(std::function<bool (const CBlockIndex* const)> funcVa
     nBestHeight = pindexBest->nHeight;
     chainActive.SetTip(pindexBest);
 
-    // Calculate nChainTrust
+    // Calculate nChainTrust and pskip, the snapshot path has done both
     vector<pair<int, CBlockIndex*> > vSortedByHeight;
-    vSortedByHeight.reserve(mapBlockIndex.size());
-    BOOST_FOREACH(const PAIRTYPE(uint256, CBlockIndex*)& item, mapBlockIndex)
+    if (!fSnapshot)
     {
-        CBlockIndex* pindex = item.second;
-        vSortedByHeight.push_back(make_pair(pindex->nHeight, pindex));
-    }
-    sort(vSortedByHeight.begin(), vSortedByHeight.end());
+        vSortedByHeight.reserve(mapBlockIndex.size());
+        BOOST_FOREACH(const PAIRTYPE(uint256, CBlockIndex*)& item, mapBlockIndex)
+        {
+            CBlockIndex* pindex = item.second;
+            vSortedByHeight.push_back(make_pair(pindex->nHeight, pindex));
+        }
+        sort(vSortedByHeight.begin(), vSortedByHeight.end());
+    };
 
     count = 0;
     BOOST_FOREACH(const PAIRTYPE(int, CBlockIndex*)& item, vSortedByHeight)
@@ -563,6 +976,9 @@ bool CTxDB::LoadBlockIndex(std::function<bool (const CBlockIndex* const)> funcVa
 
         CBlockIndex* pindex = item.second;
 
+        // - by height, the ancestors have pskip already
+        pindex->BuildSkip();
+
         uint256 blockhash = pindex->GetBlockHash();
         if ((!pindex->pprev && blockhash != Params().HashGenesisBlock()) || pindex->nHeight > nBestHeight)
         {
@@ -601,117 +1017,45 @@ bool CTxDB::LoadBlockIndex(std::function<bool (const CBlockIndex* const)> funcVa
     if (nCheckDepth > nBestHeight)
         nCheckDepth = nBestHeight;
     LogPrintf("Verifying last %i blocks at level %i\n", nCheckDepth, nCheckLevel);
-    CBlockIndex* pindexFork = NULL;
-    map<pair<unsigned int, unsigned int>, CBlockIndex*> mapBlockPos;
+    int64_t nStart = GetTimeMillis();
 
-    if (funcProgress) funcProgress(2, nCheckDepth);
+    vector<CBlockVerify> vVerify;
+    BlockPosMap mapBlockPos;
     for (CBlockIndex* pindex = pindexBest; pindex && pindex->pprev; pindex = pindex->pprev)
     {
-        boost::this_thread::interruption_point();
         if (pindex->nHeight < nBestHeight-nCheckDepth)
             break;
 
-        CBlock block;
-        if (!block.ReadFromDisk(pindex))
-            return error("LoadBlockIndex() : block.ReadFromDisk failed");
-        // check level 1: verify block validity
-        // check level 7: verify block signature too
-        if (nCheckLevel>0 && !block.CheckBlock(true, true, (nCheckLevel>6)))
-        {
-            LogPrintf("LoadBlockIndex() : *** found bad block at %d, hash=%s\n", pindex->nHeight, pindex->GetBlockHash().ToString());
-            pindexFork = pindex->pprev;
-        }
-        // check level 2: verify transaction index validity
+        CBlockVerify verify = {pindex, false};
+        vVerify.push_back(verify);
         if (nCheckLevel>1)
+            mapBlockPos[make_pair(pindex->nFile, pindex->nBlockPos)] = pindex->nHeight;
+    }
+
+    if (funcProgress) funcProgress(2, nCheckDepth);
+    {
+        // - the blocks are independent, -par workers read and check them a
+        //   window at a time
+        int nThreads = std::max(1, std::min(nScriptCheckThreads, MAX_SCRIPTCHECK_THREADS));
+        size_t nWindow = 64 * nThreads;
+        CBlockVerifier verifier(nThreads);
+        for (size_t i = 0; i < vVerify.size(); i += nWindow)
         {
-            pair<unsigned int, unsigned int> pos = make_pair(pindex->nFile, pindex->nBlockPos);
-            mapBlockPos[pos] = pindex;
-            BOOST_FOREACH(const CTransaction &tx, block.vtx)
-            {
-                uint256 hashTx = tx.GetHash();
-                CTxIndex txindex;
-                if (ReadTxIndex(hashTx, txindex))
-                {
-                    // check level 3: checker transaction hashes
-                    if (nCheckLevel>2 || pindex->nFile != txindex.pos.nFile || pindex->nBlockPos != txindex.pos.nBlockPos)
-                    {
-                        // either an error or a duplicate transaction
-                        CTransaction txFound;
-                        if (!txFound.ReadFromDisk(txindex.pos))
-                        {
-                            LogPrintf("LoadBlockIndex() : *** cannot read mislocated transaction %s\n", hashTx.ToString());
-                            pindexFork = pindex->pprev;
-                        }
-                        else
-                            if (txFound.GetHash() != hashTx) // not a duplicate tx
-                            {
-                                LogPrintf("LoadBlockIndex(): *** invalid tx position for %s\n", hashTx.ToString());
-                                pindexFork = pindex->pprev;
-                            }
-                    }
-                    // check level 4: check whether spent txouts were spent within the main chain
-                    unsigned int nOutput = 0;
-                    if (nCheckLevel>3)
-                    {
-                        BOOST_FOREACH(const CDiskTxPos &txpos, txindex.vSpent)
-                        {
-                            if (!txpos.IsNull())
-                            {
-                                pair<unsigned int, unsigned int> posFind = make_pair(txpos.nFile, txpos.nBlockPos);
-                                if (!mapBlockPos.count(posFind))
-                                {
-                                    LogPrintf("LoadBlockIndex(): *** found bad spend at %d, hashBlock=%s, hashTx=%s\n", pindex->nHeight, pindex->GetBlockHash().ToString(), hashTx.ToString());
-                                    pindexFork = pindex->pprev;
-                                }
-                                // check level 6: check whether spent txouts were spent by a valid transaction that consume them
-                                if (nCheckLevel>5)
-                                {
-                                    CTransaction txSpend;
-                                    if (!txSpend.ReadFromDisk(txpos))
-                                    {
-                                        LogPrintf("LoadBlockIndex(): *** cannot read spending transaction of %s:%i from disk\n", hashTx.ToString(), nOutput);
-                                        pindexFork = pindex->pprev;
-                                    }
-                                    else if (!txSpend.CheckTransaction())
-                                    {
-                                        LogPrintf("LoadBlockIndex(): *** spending transaction of %s:%i is invalid\n", hashTx.ToString(), nOutput);
-                                        pindexFork = pindex->pprev;
-                                    }
-                                    else
-                                    {
-                                        bool fFound = false;
-                                        BOOST_FOREACH(const CTxIn &txin, txSpend.vin)
-                                            if (txin.prevout.hash == hashTx && txin.prevout.n == nOutput)
-                                                fFound = true;
-                                        if (!fFound)
-                                        {
-                                            LogPrintf("LoadBlockIndex(): *** spending transaction of %s:%i does not spend it\n", hashTx.ToString(), nOutput);
-                                            pindexFork = pindex->pprev;
-                                        }
-                                    }
-                                }
-                            }
-                            nOutput++;
-                        }
-                    }
-                }
-                // check level 5: check whether all prevouts are marked spent
-                if (nCheckLevel>4)
-                {
-                     BOOST_FOREACH(const CTxIn &txin, tx.vin)
-                     {
-                          CTxIndex txindex;
-                          if (ReadTxIndex(txin.prevout.hash, txindex))
-                              if (txindex.vSpent.size()-1 < txin.prevout.n || txindex.vSpent[txin.prevout.n].IsNull())
-                              {
-                                  LogPrintf("LoadBlockIndex(): *** found unspent prevout %s:%i in %s\n", txin.prevout.hash.ToString(), txin.prevout.n, hashTx.ToString());
-                                  pindexFork = pindex->pprev;
-                              }
-                     }
-                }
-            }
-        }
+            boost::this_thread::interruption_point();
+            size_t nEnd = std::min(vVerify.size(), i + nWindow);
+            if (!verifier.Verify(*this, &vVerify[0] + i, &vVerify[0] + nEnd, nCheckLevel, mapBlockPos))
+                return false;
+        };
     }
+
+    // - vVerify runs down from the best block, the lowest bad block decides
+    CBlockIndex* pindexFork = NULL;
+    BOOST_FOREACH(const CBlockVerify &verify, vVerify)
+        if (verify.fBad)
+            pindexFork = verify.pindex->pprev;
+
+    LogPrintf("Verified %u blocks in %dms.\n", vVerify.size(), GetTimeMillis() - nStart);
+
     if (pindexFork)
     {
         boost::this_thread::interruption_point();
@@ -745,7 +1089,7 @@ bool CTxDB::LoadBlockThinIndex()
     uint256 hashNext = Params().HashGenesisBlock();
 
     CDiskBlockThinIndex diskindex;
-    map<uint256, CBlockThinIndex*>::iterator mi;
+    BlockThinMap::iterator mi;
     CBlockThinIndex* pIndexLast = NULL;
 
     while (hashNext != 0)
@@ -759,7 +1103,7 @@ bool CTxDB::LoadBlockThinIndex()
         //LogPrintf("[rem] bhidx %s\n", hashNext.ToString().c_str());
 
         // Construct block index object
-        CBlockThinIndex* pindexNew      = new CBlockThinIndex();
+        CBlockThinIndex* pindexNew      = blockThinIndexArena.New();
         if (!pindexNew)
             return error("LoadBlockThinIndex() : new CBlockIndex failed");
 
@@ -783,6 +1127,7 @@ bool CTxDB::LoadBlockThinIndex()
         if (pIndexLast)
             pIndexLast->pnext           = pindexNew;
 
+        pindexNew->BuildSkip();
         pindexNew->nChainTrust = (pIndexLast ? pIndexLast->nChainTrust : 0) + pindexNew->GetBlockTrust();
 
 
@@ -809,12 +1154,12 @@ bool CTxDB::LoadBlockThinIndex()
             pindexRear = pindexRear->pnext;
             pindexRear->pprev = NULL;
 
-            std::map<uint256, CBlockThinIndex*>::iterator mi = mapBlockThinIndex.find(*pRemHash);
+            BlockThinMap::iterator mi = mapBlockThinIndex.find(*pRemHash);
 
 
             if (mi != mapBlockThinIndex.end())
             {
-                delete mi->second;
+                blockThinIndexArena.Delete(mi->second);
                 mapBlockThinIndex.erase(mi);
             };
         };
@@ -12,6 +12,7 @@
 
 #include <map>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 
@@ -23,6 +24,10 @@
 /*
 prefixes
     ao
+    aoi
+    aoindex
+    anonstats
+    abs
     ki
     version
     tx
@@ -39,6 +44,52 @@ prefixes
         blockindex
 */
 
+// Key of the "aoi" index of anon outputs, by denomination and block height.
+// Both are stored big endian so LevelDB keeps the outputs of a denomination
+// together and in height order, a range of heights is a single seek.
+class CAnonOutputIndexKey
+{
+public:
+    int64_t nValue;
+    int nBlockHeight;
+    CPubKey pkCoin;
+
+    CAnonOutputIndexKey() : nValue(0), nBlockHeight(0) {}
+    CAnonOutputIndexKey(int64_t nValueIn, int nBlockHeightIn, const CPubKey &pkCoinIn = CPubKey())
+        : nValue(nValueIn), nBlockHeight(nBlockHeightIn), pkCoin(pkCoinIn) {}
+
+    unsigned int GetSerializeSize(int nType, int nVersion) const
+    {
+        return 12 + pkCoin.GetSerializeSize(nType, nVersion);
+    }
+
+    template<typename Stream> void Serialize(Stream &s, int nType, int nVersion) const
+    {
+        uint8_t data[12];
+        for (int i = 0; i < 8; ++i)
+            data[i] = ((uint64_t)nValue >> (56 - i * 8)) & 0xff;
+        for (int i = 0; i < 4; ++i)
+            data[8 + i] = ((uint32_t)nBlockHeight >> (24 - i * 8)) & 0xff;
+        s.write((char*)data, sizeof(data));
+        pkCoin.Serialize(s, nType, nVersion);
+    }
+
+    template<typename Stream> void Unserialize(Stream &s, int nType, int nVersion)
+    {
+        uint8_t data[12];
+        s.read((char*)data, sizeof(data));
+        uint64_t v = 0;
+        uint32_t h = 0;
+        for (int i = 0; i < 8; ++i)
+            v = (v << 8) | data[i];
+        for (int i = 0; i < 4; ++i)
+            h = (h << 8) | data[8 + i];
+        nValue = (int64_t)v;
+        nBlockHeight = (int)h;
+        pkCoin.Unserialize(s, nType, nVersion);
+    }
+};
+
 // Class that provides access to a LevelDB. Note that this class is frequently
 // instantiated on the stack and then destroyed again, so instantiation has to
 // be very cheap. Unfortunately that means, a CTxDB instance is actually just a
@@ -71,6 +122,10 @@ private:
     // A batch stores up writes and deletes for atomic application. When this
     // field is non-NULL, writes/deletes go there instead of directly to disk.
     leveldb::WriteBatch *activeBatch;
+
+    // The last pending write of each key in activeBatch as (deleted, value),
+    // reads look up their own writes here instead of iterating the batch.
+    std::unordered_map<std::string, std::pair<bool, std::string> > mapBatchOverlay;
     leveldb::Options openOptions;
     bool fReadOnly;
     int nVersion;
@@ -142,7 +197,9 @@ protected:
 
         if (activeBatch)
         {
-            activeBatch->Put(ssKey.str(), ssValue.str());
+            std::string strKey = ssKey.str(), strValue = ssValue.str();
+            activeBatch->Put(strKey, strValue);
+            mapBatchOverlay[strKey] = std::make_pair(false, std::move(strValue));
             return true;
         };
 
@@ -169,7 +226,9 @@ protected:
         ssKey << key;
         if (activeBatch)
         {
-            activeBatch->Delete(ssKey.str());
+            std::string strKey = ssKey.str();
+            activeBatch->Delete(strKey);
+            mapBatchOverlay[strKey] = std::make_pair(true, std::string());
             return true;
         };
 
@@ -188,10 +247,8 @@ protected:
         if (activeBatch)
         {
             bool deleted;
-            if (ScanBatch(ssKey, &unused, &deleted) && !deleted)
-            {
-                return true;
-            }
+            if (ScanBatch(ssKey, &unused, &deleted))
+                return !deleted;
         }
 
         leveldb::Status status = pdb->Get(GetReadOptions(), ssKey.str(), &unused);
@@ -206,6 +263,7 @@ public:
     {
         delete activeBatch;
         activeBatch = NULL;
+        mapBatchOverlay.clear();
         return true;
     }
 
@@ -249,10 +307,28 @@ public:
     bool ReadAnonOutput(CPubKey& pkCoin, CAnonOutput& ao);
     bool EraseAnonOutput(CPubKey& pkCoin);
 
+    // Calls funcOutput for each anon output with a value in [nMinValue, nMaxValue]
+    // and a block height in [nMinHeight, nMaxHeight], by value then height,
+    // until it returns false. Only the requested ranges are read.
+    bool ReadAnonOutputIndex(int64_t nMinValue, int64_t nMaxValue, int nMinHeight, int nMaxHeight,
+        std::function<bool (const CPubKey&, const CAnonOutput&)> funcOutput);
+    // Builds the "aoi" index from the "ao" records of databases that predate it.
+    bool BuildAnonOutputIndex();
+
     bool WriteCompromisedAnonHeights(std::map<int64_t, std::vector<int>>& mapCompromisedHeights);
     bool ReadCompromisedAnonHeights(std::map<int64_t, std::vector<int>>& mapCompromisedHeights);
     bool EraseCompromisedAnonHeights();
 
+    // Snapshot of mapAnonOutputStats at hashBlock and the per block stats of
+    // mapAnonBlockStats, kept in step with the chain so startup can skip the
+    // anon output recount.
+    bool WriteAnonStats(const uint256& hashBlock, const std::map<int64_t, CAnonOutputCount>& mapOutputStats);
+    bool ReadAnonStats(uint256& hashBlock, std::map<int64_t, CAnonOutputCount>& mapOutputStats);
+    bool EraseAnonStats();
+    bool WriteAnonBlockStats(int nBlockHeight, const std::map<int64_t, CAnonBlockStat>& mapBlockStats);
+    bool ReadAnonBlockStats(int nBlockHeight, std::map<int64_t, CAnonBlockStat>& mapBlockStats);
+    bool EraseAnonBlockStats(int nBlockHeight);
+
     bool EraseRange(const std::string &sPrefix, uint32_t &nAffected, std::function<void (const uint32_t&)> funcProgress = nullptr);
 
     bool ReadTxIndex(uint256 hash, CTxIndex& txindex);
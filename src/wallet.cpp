@@ -17,8 +17,12 @@
 #include "base58.h"
 #include "kernel.h"
 #include "coincontrol.h"
+#include "coinselection.h"
 #include "pbkdf2.h"
+#include "checkqueue.h"
+#include <atomic>
 #include <chrono>
+#include <limits>
 #include <random>
 #include <boost/algorithm/string/replace.hpp>
 #include <boost/random/mersenne_twister.hpp>
@@ -192,6 +196,9 @@ bool CWallet::AddCScript(const CScript& redeemScript)
 // provides no real security
 bool fWalletUnlockStakingOnly = false;
 
+// cross-check the balance ledger against a count over all of mapWallet
+bool fCheckBalances = false;
+
 bool CWallet::LoadCScript(const CScript& redeemScript)
 {
     /* A sanity check was added in pull #3843 to avoid adding redeemScripts
@@ -353,6 +360,13 @@ void CWallet::SetBestThinChain(const CBlockThinLocator& loc)
     walletdb.WriteBestBlockThin(loc);
 }
 
+void CWallet::SetBestTip(int nHeight, const uint256& hash)
+{
+    LOCK(cs_balances);
+    nBestTipHeight = nHeight;
+    hashBestTip = hash;
+}
+
 bool CWallet::SetMinVersion(enum WalletFeature nVersion, CWalletDB* pwalletdbIn, bool fExplicit)
 {
     LOCK(cs_wallet); // nWalletVersion
@@ -619,6 +633,11 @@ void CWallet::MarkDirty()
 {
     {
         LOCK(cs_wallet);
+        {
+            LOCK(cs_balances);
+            fBalanceRebuild = true;
+            fCoinsRebuild = true;
+        }
         BOOST_FOREACH(PAIRTYPE(const uint256, CWalletTx)& item, mapWallet)
             item.second.MarkDirty();
     }
@@ -654,7 +673,7 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, const uint256& hashIn)
                 {
                     //fInBlockIndex = mapBlockThinIndex.count(wtxIn.hashBlock);
 
-                    std::map<uint256, CBlockThinIndex*>::iterator mi = mapBlockThinIndex.find(wtxIn.hashBlock);
+                    BlockThinMap::iterator mi = mapBlockThinIndex.find(wtxIn.hashBlock);
                     if (mi == mapBlockThinIndex.end()
                         && !fThinFullIndex
                         && pindexRear)
@@ -847,13 +866,13 @@ static int GetBlockHeightFromHash(const uint256& blockHash)
 
     if (nNodeMode == NT_FULL)
     {
-        std::map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(blockHash);
+        BlockMap::iterator mi = mapBlockIndex.find(blockHash);
         if (mi == mapBlockIndex.end())
             return 0;
         return mi->second->nHeight;
     } else
     {
-        std::map<uint256, CBlockThinIndex*>::iterator mi = mapBlockThinIndex.find(blockHash);
+        BlockThinMap::iterator mi = mapBlockThinIndex.find(blockHash);
         if (mi == mapBlockThinIndex.end()
             && !fThinFullIndex
             && pindexRear)
@@ -877,7 +896,7 @@ static int GetBlockHeightFromHash(const uint256& blockHash)
 // Add a transaction to the wallet, or update it.
 // pblock is optional, but should be provided if the transaction is known to be in a block.
 // If fUpdate is true, existing transactions will be updated.
-bool CWallet::AddToWalletIfInvolvingMe(const CTransaction& tx, const uint256& hash, const void* pblock, bool fUpdate, bool fFindBlock)
+bool CWallet::AddToWalletIfInvolvingMe(const CTransaction& tx, const uint256& hash, const void* pblock, bool fUpdate, bool fFindBlock, bool fScanStealth)
 {
     //LogPrintf("AddToWalletIfInvolvingMe() %s\n", hash.ToString().c_str()); // happens often
 
@@ -893,7 +912,7 @@ bool CWallet::AddToWalletIfInvolvingMe(const CTransaction& tx, const uint256& ha
         mapValue_t mapNarr;
 
         bool fIsMine = false;
-        if(!tx.IsCoinBase() && !tx.IsCoinStake())
+        if(!tx.IsCoinBase() && !tx.IsCoinStake() && fScanStealth)
         {
             // Skip transactions that we know wouldn't be stealth...
             FindStealthTransactions(tx, mapNarr);
@@ -911,7 +930,7 @@ bool CWallet::AddToWalletIfInvolvingMe(const CTransaction& tx, const uint256& ha
             txdb.TxnBegin();
             std::vector<WalletTxMap::iterator> vUpdatedTxns;
             std::map<int64_t, CAnonBlockStat> mapAnonBlockStat;
-            if (!ProcessAnonTransaction(&walletdb, &txdb, tx, blockHash, fIsMine, mapNarr, vUpdatedTxns, mapAnonBlockStat))
+            if (!ProcessAnonTransaction(&walletdb, &txdb, tx, blockHash, fIsMine, mapNarr, vUpdatedTxns, mapAnonBlockStat, nullptr, fScanStealth))
             {
                 LogPrintf("ProcessAnonTransaction failed %s\n", hash.ToString().c_str());
                 walletdb.TxnAbort();
@@ -983,7 +1002,10 @@ bool CWallet::EraseFromWallet(uint256 hash)
     {
         LOCK(cs_wallet);
         if (mapWallet.erase(hash))
+        {
             CWalletDB(strWalletFile).EraseTx(hash);
+            BalanceChanged(hash);
+        };
     }
     return true;
 }
@@ -1621,6 +1643,7 @@ uint32_t CWallet::ClearWalletTransactions(bool onlyUnaccepted)
                             continue;
                         }
                         mapWallet.erase(hash);
+                        BalanceChanged(hash);
                         NotifyTransactionChanged(this, hash, CT_DELETED);
                         nTransactions++;
                     }
@@ -1634,6 +1657,7 @@ uint32_t CWallet::ClearWalletTransactions(bool onlyUnaccepted)
                 }
 
                 mapWallet.erase(hash);
+                BalanceChanged(hash);
                 NotifyTransactionChanged(this, hash, CT_DELETED);
 
                 nTransactions++;
@@ -1654,6 +1678,256 @@ uint32_t CWallet::ClearWalletTransactions(bool onlyUnaccepted)
     return nTransactions;
 }
 
+// Scan key and spend public key of a stealth address owned by the wallet.
+struct CStealthScanKey
+{
+    ec_secret sScan;
+    ec_point pkSpend;
+};
+
+// What the rescan workers found for one transaction: whether any output
+// could belong to one of the stealth keys (or carries a plaintext
+// narration) and how many stealth outputs it has.
+struct CStealthScanHint
+{
+    bool fScan;
+    uint32_t nStealth;
+};
+
+static bool CheckStealthKeys(const std::vector<CStealthScanKey> &vKeys, const ec_point &pkEphem, const CKeyID *pidMatch, const std::set<CKeyID> *psetMatch)
+{
+    ec_secret sScan, sShared;
+    ec_point pkEphemT = pkEphem;
+    ec_point pkExtracted;
+
+    bool fMatch = false;
+    BOOST_FOREACH(const CStealthScanKey &key, vKeys)
+    {
+        memcpy(&sScan.e[0], &key.sScan.e[0], EC_SECRET_SIZE);
+        if (StealthSecret(sScan, pkEphemT, key.pkSpend, sShared, pkExtracted) != 0)
+            continue;
+
+        CKeyID id = CPubKey(pkExtracted).GetID();
+        if ((pidMatch && id == *pidMatch)
+            || (psetMatch && psetMatch->count(id)))
+        {
+            fMatch = true;
+            break;
+        };
+    };
+
+    OPENSSL_cleanse(&sScan.e[0], EC_SECRET_SIZE);
+    OPENSSL_cleanse(&sShared.e[0], EC_SECRET_SIZE);
+    return fMatch;
+}
+
+// Same output parsing as FindStealthTransactions and the anon output loop of
+// ProcessAnonTransaction, but only decides if those can find anything.
+static void GetStealthScanHint(const CTransaction &tx, const std::vector<CStealthScanKey> &vKeys, CStealthScanHint &hint)
+{
+    hint.fScan = false;
+    hint.nStealth = 0;
+
+    std::set<CKeyID> setKeyIds;
+    bool fKeyIds = false;
+
+    std::vector<uint8_t> vchEphemPK;
+    opcodetype opCode;
+    BOOST_FOREACH(const CTxOut &txout, tx.vout)
+    {
+        const CScript &s = txout.scriptPubKey;
+        if (tx.nVersion == ANON_TXN_VERSION
+            && txout.IsAnonOutput())
+        {
+            CKeyID idCoin = CPubKey(&s[2+1], EC_COMPRESSED_SIZE).GetID();
+            vchEphemPK.assign(&s[2+EC_COMPRESSED_SIZE+2], &s[2+EC_COMPRESSED_SIZE+2] + EC_COMPRESSED_SIZE);
+            if (CheckStealthKeys(vKeys, vchEphemPK, &idCoin, NULL))
+                hint.fScan = true;
+            continue;
+        };
+
+        CScript::const_iterator itTxA = s.begin();
+        if (!s.GetOp(itTxA, opCode, vchEphemPK)
+            || opCode != OP_RETURN)
+            continue;
+
+        if (!s.GetOp(itTxA, opCode, vchEphemPK)
+            || vchEphemPK.size() != EC_COMPRESSED_SIZE)
+        {
+            // - plaintext narrations are read by FindStealthTransactions
+            if (vchEphemPK.size() > 1
+                && vchEphemPK[0] == 'n'
+                && vchEphemPK[1] == 'p')
+                hint.fScan = true;
+            continue;
+        };
+
+        hint.nStealth++;
+        if (hint.fScan)
+            continue;
+
+        if (!fKeyIds)
+        {
+            BOOST_FOREACH(const CTxOut &txoutB, tx.vout)
+            {
+                CTxDestination address;
+                if (ExtractDestination(txoutB.scriptPubKey, address)
+                    && address.type() == typeid(CKeyID))
+                    setKeyIds.insert(boost::get<CKeyID>(address));
+            };
+            fKeyIds = true;
+        };
+
+        if (!setKeyIds.empty()
+            && CheckStealthKeys(vKeys, vchEphemPK, NULL, &setKeyIds))
+            hint.fScan = true;
+    };
+}
+
+// A block of the rescan, read and matched by a worker.
+struct CWalletScanBlock
+{
+    CBlockIndex *pindex;
+    CBlock block;
+    std::vector<CStealthScanHint> vHints;
+};
+
+class CWalletScanCheck
+{
+private:
+    CWalletScanBlock *pscan;
+    const std::vector<CStealthScanKey> *pvKeys;
+
+public:
+    CWalletScanCheck() : pscan(NULL), pvKeys(NULL) {}
+    CWalletScanCheck(CWalletScanBlock *pscanIn, const std::vector<CStealthScanKey> *pvKeysIn) : pscan(pscanIn), pvKeys(pvKeysIn) {}
+
+    bool operator()()
+    {
+        pscan->block.ReadFromDisk(pscan->pindex, true);
+
+        pscan->vHints.resize(pscan->block.vtx.size());
+        for (size_t i = 0; i < pscan->block.vtx.size(); ++i)
+            GetStealthScanHint(pscan->block.vtx[i], *pvKeys, pscan->vHints[i]);
+        return true;
+    }
+
+    void swap(CWalletScanCheck &check)
+    {
+        std::swap(pscan, check.pscan);
+        std::swap(pvKeys, check.pvKeys);
+    }
+};
+
+static void ThreadWalletScan(CCheckQueue<CWalletScanCheck> *pqueue)
+{
+    RenameThread("alias-wltscan");
+    pqueue->Thread();
+}
+
+// Rescan pipeline: -par workers read the blocks ahead of the caller and run
+// the stealth ECDH against a copy of the wallet's scan keys, the caller adds
+// the transactions to the wallet in block order. Must be used with cs_main
+// held, the chain is walked through pnext.
+class CWalletScanner
+{
+private:
+    std::vector<CStealthScanKey> vKeys;
+    CCheckQueue<CWalletScanCheck> queue;
+    boost::thread_group threadGroup;
+
+    std::vector<CWalletScanBlock> vBlocks[2];
+    int nCurrent;
+    CBlockIndex *pindexNext;
+    size_t nWindow;
+
+    void Queue(std::vector<CWalletScanBlock> &v)
+    {
+        v.clear();
+        while (v.size() < nWindow && pindexNext)
+        {
+            v.push_back(CWalletScanBlock());
+            v.back().pindex = pindexNext;
+            pindexNext = pindexNext->pnext;
+        };
+
+        std::vector<CWalletScanCheck> vChecks;
+        vChecks.reserve(v.size());
+        for (size_t i = 0; i < v.size(); ++i)
+            vChecks.push_back(CWalletScanCheck(&v[i], &vKeys));
+        queue.Add(vChecks);
+    }
+
+public:
+    CWalletScanner(const CWallet &wallet, CBlockIndex *pindexStart, int nThreads) : queue(1)
+    {
+        AssertLockHeld(wallet.cs_wallet);
+
+        std::set<CStealthAddress>::const_iterator it;
+        for (it = wallet.stealthAddresses.begin(); it != wallet.stealthAddresses.end(); ++it)
+        {
+            if (it->scan_secret.size() != EC_SECRET_SIZE)
+                continue; // stealth address is not owned
+
+            CStealthScanKey key;
+            memcpy(&key.sScan.e[0], &it->scan_secret[0], EC_SECRET_SIZE);
+            key.pkSpend = it->spend_pubkey;
+            vKeys.push_back(key);
+        };
+
+        ExtKeyAccountMap::const_iterator mi;
+        for (mi = wallet.mapExtAccounts.begin(); mi != wallet.mapExtAccounts.end(); ++mi)
+        {
+            CExtKeyAccount *ea = mi->second;
+            for (AccStealthKeyMap::const_iterator it = ea->mapStealthKeys.begin(); it != ea->mapStealthKeys.end(); ++it)
+            {
+                const CEKAStealthKey &aks = it->second;
+                if (!aks.skScan.IsValid())
+                    continue;
+
+                CStealthScanKey key;
+                memcpy(&key.sScan.e[0], aks.skScan.begin(), EC_SECRET_SIZE);
+                key.pkSpend = aks.pkSpend;
+                vKeys.push_back(key);
+            };
+        };
+
+        nThreads = std::max(1, std::min(nThreads, MAX_SCRIPTCHECK_THREADS));
+        for (int i = 0; i < nThreads-1; i++)
+            threadGroup.create_thread(boost::bind(&ThreadWalletScan, &queue));
+
+        nWindow = 32 * nThreads;
+        nCurrent = 0;
+        pindexNext = pindexStart;
+        Queue(vBlocks[nCurrent]);
+    }
+
+    ~CWalletScanner()
+    {
+        queue.Wait();
+        queue.Quit();
+        threadGroup.join_all();
+
+        BOOST_FOREACH(CStealthScanKey &key, vKeys)
+            OPENSSL_cleanse(&key.sScan.e[0], EC_SECRET_SIZE);
+    }
+
+    // Blocks of the next window in chain order, NULL at the end of the chain.
+    // The following window is read while the caller works through this one.
+    std::vector<CWalletScanBlock> *Next()
+    {
+        queue.Wait();
+
+        std::vector<CWalletScanBlock> &vReady = vBlocks[nCurrent];
+        if (vReady.empty())
+            return NULL;
+
+        nCurrent ^= 1;
+        Queue(vBlocks[nCurrent]);
+        return &vReady;
+    }
+};
+
 // Scan the block chain (starting in pindexStart) for transactions
 // from or to us. If fUpdate is true, found transactions that already
 // exist in the wallet will be updated.
@@ -1682,23 +1956,35 @@ int CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate, s
         if (funcProgress) funcProgress(pindex->nHeight, nCurBestHeight, ret);
 
         CTxDB txdb;
-        while (pindex)
+        CWalletScanner scanner(*this, pindex, nScriptCheckThreads);
+        std::vector<CWalletScanBlock> *pvBlocks;
+        bool fAbort = false;
+        while (!fAbort && (pvBlocks = scanner.Next()))
         {
-            CBlock block;
-            block.ReadFromDisk(pindex, true);
-            nBestHeight = pindex->nHeight;
-
-            BOOST_FOREACH(CTransaction& tx, block.vtx)
+            BOOST_FOREACH(CWalletScanBlock &scan, *pvBlocks)
             {
-                uint256 hash = tx.GetHash();
-                if (AddToWalletIfInvolvingMe(tx, hash, &block, fUpdate))
-                    ret++;
-            };
-            if (funcProgress && pindex->nHeight % progressBatchSize == 0 && !funcProgress(pindex->nHeight, nCurBestHeight, ret)) {
-                // abort scanning indicated
-                break;
+                pindex = scan.pindex;
+                nBestHeight = pindex->nHeight;
+
+                for (size_t i = 0; i < scan.block.vtx.size(); ++i)
+                {
+                    const CTransaction &tx = scan.block.vtx[i];
+                    const CStealthScanHint &hint = scan.vHints[i];
+
+                    // - FindStealthTransactions would count the stealth outputs
+                    if (!hint.fScan)
+                        nStealth += hint.nStealth;
+
+                    uint256 hash = tx.GetHash();
+                    if (AddToWalletIfInvolvingMe(tx, hash, &scan.block, fUpdate, false, hint.fScan))
+                        ret++;
+                };
+                if (funcProgress && pindex->nHeight % progressBatchSize == 0 && !funcProgress(pindex->nHeight, nCurBestHeight, ret)) {
+                    // abort scanning indicated
+                    fAbort = true;
+                    break;
+                };
             };
-            pindex = pindex->pnext;
         };
 
         // call progress callback on end
@@ -1710,7 +1996,7 @@ int CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate, s
     fReindexing = false;
 
     // Make sure anon cache reflects restored nBestHeight
-    if (!CacheAnonStats(nBestHeight))
+    if (!CacheAnonStats(nBestHeight, hashBestChain))
         LogPrintf("ScanForWalletTransactions() : CacheAnonStats() failed.\n");
 
     return ret;
@@ -1733,7 +2019,7 @@ void CWallet::ReacceptWalletTransactions()
                 || (wtx.IsCoinStake() && wtx.IsSpent(1)))
                 continue;
 
-            std::map<uint256, CBlockThinIndex*>::iterator mi = mapBlockThinIndex.find(wtx.hashBlock);
+            BlockThinMap::iterator mi = mapBlockThinIndex.find(wtx.hashBlock);
             if (mi == mapBlockThinIndex.end())
             {
                 if (!fThinFullIndex)
@@ -1906,91 +2192,237 @@ void CWallet::ResendWalletTransactions(bool fForce)
 //
 
 
-int64_t CWallet::GetBalance() const
+// - the share of wtx in each balance, as the scans over mapWallet counted them,
+//   fPending is set when it may change as the chain grows
+static void GetTxBalances(const CWallet &wallet, const CWalletTx &wtx, CWalletBalances &b, bool &fPending)
 {
-    int64_t nTotal = 0;
+    b.SetNull();
+
+    bool fFinal = wtx.IsFinal();
+    bool fTrusted = wtx.IsTrusted();
+    bool fAnon = wtx.nVersion == ANON_TXN_VERSION;
+    int nDepth = wtx.GetDepthInMainChain();
+    int nBlocksToMaturity = wtx.GetBlocksToMaturity();
 
+    fPending = !fFinal
+        || nDepth < 1
+        || nBlocksToMaturity > 0
+        || (fAnon && nDepth < MIN_ANON_SPEND_DEPTH);
+
+    if (fTrusted)
     {
-        LOCK2(cs_main, cs_wallet);
-        for (WalletTxMap::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
-        {
-            const CWalletTx* pcoin = &(*it).second;
-            if (pcoin->IsTrusted())
-                nTotal += pcoin->GetAvailableCredit();
-        };
-    }
+        b.nBalance = wtx.GetAvailableCredit();
+        if (fAnon)
+            b.nSpectreBalance = wtx.GetAvailableSpectreCredit();
+    };
+
+    if (!fFinal || (!fTrusted && nDepth == 0))
+        b.nUnconfirmed = wtx.GetAvailableCredit();
+
+    int64_t nSPEC = 0, nSpectre = 0;
+    if (fAnon && !wtx.IsCoinBase() && !wtx.IsCoinStake()
+        && (!fFinal || (nDepth >= 0 && nDepth < MIN_ANON_SPEND_DEPTH))
+        && wallet.GetCredit(wtx, nSPEC, nSpectre))
+        b.nUnconfirmedSpectre = nSpectre;
 
-    return nTotal;
+    if (wtx.IsCoinBase() && nBlocksToMaturity > 0 && nDepth > 0)
+    {
+        b.nImmature = wtx.GetCredit();
+        b.nNewMint = wallet.GetCredit(wtx);
+    };
+
+    nSPEC = nSpectre = 0;
+    if (wtx.IsCoinStake() && nBlocksToMaturity > 0 && nDepth > 0
+        && wallet.GetCredit(wtx, nSPEC, nSpectre))
+    {
+        b.nStake = nSPEC;
+        if (fAnon)
+            b.nSpectreStake = nSpectre;
+    };
 }
 
-int64_t CWallet::GetSpectreBalance() const
+// - true if the chain of pindexTip contains the block hash at nHeight
+template<typename T>
+static bool ChainContains(const T *pindexTip, int nHeight, const uint256 &hash)
+{
+    if (!pindexTip || hash == 0)
+        return false;
+    const T *pindex = pindexTip->GetAncestor(nHeight);
+    return pindex && pindex->GetBlockHash() == hash;
+}
+
+void CWallet::BalanceChanged(const CWalletTx &wtx) const
+{
+    LOCK(cs_balances);
+    if (!fBalanceRebuild)
+        setBalanceChanged.insert(wtx.GetHash());
+    if (!fCoinsRebuild)
+        setCoinsChanged.insert(wtx.GetHash());
+}
+
+void CWallet::BalanceChanged(const uint256 &hash) const
+{
+    LOCK(cs_balances);
+    if (!fBalanceRebuild)
+        setBalanceChanged.insert(hash);
+    if (!fCoinsRebuild)
+        setCoinsChanged.insert(hash);
+}
+
+void CWallet::UpdateBalances() const
 {
-    int64_t nTotal = 0;
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+
+    // - mapTxBalances and setBalancePending are only used here, under
+    //   cs_wallet, cs_balances is held just to take the changes and to
+    //   publish the totals, so it's never held while taking another lock
+    std::set<uint256> setChanged;
+    bool fRebuild;
+    {
+        LOCK(cs_balances);
+        fRebuild = fBalanceRebuild;
+        if (hashBestChain != hashBalanceTip)
+        {
+            // - on a longer chain only the pending shares change, a reorg
+            //   can change any share
+            bool fExtends = nNodeMode == NT_FULL
+                ? ChainContains(pindexBest, nBalanceTipHeight, hashBalanceTip)
+                : ChainContains(pindexBestHeader, nBalanceTipHeight, hashBalanceTip);
+            if (fExtends)
+                setBalanceChanged.insert(setBalancePending.begin(), setBalancePending.end());
+            else
+                fRebuild = true;
+        };
+        fBalanceRebuild = false;
+        setChanged.swap(setBalanceChanged);
+    }
 
+    CWalletBalances balancesNew = balances;
+    if (fRebuild)
     {
-        LOCK2(cs_main, cs_wallet);
+        mapTxBalances.clear();
+        setBalancePending.clear();
+        balancesNew.SetNull();
+
+        setChanged.clear();
         for (WalletTxMap::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
+            setChanged.insert(it->first);
+    };
+
+    CWalletBalances b;
+    bool fPending;
+    BOOST_FOREACH(const uint256 &hash, setChanged)
+    {
+        std::map<uint256, CWalletBalances>::iterator mi = mapTxBalances.find(hash);
+        if (mi != mapTxBalances.end())
         {
-            const CWalletTx* pcoin = &(*it).second;
-            if (pcoin->nVersion == ANON_TXN_VERSION && pcoin->IsTrusted())
-                nTotal += pcoin->GetAvailableSpectreCredit();
+            balancesNew -= mi->second;
+            mapTxBalances.erase(mi);
         };
-    }
+        setBalancePending.erase(hash);
 
-    return nTotal;
-};
+        WalletTxMap::const_iterator it = mapWallet.find(hash);
+        if (it == mapWallet.end())
+            continue;
 
+        GetTxBalances(*this, it->second, b, fPending);
+        if (!b.IsNull())
+        {
+            mapTxBalances[hash] = b;
+            balancesNew += b;
+        };
+        if (fPending)
+            setBalancePending.insert(hash);
+    };
 
-int64_t CWallet::GetUnconfirmedBalance() const
-{
-    int64_t nTotal = 0;
+    if (fCheckBalances)
     {
-        LOCK2(cs_main, cs_wallet);
+        CWalletBalances total;
         for (WalletTxMap::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
         {
-            const CWalletTx* pcoin = &(*it).second;
-            if (!pcoin->IsFinal() || (!pcoin->IsTrusted() && pcoin->GetDepthInMainChain() == 0))
-                nTotal += pcoin->GetAvailableCredit();
+            GetTxBalances(*this, it->second, b, fPending);
+            total += b;
         };
-    }
-    return nTotal;
+
+        if (total != balancesNew)
+        {
+            LogPrintf("UpdateBalances() : *** ledger differs from a full count, balance %s / %s, unconfirmed %s / %s, stake %s / %s\n",
+                FormatMoney(balancesNew.nBalance), FormatMoney(total.nBalance),
+                FormatMoney(balancesNew.nUnconfirmed), FormatMoney(total.nUnconfirmed),
+                FormatMoney(balancesNew.nStake), FormatMoney(total.nStake));
+            {
+                LOCK(cs_balances);
+                fBalanceRebuild = true;
+            }
+            UpdateBalances();
+            return;
+        };
+    };
+
+    LOCK(cs_balances);
+    balances = balancesNew;
+    hashBalanceTip = hashBestChain;
+    nBalanceTipHeight = nBestHeight;
+    // - for a wallet not registered for the tip notifications
+    hashBestTip = hashBestChain;
+    nBestTipHeight = nBestHeight;
 }
 
-int64_t CWallet::GetUnconfirmedSpectreBalance() const
+void CWallet::GetBalances(CWalletBalances &balancesRet) const
 {
-    int64_t nTotal = 0;
     {
-        LOCK2(cs_main, cs_wallet);
-        for (WalletTxMap::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
+        LOCK(cs_balances);
+        if (!fBalanceRebuild
+            && setBalanceChanged.empty()
+            && nBalanceTipHeight == nBestTipHeight
+            && hashBalanceTip == hashBestTip)
         {
-            const CWalletTx* pcoin = &(*it).second;
-            if (pcoin->nVersion != ANON_TXN_VERSION || pcoin->IsCoinBase() || pcoin->IsCoinStake())
-                continue;
-            if (!pcoin->IsFinal() || (pcoin->GetDepthInMainChain() >= 0 && pcoin->GetDepthInMainChain() < MIN_ANON_SPEND_DEPTH))
-            {
-                int64_t nSPEC = 0, nSpectre = 0;
-                if (CWallet::GetCredit(*pcoin, nSPEC, nSpectre))
-                    nTotal += nSpectre;
-            }
+            balancesRet = balances;
+            return;
         };
     }
-    return nTotal;
+
+    LOCK2(cs_main, cs_wallet);
+    UpdateBalances();
+
+    LOCK(cs_balances);
+    balancesRet = balances;
+}
+
+int64_t CWallet::GetBalance() const
+{
+    CWalletBalances b;
+    GetBalances(b);
+    return b.nBalance;
+}
+
+int64_t CWallet::GetSpectreBalance() const
+{
+    CWalletBalances b;
+    GetBalances(b);
+    return b.nSpectreBalance;
+};
+
+int64_t CWallet::GetUnconfirmedBalance() const
+{
+    CWalletBalances b;
+    GetBalances(b);
+    return b.nUnconfirmed;
 }
 
+int64_t CWallet::GetUnconfirmedSpectreBalance() const
+{
+    CWalletBalances b;
+    GetBalances(b);
+    return b.nUnconfirmedSpectre;
+}
 
 int64_t CWallet::GetImmatureBalance() const
 {
-    int64_t nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (WalletTxMap::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
-        {
-            const CWalletTx& pcoin = (*it).second;
-            if (pcoin.IsCoinBase() && pcoin.GetBlocksToMaturity() > 0 && pcoin.IsInMainChain())
-                nTotal += pcoin.GetCredit();
-        }
-    }
-    return nTotal;
+    CWalletBalances b;
+    GetBalances(b);
+    return b.nImmature;
 }
 
 int64_t CWallet::GetImmatureSpectreBalance() const
@@ -1998,6 +2430,68 @@ int64_t CWallet::GetImmatureSpectreBalance() const
     return 0; // not used
 }
 
+static void GetUnspentOutputs(const CWallet &wallet, const CWalletTx &wtx, std::vector<uint32_t> &vOutputs)
+{
+    vOutputs.clear();
+    for (unsigned int i = 0; i < wtx.vout.size(); i++)
+        if (!wtx.IsSpent(i) && wallet.IsMine(wtx.vout[i]))
+            vOutputs.push_back(i);
+}
+
+void CWallet::UpdateUnspentCoins() const
+{
+    AssertLockHeld(cs_wallet);
+
+    std::set<uint256> setChanged;
+    bool fRebuild;
+    {
+        LOCK(cs_balances);
+        fRebuild = fCoinsRebuild;
+        fCoinsRebuild = false;
+        setChanged.swap(setCoinsChanged);
+    }
+
+    if (fRebuild)
+    {
+        mapUnspentCoins.clear();
+        setChanged.clear();
+        for (WalletTxMap::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
+            setChanged.insert(it->first);
+    };
+
+    std::vector<uint32_t> vOutputs;
+    BOOST_FOREACH(const uint256 &hash, setChanged)
+    {
+        mapUnspentCoins.erase(hash);
+
+        WalletTxMap::const_iterator it = mapWallet.find(hash);
+        if (it == mapWallet.end())
+            continue;
+
+        GetUnspentOutputs(*this, it->second, vOutputs);
+        if (!vOutputs.empty())
+            mapUnspentCoins[hash].swap(vOutputs);
+    };
+
+    if (fCheckBalances)
+    {
+        std::map<uint256, std::vector<uint32_t> > mapCheck;
+        for (WalletTxMap::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
+        {
+            GetUnspentOutputs(*this, it->second, vOutputs);
+            if (!vOutputs.empty())
+                mapCheck[it->first].swap(vOutputs);
+        };
+
+        if (mapCheck != mapUnspentCoins)
+        {
+            LogPrintf("UpdateUnspentCoins() : *** index differs from a full count, %u / %u transactions\n",
+                mapUnspentCoins.size(), mapCheck.size());
+            mapUnspentCoins.swap(mapCheck);
+        };
+    };
+}
+
 // populate vCoins with vector of spendable COutputs
 void CWallet::AvailableCoins(std::vector<COutput>& vCoins, bool fOnlyConfirmed, const CCoinControl *coinControl) const
 {
@@ -2005,8 +2499,16 @@ void CWallet::AvailableCoins(std::vector<COutput>& vCoins, bool fOnlyConfirmed,
 
     {
         LOCK2(cs_main, cs_wallet);
-        for (WalletTxMap::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
+        UpdateUnspentCoins();
+
+        // - only transactions with unspent outputs of the wallet, the checks
+        //   depending on the chain are done here, as they change every block
+        std::map<uint256, std::vector<uint32_t> >::const_iterator mi;
+        for (mi = mapUnspentCoins.begin(); mi != mapUnspentCoins.end(); ++mi)
         {
+            WalletTxMap::const_iterator it = mapWallet.find(mi->first);
+            if (it == mapWallet.end())
+                continue;
             const CWalletTx* pcoin = &(*it).second;
 
             if (!pcoin->IsFinal())
@@ -2022,8 +2524,8 @@ void CWallet::AvailableCoins(std::vector<COutput>& vCoins, bool fOnlyConfirmed,
             if (nDepth < 0)
                 continue;
 
-            for (unsigned int i = 0; i < pcoin->vout.size(); i++)
-                if (!(pcoin->IsSpent(i)) && IsMine(pcoin->vout[i]) && pcoin->vout[i].nValue >= nMinimumInputValue &&
+            BOOST_FOREACH(uint32_t i, mi->second)
+                if (pcoin->vout[i].nValue >= nMinimumInputValue &&
                 (!coinControl || !coinControl->HasSelected() || coinControl->IsSelected((*it).first, i)))
                     vCoins.push_back(COutput(pcoin, i, nDepth));
 
@@ -2037,11 +2539,16 @@ void CWallet::AvailableCoinsForStaking(std::vector<COutput>& vCoins, unsigned in
 
     {
         LOCK2(cs_main, cs_wallet);
+        UpdateUnspentCoins();
 
         bool fPoSv3 = Params().IsProtocolV3(nBestHeight);
 
-        for (WalletTxMap::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
+        std::map<uint256, std::vector<uint32_t> >::const_iterator mi;
+        for (mi = mapUnspentCoins.begin(); mi != mapUnspentCoins.end(); ++mi)
         {
+            WalletTxMap::const_iterator it = mapWallet.find(mi->first);
+            if (it == mapWallet.end())
+                continue;
             const CWalletTx* pcoin = &(*it).second;
 
             // Filtering by tx timestamp instead of block timestamp may give false positives but never false negatives
@@ -2055,105 +2562,38 @@ void CWallet::AvailableCoinsForStaking(std::vector<COutput>& vCoins, unsigned in
             if (nDepth < 1 || (fPoSv3 && nDepth < Params().GetStakeMinConfirmations(nSpendTime)))
                 continue;
 
-            for (unsigned int i = 0; i < pcoin->vout.size(); i++)
+            BOOST_FOREACH(uint32_t i, mi->second)
             {
                 if (pcoin->nVersion == ANON_TXN_VERSION
                     && pcoin->vout[i].IsAnonOutput())
                     continue;
-                if (!(pcoin->IsSpent(i)) && IsMine(pcoin->vout[i]) && pcoin->vout[i].nValue >= nMinimumInputValue)
+                if (pcoin->vout[i].nValue >= nMinimumInputValue)
                     vCoins.push_back(COutput(pcoin, i, nDepth));
             };
         };
     }
 }
 
-static void ApproximateBestSubset(
-    std::vector<pair<int64_t, pair<const CWalletTx*,unsigned int> > >vValue, int64_t nTotalLower, int64_t nTargetValue,
-    std::vector<char>& vfBest, int64_t& nBest, int iterations = 1000)
-{
-    std::vector<char> vfIncluded;
-
-    vfBest.assign(vValue.size(), true);
-    nBest = nTotalLower;
-
-    for (int nRep = 0; nRep < iterations && nBest != nTargetValue; nRep++)
-    {
-        vfIncluded.assign(vValue.size(), false);
-        int64_t nTotal = 0;
-        bool fReachedTarget = false;
-        for (int nPass = 0; nPass < 2 && !fReachedTarget; nPass++)
-        {
-            for (unsigned int i = 0; i < vValue.size(); i++)
-            {
-                if (nPass == 0 ? rand() % 2 : !vfIncluded[i])
-                {
-                    nTotal += vValue[i].first;
-                    vfIncluded[i] = true;
-                    if (nTotal >= nTargetValue)
-                    {
-                        fReachedTarget = true;
-                        if (nTotal < nBest)
-                        {
-                            nBest = nTotal;
-                            vfBest = vfIncluded;
-                        }
-                        nTotal -= vValue[i].first;
-                        vfIncluded[i] = false;
-                    }
-                }
-            }
-        }
-    }
-}
-
 // ppcoin: total coins staked (non-spendable until maturity)
 int64_t CWallet::GetStake() const
 {
-    int64_t nTotal = 0;
-    LOCK2(cs_main, cs_wallet);
-    for (WalletTxMap::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
-    {
-        const CWalletTx* pcoin = &(*it).second;
-        if (pcoin->IsCoinStake() && pcoin->GetBlocksToMaturity() > 0 && pcoin->GetDepthInMainChain() > 0)
-        {
-            int64_t nSPEC = 0, nSpectre = 0;
-            if (CWallet::GetCredit(*pcoin, nSPEC, nSpectre))
-                nTotal += nSPEC;
-        }
-    };
-    return nTotal;
+    CWalletBalances b;
+    GetBalances(b);
+    return b.nStake;
 }
 
 int64_t CWallet::GetSpectreStake() const
 {
-    int64_t nTotal = 0;
-    LOCK2(cs_main, cs_wallet);
-    for (WalletTxMap::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
-    {
-        const CWalletTx* pcoin = &(*it).second;
-        if (pcoin->nVersion != ANON_TXN_VERSION)
-            continue;
-        if (pcoin->IsCoinStake() && pcoin->GetBlocksToMaturity() > 0 && pcoin->GetDepthInMainChain() > 0)
-        {
-            int64_t nSPEC = 0, nSpectre = 0;
-            if (CWallet::GetCredit(*pcoin, nSPEC, nSpectre))
-                nTotal += nSpectre;
-        }
-    };
-    return nTotal;
+    CWalletBalances b;
+    GetBalances(b);
+    return b.nSpectreStake;
 }
 
 int64_t CWallet::GetNewMint() const
 {
-    int64_t nTotal = 0;
-    LOCK2(cs_main, cs_wallet);
-    for (WalletTxMap::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
-    {
-        const CWalletTx* pcoin = &(*it).second;
-        if (pcoin->IsCoinBase() && pcoin->GetBlocksToMaturity() > 0 && pcoin->GetDepthInMainChain() > 0)
-            nTotal += CWallet::GetCredit(*pcoin);
-    };
-    return nTotal;
+    CWalletBalances b;
+    GetBalances(b);
+    return b.nNewMint;
 }
 
 bool CWallet::SelectCoinsMinConf(int64_t nTargetValue, unsigned int nSpendTime, int nConfMine, int nConfTheirs, std::vector<COutput> vCoins, set<pair<const CWalletTx*,unsigned int> >& setCoinsRet, int64_t& nValueRet) const
@@ -2227,14 +2667,29 @@ bool CWallet::SelectCoinsMinConf(int64_t nTargetValue, unsigned int nSpendTime,
         return true;
     }
 
-    // Solve subset sum by stochastic approximation
     sort(vValue.rbegin(), vValue.rend(), CompareValueOnly());
+    std::vector<int64_t> vAmounts(vValue.size());
+    for (unsigned int i = 0; i < vValue.size(); ++i)
+        vAmounts[i] = vValue[i].first;
     std::vector<char> vfBest;
     int64_t nBest;
 
-    ApproximateBestSubset(vValue, nTotalLower, nTargetValue, vfBest, nBest, 1000);
+    // A set without change, the coins in the window are all in vValue
+    if (SelectCoinsBnB(vAmounts, nTargetValue, GetMaxChangeToFee(nTransactionFee), vfBest, nBest))
+    {
+        for (unsigned int i = 0; i < vValue.size(); i++)
+            if (vfBest[i])
+            {
+                setCoinsRet.insert(vValue[i].second);
+                nValueRet += vValue[i].first;
+            }
+        return true;
+    }
+
+    // Solve subset sum by stochastic approximation
+    ApproximateBestSubset(vAmounts, nTotalLower, nTargetValue, vfBest, nBest, 1000);
     if (nBest != nTargetValue && nTotalLower >= nTargetValue + CENT)
-        ApproximateBestSubset(vValue, nTotalLower, nTargetValue + CENT, vfBest, nBest, 1000);
+        ApproximateBestSubset(vAmounts, nTotalLower, nTargetValue + CENT, vfBest, nBest, 1000);
 
     // If we have a bigger coin and (either the stochastic approximation didn't find a good solution,
     //                                   or the next bigger coin is closer), return the bigger coin
@@ -2376,6 +2831,13 @@ bool CWallet::CreateTransaction(const std::vector<std::pair<CScript, int64_t> >&
                     nFeeRet += nMoveToFee;
                 };
 
+                // change worth less than creating and spending it, up to a CENT, goes to the fee
+                if (nChange > 0 && nChange <= GetMaxChangeToFee(nTransactionFee))
+                {
+                    nFeeRet += nChange;
+                    nChange = 0;
+                };
+
                 if (nChange > 0)
                 {
                     // Fill a vout to ourself
@@ -3282,12 +3744,13 @@ bool CWallet::UndoAnonTransaction(const CTransaction& tx, const std::map<CKeyID,
             return false;
         }
         mapWallet.erase(txnHash);
+        BalanceChanged(txnHash);
     }
 
     return true;
 };
 
-bool CWallet::ProcessAnonTransaction(CWalletDB *pwdb, CTxDB *ptxdb, const CTransaction& tx, const uint256& blockHash, bool& fIsMine, mapValue_t& mapNarr, std::vector<WalletTxMap::iterator>& vUpdatedTxns, std::map<int64_t, CAnonBlockStat>& mapAnonBlockStat, const std::map<CKeyID, CStealthAddress> * const mapPubStealth)
+bool CWallet::ProcessAnonTransaction(CWalletDB *pwdb, CTxDB *ptxdb, const CTransaction& tx, const uint256& blockHash, bool& fIsMine, mapValue_t& mapNarr, std::vector<WalletTxMap::iterator>& vUpdatedTxns, std::map<int64_t, CAnonBlockStat>& mapAnonBlockStat, const std::map<CKeyID, CStealthAddress> * const mapPubStealth, bool fScanStealth)
 {
     uint256 txnHash = tx.GetHash();
 
@@ -3546,6 +4009,7 @@ bool CWallet::ProcessAnonTransaction(CWalletDB *pwdb, CTxDB *ptxdb, const CTrans
         CPubKey cpkE;
         data_chunk pkScan;
         std::string sSxAddr;
+        if (fScanStealth)
         for (std::set<CStealthAddress>::iterator it = stealthAddresses.begin(); it != stealthAddresses.end(); ++it)
         {
             if (it->scan_secret.size() != EC_SECRET_SIZE)
@@ -3593,7 +4057,7 @@ bool CWallet::ProcessAnonTransaction(CWalletDB *pwdb, CTxDB *ptxdb, const CTrans
 
         // - check ext account stealth keys
         ExtKeyAccountMap::const_iterator mi;
-        if (!fOwnOutput)
+        if (!fOwnOutput && fScanStealth)
         for (mi = mapExtAccounts.begin(); mi != mapExtAccounts.end(); ++mi)
         {
             CExtKeyAccount *ea = mi->second;
@@ -4474,70 +4938,53 @@ bool CWallet::InitMixins(CMixins& mixins, const std::vector<const COwnedAnonOutp
         setDenominations.insert(oao->nValue);
     }
 
-    leveldb::Iterator *iterator = pdb->NewIterator(txdb.GetReadOptions());
-
-    // Seek to start key.
-    CPubKey pkZero;
-    pkZero.SetZero();
-
-    CDataStream ssStartKey(SER_DISK, CLIENT_VERSION);
-    ssStartKey << make_pair(string("ao"), pkZero);
-    iterator->Seek(ssStartKey.str());
+    // Only outputs of the denominations needed, confirmed deep enough to be mature, are read
+    int nMinDepth = fStaking ? Params().GetAnonStakeMinConfirmations() : std::min(MIN_ANON_SPEND_DEPTH, Params().GetAnonStakeMinConfirmations());
+    int nMaxHeight = nBestHeight + 1 - nMinDepth; // ao confirmed in last block has depth of 1
 
-    CPubKey pkAo;
-    CAnonOutput anonOutput;
-    uint32_t nTotal = 0, nMixins = 0, nInvalid = 0, nUsedTx = 0, nDiffDenom = 0, nImmature = 0, nCompromised = 0;
-    while (iterator->Valid())
+    bool fError = false;
+    uint32_t nTotal = 0, nMixins = 0, nInvalid = 0, nUsedTx = 0, nImmature = 0, nCompromised = 0;
+    for (const auto & nValue : setDenominations)
     {
-        // Unpack keys and values.
-        CDataStream ssKey(SER_DISK, CLIENT_VERSION);
-        ssKey.write(iterator->key().data(), iterator->key().size());
-        string strType;
-        ssKey >> strType;
-
-        if (strType != "ao")
-            break;
-
-        CDataStream ssValue(SER_DISK, CLIENT_VERSION);
-        ssValue.write(iterator->value().data(), iterator->value().size());
-
-        ssKey >> pkAo;
-        ssValue >> anonOutput;
-
-        nTotal++;
-        if (!pkAo.IsValid())
-            nInvalid++;
-        else if (setDenominations.find(anonOutput.nValue) == setDenominations.end())
-            nDiffDenom++;
-        else if (setUsedOutputsTxs.find(anonOutput.outpoint.hash) != setUsedOutputsTxs.end())
-            nUsedTx++;
-        else
+        int nCompromisedHeight = mapAnonOutputStats[nValue].nCompromisedHeight;
+        txdb.ReadAnonOutputIndex(nValue, nValue, 1, nMaxHeight, [&] (const CPubKey& pkAo, const CAnonOutput& anonOutput) -> bool
         {
-            int nCompromisedHeight = mapAnonOutputStats[anonOutput.nValue].nCompromisedHeight;
-            // If hiding outputs are for staking, all outputs must have a enough confirmations for staking
-            int minDepth = fStaking || anonOutput.fCoinStake ? Params().GetAnonStakeMinConfirmations() : MIN_ANON_SPEND_DEPTH;
-            if (anonOutput.nBlockHeight <= 0 || nBestHeight - anonOutput.nBlockHeight + 1 < minDepth) // ao confirmed in last block has depth of 1
-                nImmature++;
-            else if (anonOutput.nCompromised != 0 || (nCompromisedHeight != 0 && nCompromisedHeight - MIN_ANON_SPEND_DEPTH >= anonOutput.nBlockHeight))
-                nCompromised++;
+            nTotal++;
+            if (!pkAo.IsValid())
+                nInvalid++;
+            else if (setUsedOutputsTxs.find(anonOutput.outpoint.hash) != setUsedOutputsTxs.end())
+                nUsedTx++;
             else
-                try {
-                nMixins++;
-                mixins.AddAnonOutput(pkAo, anonOutput, nBestHeight);
-            } catch (std::exception& e)
             {
-                LogPrintf("ERROR: CWallet::InitMixins() : mixins.addAnonOutput threw: %s.\n", e.what());
-                return false;
+                // If hiding outputs are for staking, all outputs must have a enough confirmations for staking
+                int minDepth = fStaking || anonOutput.fCoinStake ? Params().GetAnonStakeMinConfirmations() : MIN_ANON_SPEND_DEPTH;
+                if (nBestHeight - anonOutput.nBlockHeight + 1 < minDepth)
+                    nImmature++;
+                else if (anonOutput.nCompromised != 0 || (nCompromisedHeight != 0 && nCompromisedHeight - MIN_ANON_SPEND_DEPTH >= anonOutput.nBlockHeight))
+                    nCompromised++;
+                else
+                    try {
+                    nMixins++;
+                    CPubKey pkMixin = pkAo;
+                    CAnonOutput aoMixin = anonOutput;
+                    mixins.AddAnonOutput(pkMixin, aoMixin, nBestHeight);
+                } catch (std::exception& e)
+                {
+                    LogPrintf("ERROR: CWallet::InitMixins() : mixins.addAnonOutput threw: %s.\n", e.what());
+                    fError = true;
+                    return false;
+                }
             }
-        }
-        iterator->Next();
+            return true;
+        });
+        if (fError)
+            return false;
     };
 
     if (fDebugRingSig)
-        LogPrintf("CWallet::InitMixins() : processed %d anons in %d µs; potential mixins: %d; skipped invalid: %d, txUsed: %d, diffDenom: %d, immature: %d, compromised: %d.\n",
-                  nTotal, GetTimeMicros() - nStart, nMixins, nInvalid, nUsedTx, nDiffDenom, nImmature, nCompromised);
+        LogPrintf("CWallet::InitMixins() : processed %d anons in %d µs; potential mixins: %d; skipped invalid: %d, txUsed: %d, immature: %d, compromised: %d.\n",
+                  nTotal, GetTimeMicros() - nStart, nMixins, nInvalid, nUsedTx, nImmature, nCompromised);
 
-    delete iterator;
     return true;
 }
 
@@ -5656,57 +6103,35 @@ int CWallet::CountAnonOutputs(std::map<int64_t, int>& mOutputCounts, MaturityFil
     if (!pdb)
         throw runtime_error("CWallet::CountAnonOutputs() : cannot get leveldb instance");
 
-    leveldb::Iterator *iterator = pdb->NewIterator(txdb.GetReadOptions());
-
-
-    // Seek to start key.
-    CPubKey pkZero;
-    pkZero.SetZero();
-
-    CDataStream ssStartKey(SER_DISK, CLIENT_VERSION);
-    ssStartKey << make_pair(string("ao"), pkZero);
-    iterator->Seek(ssStartKey.str());
-
-
-    while (iterator->Valid())
+    // Only the denominations asked for, and with a filter only heights that can be mature, are read
+    int nMinHeight = 0, nMaxHeight = std::numeric_limits<int>::max();
+    if (nFilter != MaturityFilter::NONE)
     {
-        // Unpack keys and values.
-        CDataStream ssKey(SER_DISK, CLIENT_VERSION);
-        ssKey.write(iterator->key().data(), iterator->key().size());
-        string strType;
-        ssKey >> strType;
-
-        if (strType != "ao")
-            break;
-
-        CDataStream ssValue(SER_DISK, CLIENT_VERSION);
-        ssValue.write(iterator->value().data(), iterator->value().size());
-
-        CAnonOutput anonOutput;
-        ssValue >> anonOutput;
-
-        // maturity (minDepth) depends on if the output was created in a staking transaction or is used for staking
-        int minBlockHeight = anonOutput.fCoinStake || nFilter == MaturityFilter::FOR_STAKING ?
-                    Params().GetAnonStakeMinConfirmations() : MIN_ANON_SPEND_DEPTH;
+        int nMinDepth = nFilter == MaturityFilter::FOR_STAKING ? Params().GetAnonStakeMinConfirmations() : std::min(MIN_ANON_SPEND_DEPTH, Params().GetAnonStakeMinConfirmations());
+        nMinHeight = 1;
+        nMaxHeight = nBestHeight + 1 - nMinDepth;
+    };
 
+    for (std::map<int64_t, int>::iterator mi = mOutputCounts.begin(); mi != mOutputCounts.end(); ++mi)
+    {
         // Don't count anons which are compromised by ALL SPENT
-        int nCompromisedHeight = mapAnonOutputStats[anonOutput.nValue].nCompromisedHeight;
+        int nCompromisedHeight = mapAnonOutputStats[mi->first].nCompromisedHeight;
 
-        if ((nFilter == MaturityFilter::NONE ||
-             (anonOutput.nBlockHeight > 0 && nBestHeight - anonOutput.nBlockHeight + 1 >= minBlockHeight)) // ao confirmed in last block has depth of 1
-                && (Params().IsProtocolV3(nBestHeight) ? anonOutput.nCompromised == 0 : true)
-                && (nCompromisedHeight == 0 || anonOutput.nBlockHeight > nCompromisedHeight - MIN_ANON_SPEND_DEPTH))
+        txdb.ReadAnonOutputIndex(mi->first, mi->first, nMinHeight, nMaxHeight, [&] (const CPubKey& pkAo, const CAnonOutput& anonOutput) -> bool
         {
-            std::map<int64_t, int>::iterator mi = mOutputCounts.find(anonOutput.nValue);
-            if (mi != mOutputCounts.end())
-                mi->second++;
-        };
+            // maturity (minDepth) depends on if the output was created in a staking transaction or is used for staking
+            int minBlockHeight = anonOutput.fCoinStake || nFilter == MaturityFilter::FOR_STAKING ?
+                        Params().GetAnonStakeMinConfirmations() : MIN_ANON_SPEND_DEPTH;
 
-        iterator->Next();
+            if ((nFilter == MaturityFilter::NONE ||
+                 (anonOutput.nBlockHeight > 0 && nBestHeight - anonOutput.nBlockHeight + 1 >= minBlockHeight)) // ao confirmed in last block has depth of 1
+                    && (Params().IsProtocolV3(nBestHeight) ? anonOutput.nCompromised == 0 : true)
+                    && (nCompromisedHeight == 0 || anonOutput.nBlockHeight > nCompromisedHeight - MIN_ANON_SPEND_DEPTH))
+                mi->second++;
+            return true;
+        });
     };
 
-    delete iterator;
-
     return 0;
 };
 
@@ -5733,49 +6158,18 @@ int CWallet::CountAllAnonOutputs(std::list<CAnonOutputCount>& lOutputCounts, int
     if (!pdb)
         throw runtime_error("CWallet::CountAnonOutputs() : cannot get leveldb instance");
 
-    leveldb::Iterator *iterator = pdb->NewIterator(txdb.GetReadOptions());
-
-    // Seek to start key.
-    CPubKey pkZero;
-    pkZero.SetZero();
-
-    CDataStream ssStartKey(SER_DISK, CLIENT_VERSION);
-    ssStartKey << make_pair(string("ao"), pkZero);
-    iterator->Seek(ssStartKey.str());
-
+    // ao confirmed in blocks after the given nBlockHeight are skipped
     uint32_t count = 0;
-    while (iterator->Valid())
-    {   
-         if (funcProgress && count != 0 && count % 10000 == 0) funcProgress(0, count);
-         count++;
-
-        // Unpack keys and values.
-        CDataStream ssKey(SER_DISK, CLIENT_VERSION);
-        ssKey.write(iterator->key().data(), iterator->key().size());
-        string strType;
-        ssKey >> strType;
-
-        if (strType != "ao")
-            break;
+    txdb.ReadAnonOutputIndex(0, std::numeric_limits<int64_t>::max(), 0, nBlockHeight, [&] (const CPubKey& pkAo, const CAnonOutput& ao) -> bool
+    {
+        if (funcProgress && count != 0 && count % 10000 == 0) funcProgress(0, count);
+        count++;
 
         nTotalAoRead++;
 
-        CDataStream ssValue(SER_DISK, CLIENT_VERSION);
-        ssValue.write(iterator->value().data(), iterator->value().size());
-
-        CAnonOutput ao;
-        ssValue >> ao;
-
         int nCompromisedHeight = 0;
         if (ao.nBlockHeight)
         {
-            // ao confirmed in blocks after the given nBlockHeight are skipped
-            if (ao.nBlockHeight > nBlockHeight)
-            {
-                iterator->Next();
-                continue;
-            }
-
             // Check if ao is compromised as mixin by ALL SPENT
             std::map<int64_t, std::vector<int>>::iterator it = mapCompromisedHeights.find(ao.nValue);
             if (it != mapCompromisedHeights.end() && it->second.size() > 0)
@@ -5796,33 +6190,28 @@ int CWallet::CountAllAnonOutputs(std::list<CAnonOutputCount>& lOutputCounts, int
         else
             nUnconfirmed++;
 
-        // -- insert by nValue asc
-        bool fProcessed = false;
-        for (std::list<CAnonOutputCount>::iterator it = lOutputCounts.begin(); it != lOutputCounts.end(); ++it)
-        {
-            if (ao.nValue == it->nValue)
-            {
-                it->nExists += nExists;
-                it->nUnconfirmed += nUnconfirmed;
-                it->nCompromised += fCompromised;
-                it->nMature += nMature;
-                it->nMixins += nMixins;
-                it->nMixinsStaking += nMixinsStaking;
-                it->nStakes += ao.fCoinStake;
-                if (it->nLastHeight < ao.nBlockHeight)
-                    it->nLastHeight = ao.nBlockHeight;
-                fProcessed = true;
-                break;
-            };
-            if (ao.nValue > it->nValue)
-                continue;
-            lOutputCounts.insert(it, CAnonOutputCount(ao.nValue, nExists, nUnconfirmed, 0, 0, ao.nBlockHeight, fCompromised, nMature, nMixins, nMixinsStaking, ao.fCoinStake, 0));
-            fProcessed = true;
-            break;
+        // -- insert by nValue asc, the index returns outputs by value so it's mostly the last entry
+        std::list<CAnonOutputCount>::iterator it = lOutputCounts.end();
+        if (!lOutputCounts.empty() && lOutputCounts.back().nValue >= ao.nValue)
+        {
+            it = std::prev(lOutputCounts.end());
+            if (it->nValue != ao.nValue)
+                for (it = lOutputCounts.begin(); it->nValue < ao.nValue; ++it);
         };
-        if (!fProcessed)
-            lOutputCounts.push_back(CAnonOutputCount(ao.nValue, nExists, nUnconfirmed, 0, 0, ao.nBlockHeight, fCompromised, nMature, nMixins, nMixinsStaking, ao.fCoinStake, 0));
 
+        if (it != lOutputCounts.end() && it->nValue == ao.nValue)
+        {
+            it->nExists += nExists;
+            it->nUnconfirmed += nUnconfirmed;
+            it->nCompromised += fCompromised;
+            it->nMature += nMature;
+            it->nMixins += nMixins;
+            it->nMixinsStaking += nMixinsStaking;
+            it->nStakes += ao.fCoinStake;
+            if (it->nLastHeight < ao.nBlockHeight)
+                it->nLastHeight = ao.nBlockHeight;
+        } else
+            lOutputCounts.insert(it, CAnonOutputCount(ao.nValue, nExists, nUnconfirmed, 0, 0, ao.nBlockHeight, fCompromised, nMature, nMixins, nMixinsStaking, ao.fCoinStake, 0));
 
         // add last 1000 anon blocks to mapAnonBlockStats
         if (ao.nBlockHeight && nBlockHeight - ao.nBlockHeight <= nMaxAnonBlockCache)
@@ -5835,17 +6224,20 @@ int CWallet::CountAllAnonOutputs(std::list<CAnonOutputCount>& lOutputCounts, int
                 anonBlockStat.nOutputs++;
         }
 
-        iterator->Next();
-    };
+        return true;
+    });
     if (funcProgress) funcProgress(0, count);
 
-    delete iterator;
-
 
     // -- count spends
 
-    iterator = pdb->NewIterator(txdb.GetReadOptions());
-    ssStartKey.clear();
+    leveldb::Iterator *iterator = pdb->NewIterator(txdb.GetReadOptions());
+
+    // Seek to start key.
+    CPubKey pkZero;
+    pkZero.SetZero();
+
+    CDataStream ssStartKey(SER_DISK, CLIENT_VERSION);
     ssStartKey << make_pair(string("ki"), pkZero);
     iterator->Seek(ssStartKey.str());
 
@@ -6056,6 +6448,8 @@ uint64_t CWallet::EraseAllAnonData(std::function<void (const char *, const uint3
          });
     else
         txdb.EraseRange(std::string("ao"), nAo);
+    uint32_t nAoIndex = 0;
+    txdb.EraseRange(std::string("aoi"), nAoIndex);
     LogPrintf("Erasing spent key images.\n");
     if (funcProgress)
          txdb.EraseRange(std::string("ki"), nKi, [funcProgress] (const uint32_t& nErased) -> void {
@@ -6067,6 +6461,11 @@ uint64_t CWallet::EraseAllAnonData(std::function<void (const char *, const uint3
     LogPrintf("Erasing compromised anon heights.\n");
     txdb.EraseCompromisedAnonHeights();
 
+    LogPrintf("Erasing anon stats.\n");
+    txdb.EraseAnonStats();
+    uint32_t nAbs = 0;
+    txdb.EraseRange(std::string("abs"), nAbs);
+
     uint32_t nLao = 0;
     uint32_t nOao = 0;
     uint32_t nOal = 0;
@@ -6098,6 +6497,13 @@ bool CWallet::UpdateAnonStats(CTxDB& txdb, int nBlockHeight)
 
     // Update anon cache (mapAnonOutputStats) with block stats (mapAnonBlockStats)
     std::map<int64_t, CAnonBlockStat> & mapAnonBlockStat = mapAnonBlockStats[nBlockHeight];
+    if (!txdb.WriteAnonBlockStats(nBlockHeight, mapAnonBlockStat))
+        return error("%s: WriteAnonBlockStats failed for block height %d.", __func__, nBlockHeight);
+    // - the persisted block stats are a window by height, an entry drops out
+    //   as the block nMaxAnonBlockCache above it is connected
+    if (nBlockHeight > nMaxAnonBlockCache)
+        txdb.EraseAnonBlockStats(nBlockHeight - nMaxAnonBlockCache);
+
     for (const auto & [nValue, anonBlockStat] : mapAnonBlockStat)
     {
         CAnonOutputCount& anonOutputCount = mapAnonOutputStats[nValue];
@@ -6281,11 +6687,62 @@ bool CWallet::RemoveAnonStats(CTxDB& txdb, int nBlockHeight)
     }
 
     mapAnonBlockStats.erase(nBlockHeight);
+    txdb.EraseAnonBlockStats(nBlockHeight);
+
+    return true;
+}
+
+bool CWallet::WriteAnonStats(CTxDB& txdb, const uint256& hashBlock)
+{
+    AssertLockHeld(cs_main);
+
+    // - a stale cache is recounted, it must not be loaded on the next start
+    if (fStaleAnonCache)
+        return txdb.EraseAnonStats();
+
+    if (!txdb.WriteAnonStats(hashBlock, mapAnonOutputStats))
+        return error("%s: WriteAnonStats failed for block %s.", __func__, hashBlock.ToString());
+
+    return true;
+}
+
+bool CWallet::LoadAnonStats(CTxDB& txdb, int nBlockHeight, const uint256& hashBlock)
+{
+    AssertLockHeld(cs_main);
+
+    int64_t nStart = GetTimeMillis();
 
+    uint256 hashStats;
+    std::map<int64_t, CAnonOutputCount> mapOutputStats;
+    if (!txdb.ReadAnonStats(hashStats, mapOutputStats))
+    {
+        LogPrintf("LoadAnonStats() : No persisted anon stats.\n");
+        return false;
+    };
+
+    if (hashStats != hashBlock)
+    {
+        LogPrintf("LoadAnonStats() : Anon stats of block %s, best block is %s.\n", hashStats.ToString(), hashBlock.ToString());
+        return false;
+    };
+
+    mapAnonOutputStats.swap(mapOutputStats);
+
+    mapAnonBlockStats.clear();
+    for (int i = nBlockHeight; i > 0 && i > nBlockHeight - nMaxAnonBlockCache; --i)
+    {
+        std::map<int64_t, CAnonBlockStat> mapBlockStats;
+        if (txdb.ReadAnonBlockStats(i, mapBlockStats))
+            mapAnonBlockStats[i].swap(mapBlockStats);
+    };
+    fStaleAnonCache = false;
+
+    LogPrintf("Loaded anon stats of %u values and %u blocks in %dms.\n",
+        mapAnonOutputStats.size(), mapAnonBlockStats.size(), GetTimeMillis() - nStart);
     return true;
 }
 
-bool CWallet::CacheAnonStats(int nBlockHeight, std::function<void (const unsigned mode, const uint32_t&)> funcProgress)
+bool CWallet::CacheAnonStats(int nBlockHeight, const uint256& hashBlock, std::function<void (const unsigned mode, const uint32_t&)> funcProgress)
 {
     if (fDebugRingSig)
         LogPrintf("CacheAnonStats(%d)\n", nBlockHeight);
@@ -6320,7 +6777,14 @@ bool CWallet::CacheAnonStats(int nBlockHeight, std::function<void (const unsigne
     };
     fStaleAnonCache = false;
 
-    return true;
+    // - persist the recounted block stats and the stats of hashBlock, a restart
+    //   loads them instead of finding gaps in the window and recounting again
+    CTxDB txdb("r+");
+    for (const auto & [nHeight, mapBlockStats] : mapAnonBlockStats)
+        if (!txdb.WriteAnonBlockStats(nHeight, mapBlockStats))
+            return error("%s: WriteAnonBlockStats failed for block height %d.", __func__, nHeight);
+
+    return WriteAnonStats(txdb, hashBlock);
 };
 
 bool CWallet::InitBloomFilter()
@@ -6521,6 +6985,158 @@ uint64_t CWallet::GetSpectreStakeWeight() const
     return nWeight;
 }
 
+class CKernelSearch;
+
+class CKernelSearchCheck
+{
+private:
+    CKernelSearch *psearch;
+    size_t nCoin;
+
+public:
+    CKernelSearchCheck() : psearch(NULL), nCoin(0) {}
+    CKernelSearchCheck(CKernelSearch *psearchIn, size_t nCoinIn) : psearch(psearchIn), nCoin(nCoinIn) {}
+
+    bool operator()();
+
+    void swap(CKernelSearchCheck &check)
+    {
+        std::swap(psearch, check.psearch);
+        std::swap(nCoin, check.nCoin);
+    }
+};
+
+// - created once, the -stakethreads workers are started in AppInit2
+static CCheckQueue<CKernelSearchCheck> kernelSearchQueue(64);
+static boost::mutex cs_kernelSearch;
+
+void ThreadKernelSearch()
+{
+    RenameThread("alias-stake");
+    kernelSearchQueue.Thread();
+}
+
+// Kernel search of CreateCoinStake and CreateAnonCoinStake: the coins are
+// tried for nSearch times back from nTime, sharded over the -stakethreads
+// workers. A kernel found, a new best block or an interrupt of the caller
+// cancel the search, coins before the one found are still searched.
+class CKernelSearch
+{
+private:
+    std::function<bool (size_t, unsigned int)> fnCheck;
+    const CBlockIndex *pindexPrev;
+    unsigned int nTime;
+    unsigned int nSearch;
+
+    boost::mutex mutex;
+    // - the first coin of a kernel found so far, NOT_FOUND if none, the
+    //   workers read it without the mutex
+    static const size_t NOT_FOUND = std::numeric_limits<size_t>::max();
+    std::atomic<size_t> nFoundCoin;
+    unsigned int nFoundOffset;
+
+public:
+    CKernelSearch(std::function<bool (size_t, unsigned int)> fnCheckIn, const CBlockIndex *pindexPrevIn, unsigned int nTimeIn, unsigned int nSearchIn)
+        : fnCheck(fnCheckIn), pindexPrev(pindexPrevIn), nTime(nTimeIn), nSearch(nSearchIn),
+          nFoundCoin(NOT_FOUND), nFoundOffset(0)
+    {
+    }
+
+    // false to cancel the rest of the search
+    bool Check(size_t nCoin)
+    {
+        for (unsigned int n = 0; n < nSearch; n++)
+        {
+            // - only the caller can be interrupted, it works along in Wait()
+            if (pindexPrev != pindexBest || boost::this_thread::interruption_requested())
+                return false;
+
+            // - another worker found a kernel of an earlier coin, this one can't be chosen
+            if (nCoin > nFoundCoin.load())
+                return false;
+
+            // Search backward in time from the given txNew timestamp
+            if (fnCheck(nCoin, nTime - n))
+            {
+                boost::lock_guard<boost::mutex> lock(mutex);
+                if (nCoin < nFoundCoin.load())
+                {
+                    nFoundCoin = nCoin;
+                    nFoundOffset = n;
+                };
+                return false;
+            };
+        };
+        return true;
+    }
+
+    // A kernel of the coins from nCoinStart to nCoins, and its offset back
+    // from nTime. Of the kernels found before the search stopped, the one of
+    // the first coin.
+    bool Find(size_t nCoinStart, size_t nCoins, size_t &nCoinRet, unsigned int &nOffsetRet)
+    {
+        nFoundCoin = NOT_FOUND;
+        if (nCoinStart >= nCoins)
+            return false;
+
+        // - the workers are waited for, an interrupt only cancels the checks
+        boost::this_thread::disable_interruption di;
+
+        // - the queue has a single master
+        boost::lock_guard<boost::mutex> lockSearch(cs_kernelSearch);
+
+        // - the queue is taken from the back, the first coins go first
+        std::vector<CKernelSearchCheck> vChecks;
+        vChecks.reserve(nCoins - nCoinStart);
+        for (size_t i = nCoins; i-- > nCoinStart; )
+            vChecks.push_back(CKernelSearchCheck(this, i));
+        kernelSearchQueue.Add(vChecks);
+        kernelSearchQueue.Wait();
+
+        boost::lock_guard<boost::mutex> lock(mutex);
+        if (nFoundCoin.load() == NOT_FOUND)
+            return false;
+        nCoinRet = nFoundCoin;
+        nOffsetRet = nFoundOffset;
+        return true;
+    }
+};
+
+bool CKernelSearchCheck::operator()()
+{
+    return psearch->Check(nCoin);
+}
+
+bool CWallet::GetStakeCandidate(CTxDB& txdb, const CBlockIndex* pindexPrev, const COutPoint& prevout, CStakeCandidate& candidate)
+{
+    // - the candidates are read once per tip, instead of for every time
+    //   tried, a new tip drops the ones of coins since spent or reorganised
+    uint256 hashTip = pindexPrev->GetBlockHash();
+    {
+        LOCK(cs_stakeCandidates);
+        if (hashStakeCandidatesTip != hashTip)
+        {
+            mapStakeCandidates.clear();
+            hashStakeCandidatesTip = hashTip;
+        };
+
+        std::map<COutPoint, CStakeCandidate>::const_iterator mi = mapStakeCandidates.find(prevout);
+        if (mi != mapStakeCandidates.end())
+        {
+            candidate = mi->second;
+            return true;
+        };
+    }
+
+    if (!ReadStakeCandidate(txdb, prevout, candidate))
+        return false;
+
+    LOCK(cs_stakeCandidates);
+    if (hashStakeCandidatesTip == hashTip)
+        mapStakeCandidates[prevout] = candidate;
+    return true;
+}
+
 boost::random::mt19937 stakingDonationRng;
 boost::random::uniform_int_distribution<> stakingDonationDistribution(0, 99);
 
@@ -6559,96 +7175,103 @@ bool CWallet::CreateCoinStake(unsigned int nBits, int64_t nSearchInterval, int64
     int64_t nCredit = 0;
     CScript scriptPubKeyKernel;
     CTxDB txdb("r");
+
+    // - the kernel data of the coins is read first, the search only hashes
+    std::vector<pair<const CWalletTx*,unsigned int> > vCoins;
+    std::vector<CStakeCandidate> vCandidates;
     BOOST_FOREACH(PAIRTYPE(const CWalletTx*, unsigned int) pcoin, setCoins)
     {
         boost::this_thread::interruption_point();
-        static int nMaxStakeSearchInterval = 60;
-
-        bool fKernelFound = false;
-        for (unsigned int n=0; n<min(nSearchInterval,(int64_t)nMaxStakeSearchInterval) && !fKernelFound && pindexPrev == pindexBest; n++)
-        {
-            boost::this_thread::interruption_point();
-            // Search backward in time from the given txNew timestamp
-            // Search nSearchInterval seconds back up to nMaxStakeSearchInterval
-            COutPoint prevoutStake = COutPoint(pcoin.first->GetHash(), pcoin.second);
 
-            int64_t nBlockTime;
-            if (CheckKernel(pindexPrev, nBits, txNew.nTime - n, prevoutStake, &nBlockTime))
-            {
-                // Found a kernel
-                if (fDebugPoS)
-                    LogPrintf("CreateCoinStake : kernel found\n");
+        CStakeCandidate candidate;
+        if (!GetStakeCandidate(txdb, pindexPrev, COutPoint(pcoin.first->GetHash(), pcoin.second), candidate))
+            continue;
+        vCoins.push_back(pcoin);
+        vCandidates.push_back(candidate);
+    };
 
-                std::vector<valtype> vSolutions;
-                txnouttype whichType;
-                CScript scriptPubKeyOut;
-                scriptPubKeyKernel = pcoin.first->vout[pcoin.second].scriptPubKey;
+    // Search nSearchInterval seconds back up to nMaxStakeSearchInterval
+    static int nMaxStakeSearchInterval = 60;
+    CKernelSearch search([&] (size_t nCoin, unsigned int nTime) {
+        return CheckKernel(pindexPrev, nBits, nTime, vCandidates[nCoin]);
+    }, pindexPrev, txNew.nTime, min(nSearchInterval,(int64_t)nMaxStakeSearchInterval));
 
-                if (!Solver(scriptPubKeyKernel, whichType, vSolutions))
-                {
-                    if (fDebugPoS)
-                        LogPrintf("CreateCoinStake : failed to parse kernel\n");
-                    break;
-                };
+    size_t nCoin = 0;
+    unsigned int n;
+    while (search.Find(nCoin, vCoins.size(), nCoin, n))
+    {
+        // - the coins after it are searched again if it can't be used
+        PAIRTYPE(const CWalletTx*, unsigned int) pcoin = vCoins[nCoin++];
 
-                if (fDebugPoS)
-                    LogPrintf("CreateCoinStake : parsed kernel type=%d\n", whichType);
+        // Found a kernel
+        if (fDebugPoS)
+            LogPrintf("CreateCoinStake : kernel found\n");
 
-                if (whichType != TX_PUBKEY && whichType != TX_PUBKEYHASH)
-                {
-                    if (fDebugPoS)
-                        LogPrintf("CreateCoinStake : no support for kernel type=%d\n", whichType);
-                    break;  // only support pay to public key and pay to address
-                };
+        std::vector<valtype> vSolutions;
+        txnouttype whichType;
+        CScript scriptPubKeyOut;
+        scriptPubKeyKernel = pcoin.first->vout[pcoin.second].scriptPubKey;
 
-                if (whichType == TX_PUBKEYHASH) // pay to address type
-                {
-                    // convert to pay to public key type
-                    if (!GetKey(uint160(vSolutions[0]), key))
-                    {
-                        if (fDebugPoS)
-                            LogPrintf("CreateCoinStake : failed to get key for kernel type=%d\n", whichType);
-                        break;  // unable to find corresponding public key
-                    };
-                    scriptPubKeyOut << key.GetPubKey() << OP_CHECKSIG;
-                };
+        if (!Solver(scriptPubKeyKernel, whichType, vSolutions))
+        {
+            if (fDebugPoS)
+                LogPrintf("CreateCoinStake : failed to parse kernel\n");
+            continue;
+        };
 
-                if (whichType == TX_PUBKEY)
-                {
-                    valtype& vchPubKey = vSolutions[0];
-                    if (!GetKey(Hash160(vchPubKey), key))
-                    {
-                        if (fDebugPoS)
-                            LogPrintf("CreateCoinStake : failed to get key for kernel type=%d\n", whichType);
-                        break;  // unable to find corresponding public key
-                    };
+        if (fDebugPoS)
+            LogPrintf("CreateCoinStake : parsed kernel type=%d\n", whichType);
 
-                    if (key.GetPubKey() != vchPubKey)
-                    {
-                        if (fDebugPoS)
-                            LogPrintf("CreateCoinStake : invalid key for kernel type=%d\n", whichType);
-                        break; // keys mismatch
-                    };
+        if (whichType != TX_PUBKEY && whichType != TX_PUBKEYHASH)
+        {
+            if (fDebugPoS)
+                LogPrintf("CreateCoinStake : no support for kernel type=%d\n", whichType);
+            continue;  // only support pay to public key and pay to address
+        };
 
-                    scriptPubKeyOut = scriptPubKeyKernel;
-                };
+        if (whichType == TX_PUBKEYHASH) // pay to address type
+        {
+            // convert to pay to public key type
+            if (!GetKey(uint160(vSolutions[0]), key))
+            {
+                if (fDebugPoS)
+                    LogPrintf("CreateCoinStake : failed to get key for kernel type=%d\n", whichType);
+                continue;  // unable to find corresponding public key
+            };
+            scriptPubKeyOut << key.GetPubKey() << OP_CHECKSIG;
+        };
 
-                txNew.nTime -= n;
-                txNew.vin.push_back(CTxIn(pcoin.first->GetHash(), pcoin.second));
-                nCredit += pcoin.first->vout[pcoin.second].nValue;
-                vwtxPrev.push_back(pcoin.first);
-                txNew.vout.push_back(CTxOut(0, scriptPubKeyOut));
+        if (whichType == TX_PUBKEY)
+        {
+            valtype& vchPubKey = vSolutions[0];
+            if (!GetKey(Hash160(vchPubKey), key))
+            {
+                if (fDebugPoS)
+                    LogPrintf("CreateCoinStake : failed to get key for kernel type=%d\n", whichType);
+                continue;  // unable to find corresponding public key
+            };
 
+            if (key.GetPubKey() != vchPubKey)
+            {
                 if (fDebugPoS)
-                    LogPrintf("CreateCoinStake : added kernel type=%d\n", whichType);
-                fKernelFound = true;
-                break;
+                    LogPrintf("CreateCoinStake : invalid key for kernel type=%d\n", whichType);
+                continue; // keys mismatch
             };
+
+            scriptPubKeyOut = scriptPubKeyKernel;
         };
 
-        if (fKernelFound)
-            break; // if kernel is found stop searching
-    }
+        txNew.nTime -= n;
+        txNew.vin.push_back(CTxIn(pcoin.first->GetHash(), pcoin.second));
+        nCredit += pcoin.first->vout[pcoin.second].nValue;
+        vwtxPrev.push_back(pcoin.first);
+        txNew.vout.push_back(CTxOut(0, scriptPubKeyOut));
+
+        if (fDebugPoS)
+            LogPrintf("CreateCoinStake : added kernel type=%d\n", whichType);
+        break;
+    };
+    boost::this_thread::interruption_point();
 
     if (nCredit == 0 || nCredit > nBalance - nReserveBalance)
         return false;
@@ -6798,193 +7421,192 @@ bool CWallet::CreateAnonCoinStake(unsigned int nBits, int64_t nSearchInterval, i
     if (lAvailableCoins.empty())
         return false;
 
-    bool fKernelFound = false;
+    std::vector<const COwnedAnonOutput*> vCoins;
     for (const auto & oao : lAvailableCoins)
-    {
-        boost::this_thread::interruption_point();
+        vCoins.push_back(&oao);
 
-        static int nMaxStakeSearchInterval = 60;
-        for (unsigned int n=0; n<min(nSearchInterval,(int64_t)nMaxStakeSearchInterval) && !fKernelFound && pindexPrev == pindexBest; n++)
-        {
-            boost::this_thread::interruption_point();
-            // Search backward in time from the given txNew timestamp
-            // Search nSearchInterval seconds back up to nMaxStakeSearchInterval
-            if (CheckAnonKernel(pindexPrev, nBits, oao.nValue, oao.vchImage, txNew.nTime - n))
-            {
-                // Found a kernel
-                if (fDebugPoS)
-                    LogPrintf("CreateAnonCoinStake : kernel found for keyImage %s\n", HexStr(oao.vchImage));
+    // Search nSearchInterval seconds back up to nMaxStakeSearchInterval
+    static int nMaxStakeSearchInterval = 60;
+    CKernelSearch search([&] (size_t nCoin, unsigned int nTime) {
+        return CheckAnonKernel(pindexPrev, nBits, vCoins[nCoin]->nValue, vCoins[nCoin]->vchImage, nTime);
+    }, pindexPrev, txNew.nTime, min(nSearchInterval,(int64_t)nMaxStakeSearchInterval));
 
-                LOCK(cs_main);
+    bool fKernelFound = false;
+    size_t nCoin;
+    unsigned int n;
+    if (search.Find(0, vCoins.size(), nCoin, n))
+    {
+        const COwnedAnonOutput &oao = *vCoins[nCoin];
 
-                txNew.nVersion = ANON_TXN_VERSION;
-                txNew.nTime -= n;
+        // Found a kernel
+        if (fDebugPoS)
+            LogPrintf("CreateAnonCoinStake : kernel found for keyImage %s\n", HexStr(oao.vchImage));
 
-                int64_t nCredit = 0;
-                std::vector<const COwnedAnonOutput*> vPickedCoins;
-                vPickedCoins.push_back(&oao);
+        LOCK(cs_main);
 
-                // -- Check if stake should be split for balancing unspent ATXOs
-                std::vector<int64_t> vOutAmounts;
-                // find the anon denomination with the least number of unspent outputs
-                CAnonOutputCount* lowestAOC = nullptr;
-                for (auto it = mapAnonOutputStats.rbegin(); it != mapAnonOutputStats.rend(); it++)
-                {
-                    if (it->first < nMinTxFee * 10)
-                        break;
-                    if (it->first >= oao.nValue)
-                        continue;
-                    if (it->second.numOfUnspends() > UNSPENT_ANON_BALANCE_MIN)
-                        continue;
-                    if (lowestAOC == nullptr || lowestAOC->numOfUnspends() > it->second.numOfUnspends())
-                        lowestAOC = &it->second;
-                }
-                if (lowestAOC)
-                {
-                    vOutAmounts.push_back(lowestAOC->nValue);
-                    nCredit += oao.nValue - lowestAOC->nValue;
-                    LogPrintf("CreateAnonCoinStake : Split anon stake of value %d to create 1 additional ATXO of value %d which has only %d unspents\n",
-                              oao.nValue, lowestAOC->nValue, lowestAOC->numOfUnspends());
-                }
-                else
-                    nCredit += oao.nValue;
-
-                // -- Add more anon inputs for consolidation
-                int64_t nMaxCombineOutput = nMaxAnonStakeOutput / 10;
-                int64_t lastCombineValue = -1;
-                std::vector<const COwnedAnonOutput*> vConsolidateCoins;
-                int nMaxConsolidation = 0, nNumOfConsolidated = 0;
-                for (const auto & oaoc : lAvailableCoins)
-                {
-                    if (oaoc.nValue > nMaxCombineOutput)
-                        break;
-                    // skip the input used for staking (TODO could be optimized by considering in combining inputs)
-                    if (&oaoc == &oao)
-                        continue;
-                    if (lastCombineValue != oaoc.nValue)
-                    {
-                        vConsolidateCoins.clear();
-                        lastCombineValue = oaoc.nValue;
-                        // calculate how many outputs can be consolidated considering the amount of mature unspents
-                        nMaxConsolidation = mapAnonOutputStats[oaoc.nValue].numOfMatureUnspends() - UNSPENT_ANON_BALANCE_MAX;
-                        nNumOfConsolidated = 0;
-                    }
-                    vConsolidateCoins.push_back(&oaoc);
-                    nNumOfConsolidated++;
-                    if (nNumOfConsolidated <= nMaxConsolidation && vConsolidateCoins.size() == 10)
-                    {
-                        vPickedCoins.insert(vPickedCoins.end(), vConsolidateCoins.begin(), vConsolidateCoins.end());
-                        vConsolidateCoins.clear();
-                        nCredit += oaoc.nValue * 10;
-                        LogPrintf("CreateAnonCoinStake : Consolidate 10 additional ATXOs of value %d which has %d mature unspents\n",
-                                  oaoc.nValue, mapAnonOutputStats[oaoc.nValue].numOfMatureUnspends());
-                    }
-                    // Consolidate maximal 50 inputs
-                    if (vPickedCoins.size() == 51)
-                        break;
-                }
+        txNew.nVersion = ANON_TXN_VERSION;
+        txNew.nTime -= n;
 
-                // -- Calculate staking reward
-                int64_t nReward = Params().GetProofOfAnonStakeReward(pindexPrev, nFees);
-                if (nReward <= 0)
-                    return error("CreateAnonCoinStake : GetProofOfStakeReward() reward <= 0");
-
-                // -- Check if staking reward gets donated to developers, according to the configured probability and DCB rules
-                int sample = stakingDonationDistribution(stakingDonationRng);
-                LogPrintf("sample: %d, donation: %d\n", sample, nStakingDonation);
-                bool donateReward = false;
-                bool fSupplyIncrease = Params().IsForkV4SupplyIncrease(pindexPrev);
-                if (fSupplyIncrease || sample < nStakingDonation || (pindexPrev->nHeight+1) % 6 == 0) {
-                    LogPrintf("Donating this (potential) stake to the developers\n");
-                    donateReward = true;
-                }
-                else {
-                    LogPrintf("Not donating this (potential) stake to the developers\n");
-                    nCredit += nReward;
-                }
+        int64_t nCredit = 0;
+        std::vector<const COwnedAnonOutput*> vPickedCoins;
+        vPickedCoins.push_back(&oao);
 
-                // -- Get stealth address for creating new anon outputs.
-                CStealthAddress sxAddress;
-                if (!GetAnonStakeAddress(oao, sxAddress))
-                    return error("CreateAnonCoinStake : GetAnonStakeAddress() change failed");
-
-                // -- create anon output
-                CScript scriptNarration; // needed to match output id of narr
-                std::vector<std::pair<CScript, int64_t> > vecSend;
-                std::vector<ec_secret> vecSecShared;
-                std::string sNarr;
-                if (nCredit)
-                    splitAmount(nCredit, vOutAmounts, nMaxAnonStakeOutput);
-                if (!CreateAnonOutputs(&sxAddress, vOutAmounts, sNarr, vecSend, scriptNarration, nullptr, &vecSecShared))
-                    return error("CreateAnonCoinStake : CreateAnonOutputs() failed");
-
-                // Sort anon ouputs together with corresponding ec_secret ascending by anon value
-                std::vector<std::pair<CTxOut, ec_secret>> vTxOutSecret;
-                vTxOutSecret.reserve(vecSend.size());
-                for (uint32_t i = 0; i < vecSend.size(); ++i)
-                    vTxOutSecret.push_back(std::make_pair(CTxOut(vecSend.at(i).second, vecSend.at(i).first), vecSecShared.at(i)));
-                std::sort(vTxOutSecret.begin(), vTxOutSecret.end(), [] (const auto &a, const auto &b) {
-                    return (a.first < b.first);
-                });
-                // Add sorted anon outputs to transaction
-                for (auto [txOut, secret] : vTxOutSecret)
-                    txNew.vout.push_back(txOut);
-
-                // -- Set one-time private key of vout[1] for signing the block
-                ec_secret sSpend;
-                ec_secret sSpendR;
-                memcpy(&sSpend.e[0], &sxAddress.spend_secret[0], EC_SECRET_SIZE);
-                if (StealthSharedToSecretSpend(vTxOutSecret.at(0).second, sSpend, sSpendR) != 0)
-                    return error("CreateAnonCoinStake : failed to get private key of anon output");
-                key.Set(&sSpendR.e[0], true);
-
-                // -- create donation output
-                if (donateReward)
-                {
-                    CBitcoinAddress address(fSupplyIncrease ? Params().GetSupplyIncreaseAddress() : Params().GetDevContributionAddress());
-                    // push a new output donating to the developers
-                    CScript script;
-                    script.SetDestination(address.Get());
-                    txNew.vout.push_back(CTxOut(nReward, script));
-                    LogPrintf("donation complete\n");
-                }
+        // -- Check if stake should be split for balancing unspent ATXOs
+        std::vector<int64_t> vOutAmounts;
+        // find the anon denomination with the least number of unspent outputs
+        CAnonOutputCount* lowestAOC = nullptr;
+        for (auto it = mapAnonOutputStats.rbegin(); it != mapAnonOutputStats.rend(); it++)
+        {
+            if (it->first < nMinTxFee * 10)
+                break;
+            if (it->first >= oao.nValue)
+                continue;
+            if (it->second.numOfUnspends() > UNSPENT_ANON_BALANCE_MIN)
+                continue;
+            if (lowestAOC == nullptr || lowestAOC->numOfUnspends() > it->second.numOfUnspends())
+                lowestAOC = &it->second;
+        }
+        if (lowestAOC)
+        {
+            vOutAmounts.push_back(lowestAOC->nValue);
+            nCredit += oao.nValue - lowestAOC->nValue;
+            LogPrintf("CreateAnonCoinStake : Split anon stake of value %d to create 1 additional ATXO of value %d which has only %d unspents\n",
+                      oao.nValue, lowestAOC->nValue, lowestAOC->numOfUnspends());
+        }
+        else
+            nCredit += oao.nValue;
+
+        // -- Add more anon inputs for consolidation
+        int64_t nMaxCombineOutput = nMaxAnonStakeOutput / 10;
+        int64_t lastCombineValue = -1;
+        std::vector<const COwnedAnonOutput*> vConsolidateCoins;
+        int nMaxConsolidation = 0, nNumOfConsolidated = 0;
+        for (const auto & oaoc : lAvailableCoins)
+        {
+            if (oaoc.nValue > nMaxCombineOutput)
+                break;
+            // skip the input used for staking (TODO could be optimized by considering in combining inputs)
+            if (&oaoc == &oao)
+                continue;
+            if (lastCombineValue != oaoc.nValue)
+            {
+                vConsolidateCoins.clear();
+                lastCombineValue = oaoc.nValue;
+                // calculate how many outputs can be consolidated considering the amount of mature unspents
+                nMaxConsolidation = mapAnonOutputStats[oaoc.nValue].numOfMatureUnspends() - UNSPENT_ANON_BALANCE_MAX;
+                nNumOfConsolidated = 0;
+            }
+            vConsolidateCoins.push_back(&oaoc);
+            nNumOfConsolidated++;
+            if (nNumOfConsolidated <= nMaxConsolidation && vConsolidateCoins.size() == 10)
+            {
+                vPickedCoins.insert(vPickedCoins.end(), vConsolidateCoins.begin(), vConsolidateCoins.end());
+                vConsolidateCoins.clear();
+                nCredit += oaoc.nValue * 10;
+                LogPrintf("CreateAnonCoinStake : Consolidate 10 additional ATXOs of value %d which has %d mature unspents\n",
+                          oaoc.nValue, mapAnonOutputStats[oaoc.nValue].numOfMatureUnspends());
+            }
+            // Consolidate maximal 50 inputs
+            if (vPickedCoins.size() == 51)
+                break;
+        }
 
-                // -- create anon inputs
-                txNew.vin.resize(vPickedCoins.size());
-                uint256 preimage = 0; // not needed for RING_SIG_2
-                uint32_t iVin = 0;
-                // Initialize mixins set
-                CMixins mixins;
-                if (!InitMixins(mixins, vPickedCoins, true))
-                     return error("CreateAnonCoinStake() : InitMixins() failed");
+        // -- Calculate staking reward
+        int64_t nReward = Params().GetProofOfAnonStakeReward(pindexPrev, nFees);
+        if (nReward <= 0)
+            return error("CreateAnonCoinStake : GetProofOfStakeReward() reward <= 0");
+
+        // -- Check if staking reward gets donated to developers, according to the configured probability and DCB rules
+        int sample = stakingDonationDistribution(stakingDonationRng);
+        LogPrintf("sample: %d, donation: %d\n", sample, nStakingDonation);
+        bool donateReward = false;
+        bool fSupplyIncrease = Params().IsForkV4SupplyIncrease(pindexPrev);
+        if (fSupplyIncrease || sample < nStakingDonation || (pindexPrev->nHeight+1) % 6 == 0) {
+            LogPrintf("Donating this (potential) stake to the developers\n");
+            donateReward = true;
+        }
+        else {
+            LogPrintf("Not donating this (potential) stake to the developers\n");
+            nCredit += nReward;
+        }
 
-                for (const auto * pickedCoin : vPickedCoins)
-                {
-                    int oaoRingIndex;
-                    if (!AddAnonInput(mixins, txNew.vin[iVin], *pickedCoin, RING_SIG_2, nRingSize, oaoRingIndex, true, false, sError))
-                        return error(("CreateAnonCoinStake() : " + sError).c_str());
+        // -- Get stealth address for creating new anon outputs.
+        CStealthAddress sxAddress;
+        if (!GetAnonStakeAddress(oao, sxAddress))
+            return error("CreateAnonCoinStake : GetAnonStakeAddress() change failed");
 
-                    if (!GenerateRingSignature(txNew.vin[iVin], RING_SIG_2, nRingSize, oaoRingIndex, preimage, sError))
-                        return error(("CreateAnonCoinStake() : " + sError).c_str());
+        // -- create anon output
+        CScript scriptNarration; // needed to match output id of narr
+        std::vector<std::pair<CScript, int64_t> > vecSend;
+        std::vector<ec_secret> vecSecShared;
+        std::string sNarr;
+        if (nCredit)
+            splitAmount(nCredit, vOutAmounts, nMaxAnonStakeOutput);
+        if (!CreateAnonOutputs(&sxAddress, vOutAmounts, sNarr, vecSend, scriptNarration, nullptr, &vecSecShared))
+            return error("CreateAnonCoinStake : CreateAnonOutputs() failed");
+
+        // Sort anon ouputs together with corresponding ec_secret ascending by anon value
+        std::vector<std::pair<CTxOut, ec_secret>> vTxOutSecret;
+        vTxOutSecret.reserve(vecSend.size());
+        for (uint32_t i = 0; i < vecSend.size(); ++i)
+            vTxOutSecret.push_back(std::make_pair(CTxOut(vecSend.at(i).second, vecSend.at(i).first), vecSecShared.at(i)));
+        std::sort(vTxOutSecret.begin(), vTxOutSecret.end(), [] (const auto &a, const auto &b) {
+            return (a.first < b.first);
+        });
+        // Add sorted anon outputs to transaction
+        for (auto [txOut, secret] : vTxOutSecret)
+            txNew.vout.push_back(txOut);
+
+        // -- Set one-time private key of vout[1] for signing the block
+        ec_secret sSpend;
+        ec_secret sSpendR;
+        memcpy(&sSpend.e[0], &sxAddress.spend_secret[0], EC_SECRET_SIZE);
+        if (StealthSharedToSecretSpend(vTxOutSecret.at(0).second, sSpend, sSpendR) != 0)
+            return error("CreateAnonCoinStake : failed to get private key of anon output");
+        key.Set(&sSpendR.e[0], true);
+
+        // -- create donation output
+        if (donateReward)
+        {
+            CBitcoinAddress address(fSupplyIncrease ? Params().GetSupplyIncreaseAddress() : Params().GetDevContributionAddress());
+            // push a new output donating to the developers
+            CScript script;
+            script.SetDestination(address.Get());
+            txNew.vout.push_back(CTxOut(nReward, script));
+            LogPrintf("donation complete\n");
+        }
 
-                    iVin++;
-                }
+        // -- create anon inputs
+        txNew.vin.resize(vPickedCoins.size());
+        uint256 preimage = 0; // not needed for RING_SIG_2
+        uint32_t iVin = 0;
+        // Initialize mixins set
+        CMixins mixins;
+        if (!InitMixins(mixins, vPickedCoins, true))
+             return error("CreateAnonCoinStake() : InitMixins() failed");
 
-                // -- check if new coins already exist (in case random is broken ?)
-                if (!AreOutputsUnique(txNew))
-                    return error("CreateAnonCoinStake() : anon outputs are not unique - is random working?!");
+        for (const auto * pickedCoin : vPickedCoins)
+        {
+            int oaoRingIndex;
+            if (!AddAnonInput(mixins, txNew.vin[iVin], *pickedCoin, RING_SIG_2, nRingSize, oaoRingIndex, true, false, sError))
+                return error(("CreateAnonCoinStake() : " + sError).c_str());
 
-                if (fDebugPoS)
-                    LogPrintf("CreateAnonCoinStake() : added kernel for keyImage %s\n", HexStr(oao.vchImage));
+            if (!GenerateRingSignature(txNew.vin[iVin], RING_SIG_2, nRingSize, oaoRingIndex, preimage, sError))
+                return error(("CreateAnonCoinStake() : " + sError).c_str());
 
-                fKernelFound = true;
-                break;
-            }
+            iVin++;
         }
 
-        if (fKernelFound)
-            break; // if kernel is found stop searching
-    }
+        // -- check if new coins already exist (in case random is broken ?)
+        if (!AreOutputsUnique(txNew))
+            return error("CreateAnonCoinStake() : anon outputs are not unique - is random working?!");
+
+        if (fDebugPoS)
+            LogPrintf("CreateAnonCoinStake() : added kernel for keyImage %s\n", HexStr(oao.vchImage));
+
+        fKernelFound = true;
+    };
+    boost::this_thread::interruption_point();
 
     if (!fKernelFound)
         return false;
@@ -9921,7 +10543,7 @@ void CWallet::GetKeyBirthTimes(std::map<CKeyID, int64_t> &mapKeyBirth) const
     {
         // iterate over all wallet transactions...
         const CWalletTx &wtx = (*it).second;
-        std::map<uint256, CBlockIndex*>::const_iterator blit = mapBlockIndex.find(wtx.hashBlock);
+        BlockMap::const_iterator blit = mapBlockIndex.find(wtx.hashBlock);
         if (blit != mapBlockIndex.end() && blit->second->IsInMainChain())
         {
             // ... which are already in a block
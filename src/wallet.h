@@ -52,6 +52,7 @@ static bool IsStealthAddressMappingLabel(const std::string& address, const bool&
 
 extern bool fWalletUnlockStakingOnly;
 extern bool fConfChange;
+extern bool fCheckBalances;
 class CAccountingEntry;
 class CWalletTx;
 class CReserveKey;
@@ -107,8 +108,91 @@ public:
 bool IsDestMine(const CWallet &wallet, const CTxDestination &dest);
 bool IsMine(const CWallet& wallet, const CScript& scriptPubKey);
 
+// - a worker of the stake kernel search, the -stakethreads are started in AppInit2
+void ThreadKernelSearch();
+
 int SetupWalletData(const std::string& strWalletFile, const std::string& sBip44Key, const SecureString& strWalletPassphrase);
 
+/** Totals of the balance queries of a wallet, or the share of one transaction in them.
+ */
+class CWalletBalances
+{
+public:
+    int64_t nBalance;
+    int64_t nSpectreBalance;
+    int64_t nUnconfirmed;
+    int64_t nUnconfirmedSpectre;
+    int64_t nImmature;
+    int64_t nStake;
+    int64_t nSpectreStake;
+    int64_t nNewMint;
+
+    CWalletBalances()
+    {
+        SetNull();
+    }
+
+    void SetNull()
+    {
+        nBalance = 0;
+        nSpectreBalance = 0;
+        nUnconfirmed = 0;
+        nUnconfirmedSpectre = 0;
+        nImmature = 0;
+        nStake = 0;
+        nSpectreStake = 0;
+        nNewMint = 0;
+    }
+
+    bool IsNull() const
+    {
+        return *this == CWalletBalances();
+    }
+
+    CWalletBalances &operator+=(const CWalletBalances &b)
+    {
+        nBalance += b.nBalance;
+        nSpectreBalance += b.nSpectreBalance;
+        nUnconfirmed += b.nUnconfirmed;
+        nUnconfirmedSpectre += b.nUnconfirmedSpectre;
+        nImmature += b.nImmature;
+        nStake += b.nStake;
+        nSpectreStake += b.nSpectreStake;
+        nNewMint += b.nNewMint;
+        return *this;
+    }
+
+    CWalletBalances &operator-=(const CWalletBalances &b)
+    {
+        nBalance -= b.nBalance;
+        nSpectreBalance -= b.nSpectreBalance;
+        nUnconfirmed -= b.nUnconfirmed;
+        nUnconfirmedSpectre -= b.nUnconfirmedSpectre;
+        nImmature -= b.nImmature;
+        nStake -= b.nStake;
+        nSpectreStake -= b.nSpectreStake;
+        nNewMint -= b.nNewMint;
+        return *this;
+    }
+
+    friend bool operator==(const CWalletBalances &a, const CWalletBalances &b)
+    {
+        return a.nBalance == b.nBalance
+            && a.nSpectreBalance == b.nSpectreBalance
+            && a.nUnconfirmed == b.nUnconfirmed
+            && a.nUnconfirmedSpectre == b.nUnconfirmedSpectre
+            && a.nImmature == b.nImmature
+            && a.nStake == b.nStake
+            && a.nSpectreStake == b.nSpectreStake
+            && a.nNewMint == b.nNewMint;
+    }
+
+    friend bool operator!=(const CWalletBalances &a, const CWalletBalances &b)
+    {
+        return !(a == b);
+    }
+};
+
 /** A CWallet is an extension of a keystore, which also maintains a set of transactions and balances,
  * and provides the ability to create new transactions.
  */
@@ -161,6 +245,38 @@ public:
 
     WalletTxMap mapWallet;
     int64_t nOrderPosNext;
+
+    /// Balance ledger: the share of each transaction in the balances and
+    /// their sum. Only transactions that changed, or whose share depends on
+    /// the height of the chain, are recounted, see UpdateBalances().
+    /// Guarded by cs_balances, which is taken last, as are the change sets
+    /// of the unspent coins below.
+    mutable CCriticalSection cs_balances;
+    mutable std::map<uint256, CWalletBalances> mapTxBalances;
+    mutable std::set<uint256> setBalanceChanged;
+    mutable std::set<uint256> setBalancePending;
+    mutable CWalletBalances balances;
+    mutable uint256 hashBalanceTip;
+    mutable int nBalanceTipHeight;
+    mutable bool fBalanceRebuild;
+    /// The tip the wallet was last told of, see SetBestTip(), GetBalances()
+    /// compares it to the tip of the balances without cs_main.
+    mutable uint256 hashBestTip;
+    mutable int nBestTipHeight;
+
+    /// Unspent coins: the outputs of each transaction that are IsMine and
+    /// not spent, for AvailableCoins(). Updated from the same notifications
+    /// as the balance ledger, see UpdateUnspentCoins(). mapUnspentCoins is
+    /// guarded by cs_wallet.
+    mutable std::map<uint256, std::vector<uint32_t> > mapUnspentCoins;
+    mutable std::set<uint256> setCoinsChanged;
+    mutable bool fCoinsRebuild;
+
+    /// Staking candidates: the kernel data of the coins CreateCoinStake
+    /// searched on the tip hashStakeCandidatesTip, see GetStakeCandidate().
+    CCriticalSection cs_stakeCandidates;
+    std::map<COutPoint, CStakeCandidate> mapStakeCandidates;
+    uint256 hashStakeCandidatesTip;
     std::map<uint256, int> mapRequestCount;
 
     std::map<CTxDestination, std::string> mapAddressBook;
@@ -193,7 +309,10 @@ public:
         nOrderPosNext = 0;
         nTimeFirstKey = 0;
         nLastFilteredHeight = 0;
-
+        nBalanceTipHeight = 0;
+        fBalanceRebuild = true;
+        nBestTipHeight = 0;
+        fCoinsRebuild = true;
     }
 
     int Finalise();
@@ -254,7 +373,7 @@ public:
 
     void MarkDirty();
     bool AddToWallet(const CWalletTx& wtxIn, const uint256& hashIn);
-    bool AddToWalletIfInvolvingMe(const CTransaction& tx, const uint256& hash, const void* pblock, bool fUpdate = false, bool fFindBlock = false);
+    bool AddToWalletIfInvolvingMe(const CTransaction& tx, const uint256& hash, const void* pblock, bool fUpdate = false, bool fFindBlock = false, bool fScanStealth = true);
 
     bool EraseFromWallet(uint256 hash);
     void WalletUpdateSpent(const CTransaction& prevout, bool fBlock = false);
@@ -263,6 +382,14 @@ public:
 
     void ReacceptWalletTransactions();
     void ResendWalletTransactions(bool fForce = false);
+
+    // Marks the balances of a transaction to be recounted, called as it changes.
+    void BalanceChanged(const CWalletTx &wtx) const;
+    void BalanceChanged(const uint256 &hash) const;
+    // Recounts the changed transactions, requires cs_main and cs_wallet.
+    void UpdateBalances() const;
+    void GetBalances(CWalletBalances &balancesRet) const;
+    void UpdateUnspentCoins() const;
     int64_t GetBalance() const;
     int64_t GetSpectreBalance() const;
 
@@ -282,6 +409,7 @@ public:
 
     uint64_t GetStakeWeight() const;
     uint64_t GetSpectreStakeWeight() const;
+    bool GetStakeCandidate(CTxDB& txdb, const CBlockIndex* pindexPrev, const COutPoint& prevout, CStakeCandidate& candidate);
     bool CreateCoinStake(unsigned int nBits, int64_t nSearchInterval, int64_t nFees, CTransaction& txNew, CKey& key);
     bool CreateAnonCoinStake(unsigned int nBits, int64_t nSearchInterval, int64_t nFees, CTransaction& txNew, CKey& key);
 
@@ -297,7 +425,7 @@ public:
     bool FindStealthTransactions(const CTransaction& tx, mapValue_t& mapNarr);
 
     bool UndoAnonTransaction(const CTransaction& tx, const std::map<CKeyID, CStealthAddress> * const mapPubStealth=nullptr, bool fEraseTx=true);
-    bool ProcessAnonTransaction(CWalletDB *pwdb, CTxDB *ptxdb, const CTransaction& tx, const uint256& blockHash, bool& fIsMine, mapValue_t& mapNarr, std::vector<WalletTxMap::iterator>& vUpdatedTxns, std::map<int64_t, CAnonBlockStat>& mapAnonBlockStat, const std::map<CKeyID, CStealthAddress> * const mapPubStealth=nullptr);
+    bool ProcessAnonTransaction(CWalletDB *pwdb, CTxDB *ptxdb, const CTransaction& tx, const uint256& blockHash, bool& fIsMine, mapValue_t& mapNarr, std::vector<WalletTxMap::iterator>& vUpdatedTxns, std::map<int64_t, CAnonBlockStat>& mapAnonBlockStat, const std::map<CKeyID, CStealthAddress> * const mapPubStealth=nullptr, bool fScanStealth=true);
 
     bool GetAnonChangeAddress(CStealthAddress& sxAddress);
     bool GetAnonStakeAddress(const COwnedAnonOutput& stakedOao, CStealthAddress& sxAddress);
@@ -332,9 +460,14 @@ public:
 
     uint64_t EraseAllAnonData(std::function<void (const char *, const uint32_t&)> funcProgress = nullptr);
 
-    bool CacheAnonStats(int nBlockHeight, std::function<void (const unsigned mode, const uint32_t&)> funcProgress = nullptr);
+    // Recounts the anon stats as of block hashBlock at nBlockHeight and persists them.
+    bool CacheAnonStats(int nBlockHeight, const uint256& hashBlock, std::function<void (const unsigned mode, const uint32_t&)> funcProgress = nullptr);
     bool UpdateAnonStats(CTxDB& txdb, int nBlockHeight);
     bool RemoveAnonStats(CTxDB& txdb, int nBlockHeight);
+    // Persists the anon stats as of hashBlock in the batch of txdb, erases them when stale.
+    bool WriteAnonStats(CTxDB& txdb, const uint256& hashBlock);
+    // Loads the persisted anon stats, false when they aren't of hashBlock.
+    bool LoadAnonStats(CTxDB& txdb, int nBlockHeight, const uint256& hashBlock);
     void AddToAnonBlockStats(const std::map<int64_t, CAnonBlockStat>& mapAnonBlockStat, int nBlockHeight);
 
     bool InitBloomFilter();
@@ -474,6 +607,8 @@ public:
 
     void SetBestThinChain(const CBlockThinLocator& loc);
 
+    void SetBestTip(int nHeight, const uint256& hash);
+
     DBErrors LoadWallet(int& oltWalletVersion, std::function<void (const uint32_t&)> funcProgress);
 
     bool SetAddressBookName(const CTxDestination& address, const std::string& strName, CWalletDB *pwdb = NULL, bool fAddKeyToMerkleFilters = true, bool fManual = false);
@@ -812,6 +947,8 @@ public:
                 fAvailableSpectreCreditCached = false;
             };
         };
+        if (fReturn && pwallet)
+            pwallet->BalanceChanged(*this);
         return fReturn;
     }
 
@@ -824,6 +961,8 @@ public:
         fDebitCached = false;
         fChangeCached = false;
         fCreditSplitCached = false;
+        if (pwallet)
+            pwallet->BalanceChanged(*this);
     }
 
     bool ForceUpdate()
@@ -847,6 +986,8 @@ public:
         {
             vfSpent[nOut] = true;
             fAvailableCreditCached = false;
+            if (pwallet)
+                pwallet->BalanceChanged(*this);
         };
     }
 
@@ -860,6 +1001,8 @@ public:
         {
             vfSpent[nOut] = false;
             fAvailableCreditCached = false;
+            if (pwallet)
+                pwallet->BalanceChanged(*this);
         };
     }
 